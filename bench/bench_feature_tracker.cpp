@@ -0,0 +1,157 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+
+#include "fixtures.h"
+#include "image/phase_tracker.h"
+#include "image/tracker_steps.h"
+
+namespace {
+using img::detail::tracker_steps;
+
+auto tracker_for(benchmark::State const& state) -> img::feature_tracker {
+  const auto& [img_1, img_2] =
+      bench::frame_pair(cv::Size(static_cast<int>(state.range(0)),
+                                 static_cast<int>(state.range(1))));
+
+  return img::feature_tracker{img_1, img_2};
+}
+
+auto detect_features(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+
+  for (auto _ : state) tracker_steps::detect_features(ft);
+
+  state.counters["key_points"] = static_cast<double>(ft.key_point_count());
+}
+
+auto match_features(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+  tracker_steps::detect_features(ft);
+
+  for (auto _ : state) tracker_steps::match_features(ft);
+
+  state.counters["matches"] = static_cast<double>(ft.match_count());
+}
+
+/**
+ * \brief Times matching with the homography of a first pass over the pair as
+ * the prediction, as each pair after the first of a run is matched.
+ */
+auto match_guided_features(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+  ft.track();
+
+  for (auto _ : state) tracker_steps::match_features(ft);
+
+  state.counters["matches"] = static_cast<double>(ft.match_count());
+  state.counters["guided"] = ft.guided() ? 1.0 : 0.0;
+}
+
+auto find_best_homography(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+  tracker_steps::detect_features(ft);
+  tracker_steps::match_features(ft);
+
+  for (auto _ : state) tracker_steps::find_best_homography(ft);
+
+  state.counters["inliers"] = static_cast<double>(ft.inlier_count());
+  state.counters["iterations"] = ft.ransac_iterations();
+}
+
+/**
+ * \brief Times RANSAC seeded with the homography of a first pass over the
+ * pair, as each pair after the first of a run is estimated.
+ */
+auto find_seeded_homography(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+  ft.track();
+
+  for (auto _ : state) tracker_steps::find_best_homography(ft);
+
+  state.counters["inliers"] = static_cast<double>(ft.inlier_count());
+  state.counters["iterations"] = ft.ransac_iterations();
+}
+
+auto calc_error(benchmark::State& state) -> void {
+  auto ft = tracker_for(state);
+  tracker_steps::detect_features(ft);
+  tracker_steps::match_features(ft);
+  tracker_steps::find_best_homography(ft);
+
+  const auto h = ft.h_mat();
+  const auto& matches = tracker_steps::matches(ft);
+  for (auto _ : state) {
+    for (const auto& m : matches)
+      benchmark::DoNotOptimize(tracker_steps::calc_error(ft, h, m));
+  }
+
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(matches.size()));
+}
+
+/**
+ * \brief Times the phase estimator on a sequence of frames, so each
+ * iteration prepares one new frame and reuses the previous one.
+ */
+auto phase_correlate(benchmark::State& state, const bool rotation_scale)
+    -> void {
+  const auto& [img_1, img_2] =
+      bench::frame_pair(cv::Size(static_cast<int>(state.range(0)),
+                                 static_cast<int>(state.range(1))));
+  const std::array<cv::Mat, 3> frames{img_1, img_2, img_1.clone()};
+
+  img::phase_options options;
+  options.rotation_scale = rotation_scale;
+  img::phase_tracker pt{options};
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    pt.set_images(frames[(i + 1) % 3], frames[i % 3]);
+    pt.track();
+    benchmark::DoNotOptimize(pt.h_mat());
+    ++i;
+  }
+
+  state.counters["response"] = pt.response();
+  state.SetItemsProcessed(state.iterations());
+}
+
+auto h_transform(benchmark::State& state) -> void {
+  cv::RNG rng(3);
+  const auto h = vid::synthetic::shake_homography(rng, cv::Size(1920, 1080));
+  const cv::Point2f point(960.0f, 540.0f);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tracker_steps::h_transform(h, point));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+}  // namespace
+
+BENCHMARK(detect_features)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(match_features)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(match_guided_features)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(find_best_homography)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(find_seeded_homography)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(calc_error)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(phase_correlate, translation, false)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(phase_correlate, rotation_scale, true)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(h_transform);
@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+#include "fixtures.h"
+#include "memory/frame_pool.h"
+
+namespace {
+/**
+ * @brief Allocates and fills a frame, then frees it, the way every stage
+ * handles its output, with either OpenCV's allocator or the frame pool.
+ */
+auto allocate_frame(benchmark::State& state, const bool pooled) -> void {
+  const cv::Size size(static_cast<int>(state.range(0)),
+                      static_cast<int>(state.range(1)));
+  auto* const allocator =
+      pooled ? static_cast<cv::MatAllocator*>(mem::frame_pool::instance())
+             : cv::Mat::getStdAllocator();
+
+  for (auto _ : state) {
+    cv::Mat frame;
+    frame.allocator = allocator;
+    frame.create(size, CV_8UC3);
+
+    // Touch every page, as writing the stage's output would
+    frame.setTo(cv::Scalar::all(0));
+    benchmark::DoNotOptimize(frame.data);
+  }
+
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<std::int64_t>(size.area() * 3));
+}
+}  // namespace
+
+BENCHMARK_CAPTURE(allocate_frame, std, false)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(allocate_frame, pooled, true)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "logger/logger.h"
+
+namespace {
+// Only measure the producers; nothing is written anywhere
+[[maybe_unused]] const auto configured =
+    logger::configure({.stderr_severity = severity::off});
+
+// Logging below the minimum severity should cost next to nothing
+auto log_filtered(benchmark::State& state) -> void {
+  for (auto _ : state) logger::instance()->debug("frame %d", 42);
+}
+
+// The cost a worker pays on its hot path: a clock read and a copy into the
+// ring buffer. Messages the consumer can't keep up with are dropped and
+// counted rather than slowing the producer down.
+auto log_numbers(benchmark::State& state) -> void {
+  auto i = 0;
+  for (auto _ : state) {
+    logger::instance()->info("frame %d: %d matches, %.3f inliers", i, i * 3,
+                             0.5);
+    ++i;
+  }
+}
+
+auto log_string(benchmark::State& state) -> void {
+  const std::string path = "/videos/holiday/IMG_0042.mov";
+  for (auto _ : state) logger::instance()->info("Opened %s", path);
+}
+}  // namespace
+
+BENCHMARK(log_filtered);
+BENCHMARK(log_numbers)->ThreadRange(1, 8);
+BENCHMARK(log_string);
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <thread>
+
+#include "fixtures.h"
+#include "video/frame_sink.h"
+#include "video/shm_ring.h"
+
+namespace {
+/**
+ * @brief Publishes frames to a shared memory ring as fast as a reader on
+ * another thread, with a mapping of its own as another process would have,
+ * can take them. The reader only touches the first row of each frame, so
+ * this times the handoff rather than any analysis.
+ */
+auto shm_handoff(benchmark::State& state, const bool drop) -> void {
+  const cv::Size size(static_cast<int>(state.range(0)),
+                      static_cast<int>(state.range(1)));
+  const std::string name = "vidstab_bench_ring";
+  const cv::Mat frame(size, CV_8UC3, cv::Scalar::all(128));
+
+  vid::shm_sink sink{name, img::pixel_format::bgr, {8, drop}};
+  if (!sink.open(size, 30.0)) {
+    state.SkipWithError("Could not create the ring");
+    return;
+  }
+
+  std::atomic<std::uint64_t> read = 0;
+  std::jthread reader([&]() {
+    vid::shm_reader r{name};
+    if (!r.connect(std::chrono::seconds(5))) return;
+
+    vid::shm_frame f;
+    while (r.acquire(f, std::chrono::seconds(5)) ==
+           vid::shm_reader::status::frame) {
+      benchmark::DoNotOptimize(f.frame.ptr(0)[f.frame.cols - 1]);
+      r.release();
+      read.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  for (auto _ : state) {
+    if (!sink.write(frame)) {
+      state.SkipWithError("The reader stopped reading");
+      break;
+    }
+  }
+  sink.close();
+  reader.join();
+
+  const auto frames = static_cast<std::int64_t>(read.load());
+  state.SetItemsProcessed(frames);
+  state.SetBytesProcessed(frames *
+                          static_cast<std::int64_t>(frame.total() *
+                                                    frame.elemSize()));
+  state.counters["dropped"] = static_cast<double>(
+      static_cast<std::uint64_t>(state.iterations()) - read.load());
+}
+}  // namespace
+
+BENCHMARK_CAPTURE(shm_handoff, blocking, false)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(shm_handoff, dropping, true)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
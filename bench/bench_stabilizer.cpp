@@ -0,0 +1,107 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "video/stabilizer_stages.h"
+
+namespace {
+using vid::detail::stabilizer_stages;
+
+// Number of frames in the synthetic clips used by the per-frame stages
+constexpr int clip_length = 10;
+
+auto size_of(benchmark::State const& state) -> cv::Size {
+  return {static_cast<int>(state.range(0)), static_cast<int>(state.range(1))};
+}
+
+/**
+ * @brief Fills the stabilizer with a short clip, stored in the given format,
+ * and a set of update transforms, as if the analysis stages had already run.
+ */
+auto prepare(vid::stabilizer& s, const cv::Size size,
+             const img::pixel_format format = img::pixel_format::bgr)
+    -> void {
+  const auto& [img_1, img_2] = bench::frame_pair(size);
+  cv::Mat frame_1;
+  cv::Mat frame_2;
+  img::from_bgr(img_1, frame_1, format);
+  img::from_bgr(img_2, frame_2, format);
+
+  std::vector<cv::Mat> frames;
+  std::vector<cv::Mat> update_transforms;
+  cv::RNG rng(5);
+  for (auto i = 0; i < clip_length; ++i) {
+    frames.push_back(i % 2 ? frame_1 : frame_2);
+    update_transforms.push_back(
+        vid::synthetic::shake_homography(rng, size, 0.5));
+  }
+
+  stabilizer_stages::load(s, std::move(frames), format,
+                          std::move(update_transforms));
+}
+
+auto compute_h_tilde_prime(benchmark::State& state) -> void {
+  vid::stabilizer s;
+  stabilizer_stages::load_trajectory(
+      s, bench::trajectory(static_cast<int>(state.range(0)),
+                           cv::Size(1920, 1080)));
+
+  for (auto _ : state) stabilizer_stages::compute_h_tilde_prime(s);
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+auto stabilize_frames(benchmark::State& state) -> void {
+  vid::stabilizer s;
+  prepare(s, size_of(state));
+
+  for (auto _ : state) stabilizer_stages::stabilize_frames(s);
+
+  state.SetItemsProcessed(state.iterations() * clip_length);
+}
+
+auto stabilize_i420_frames(benchmark::State& state) -> void {
+  vid::stabilizer s;
+  prepare(s, size_of(state), img::pixel_format::i420);
+
+  for (auto _ : state) stabilizer_stages::stabilize_frames(s);
+
+  state.SetItemsProcessed(state.iterations() * clip_length);
+}
+
+auto stabilize_cropped_frames(benchmark::State& state) -> void {
+  vid::stabilizer s;
+  prepare(s, size_of(state));
+  stabilizer_stages::find_crop(s);
+
+  for (auto _ : state) stabilizer_stages::stabilize_frames(s);
+
+  const auto crop = stabilizer_stages::crop(s);
+  state.counters["crop_fraction"] =
+      static_cast<double>(crop.area()) /
+      static_cast<double>(size_of(state).area());
+  state.SetItemsProcessed(state.iterations() * clip_length);
+}
+
+auto find_crop(benchmark::State& state) -> void {
+  vid::stabilizer s;
+  prepare(s, size_of(state));
+
+  for (auto _ : state) stabilizer_stages::find_crop(s);
+
+  state.SetItemsProcessed(state.iterations() * clip_length);
+}
+}  // namespace
+
+BENCHMARK(compute_h_tilde_prime)->ArgName("frames")->Arg(300)->Arg(3000);
+BENCHMARK(stabilize_frames)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(stabilize_i420_frames)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(stabilize_cropped_frames)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(find_crop)
+    ->Apply(bench::resolutions)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,103 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <opencv2/imgproc.hpp>
+#include <utility>
+
+#include "fixtures.h"
+#include "image/warp.h"
+
+namespace {
+// Kinds of homography, each of which runs on its own kernel
+enum class motion : std::uint8_t { translation, affine, perspective };
+
+/**
+ * @brief Returns a shake of the given kind for frames of the given size.
+ */
+auto shake_for(const motion kind, const cv::Size size) -> cv::Mat {
+  switch (kind) {
+    case motion::translation:
+      return cv::Mat(cv::Matx33d(1.0, 0.0, 3.4,
+                                 0.0, 1.0, -2.7,
+                                 0.0, 0.0, 1.0));
+    case motion::affine: {
+      const cv::Point2f centre(size.width * 0.5f, size.height * 0.5f);
+      cv::Mat h = cv::Mat::eye(3, 3, CV_64FC1);
+      cv::getRotationMatrix2D(centre, 1.5, 1.02).copyTo(h.rowRange(0, 2));
+      return h;
+    }
+    case motion::perspective:
+      break;
+  }
+
+  cv::RNG rng(5);
+  return vid::synthetic::shake_homography(rng, size);
+}
+
+/**
+ * @brief Registers every kind of homography at every frame size.
+ */
+auto warp_cases(benchmark::internal::Benchmark* b) -> void {
+  b->ArgNames({"width", "height", "motion"});
+  for (const auto& [width, height] :
+       {std::pair{1280, 720}, std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+    for (const auto kind :
+         {motion::translation, motion::affine, motion::perspective}) {
+      b->Args({width, height, static_cast<int>(kind)});
+    }
+  }
+}
+
+/**
+ * @brief Returns the frame and homography of the benchmark's arguments.
+ */
+auto case_for(benchmark::State const& state) -> std::pair<cv::Mat, cv::Mat> {
+  const cv::Size size(static_cast<int>(state.range(0)),
+                      static_cast<int>(state.range(1)));
+  const auto kind = static_cast<motion>(state.range(2));
+
+  return {bench::frame_pair(size).first, shake_for(kind, size)};
+}
+
+auto opencv_warp(benchmark::State& state) -> void {
+  const auto [frame, h] = case_for(state);
+
+  cv::Mat warped;
+  for (auto _ : state) {
+    cv::warpPerspective(frame, warped, h, frame.size(), cv::INTER_LINEAR,
+                        cv::BORDER_CONSTANT);
+  }
+
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(frame.total()));
+}
+
+auto warp_kernel(benchmark::State& state, const img::warp_isa isa) -> void {
+  if (img::best_warp_isa() < isa) {
+    state.SkipWithError("Instruction set not supported by this CPU");
+    return;
+  }
+
+  const auto [frame, h] = case_for(state);
+
+  cv::Mat warped;
+  for (auto _ : state) img::warp_perspective(frame, warped, h, {}, {}, isa);
+
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<std::int64_t>(frame.total()));
+}
+}  // namespace
+
+BENCHMARK(opencv_warp)->Apply(warp_cases)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(warp_kernel, scalar, img::warp_isa::scalar)
+    ->Apply(warp_cases)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(warp_kernel, sse4, img::warp_isa::sse4)
+    ->Apply(warp_cases)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(warp_kernel, avx2, img::warp_isa::avx2)
+    ->Apply(warp_cases)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(warp_kernel, avx512, img::warp_isa::avx512)
+    ->Apply(warp_cases)
+    ->Unit(benchmark::kMillisecond);
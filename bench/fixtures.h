@@ -0,0 +1,64 @@
+#ifndef BENCH_FIXTURES_H
+#define BENCH_FIXTURES_H
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/imgproc.hpp>
+#include <utility>
+#include <vector>
+
+#include "image/feature_tracker.h"
+#include "video/stabilizer.h"
+#include "video/synthetic.h"
+
+namespace bench {
+/**
+ * @brief Returns a pair of synthetic frames of the given size, where the
+ * first is the second warped by a small random camera shake. Pairs are
+ * generated once per size and cached for the rest of the run.
+ */
+inline auto frame_pair(const cv::Size size)
+    -> std::pair<cv::Mat, cv::Mat> const& {
+  static std::map<std::pair<int, int>, std::pair<cv::Mat, cv::Mat>> cache;
+
+  const auto key = std::make_pair(size.width, size.height);
+  if (const auto it = cache.find(key); it != cache.end()) return it->second;
+
+  cv::RNG rng(7);
+  auto img_2 = vid::synthetic::textured_frame(size, 42);
+  cv::Mat img_1;
+  cv::warpPerspective(img_2, img_1, vid::synthetic::shake_homography(rng, size),
+                      size, cv::INTER_LINEAR, cv::BORDER_REFLECT);
+
+  return cache.emplace(key, std::make_pair(img_1, img_2)).first->second;
+}
+
+/**
+ * @brief Returns a random camera trajectory of <code>n</code> cumulative
+ * transformation matrices, as computed by <code>compute_h_tilde()</code>.
+ */
+inline auto trajectory(const int n, const cv::Size size)
+    -> std::vector<cv::Mat> {
+  cv::RNG rng(11);
+  std::vector<cv::Mat> h_tilde{cv::Mat::eye(3, 3, CV_64FC1)};
+  for (auto i = 1; i < n; ++i)
+    h_tilde.push_back(h_tilde.back() *
+                      vid::synthetic::shake_homography(rng, size, 0.5));
+
+  return h_tilde;
+}
+
+/**
+ * @brief Registers the 720p, 1080p and 4K frame sizes as benchmark arguments.
+ */
+inline auto resolutions(benchmark::internal::Benchmark* b) -> void {
+  b->ArgNames({"width", "height"})
+      ->Args({1280, 720})
+      ->Args({1920, 1080})
+      ->Args({3840, 2160});
+}
+}  // namespace bench
+
+#endif  // BENCH_FIXTURES_H
@@ -10,49 +10,152 @@
 #include <nfd.h>
 
 #include <iostream>
+#include <stop_token>
 
+#include "log_panel.h"
 #include "logger/logger.h"
+#include "memory/governor.h"
+#include "preview_panel.h"
+#include "profiler/profiler.h"
+#include "sched/future.h"
+#include "sched/serial_queue.h"
+#include "sched/thread_pool.h"
+#include "utils.h"
+#include "video/preview.h"
 #include "video/stabilizer.h"
 #include "model.h"
 
 namespace app {
 static constexpr int window_width = 500;
-static constexpr int window_height = 600;
+static constexpr int window_height = 860;
+
+// How often to redraw while a job is running, in seconds
+static constexpr double busy_redraw_interval_s = 0.1;
+
+// Jobs started from the GUI are queued ahead of the stabilizer's per-frame
+// work, so a new job starts on the next free worker
+static constexpr int job_priority = 0;
+static constexpr int stage_priority = 1;
+
+// Frames drawn after each wake-up so ImGui can settle
+static constexpr int settle_frame_count = 2;
 
 static GLFWwindow *window;
 
 static model mod;
 
-static std::thread worker;
+// Runs every job started from the GUI, and the stabilizer's parallel stages,
+// so they share one CPU budget
+static sched::thread_pool pool;
 
 static vid::stabilizer stabilizer;
 
+/**
+ * @brief A job started from the GUI: its progress, published by the job and
+ * polled by the GUI each frame, how to cancel it, and its completion.
+ */
+struct job {
+  vid::progress progress;
+  std::stop_source stop;
+  sched::future<void> done;
+};
+
+static job load_job;
+static job stabilize_job;
+static job save_job;
+
+// Proxies of the original and stabilized videos, built in the background
+static vid::preview previews;
+
+static preview_panel preview_view{previews};
+
 static bool auto_scroll = true;
 
-inline auto loading_char() -> std::string {
-  return std::string{"|/-\\"[static_cast<int>(ImGui::GetTime() / 0.05f) & 3]};
+// Shows the log in the main window
+static const auto panel = std::make_shared<log_panel>();
+
+static bool record_profile = false;
+
+// Most megabytes of frames to keep in memory, 0 for no limit. Once over it,
+// frames of videos that are only previewed are spilled to disk.
+static int memory_budget_mb = 0;
+
+// Chrome-trace/Perfetto file written after each profiled stabilization
+static const std::filesystem::path trace_path = "stabilizer_trace.json";
+
+/**
+ * @brief Wakes the main loop, which otherwise sleeps until the next input
+ * event. Safe to call from any thread.
+ */
+inline auto request_redraw() -> void { glfwPostEmptyEvent(); }
+
+// Hands the results of jobs back to the GUI thread, which drains it every
+// frame, so only the GUI thread ever touches the model
+static sched::serial_queue gui_queue{request_redraw};
+
+/**
+ * @brief Logs the frames each video holds in memory and on disk.
+ */
+inline auto log_memory() -> void {
+  for (auto const& usage : mem::governor::instance()->report()) {
+    if (usage.resident_bytes == 0 && usage.spilled_bytes == 0) continue;
+    logger::instance()->info("  - %s: %zu MB in memory, %zu MB on disk",
+                             usage.name, usage.resident_bytes >> 20,
+                             usage.spilled_bytes >> 20);
+  }
+}
+
+/**
+ * @brief Returns the job of the given kind.
+ */
+inline auto job_for(const state s) -> job & {
+  switch (s) {
+    case state::loading:
+      return load_job;
+    case state::saving:
+      return save_job;
+    default:
+      return stabilize_job;
+  }
+}
+
+/**
+ * @brief Returns whether the user asked the job of the given kind to stop.
+ */
+inline auto cancel_requested(const state s) -> bool {
+  return job_for(s).stop.stop_requested();
+}
+
+/**
+ * @brief Readies the job of the given kind to run again.
+ */
+inline auto reset_job(const state s) -> job & {
+  auto &j = job_for(s);
+  j.progress.reset();
+  j.stop = {};
+
+  return j;
 }
 
 inline auto state_changed(const state old_state, const state new_state)
     -> void {
+  // Jobs finish in continuations the GUI drains between frames, so make
+  // sure it draws one more to show them
+  request_redraw();
+
   switch (old_state) {
     case state::waiting: {
       switch (new_state) {
         case state::loading: {
-          logger::instance()->add_dynamic_log("Loading", []() -> std::string {
-            return "Loading " + loading_char() + "\n";
-          });
+          logger::instance()->info("Loading video...");
           break;
         }
         case state::stabilizing: {
-          logger::instance()->add_dynamic_log(
-              "Stabilizing", []() -> std::string {
-                return "Stabilizing " + loading_char() + "\n";
-              });
+          logger::instance()->info("Stabilizing video...");
           break;
         }
         case state::saving: {
-          logger::instance()->add_log("Saving video...\n");
+          logger::instance()->info("Saving video...");
           break;
         }
         case state::waiting:
@@ -66,13 +169,13 @@ inline auto state_changed(const state old_state, const state new_state)
         // TODO: introduce custom error
         // Some kind of error!
       }
-      logger::instance()->remove_dynamic_log("Loading");
-      if (mod.did_load()) {
-        logger::instance()->add_log("Video loaded!\n");
-        logger::instance()->add_log("File path: \"%s\"\n",
-                                    mod.video_path.string().c_str());
+      if (cancel_requested(state::loading)) {
+        logger::instance()->info("Loading cancelled");
+      } else if (mod.last_load_successful) {
+        logger::instance()->info("Video loaded!");
+        logger::instance()->info("File path: \"%s\"", mod.video_path);
 
-        logger::instance()->add_log("  - FPS: %i\n", mod.video->fps());
+        logger::instance()->info("  - FPS: %i", mod.video->fps());
 
         const auto fourcc = mod.video->fourcc();
         // Transform from int to char via Bitwise operators
@@ -80,11 +183,12 @@ inline auto state_changed(const state old_state, const state new_state)
                            static_cast<char>((fourcc & 0XFF00) >> 8),
                            static_cast<char>((fourcc & 0XFF0000) >> 16),
                            static_cast<char>((fourcc & 0XFF000000) >> 24), 0};
-        logger::instance()->add_log("  - CODEC: %s\n", encoding);
-        logger::instance()->add_log("  - Bitrate: %f kbits/sec\n",
-                                    mod.video->bitrate());
+        logger::instance()->info("  - CODEC: %s", encoding);
+        logger::instance()->info("  - Bitrate: %f kbits/sec",
+                                 mod.video->bitrate());
+        log_memory();
       } else {
-        logger::instance()->add_log("Error: video could not be loaded :(");
+        logger::instance()->error("Video could not be loaded :(");
       }
 
       break;
@@ -93,11 +197,23 @@ inline auto state_changed(const state old_state, const state new_state)
       if (new_state != state::waiting) {
         // Some kind of error!
       }
-      logger::instance()->remove_dynamic_log("Stabilizing");
-      logger::instance()->add_log(
-          "%s\n",
-          (mod.is_stabilized() ? "Video stabilized!"
-                               : "Error: video could not be stabilized :("));
+      if (cancel_requested(state::stabilizing)) {
+        logger::instance()->info("Stabilizing cancelled, tracked frames "
+                                 "are kept for the next try");
+      } else if (mod.video_stabilized) {
+        logger::instance()->info("Video stabilized!");
+        log_memory();
+      } else {
+        logger::instance()->error("Video could not be stabilized :(");
+      }
+
+      if (prof::profiler::instance()->enabled()) {
+        const auto* profiler = prof::profiler::instance();
+        logger::instance()->log_lines(severity::info, profiler->summary());
+        if (profiler->export_trace(trace_path)) {
+          logger::instance()->info("Trace written to \"%s\"", trace_path);
+        }
+      }
       break;
     }
     case state::saving: {
@@ -105,76 +221,141 @@ inline auto state_changed(const state old_state, const state new_state)
         // Some kind of error!
       }
 
-      logger::instance()->add_log(
-          "%s\n", (mod.did_save() ? "Video saved!"
-                                  : "Error: video could not be saved :("));
+      if (cancel_requested(state::saving)) {
+        logger::instance()->info("Saving cancelled");
+      } else if (mod.did_save()) {
+        logger::instance()->info("Video saved!");
+      } else {
+        logger::instance()->error("Video could not be saved :(");
+      }
       break;
     }
   }
 }
 
 inline auto on_load_clicked() -> void {
-  // Ensure the previous thread has finished before starting a new one
-  if (worker.joinable()) worker.join();
-  if (utils::get_video_path(window, mod.video_path)) {
-    mod.transition_to_state(state::loading);
-    worker = std::thread(
-        [](model &m) {
-          // Create a new video object if it doesn't exist
-          if (!m.video) {
-            m.video = new vid::video(m.video_path);
-          } else {
-            m.video->load_video_from_file(m.video_path.string());
-          }
-
-          // If we failed to load a video, reset the pointer
-          if (m.video && m.video->empty()) {
-            m.video = nullptr;
-            m.video_path = "";
-          } else {
-            m.last_save_successful = false;
-            m.video_stabilized = false;
-            m.save_dir = "";
-          }
-
-          m.transition_to_state(state::waiting);
-        },
-        std::ref(mod));
-  }
+  if (mod.busy(state::loading)) return;
+
+  std::filesystem::path path;
+  if (!utils::get_video_path(window, path)) return;
+
+  auto &j = reset_job(state::loading);
+  mod.begin_job(state::loading);
+
+  // Decoding runs alongside any other job, and the new video only replaces
+  // the old one once it's loaded
+  j.done =
+      sched::async(pool, job_priority,
+                   [path, stop = j.stop.get_token()]() {
+                     auto loaded = std::make_shared<vid::video>();
+                     loaded->load_video_from_file(path, &load_job.progress,
+                                                  stop);
+                     return loaded;
+                   })
+          .then(gui_queue, job_priority,
+                [path](sched::future<std::shared_ptr<vid::video>> const &f) {
+                  auto loaded = f.get();
+                  mod.last_load_successful = !loaded->empty();
+                  if (mod.last_load_successful) {
+                    mod.video = std::move(loaded);
+                    mod.video_path = path;
+                    mod.last_save_successful = false;
+                    mod.video_stabilized = false;
+                    mod.save_dir = "";
+
+                    // Start building the preview while the user looks
+                    // around. A stabilized video of the previous one can
+                    // still be saved, but is no longer shown.
+                    previews.set_source(vid::track::original, mod.video);
+                    previews.clear(vid::track::stabilized);
+                  }
+
+                  mod.end_job(state::loading);
+                });
 }
 
 inline auto on_stabilize_clicked() -> void {
-  if (worker.joinable()) worker.join();
-
-  mod.transition_to_state(state::stabilizing);
-
-  worker = std::thread(
-      [](model &m) {
-        if (!m.video) std::cerr << "Error: no video to stabilize\n";
-        else {
-          m.stabilized_video = new vid::video();
-          m.video_stabilized = stabilizer.stabilize(m.video, m.stabilized_video);
-          if (!m.video_stabilized) m.stabilized_video = nullptr;
-        }
-
-        m.transition_to_state(state::waiting);
-      },
-      std::ref(mod));
+  if (!mod.video || mod.busy(state::stabilizing)) return;
+
+  auto &j = reset_job(state::stabilizing);
+  mod.begin_job(state::stabilizing);
+
+  // Each profiled run gets a fresh trace
+  prof::profiler::instance()->reset();
+  stabilizer.set_progress(&j.progress);
+  stabilizer.set_thread_pool(&pool, stage_priority);
+
+  // A cancelled run picks up from its checkpoint when it's started again
+  stabilizer.set_checkpoint_path(
+      std::filesystem::temp_directory_path() /
+      (mod.video_path.stem().string() + ".checkpoint"));
+
+  const auto source = mod.video;
+  j.done =
+      sched::async(
+          pool, job_priority,
+          [source, stop = j.stop.get_token()]()
+              -> std::shared_ptr<vid::video> {
+            auto stabilized = std::make_shared<vid::video>();
+            if (!stabilizer.stabilize(source.get(), stabilized.get(), stop)) {
+              return nullptr;
+            }
+            stabilized->set_name(source->name() + " (stabilized)");
+
+            // The original is only previewed from now on, so its frames can
+            // go to disk if they don't fit
+            source->set_cold(true);
+
+            return stabilized;
+          })
+          .then(gui_queue, job_priority,
+                [source](
+                    sched::future<std::shared_ptr<vid::video>> const &f) {
+                  auto stabilized = f.get();
+                  mod.video_stabilized = stabilized != nullptr;
+                  if (stabilized) {
+                    mod.stabilized_video = std::move(stabilized);
+                    mod.stabilized_from = source;
+                    mod.last_save_successful = false;
+
+                    // Only shown next to the video it was made from, which
+                    // may have been replaced while it was stabilized
+                    if (source == mod.video) {
+                      previews.set_source(vid::track::stabilized,
+                                          mod.stabilized_video);
+                    }
+                  }
+
+                  mod.end_job(state::stabilizing);
+                });
 }
 
 inline auto on_save_clicked() -> void {
-  if (worker.joinable()) worker.join();
-
-  mod.transition_to_state(state::saving);
-  if (utils::get_save_directory(mod.save_dir)) {
-    worker = std::thread(
-        [&](model &m) {
-          m.last_save_successful = m.video->export_to_file(m.save_dir.string());
+  if (!mod.can_save() || mod.busy(state::saving)) return;
+
+  std::filesystem::path dir;
+  if (!utils::get_save_directory(dir)) return;
+
+  auto &j = reset_job(state::saving);
+  mod.save_dir = dir;
+  mod.begin_job(state::saving);
+
+  j.done = sched::async(pool, job_priority,
+                        [video = mod.stabilized_video, dir,
+                         stop = j.stop.get_token()]() {
+                          return video->export_to_file(
+                              dir.string(), &save_job.progress, stop);
+                        })
+               .then(gui_queue, job_priority,
+                     [](sched::future<bool> const &f) {
+                       mod.last_save_successful = f.get();
+                       mod.end_job(state::saving);
+                     });
+}
 
-          m.transition_to_state(state::waiting);
-        },
-        std::ref(mod));
-  }
+inline auto on_cancel_clicked(const state s) -> void {
+  // The job stops at the next frame and hands control back to the GUI
+  job_for(s).stop.request_stop();
 }
 
 /**
@@ -251,10 +432,9 @@ inline auto debug_cb(const GLenum source, const GLenum type, const GLuint id,
   // nvidia: avoid debug spam about attribute offsets
   if (id == 131076) return;
 
-  // TODO: convert to debug logs
-  std::cerr << "GL [" << source_string(source) << "] " << type_string(type)
-            << ' ' << id << " : ";
-  std::cerr << message << " (Severity: " << severity_string(severity) << ")\n";
+  logger::instance()->debug("GL [%s] %s %u : %s (Severity: %s)",
+                            source_string(source), type_string(type), id,
+                            message, severity_string(severity));
 }
 
 /**
@@ -299,6 +479,15 @@ inline auto init_glfw() -> bool {
  * @brief Shuts down all appropriate systems.
  */
 inline auto shutdown() -> void {
+  // Don't make the user wait for jobs they're walking away from. Their
+  // continuations are left queued, since the GUI is going away.
+  for (const auto s : {state::loading, state::stabilizing, state::saving}) {
+    job_for(s).stop.request_stop();
+  }
+  pool.wait_idle();
+
+  preview_view.release();
+
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
@@ -307,8 +496,6 @@ inline auto shutdown() -> void {
 
   glfwDestroyWindow(window);
   glfwTerminate();
-
-  if (worker.joinable()) worker.join();
 }
 }  // namespace app
 
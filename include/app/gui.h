@@ -1,6 +1,8 @@
 #ifndef GUI_H
 #define GUI_H
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 
 #include "app.h"
@@ -56,25 +58,57 @@ inline auto render() -> void {
         "Stabilized videos will be saved as a new file in your chosen folder.\n\n");
 
     //----------------------------------------------------- Action Buttons --//
-    // Disable the import button if we are busying loading or stabilizing a video
-    ImGui::BeginDisabled(app::mod.state() != app::state::waiting);
+    // Jobs of different kinds run side by side, so another video can be
+    // loaded while the last one is stabilized or saved
+    ImGui::BeginDisabled(app::mod.busy(app::state::loading));
     if (ImGui::Button("Import Video")) app::on_load_clicked();
     ImGui::EndDisabled();
     ImGui::SameLine();
 
     ImGui::BeginDisabled(!app::mod.did_load() 
-      || app::mod.state() == app::state::stabilizing 
+      || app::mod.busy(app::state::stabilizing) 
       || app::mod.is_stabilized());
     if (ImGui::Button("Stabilize")) app::on_stabilize_clicked();
     ImGui::EndDisabled();
     ImGui::SameLine();
 
-    ImGui::BeginDisabled(!app::mod.is_stabilized());
+    ImGui::BeginDisabled(!app::mod.can_save() ||
+                         app::mod.busy(app::state::saving));
     if (ImGui::Button("Save")) app::on_save_clicked();
     ImGui::EndDisabled();
 
     ImGui::Spacing();
 
+    //--------------------------------------------------------- Progress --//
+    // Poll the progress of every job in flight; they never wait on the GUI
+    for (const auto s : {app::state::loading, app::state::stabilizing,
+                         app::state::saving}) {
+      if (!app::mod.busy(s)) continue;
+
+      ImGui::PushID(static_cast<int>(s));
+      const auto snap = app::job_for(s).progress.snapshot();
+      char label[128];
+      std::snprintf(label, sizeof(label), "%s (%.0f/s)",
+                    vid::stage_name(snap.current).data(), snap.throughput);
+      const auto cancel_width = ImGui::CalcTextSize("Cancel").x +
+                                ImGui::GetStyle().FramePadding.x * 2.0f;
+      ImGui::ProgressBar(
+          snap.fraction(),
+          ImVec2(-cancel_width - ImGui::GetStyle().ItemSpacing.x, 0.0f),
+          label);
+      ImGui::SameLine();
+      ImGui::BeginDisabled(app::cancel_requested(s));
+      if (ImGui::Button("Cancel")) app::on_cancel_clicked(s);
+      ImGui::EndDisabled();
+      ImGui::PopID();
+    }
+
+    //------------------------------------------------------------ Preview --//
+    if (app::mod.did_load() &&
+        ImGui::CollapsingHeader("Preview", ImGuiTreeNodeFlags_DefaultOpen)) {
+      app::preview_view.draw();
+    }
+
     //---------------------------------------------------------- File Info --//
 
     ImGui::Spacing();
@@ -83,7 +117,7 @@ inline auto render() -> void {
     if (ImGui::Button("Help")) {
       // ImGui::OpenPopup("help_popup");
       // TODO: decide whether we like the help popup or help log better
-      logger::instance()->add_log(
+      logger::instance()->info(
           "This will display the help menu.\n"
           "This will display the help menu.\n"
           "This will display the help menu.\n"
@@ -101,7 +135,19 @@ inline auto render() -> void {
     // Options menu
     if (ImGui::BeginPopup("Options")) {
       if (ImGui::Checkbox("Auto-scroll", &app::auto_scroll)) {
-        logger::instance()->set_auto_scroll(app::auto_scroll);
+        app::panel->set_auto_scroll(app::auto_scroll);
+      }
+
+      if (ImGui::Checkbox("Record profile", &app::record_profile)) {
+        prof::profiler::instance()->set_enabled(app::record_profile);
+      }
+
+      ImGui::SetNextItemWidth(120.0f);
+      if (ImGui::InputInt("Memory budget (MB)", &app::memory_budget_mb, 256,
+                          1024)) {
+        app::memory_budget_mb = std::max(app::memory_budget_mb, 0);
+        mem::governor::instance()->set_budget(
+            static_cast<std::size_t>(app::memory_budget_mb) << 20);
       }
 
       ImGui::EndPopup();
@@ -112,14 +158,14 @@ inline auto render() -> void {
     ImGui::SameLine();
 
     // Create a disabled button if the buffer is empty
-    ImGui::BeginDisabled(logger::instance()->empty());
+    ImGui::BeginDisabled(app::panel->empty());
     if (ImGui::Button("Clear")) {
-      logger::instance()->clear();
+      app::panel->clear();
     }
     ImGui::EndDisabled();
 
     //------------------------------------------------------ Logger window --//
-    logger::instance()->draw();
+    app::panel->draw();
     ImGui::Spacing();
 
     //------------------------------------------------------------- Footer --//
@@ -0,0 +1,127 @@
+#ifndef LOG_PANEL_H
+#define LOG_PANEL_H
+
+#include <imgui.h>
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "logger/logger.h"
+
+namespace app {
+/**
+ * @brief A log sink that keeps the most recent lines for display in the GUI.
+ * Only the logger's consumer thread and the GUI thread ever take its lock, so
+ * workers never wait on the panel.
+ */
+class log_panel final : public log_sink {
+ public:
+  explicit log_panel(const std::size_t max_lines = 5000,
+                     const severity min_severity = severity::info)
+      : log_sink{min_severity}, max_lines_{max_lines} {}
+
+  auto write(log_entry const& entry) -> void override {
+    std::lock_guard lock(mutex_);
+
+    // Messages may span several lines
+    auto text = entry.message;
+    while (true) {
+      const auto end = text.find('\n');
+      lines_.push_back({entry.level, std::string{text.substr(0, end)}});
+      if (end == std::string_view::npos || end + 1 == text.size()) break;
+      text.remove_prefix(end + 1);
+    }
+
+    // Keep memory bounded on long runs
+    while (lines_.size() > max_lines_) lines_.pop_front();
+  }
+
+  /**
+   * @brief Draws the panel in the current ImGui window.
+   */
+  auto draw() -> void {
+    std::lock_guard lock(mutex_);
+
+    ImGui::Separator();
+
+    // Text area
+    const float footer_height = ImGui::GetStyle().ItemSpacing.y +
+                                ImGui::GetFrameHeightWithSpacing() +
+                                footer_buffer;
+
+    if (ImGui::BeginChild("scrolling", ImVec2(0, -footer_height),
+                          ImGuiChildFlags_None,
+                          ImGuiWindowFlags_HorizontalScrollbar)) {
+      ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4, 1));
+
+      // Only lay out the lines that are visible
+      ImGuiListClipper clipper;
+      clipper.Begin(static_cast<int>(lines_.size()));
+      while (clipper.Step()) {
+        for (auto i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+          draw_line(lines_[static_cast<std::size_t>(i)]);
+        }
+      }
+      clipper.End();
+
+      ImGui::PopStyleVar();
+
+      // Keep up at the bottom of the scroll region if we were already at the
+      // bottom at the beginning of the frame. Using a scrollbar or
+      // mouse-wheel will take away from the bottom edge.
+      if (auto_scroll_ && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+        ImGui::SetScrollHereY(1.0f);
+    }
+    ImGui::EndChild();
+
+    ImGui::Separator();
+  }
+
+  [[nodiscard]] auto empty() const -> bool {
+    std::lock_guard lock(mutex_);
+    return lines_.empty();
+  }
+
+  auto clear() -> void {
+    std::lock_guard lock(mutex_);
+    lines_.clear();
+  }
+
+  auto set_auto_scroll(const bool b) noexcept -> void { auto_scroll_ = b; }
+
+ private:
+  struct line {
+    severity level;
+    std::string text;
+  };
+
+  static constexpr float footer_buffer = 38.0f;
+
+  mutable std::mutex mutex_;
+  std::deque<line> lines_;
+  const std::size_t max_lines_;
+  bool auto_scroll_ = true;
+
+  static auto draw_line(line const& l) -> void {
+    switch (l.level) {
+      case severity::warning:
+        ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f), "%s",
+                           l.text.c_str());
+        break;
+      case severity::error:
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s",
+                           l.text.c_str());
+        break;
+      default:
+        ImGui::TextUnformatted(l.text.c_str(),
+                               l.text.c_str() + l.text.size());
+        break;
+    }
+  }
+};
+}  // namespace app
+
+#endif  // LOG_PANEL_H
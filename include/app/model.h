@@ -4,6 +4,7 @@
 #include <atomic>
 #include <functional>
 #include <future>
+#include <memory>
 
 #include "logger/logger.h"
 #include "video/vid.h"
@@ -16,39 +17,79 @@ enum class state {
   stabilizing  // Stabilizing state
 };
 
+/**
+ * @brief What the GUI shows. Only the GUI thread touches it; jobs hand their
+ * results back to it through continuations.
+ */
 class model {
 public:
-  std::atomic<state> current_state;
   std::atomic<bool> video_stabilized = false;
+  std::atomic<bool> last_load_successful = false;
   std::atomic<bool> last_save_successful = false;
   std::function<void(state, state)> state_change_cb;
-  vid::video* video;
-  vid::video* stabilized_video;
+  // Shared with the preview, so neither outlives the other's use of it
+  std::shared_ptr<vid::video> video;
+  // The last stabilized video, which can be saved even once another video
+  // has been loaded, and the video it was made from
+  std::shared_ptr<vid::video> stabilized_video;
+  std::weak_ptr<vid::video> stabilized_from;
   std::filesystem::path video_path;
   std::filesystem::path save_dir;
 
-  model() : current_state(state::waiting), video(nullptr) {}
+  model() = default;
 
-  ~model() { delete video; }
+  /**
+   * @brief Returns whether no job is in flight.
+   */
+  auto idle() const noexcept -> bool { return busy_ == 0; }
 
-  auto state() const noexcept -> state { return current_state; }
+  /**
+   * @brief Returns whether a job of the given kind is in flight.
+   */
+  auto busy(const app::state s) const noexcept -> bool {
+    return (busy_ & bit(s)) != 0;
+  }
 
   auto did_load() const noexcept -> bool { return video != nullptr; }
 
   auto did_save() const noexcept -> bool { return last_save_successful; }
 
-  auto is_stabilized() const noexcept -> bool { return video_stabilized; }
+  /**
+   * @brief Returns whether the loaded video has been stabilized.
+   */
+  auto is_stabilized() const noexcept -> bool {
+    return stabilized_video && video && stabilized_from.lock() == video;
+  }
+
+  auto can_save() const noexcept -> bool {
+    return stabilized_video != nullptr;
+  }
 
   auto set_state_change_cb(
       const std::function<void(app::state, app::state)>& callback) {
     state_change_cb = callback;
   }
 
-  auto transition_to_state(const app::state new_state) -> void {
-    const auto old_state = current_state.load();
-    current_state.store(new_state);
+  /**
+   * @brief Marks a job of the given kind as started. Jobs of different kinds
+   * run side by side, so each one moves from and back to waiting on its own.
+   */
+  auto begin_job(const app::state s) -> void {
+    busy_ |= bit(s);
+    if (state_change_cb) state_change_cb(state::waiting, s);
+  }
+
+  auto end_job(const app::state s) -> void {
+    busy_ &= ~bit(s);
+    if (state_change_cb) state_change_cb(s, state::waiting);
+  }
+
+private:
+  // One bit for each kind of job in flight
+  std::atomic<unsigned> busy_ = 0;
 
-    if (state_change_cb) state_change_cb(old_state, new_state);
+  static constexpr auto bit(const app::state s) noexcept -> unsigned {
+    return 1u << static_cast<unsigned>(s);
   }
 };
 }  // namespace app
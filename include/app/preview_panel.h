@@ -0,0 +1,258 @@
+#ifndef PREVIEW_PANEL_H
+#define PREVIEW_PANEL_H
+
+// Always ensure GLAD is included before GLFW or face compiler errors!
+#include <glad/glad.h>
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+
+#include "video/preview.h"
+
+namespace app {
+/**
+ * @brief An OpenGL texture holding an RGBA image.
+ */
+class texture {
+ public:
+  texture() = default;
+  ~texture() { reset(); }
+
+  texture(texture const&) = delete;
+  texture& operator=(texture const&) = delete;
+
+  /**
+   * @brief Uploads an 8-bit RGBA image, reusing the texture's storage if the
+   * size hasn't changed.
+   */
+  auto upload(cv::Mat const& rgba) -> void {
+    if (rgba.empty() || rgba.type() != CV_8UC4) return;
+
+    if (!id_) {
+      glGenTextures(1, &id_);
+      glBindTexture(GL_TEXTURE_2D, id_);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+      glBindTexture(GL_TEXTURE_2D, id_);
+    }
+
+    // Rows of a proxy are tightly packed, but may not be continuous if the
+    // proxy is a view into a larger image
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,
+                  static_cast<GLint>(rgba.step / rgba.elemSize()));
+
+    if (rgba.size() == size_) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, rgba.cols, rgba.rows, GL_RGBA,
+                      GL_UNSIGNED_BYTE, rgba.data);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgba.cols, rgba.rows, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, rgba.data);
+      size_ = rgba.size();
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  /**
+   * @brief Deletes the texture. Must be called while the GL context is
+   * current.
+   */
+  auto reset() -> void {
+    if (id_) glDeleteTextures(1, &id_);
+    id_ = 0;
+    size_ = {};
+  }
+
+  [[nodiscard]] auto empty() const noexcept -> bool { return id_ == 0; }
+
+  [[nodiscard]] auto id() const noexcept -> ImTextureID {
+    return (ImTextureID)(intptr_t)id_;
+  }
+
+  [[nodiscard]] auto size() const noexcept -> cv::Size { return size_; }
+
+ private:
+  GLuint id_ = 0;
+  cv::Size size_;
+};
+
+/**
+ * @brief Plays back and scrubs through the original and stabilized videos.
+ * Only ever shows proxies from the preview cache, so drawing never waits on
+ * full-resolution frames.
+ */
+class preview_panel {
+ public:
+  explicit preview_panel(vid::preview& previews) : previews_{previews} {}
+
+  /**
+   * @brief Returns whether the panel needs to be redrawn soon, without any
+   * input: while playing, or while waiting for a proxy to be built.
+   */
+  [[nodiscard]] auto animating() const -> bool {
+    if (previews_.frame_count(track_) == 0) return false;
+
+    const auto version = previews_.version(track_);
+    return playing_ || shown_frame_ != frame_ || shown_track_ != track_ ||
+           shown_version_ != version || thumbs_version_ != version;
+  }
+
+  /**
+   * @brief Returns how long to wait between redraws while animating.
+   */
+  [[nodiscard]] auto redraw_interval_s() const -> double {
+    const auto fps = previews_.fps(track_);
+    return playing_ && fps > 0 ? 1.0 / fps : 1.0 / 30.0;
+  }
+
+  /**
+   * @brief Releases the panel's textures, before the GL context goes away.
+   */
+  auto release() -> void {
+    frame_texture_.reset();
+    thumbs_texture_.reset();
+    shown_frame_ = -1;
+    thumbs_version_ = 0;
+  }
+
+  auto draw() -> void {
+    const auto count = previews_.frame_count(track_);
+    if (count == 0) {
+      playing_ = false;
+      if (previews_.frame_count(vid::track::original) == 0) return;
+      track_ = vid::track::original;
+      return;
+    }
+
+    //---------------------------------------------------- Track select --//
+    if (ImGui::RadioButton("Original", track_ == vid::track::original)) {
+      select(vid::track::original);
+    }
+    ImGui::SameLine();
+    ImGui::BeginDisabled(previews_.frame_count(vid::track::stabilized) == 0);
+    if (ImGui::RadioButton("Stabilized", track_ == vid::track::stabilized)) {
+      select(vid::track::stabilized);
+    }
+    ImGui::EndDisabled();
+
+    //--------------------------------------------------------- Playback --//
+    if (playing_) advance(count);
+    frame_ = std::clamp(frame_, 0, count - 1);
+
+    const auto version = previews_.version(track_);
+    if (frame_ != shown_frame_ || track_ != shown_track_ ||
+        version != shown_version_) {
+      // Keep showing the last frame until the proxy is ready
+      const auto proxy = previews_.try_frame(track_, frame_);
+      if (!proxy.empty()) {
+        frame_texture_.upload(proxy);
+        shown_frame_ = frame_;
+        shown_track_ = track_;
+        shown_version_ = version;
+      }
+    }
+
+    const auto width = ImGui::GetContentRegionAvail().x;
+    const auto tex_size = frame_texture_.size();
+    const auto height = tex_size.width > 0
+                            ? width * static_cast<float>(tex_size.height) /
+                                  static_cast<float>(tex_size.width)
+                            : width * 9.0f / 16.0f;
+    if (frame_texture_.empty()) {
+      ImGui::Dummy(ImVec2(width, height));
+    } else {
+      ImGui::Image(frame_texture_.id(), ImVec2(width, height));
+    }
+
+    //--------------------------------------------------------- Controls --//
+    if (ImGui::Button(playing_ ? "Pause" : "Play")) {
+      playing_ = !playing_;
+      last_advance_s_ = ImGui::GetTime();
+      if (playing_) previews_.prefetch(track_, frame_);
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(-1.0f);
+    if (ImGui::SliderInt("##frame", &frame_, 0, count - 1)) {
+      previews_.prefetch(track_, frame_);
+    }
+
+    //------------------------------------------------------- Thumbnails --//
+    if (previews_.version(track_) != thumbs_version_ ||
+        track_ != thumbs_track_) {
+      thumbs_ = previews_.thumbnails(track_);
+      if (!thumbs_.atlas.empty()) {
+        thumbs_texture_.upload(thumbs_.atlas);
+        thumbs_version_ = previews_.version(track_);
+        thumbs_track_ = track_;
+      }
+    }
+
+    if (!thumbs_texture_.empty() && thumbs_track_ == track_ &&
+        !thumbs_.frames.empty()) {
+      const auto atlas_size = thumbs_texture_.size();
+      const auto strip_height = width *
+                                static_cast<float>(atlas_size.height) /
+                                static_cast<float>(atlas_size.width);
+      ImGui::Image(thumbs_texture_.id(), ImVec2(width, strip_height));
+
+      // Jump to the frame of the thumbnail that was clicked
+      if (ImGui::IsItemClicked()) {
+        const auto x = ImGui::GetMousePos().x - ImGui::GetItemRectMin().x;
+        const auto n = static_cast<int>(thumbs_.frames.size());
+        const auto i = std::clamp(static_cast<int>(x / width * n), 0, n - 1);
+        frame_ = thumbs_.frames[i];
+        previews_.prefetch(track_, frame_);
+      }
+    }
+  }
+
+ private:
+  vid::preview& previews_;
+  vid::track track_ = vid::track::original;
+  int frame_ = 0;
+  bool playing_ = false;
+  double last_advance_s_ = 0.0;
+
+  texture frame_texture_;
+  int shown_frame_ = -1;
+  vid::track shown_track_ = vid::track::original;
+  std::uint64_t shown_version_ = 0;
+
+  texture thumbs_texture_;
+  vid::thumbnail_strip thumbs_;
+  vid::track thumbs_track_ = vid::track::original;
+  std::uint64_t thumbs_version_ = 0;
+
+  auto select(const vid::track t) -> void {
+    if (t == track_) return;
+    track_ = t;
+    previews_.prefetch(track_, frame_);
+  }
+
+  /**
+   * @brief Moves the playhead on by however many frames are due, looping at
+   * the end of the video.
+   */
+  auto advance(const int count) -> void {
+    const auto fps = previews_.fps(track_);
+    if (fps <= 0) return;
+
+    const auto now = ImGui::GetTime();
+    const auto due = static_cast<int>((now - last_advance_s_) * fps);
+    if (due <= 0) return;
+
+    last_advance_s_ += static_cast<double>(due) / fps;
+    frame_ = (frame_ + due) % count;
+    previews_.prefetch(track_, frame_ + 1);
+  }
+};
+}  // namespace app
+
+#endif  // PREVIEW_PANEL_H
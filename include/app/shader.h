@@ -5,13 +5,14 @@
 
 #include <fstream>
 #include <filesystem>
-#include <iostream>
 #include <map>
 #include <ranges>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "logger/logger.h"
+
 namespace app {
 class shader_error : public std::runtime_error {
  public:
@@ -49,9 +50,8 @@ class shader_builder {
     const std::ifstream file_stream(std::filesystem::current_path().string() + file_name);
 
     if (!file_stream) {
-      // TODO: convert to debug log
-      std::cerr << "Error: Could not locate and open file " << file_name
-                << '\n';
+      logger::instance()->error("Could not locate and open file %s",
+                                file_name);
       throw std::runtime_error("Error: Could not locate and open file " +
                                file_name);
     }
@@ -62,9 +62,8 @@ class shader_builder {
     try {
       set_shader_source(type, buffer.str());
     } catch (shader_compile_error &e) {
-      // TODO: convert to debug log
-      std::cerr << "Error: Could not compile " << file_name << '\n';
-      std::cerr << "Shader Error: " << e.what() << "\n";
+      logger::instance()->error("Could not compile %s", file_name);
+      logger::instance()->log_lines(severity::error, e.what());
       throw;
     }
   }
@@ -158,8 +157,8 @@ class shader_builder {
     if (info_log_length > 1) {
       std::vector<char> info_log(info_log_length);
       glGetShaderInfoLog(obj, info_log_length, &chars_written, info_log.data());
-      // TODO: convert to debug log
-      std::cout << "SHADER:\n" << info_log.data() << '\n';
+      logger::instance()->debug("SHADER:");
+      logger::instance()->log_lines(severity::debug, info_log.data());
     }
   }
 
@@ -171,8 +170,8 @@ class shader_builder {
       std::vector<char> info_log(info_log_length);
       glGetProgramInfoLog(obj, info_log_length, &chars_written,
                           info_log.data());
-      // TODO: convert to debug log
-      std::cout << "PROGRAM:\n" << info_log.data() << '\n';
+      logger::instance()->debug("PROGRAM:");
+      logger::instance()->log_lines(severity::debug, info_log.data());
     }
   }
 };
@@ -0,0 +1,62 @@
+#ifndef DETECTION_MASK_H
+#define DETECTION_MASK_H
+
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+namespace img {
+/**
+ * \brief Tuning parameters for <code>build_detection_mask()</code>.
+ */
+struct mask_options {
+  // Frames sampled, evenly spaced, to measure how much each pixel changes
+  int sample_count = 30;
+  // Pixels whose intensity varies less than this, in grey levels of
+  // standard deviation across the samples, count as static
+  double static_stddev = 2.0;
+  // Static rows and columns at the edges darker than this are letterboxing
+  double letterbox_luma = 24.0;
+  // Static pixels only produce features, and so are only masked out, where
+  // the mean image has at least this much gradient
+  double overlay_gradient = 20.0;
+  // If more of the picture than this is static, the camera is most likely
+  // locked off rather than overlaid, so nothing but letterboxing is masked
+  double max_overlay_fraction = 0.25;
+  // Overlays are grown by this many pixels, so no feature straddles their
+  // edges
+  int overlay_margin = 8;
+};
+
+/**
+ * \brief Where to look for features in a video.
+ */
+struct detection_mask {
+  // 8-bit mask, non-zero where features may be detected. Empty if every
+  // pixel may be used.
+  cv::Mat mask;
+  // The picture inside any letterbox bars
+  cv::Rect content;
+  // Fraction of the content covered by static overlays
+  double overlay_fraction = 0.0;
+};
+
+/**
+ * \brief Finds letterbox bars and static overlays, such as burned-in
+ * timestamps or HUDs, from the temporal variance of a sample of the frames.
+ * Neither moves with the camera, so features on them only produce zero-motion
+ * matches for RANSAC to reject.
+ */
+[[nodiscard]] auto build_detection_mask(std::vector<cv::Mat> const& frames,
+                                        mask_options const& options = {})
+    -> detection_mask;
+
+/**
+ * \brief Combines an automatic mask with a user-supplied one, either of which
+ * may be empty. The user mask is resized to the frame size if needed, and
+ * any non-zero pixel in it allows detection.
+ */
+[[nodiscard]] auto combine_masks(cv::Mat const& automatic, cv::Mat const& user,
+                                 cv::Size frame_size) -> cv::Mat;
+}  // namespace img
+
+#endif  // DETECTION_MASK_H
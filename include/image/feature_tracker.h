@@ -4,17 +4,52 @@
 #include <opencv2/core/mat.hpp>
 #include <opencv2/features2d.hpp>
 
+namespace img::detail {
+struct tracker_steps;
+}
+
 namespace img {
+/**
+ * \brief Tuning parameters for <code>feature_tracker</code>.
+ */
+struct tracker_options {
+  // Most RANSAC iterations used to estimate each homography
+  int ransac_iterations = 1000;
+  // Confidence that no homography with more inliers is left to find once
+  // RANSAC stops, which ends it early once the best homography has enough
+  // inliers. 1 always runs every iteration.
+  float ransac_confidence = 0.99f;
+  // Maximum distance, in pixels, between a transformed point and its match
+  // for the match to count as an inlier
+  float ransac_epsilon = 10.0f;
+  // Maximum number of SIFT features kept per image, 0 keeps all of them
+  int max_features = 0;
+  // Whether features are only matched to features near where the previous
+  // pair's homography predicts them, rather than to every feature
+  bool guided_matching = true;
+  // Radius, in pixels, around the predicted position of a feature that its
+  // match is searched for in
+  float search_radius = 32.0f;
+  // Fewest guided matches for the prediction to be used, before falling back
+  // to matching every feature
+  int min_guided_matches = 32;
+};
+
 class feature_tracker {
+  // Runs each tracking step on its own, see tracker_steps.h
+  friend struct detail::tracker_steps;
+
  public:
-  explicit feature_tracker() {
-    sift_ = sift_->create();
+  explicit feature_tracker(tracker_options options = {})
+      : options_{options} {
+    sift_ = sift_->create(options_.max_features);
     matcher_ = matcher_->create(cv::NORM_L2, true);
   }
 
-  explicit feature_tracker(cv::Mat img_1, cv::Mat img_2)
-      : img_1_{std::move(img_1)}, img_2_{std::move(img_2)} {
-    sift_ = sift_->create();
+  explicit feature_tracker(cv::Mat img_1, cv::Mat img_2,
+                           tracker_options options = {})
+      : img_1_{std::move(img_1)}, img_2_{std::move(img_2)}, options_{options} {
+    sift_ = sift_->create(options_.max_features);
     matcher_ = matcher_->create(cv::NORM_L2, true);
   }
 
@@ -26,14 +61,35 @@ class feature_tracker {
     img_2_ = std::move(img_2);
   }
 
+  /**
+   * \brief Restricts feature detection to the non-zero pixels of the given
+   * 8-bit mask, which must match the size of the images. An empty mask
+   * allows detection everywhere.
+   */
+  auto set_mask(cv::Mat mask) noexcept -> void { mask_ = std::move(mask); }
+
   /**
    * \brief Detects and matches the features in the two images. This function
    * should be called <i>before</i> calling <code>visualize_matches()</code>,
    * or <code>visualize_match_quality()</code>. If images have recently been
    * set, this function should be called again.
+   *
+   * The images are expected to follow on from the previous pair tracked, so
+   * the homography found for that pair predicts where the features of this
+   * one are, and is the first homography RANSAC tries, unless
+   * <code>reset_prediction()</code> was called since.
    */
   auto track() noexcept -> void;
 
+  /**
+   * \brief Forgets the homographies of the previous pairs, so the next pair
+   * is matched against every feature and estimated from random samples only.
+   */
+  auto reset_prediction() noexcept -> void {
+    prediction_ = cv::Mat{};
+    previous_prediction_ = cv::Mat{};
+  }
+
   /**
    * \brief Returns an image that is a combination of the two images based on
    * their matching feature points. Assumes that <code>track()</code> has
@@ -49,10 +105,54 @@ class feature_tracker {
    */
   [[nodiscard]] auto h_mat() const noexcept -> cv::Mat { return h_mat_; }
 
+  /**
+   * \brief Returns the number of key points detected in the first image by
+   * the last call to <code>track()</code>.
+   */
+  [[nodiscard]] auto key_point_count() const noexcept -> std::size_t {
+    return key_points_1_.size();
+  }
+
+  /**
+   * \brief Returns the number of matches found by the last call to
+   * <code>track()</code>.
+   */
+  [[nodiscard]] auto match_count() const noexcept -> std::size_t {
+    return matches_.size();
+  }
+
+  /**
+   * \brief Returns the number of matches that were inliers of the best
+   * homography found by the last call to <code>track()</code>.
+   */
+  [[nodiscard]] auto inlier_count() const noexcept -> std::size_t {
+    return inlier_count_;
+  }
+
+  /**
+   * \brief Returns the number of RANSAC iterations run by the last call to
+   * <code>track()</code>.
+   */
+  [[nodiscard]] auto ransac_iterations() const noexcept -> int {
+    return ransac_iterations_;
+  }
+
+  /**
+   * \brief Returns whether the matches found by the last call to
+   * <code>track()</code> came from guided matching, rather than from
+   * matching every feature.
+   */
+  [[nodiscard]] auto guided() const noexcept -> bool { return guided_; }
+
  private:
   // The original images
   cv::Mat img_1_, img_2_;
 
+  tracker_options options_;
+
+  // Where features may be detected, empty for everywhere
+  cv::Mat mask_;
+
   // Key points
   cv::Ptr<cv::SIFT> sift_{};
   std::vector<cv::KeyPoint> key_points_1_, key_points_2_;
@@ -62,6 +162,17 @@ class feature_tracker {
   cv::Ptr<cv::BFMatcher> matcher_{};
   std::vector<cv::DMatch> matches_;
 
+  // Homography of the previous pair, which predicts where the features of
+  // the first image are in the second, and whether it was used, and the
+  // homography of the pair before that
+  cv::Mat prediction_;
+  cv::Mat previous_prediction_;
+  bool guided_ = false;
+
+  // Features of the second image sorted by the cell of the search grid they
+  // fall in, and where each cell's features start
+  std::vector<int> grid_order_, grid_starts_;
+
   // Colors
   static const cv::Scalar match_color;
   static const cv::Scalar inlier_color;
@@ -70,7 +181,8 @@ class feature_tracker {
 
   // Hessian Matrix Values
   cv::Mat h_mat_;
-  static constexpr float epsilon = 10.0f;
+  std::size_t inlier_count_ = 0;
+  int ransac_iterations_ = 0;
 
   // Warp Values
   static constexpr int border_size = 50;
@@ -81,16 +193,39 @@ class feature_tracker {
   auto detect_features() noexcept -> void;
 
   /**
-   * \brief Matches the features in the two images.
+   * \brief Matches the features in the two images, near their predicted
+   * positions if there is a prediction, and every feature to every other
+   * otherwise.
    */
   auto match_features() noexcept -> void;
 
+  /**
+   * \brief Matches each feature of the first image only to the features of
+   * the second image within the search radius of its predicted position,
+   * keeping the pairs that are each other's closest.
+   */
+  auto match_guided_features() noexcept -> void;
+
   /**
    * \brief Finds the best homography matrix that transforms the points from
    * the first image to the second image.
    */
   auto find_best_homography() noexcept -> void;
 
+  /**
+   * \brief Collects the matches that the given homography maps to within
+   * epsilon of their match. An empty homography has no inliers.
+   */
+  auto find_inliers(cv::Mat const& h_mat,
+                    std::vector<cv::DMatch>& inliers) const noexcept -> void;
+
+  /**
+   * \brief Returns the homography that best fits the given matches, or an
+   * empty matrix if they are degenerate.
+   */
+  [[nodiscard]] auto fit_homography(
+      std::vector<cv::DMatch> const& matches) const -> cv::Mat;
+
   /**
    * \brief Calculates the error between the match point and the transformed
    * point for the given match.
@@ -0,0 +1,41 @@
+#ifndef HOMOGRAPHY_H
+#define HOMOGRAPHY_H
+
+#include <opencv2/core/mat.hpp>
+
+namespace img {
+/**
+ * \brief Returns the matrix logarithm of the homography, scaled to unit
+ * determinant first, since homographies are only defined up to scale. Expects
+ * a homography close enough to the identity to have no negative real
+ * eigenvalues, which holds for the motion between nearby frames.
+ * \param ok Set to whether the logarithm could be computed.
+ */
+[[nodiscard]] auto homography_log(cv::Matx33d const& h, bool* ok = nullptr)
+    -> cv::Matx33d;
+
+/**
+ * \brief Returns the matrix exponential, the inverse of
+ * <code>homography_log()</code>.
+ */
+[[nodiscard]] auto homography_exp(cv::Matx33d const& l) -> cv::Matx33d;
+
+/**
+ * \brief Returns the fraction <code>t</code> of the motion described by the
+ * homography, i.e. H^t, interpolated along the shortest path through the
+ * group of homographies rather than entry by entry. The result is scaled so
+ * its bottom-right entry is 1, like the output of
+ * <code>cv::findHomography()</code>.
+ */
+[[nodiscard]] auto interpolate_homography(cv::Mat const& h, double t)
+    -> cv::Mat;
+
+/**
+ * \brief Returns the homography that, applied <code>n</code> times, gives
+ * <code>h</code>: the per-frame motion of a camera moving at constant
+ * velocity.
+ */
+[[nodiscard]] auto homography_root(cv::Mat const& h, int n) -> cv::Mat;
+}  // namespace img
+
+#endif  // HOMOGRAPHY_H
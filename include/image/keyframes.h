@@ -0,0 +1,107 @@
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include <array>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+namespace img {
+/**
+ * \brief Tuning parameters for <code>keyframe_selector</code>.
+ */
+struct keyframe_options {
+  // Whether to track only keyframes and interpolate the motion in between
+  bool enabled = true;
+  // Width frames are downscaled to before their motion is measured
+  int probe_width = 320;
+  // Largest distance, in full-resolution pixels, allowed between the
+  // measured position of a frame and where moving at constant velocity
+  // between the surrounding keyframes would put it
+  double max_deviation = 1.0;
+  // Most frame pairs between consecutive keyframes
+  int max_gap = 10;
+  // Motion measured with less confidence than this, from 0 to 1, isn't a
+  // plain translation, e.g. because of rotation, zoom, blur or a cut, so the
+  // frames are tracked rather than interpolated
+  double min_response = 0.5;
+};
+
+/**
+ * \brief Picks the frames to run full feature tracking on, from a cheap
+ * motion measurement of every frame.
+ *
+ * Each frame is downscaled, and each quarter of it is phase-correlated with
+ * the same quarter of the previous frame, so rotation and zoom show up as
+ * the quarters moving apart. A run of frames stays between two keyframes for
+ * as long as every quarter moves at close to constant velocity, so the
+ * homographies in between can be interpolated. Static and oversampled
+ * footage yields few keyframes; shaky footage yields a keyframe for every
+ * frame.
+ */
+class keyframe_selector {
+ public:
+  explicit keyframe_selector(keyframe_options options = {})
+      : options_{options} {}
+
+  /**
+   * \brief Starts a new run of frames at the given keyframe, keeping the
+   * keyframes picked so far.
+   */
+  auto start(int index, cv::Mat const& frame) -> void;
+
+  /**
+   * \brief Adds the frame following the last one added or started from.
+   */
+  auto add(int index, cv::Mat const& frame) -> void;
+
+  /**
+   * \brief Ends the run, making the last frame added a keyframe.
+   */
+  auto finish() -> void;
+
+  /**
+   * \brief Returns the keyframes picked so far, in the order they were
+   * picked.
+   */
+  [[nodiscard]] auto keyframes() const noexcept -> std::vector<int> const& {
+    return keyframes_;
+  }
+
+ private:
+  keyframe_options options_;
+  std::vector<int> keyframes_;
+
+  // Frames are measured in a 2x2 grid of tiles
+  static constexpr int tile_count = 4;
+  using tile_points = std::array<cv::Point2d, tile_count>;
+
+  // Downscaled frames, and the windows that taper the edges of a tile and of
+  // a whole frame
+  cv::Mat key_proxy_, last_proxy_;
+  cv::Mat tile_window_, frame_window_;
+  double scale_ = 1.0;
+  int last_index_ = -1;
+
+  // Measured position of each tile of each frame since the last keyframe,
+  // relative to the keyframe
+  std::vector<tile_points> path_;
+
+  /**
+   * \brief Returns tile <code>t</code> of the proxy, in row-major order.
+   */
+  [[nodiscard]] static auto tile(cv::Mat const& proxy, int t) -> cv::Mat;
+
+  /**
+   * \brief Returns a small, single-channel floating-point copy of the frame.
+   */
+  auto make_proxy(cv::Mat const& frame) -> cv::Mat;
+
+  /**
+   * \brief Returns whether every tile on the path is close enough to where
+   * constant velocity from the first to the last frame would put it.
+   */
+  [[nodiscard]] auto is_linear() const noexcept -> bool;
+};
+}  // namespace img
+
+#endif  // KEYFRAMES_H
@@ -0,0 +1,163 @@
+#ifndef PHASE_TRACKER_H
+#define PHASE_TRACKER_H
+
+#include <array>
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+
+namespace img {
+/**
+ * \brief How the motion between two frames is estimated.
+ */
+enum class estimator : std::uint8_t {
+  // SIFT features matched with RANSAC, see <code>feature_tracker</code>
+  features,
+  // FFT phase correlation of downscaled frames, see
+  // <code>phase_tracker</code>
+  phase,
+};
+
+/**
+ * \brief Tuning parameters for <code>phase_tracker</code>.
+ */
+struct phase_options {
+  // Width frames are downscaled to before they're correlated
+  int width = 320;
+  // Whether to also estimate rotation and scale, from the log-polar
+  // transform of the frames' spectra, rather than translation alone
+  bool rotation_scale = false;
+  // Motion measured with less confidence than this, from 0 to 1, is
+  // treated as a failure to track, e.g. across a cut
+  double min_response = 0.05;
+};
+
+/**
+ * \brief Estimates the motion between two frames by phase correlation: a
+ * translation, or a similarity transform when rotation and scale are
+ * enabled.
+ *
+ * Much cheaper than <code>feature_tracker</code>, but it measures a single
+ * global motion, so it suits footage whose shake is mostly a pan or tilt of
+ * a distant scene. Rotation and scale come from correlating the log-polar
+ * transforms of the frames' magnitude spectra, which don't depend on the
+ * translation, and are only recovered for small angles, up to 90 degrees
+ * either way.
+ *
+ * The downscaled copies of the last two frames seen are kept, so tracking a
+ * sequence of frames in order prepares each frame only once. Frames are
+ * recognised by their pixel buffer, which the cache holds a reference to
+ * until the frame is evicted, so the buffer can't be handed to another frame
+ * in the meantime. A frame mustn't be modified in place between calls.
+ */
+class phase_tracker {
+ public:
+  explicit phase_tracker(phase_options options = {}) : options_{options} {}
+
+  /**
+   * \brief Sets the images.
+   */
+  auto set_images(cv::Mat img_1, cv::Mat img_2) noexcept -> void {
+    img_1_ = std::move(img_1);
+    img_2_ = std::move(img_2);
+  }
+
+  /**
+   * \brief Restricts the correlation to the bounding box of the non-zero
+   * pixels of the given 8-bit mask, which must match the size of the
+   * images. The zero pixels inside it are filled in with the mean of the
+   * rest, so overlays don't pin the estimate to no motion. An empty mask
+   * uses the whole frame.
+   */
+  auto set_mask(cv::Mat const& mask) -> void;
+
+  /**
+   * \brief Estimates the motion between the two images. If images have
+   * recently been set, this function should be called again.
+   */
+  auto track() noexcept -> void;
+
+  /**
+   * \brief Returns the homography that transforms the points in the first
+   * image to the points in the second image. Assumes that
+   * <code>track()</code> has already been called, otherwise, or if the
+   * correlation was too weak, returns an empty matrix.
+   */
+  [[nodiscard]] auto h_mat() const noexcept -> cv::Mat { return h_mat_; }
+
+  /**
+   * \brief Returns the confidence of the last call to <code>track()</code>,
+   * from 0 to 1: the weaker of the translation and, if enabled, the
+   * rotation and scale correlation peaks.
+   */
+  [[nodiscard]] auto response() const noexcept -> double { return response_; }
+
+ private:
+  // The original images
+  cv::Mat img_1_, img_2_;
+
+  phase_options options_;
+
+  // Region of the frames that's correlated, empty for the whole frame, and
+  // the mask inside it, empty if nothing in it is masked
+  cv::Rect roi_;
+  cv::Mat roi_mask_;
+
+  /**
+   * \brief A frame prepared for correlation.
+   */
+  struct prepared {
+    // The frame it was prepared from, holding on to its pixel buffer so no
+    // other frame can be allocated at the same address while it's cached
+    cv::Mat frame;
+    // Downscaled, single-channel floating-point copy of the region of
+    // interest
+    cv::Mat proxy;
+    // Log-polar transform of the proxy's magnitude spectrum, only when
+    // rotation and scale are enabled
+    cv::Mat log_polar;
+  };
+
+  // The last two frames prepared, and which of them to replace next
+  std::array<prepared, 2> cache_;
+  std::size_t cache_next_ = 0;
+
+  // Size the windows and filter below were made for
+  cv::Size proxy_size_;
+  // Downscale factor from the region of interest to the proxies
+  double scale_ = 1.0;
+  // Where to fill in the mean of a proxy
+  cv::Mat fill_mask_;
+  // Tapers the edges of a proxy and of its centred square, and emphasises
+  // the higher frequencies of the spectrum
+  cv::Mat window_, square_window_, high_pass_;
+
+  // Result
+  cv::Mat h_mat_;
+  double response_ = 0.0;
+
+  /**
+   * \brief Returns the prepared copy of the frame, preparing it if it isn't
+   * cached.
+   */
+  auto prepare(cv::Mat const& frame) -> prepared const&;
+
+  /**
+   * \brief Returns a small, single-channel floating-point copy of the region
+   * of interest of the frame.
+   */
+  auto make_proxy(cv::Mat const& frame) -> cv::Mat;
+
+  /**
+   * \brief Returns the log-polar transform of the high-passed magnitude
+   * spectrum of the centred square of the proxy.
+   */
+  auto make_log_polar(cv::Mat const& proxy) const -> cv::Mat;
+
+  /**
+   * \brief Recreates the windows and filter for proxies of the given size.
+   */
+  auto resize_windows(cv::Size size) -> void;
+};
+}  // namespace img
+
+#endif  // PHASE_TRACKER_H
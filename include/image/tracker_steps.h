@@ -0,0 +1,71 @@
+#ifndef TRACKER_STEPS_H
+#define TRACKER_STEPS_H
+
+#include <vector>
+
+#include "feature_tracker.h"
+
+// Internal to the tracking code and its benchmarks: runs the steps of
+// img::feature_tracker::track() one at a time, so each can be timed on its
+// own. Nothing here is part of the public API.
+
+namespace img::detail {
+/**
+ * \brief The individual steps of <code>feature_tracker::track()</code>.
+ * Unlike <code>track()</code>, none of them updates the prediction for the
+ * next pair.
+ */
+struct tracker_steps {
+  /**
+   * \brief Detects the features in both images.
+   */
+  static auto detect_features(feature_tracker& ft) noexcept -> void {
+    ft.detect_features();
+  }
+
+  /**
+   * \brief Matches the detected features, near their predicted positions if
+   * the tracker has a prediction.
+   */
+  static auto match_features(feature_tracker& ft) noexcept -> void {
+    ft.match_features();
+  }
+
+  /**
+   * \brief Runs RANSAC over the matches.
+   */
+  static auto find_best_homography(feature_tracker& ft) noexcept -> void {
+    ft.find_best_homography();
+  }
+
+  /**
+   * \brief Returns the error RANSAC scores the given match by.
+   */
+  [[nodiscard]] static auto calc_error(feature_tracker const& ft,
+                                       cv::Mat const& h,
+                                       cv::DMatch const& match) noexcept
+      -> float {
+    return ft.calc_error(h, match);
+  }
+
+  /**
+   * \brief Transforms a point by the given homography, as RANSAC does.
+   */
+  [[nodiscard]] static auto h_transform(cv::Mat const& h,
+                                        cv::Point2f const& point) noexcept
+      -> cv::Point2f {
+    return feature_tracker::h_transform(h, point);
+  }
+
+  /**
+   * \brief Returns the matches of the last call to
+   * <code>match_features()</code>.
+   */
+  [[nodiscard]] static auto matches(feature_tracker const& ft) noexcept
+      -> std::vector<cv::DMatch> const& {
+    return ft.matches_;
+  }
+};
+}  // namespace img::detail
+
+#endif  // TRACKER_STEPS_H
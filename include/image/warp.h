@@ -0,0 +1,45 @@
+#ifndef WARP_H
+#define WARP_H
+
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+#include <string_view>
+
+namespace img {
+/**
+ * \brief Instruction sets the warp kernels are built for, from the oldest.
+ */
+enum class warp_isa : std::uint8_t { scalar, sse4, avx2, avx512 };
+
+/**
+ * \brief Returns the newest instruction set both the kernels and this CPU
+ * support, which <code>warp_perspective()</code> uses by default.
+ */
+[[nodiscard]] auto best_warp_isa() noexcept -> warp_isa;
+
+[[nodiscard]] auto warp_isa_name(warp_isa isa) noexcept -> std::string_view;
+
+/**
+ * \brief Warps the image by the homography, like
+ * <code>cv::warpPerspective()</code> with bilinear interpolation and a
+ * constant border, but only computes the given region of the output, which
+ * becomes the whole of <code>dst</code>.
+ *
+ * 8-bit, 3-channel images run on dedicated kernels, which round source
+ * coordinates to 1/32 of a pixel and blend in fixed point. The homography
+ * picks the kernel: a translation blends two source rows with fixed weights,
+ * or copies them for whole pixels, an affine map skips the per-pixel
+ * division of a full perspective one. Homographies within 1/64 of a pixel of
+ * a cheaper kind over the region count as that kind. Other image types,
+ * including the single-channel planes of I420 frames, fall back to
+ * <code>cv::warpPerspective()</code>.
+ * \param region Region of the output to compute, empty for the size of
+ * <code>src</code>.
+ * \param isa Instruction set to run on, lowered to what the CPU supports.
+ */
+auto warp_perspective(cv::Mat const& src, cv::Mat& dst, cv::Mat const& h,
+                      cv::Rect region = {}, cv::Scalar const& border = {},
+                      warp_isa isa = best_warp_isa()) -> void;
+}  // namespace img
+
+#endif  // WARP_H
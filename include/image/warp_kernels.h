@@ -0,0 +1,245 @@
+#ifndef WARP_KERNELS_H
+#define WARP_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Internal to img_lib: the kernels behind img::warp_perspective(), which are
+// compiled once per instruction set and picked at runtime. Every translation
+// unit that includes this header gets its own copy of the helpers below, built
+// for its own instruction set, so nothing here may have external linkage, and
+// this header must not pull in OpenCV.
+
+namespace img::detail {
+/**
+ * \brief A warp of an 8-bit, 3-channel image, described by the map from
+ * destination pixels back to source pixels.
+ */
+struct warp_job {
+  const std::uint8_t* src = nullptr;
+  std::ptrdiff_t src_step = 0;
+  int src_cols = 0, src_rows = 0;
+
+  std::uint8_t* dst = nullptr;
+  std::ptrdiff_t dst_step = 0;
+  int dst_cols = 0, dst_rows = 0;
+
+  // Row-major homography from destination to source pixel coordinates, with
+  // a bottom-right entry of 1
+  double map[9] = {};
+  // Colour of the pixels outside the source
+  std::uint8_t border[3] = {};
+};
+
+using warp_fn = void (*)(warp_job const&);
+
+/**
+ * \brief The kernels for one instruction set, from the cheapest to the most
+ * general map they handle.
+ */
+struct warp_kernels {
+  // Maps whose linear part is the identity
+  warp_fn translation = nullptr;
+  // Maps whose bottom row is (0, 0, 1)
+  warp_fn affine = nullptr;
+  warp_fn perspective = nullptr;
+};
+
+[[nodiscard]] auto scalar_kernels() noexcept -> warp_kernels;
+[[nodiscard]] auto sse4_kernels() noexcept -> warp_kernels;
+[[nodiscard]] auto avx2_kernels() noexcept -> warp_kernels;
+[[nodiscard]] auto avx512_kernels() noexcept -> warp_kernels;
+
+namespace {
+// Source coordinates are rounded to 1/32 of a pixel, like
+// cv::warpPerspective() does
+constexpr int sub_bits = 5;
+constexpr int sub_size = 1 << sub_bits;
+constexpr int sub_mask = sub_size - 1;
+
+// Furthest source coordinate kept, in fixed point, so far away points still
+// fit in 32 bits and land outside the source
+constexpr float fixed_limit = 1073741824.0f;
+
+/**
+ * \brief Returns the coordinate in fixed point, rounded to nearest even like
+ * the vector conversions. NaN maps to the far negative limit, like the
+ * vector clamps do.
+ */
+inline auto to_fixed(const float v) noexcept -> int {
+  auto f = v * static_cast<float>(sub_size);
+  if (!(f > -fixed_limit)) f = -fixed_limit;
+  if (f > fixed_limit) f = fixed_limit;
+
+  return static_cast<int>(std::nearbyint(f));
+}
+
+/**
+ * \brief Blends four neighbouring 8-bit values with the sub-pixel weights.
+ * The horizontal pass is exact in 16 bits, and the vertical one rounds like
+ * <code>_mm_mulhrs_epi16()</code>, so the vector kernels, which follow the
+ * same steps, agree with it bit for bit.
+ */
+inline auto blend(const int p00, const int p01, const int p10, const int p11,
+                  const int fx, const int fy) noexcept -> std::uint8_t {
+  const auto h0 = (p00 << sub_bits) + (p01 - p00) * fx;
+  const auto h1 = (p10 << sub_bits) + (p11 - p10) * fx;
+  const auto v = h0 + (((h1 - h0) * (fy << 10) + (1 << 14)) >> 15);
+
+  return static_cast<std::uint8_t>((v + sub_size / 2) >> sub_bits);
+}
+
+/**
+ * \brief Writes the destination pixel sampled at the fixed-point source
+ * coordinates, taking neighbours outside the source from the border.
+ */
+inline auto sample(warp_job const& job, const int sx, const int sy,
+                   std::uint8_t* out) noexcept -> void {
+  const auto ix = sx >> sub_bits;
+  const auto iy = sy >> sub_bits;
+  if (ix < -1 || iy < -1 || ix >= job.src_cols || iy >= job.src_rows) {
+    std::memcpy(out, job.border, 3);
+    return;
+  }
+
+  const auto pixel = [&](const int x, const int y) -> const std::uint8_t* {
+    if (x < 0 || y < 0 || x >= job.src_cols || y >= job.src_rows) {
+      return job.border;
+    }
+    return job.src + y * job.src_step + x * 3;
+  };
+
+  const auto* p00 = pixel(ix, iy);
+  const auto* p01 = pixel(ix + 1, iy);
+  const auto* p10 = pixel(ix, iy + 1);
+  const auto* p11 = pixel(ix + 1, iy + 1);
+  const auto fx = sx & sub_mask;
+  const auto fy = sy & sub_mask;
+  for (auto c = 0; c < 3; ++c) {
+    out[c] = blend(p00[c], p01[c], p10[c], p11[c], fx, fy);
+  }
+}
+
+/**
+ * \brief The map evaluated at the start of a destination row, in single
+ * precision like the vector kernels.
+ */
+struct map_row {
+  float m0, m3, m6;
+  float x, y, w;
+};
+
+inline auto row_of(warp_job const& job, const int y) noexcept -> map_row {
+  auto const& m = job.map;
+  return {static_cast<float>(m[0]),
+          static_cast<float>(m[3]),
+          static_cast<float>(m[6]),
+          static_cast<float>(m[1] * y + m[2]),
+          static_cast<float>(m[4] * y + m[5]),
+          static_cast<float>(m[7] * y + m[8])};
+}
+
+/**
+ * \brief Writes destination pixels [x, end) of a row one at a time.
+ */
+template <bool perspective>
+auto remap_pixels(warp_job const& job, map_row const& r, int x, const int end,
+                  std::uint8_t* row) noexcept -> void {
+  for (; x < end; ++x) {
+    const auto fx = static_cast<float>(x);
+    auto sx = r.x + r.m0 * fx;
+    auto sy = r.y + r.m3 * fx;
+    if constexpr (perspective) {
+      const auto w = r.w + r.m6 * fx;
+      sx = sx / w;
+      sy = sy / w;
+    }
+    sample(job, to_fixed(sx), to_fixed(sy), row + x * 3);
+  }
+}
+
+/**
+ * \brief Runs an affine or perspective warp, handing each row to the vector
+ * kernel in blocks of <code>lanes</code> pixels and finishing it a pixel at a
+ * time.
+ */
+template <bool perspective, int lanes, typename Block>
+auto remap(warp_job const& job, Block block) noexcept -> void {
+  for (auto y = 0; y < job.dst_rows; ++y) {
+    const auto r = row_of(job, y);
+    auto* row = job.dst + y * job.dst_step;
+
+    auto x = 0;
+    for (; x + lanes <= job.dst_cols; x += lanes) block(r, x, row);
+    remap_pixels<perspective>(job, r, x, job.dst_cols, row);
+  }
+}
+
+/**
+ * \brief Runs a translation. Every pixel shares the same sub-pixel weights,
+ * so rows whose neighbours are all inside the source are blended a byte at a
+ * time by the vector kernel, <code>blend_bytes(a, b, out, count, fx,
+ * fy)</code>, which reads <code>count + 3</code> bytes of each source row.
+ * Whole-pixel translations are plain copies.
+ */
+template <typename BlendBytes>
+auto translate(warp_job const& job, BlendBytes blend_bytes) noexcept -> void {
+  const auto tx = to_fixed(static_cast<float>(job.map[2]));
+  const auto ty = to_fixed(static_cast<float>(job.map[5]));
+  const auto dx = tx >> sub_bits;
+  const auto dy = ty >> sub_bits;
+  const auto fx = tx & sub_mask;
+  const auto fy = ty & sub_mask;
+
+  // Destination columns whose neighbours are both inside the source
+  const auto begin = dx < 0 ? -dx : 0;
+  const auto last = job.src_cols - 1 - dx;
+  const auto end = last < job.dst_cols ? last : job.dst_cols;
+
+  for (auto y = 0; y < job.dst_rows; ++y) {
+    auto* row = job.dst + y * job.dst_step;
+    const auto iy = y + dy;
+    if (iy < 0 || iy + 1 >= job.src_rows || begin >= end) {
+      for (auto x = 0; x < job.dst_cols; ++x) {
+        sample(job, (x << sub_bits) + tx, (y << sub_bits) + ty, row + x * 3);
+      }
+      continue;
+    }
+
+    for (auto x = 0; x < begin; ++x) {
+      sample(job, (x << sub_bits) + tx, (y << sub_bits) + ty, row + x * 3);
+    }
+
+    const auto* a = job.src + iy * job.src_step + (begin + dx) * 3;
+    if (fx == 0 && fy == 0) {
+      std::memcpy(row + begin * 3, a,
+                  static_cast<std::size_t>(end - begin) * 3);
+    } else {
+      blend_bytes(a, a + job.src_step, row + begin * 3, (end - begin) * 3, fx,
+                  fy);
+    }
+
+    for (auto x = end; x < job.dst_cols; ++x) {
+      sample(job, (x << sub_bits) + tx, (y << sub_bits) + ty, row + x * 3);
+    }
+  }
+}
+
+/**
+ * \brief Blends <code>count</code> bytes of a translated row a byte at a
+ * time, each with the byte one pixel to its right and the same bytes of the
+ * next row.
+ */
+inline auto blend_bytes_scalar(const std::uint8_t* a, const std::uint8_t* b,
+                               std::uint8_t* out, const int count,
+                               const int fx, const int fy) noexcept -> void {
+  for (auto k = 0; k < count; ++k) {
+    out[k] = blend(a[k], a[k + 3], b[k], b[k + 3], fx, fy);
+  }
+}
+}  // namespace
+}  // namespace img::detail
+
+#endif  // WARP_KERNELS_H
@@ -0,0 +1,82 @@
+#ifndef YUV_H
+#define YUV_H
+
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+
+namespace img {
+/**
+ * \brief How a frame's pixels are laid out in memory.
+ *
+ * <code>bgr</code> frames are 8-bit, 3-channel images. <code>i420</code>
+ * frames are planar YUV 4:2:0, as OpenCV's <code>COLOR_BGR2YUV_I420</code>
+ * lays it out: a single-channel 8-bit matrix, half as tall again as the
+ * picture, holding the full-resolution Y plane followed by the U and V planes
+ * at half the width and height. They take half the memory of BGR frames.
+ */
+enum class pixel_format : std::uint8_t { bgr, i420 };
+
+/**
+ * \brief The planes of an I420 frame, sharing its data.
+ */
+struct yuv_planes {
+  cv::Mat y, u, v;
+};
+
+/**
+ * \brief Returns whether frames of the given size can be stored as I420,
+ * which needs an even width and height.
+ */
+[[nodiscard]] auto fits_i420(cv::Size size) noexcept -> bool;
+
+/**
+ * \brief Returns the size of the picture a frame of the given format holds.
+ */
+[[nodiscard]] auto picture_size(cv::Mat const& frame, pixel_format format)
+    -> cv::Size;
+
+/**
+ * \brief Returns the planes of a continuous I420 frame.
+ */
+[[nodiscard]] auto i420_planes(cv::Mat const& frame) -> yuv_planes;
+
+/**
+ * \brief Returns the image motion is measured on: the Y plane of an I420
+ * frame, sharing its data, or the frame itself otherwise.
+ */
+[[nodiscard]] auto luma(cv::Mat const& frame, pixel_format format) -> cv::Mat;
+
+/**
+ * \brief Converts a BGR frame to the given format, sharing its data if it's
+ * already in that format.
+ */
+auto from_bgr(cv::Mat const& bgr, cv::Mat& dst, pixel_format format) -> void;
+
+/**
+ * \brief Converts a frame of the given format to BGR, sharing its data if
+ * it's already BGR.
+ */
+auto to_bgr(cv::Mat const& frame, cv::Mat& dst, pixel_format format) -> void;
+
+/**
+ * \brief Warps an I420 frame by a homography between pixels of its picture,
+ * like <code>warp_perspective()</code> does a BGR frame. The chroma planes
+ * are warped by the same motion expressed in their own, half-resolution
+ * pixels, and the introduced borders are black. Every plane is
+ * single-channel, so none of them runs on the dedicated BGR kernels; each is
+ * warped by <code>cv::warpPerspective()</code>.
+ * \param region Region of the picture to compute, empty for all of it. Its
+ * corners are rounded inwards to even pixels, so it lines up with the chroma
+ * samples.
+ */
+auto warp_i420(cv::Mat const& src, cv::Mat& dst, cv::Mat const& h,
+               cv::Rect region = {}) -> void;
+
+/**
+ * \brief Returns the largest region inside the given one whose corners lie
+ * on even pixels, so it can be cropped out of an I420 frame.
+ */
+[[nodiscard]] auto even_region(cv::Rect region) noexcept -> cv::Rect;
+}  // namespace img
+
+#endif  // YUV_H
@@ -1,55 +1,228 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include "imgui.h"
-#include "utils.h"
-
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
 #include <string>
-#include <functional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "record.h"
+#include "ring_buffer.h"
+
+/**
+ * @brief What to do with a message when the ring buffer is full.
+ */
+enum class drop_policy : std::uint8_t {
+  drop_newest,  // Discard the message and count it, never wait
+  block         // Wait for the consumer to make room
+};
 
-class logger {
-  std::mutex mutex_;
+struct logger_options {
+  // Number of messages that can be waiting to be formatted; rounded up to a
+  // power of two
+  std::size_t capacity = 8192;
+  drop_policy policy = drop_policy::drop_newest;
+  // Messages below this severity are discarded before they are queued
+  severity min_severity = severity::info;
+  // Severity at which messages are echoed to stderr, or off
+  severity stderr_severity = severity::warning;
+  // How often the consumer wakes up to format and write queued messages
+  std::chrono::milliseconds flush_interval{20};
+};
+
+/**
+ * @brief A formatted log message, as handed to sinks.
+ */
+struct log_entry {
+  severity level;
+  // Nanoseconds since the logger was created
+  std::int64_t timestamp_ns;
+  std::uint32_t thread;
+  std::string_view message;
+};
 
-  // Dynamic logs
-  std::unordered_map<std::string, std::function<std::string()>> dynamic_logs_;
+/**
+ * @brief A destination for log messages. Sinks are only ever called from the
+ * logger's consumer thread, one message at a time.
+ */
+class log_sink {
+ public:
+  explicit log_sink(const severity min_severity = severity::debug)
+      : min_severity_{min_severity} {}
+  virtual ~log_sink() = default;
 
-protected:
-  explicit logger();
-  ~logger();
+  virtual auto write(log_entry const& entry) -> void = 0;
+
+  virtual auto flush() -> void {}
 
-  bool auto_scroll_ = true;
-  bool clear_ = false;
-  ImGuiTextBuffer buf_;
-  // Index to lines offset. We maintain this with add_log() calls.
-  ImVector<int> line_offsets_;
-  static constexpr float footer_buffer = 38.0f;
+  [[nodiscard]] auto accepts(const severity s) const noexcept -> bool {
+    return s >= min_severity_.load(std::memory_order_relaxed);
+  }
 
-  auto clear_log() -> void;
+  auto set_min_severity(const severity s) noexcept -> void {
+    min_severity_.store(s, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<severity> min_severity_;
+};
 
-public:
+/**
+ * @brief Process-wide logger.
+ *
+ * Producers copy a format string pointer and their arguments into a
+ * fixed-size record in a lock-free ring buffer, so logging from a worker
+ * costs a severity check, a clock read and a copy. A background thread
+ * formats the records and hands them to the sinks.
+ */
+class logger {
+ protected:
+  explicit logger(logger_options options);
+  ~logger();
+
+ public:
   // Delete unused constructors and assignment operators
   logger(logger const& other) = delete;              // Copy Constructor
   logger(logger const&& other) = delete;             // Move Constructor
   logger& operator=(const logger& other) = delete;   // Copy-Assignment Operator
   logger& operator=(const logger&& other) = delete;  // Move-Assignment Operator
 
-  static auto instance() -> logger*;
-
-  auto add_log(const char* fmt, ...) -> void IM_FMTARGS(2);
+  /**
+   * @brief Sets the options the logger is created with. Has no effect once
+   * <code>instance()</code> has been called.
+   * @return False if the logger already exists.
+   */
+  static auto configure(logger_options const& options) -> bool;
 
-  auto draw() -> void;
-  
-  auto add_dynamic_log(const std::string& id, std::function<std::string()> getter) -> void;
-
-  auto remove_dynamic_log(const std::string& id) -> void;
-
-  [[nodiscard]] auto empty() const noexcept -> bool;
-
-  auto clear() noexcept -> void;
+  static auto instance() -> logger*;
 
-  auto set_auto_scroll(bool b) noexcept -> void;
+  /**
+   * @brief Queues a printf-style message. The format string must be a string
+   * literal, and is checked against the arguments at compile time; arguments
+   * may be numbers, pointers or strings, which are copied (and truncated if
+   * very long).
+   */
+  template <typename... Args>
+  auto log(const severity level, checked_format<Args...> fmt,
+           Args const&... args) noexcept -> void {
+    if (!enabled(level)) return;
+
+    const auto fill = [&](log_record& r) {
+      r.timestamp_ns = now_ns();
+      r.thread = thread_index();
+      r.level = level;
+      r.fmt = fmt.get();
+      log_detail::fill_record(r, args...);
+    };
+
+    if (ring_.try_push(fill)) return;
+    if (options_.policy == drop_policy::drop_newest) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    while (!ring_.try_push(fill)) std::this_thread::yield();
+  }
+
+  template <typename... Args>
+  auto debug(checked_format<Args...> fmt, Args const&... args) noexcept
+      -> void {
+    log(severity::debug, fmt, args...);
+  }
+
+  template <typename... Args>
+  auto info(checked_format<Args...> fmt, Args const&... args) noexcept
+      -> void {
+    log(severity::info, fmt, args...);
+  }
+
+  template <typename... Args>
+  auto warn(checked_format<Args...> fmt, Args const&... args) noexcept
+      -> void {
+    log(severity::warning, fmt, args...);
+  }
+
+  template <typename... Args>
+  auto error(checked_format<Args...> fmt, Args const&... args) noexcept
+      -> void {
+    log(severity::error, fmt, args...);
+  }
+
+  /**
+   * @brief Logs each line of a long, already-formatted block of text, such
+   * as a report, at the given severity. A line too long for one record
+   * carries on in the next.
+   */
+  auto log_lines(severity level, std::string_view text) noexcept -> void;
+
+  [[nodiscard]] auto enabled(const severity level) const noexcept -> bool {
+    return level >= min_severity_.load(std::memory_order_relaxed) &&
+           level != severity::off;
+  }
+
+  auto set_min_severity(const severity s) noexcept -> void {
+    min_severity_.store(s, std::memory_order_relaxed);
+  }
+
+  auto add_sink(std::shared_ptr<log_sink> sink) -> void;
+
+  auto remove_sink(std::shared_ptr<log_sink> const& sink) -> void;
+
+  /**
+   * @brief Formats and writes every queued message before returning.
+   */
+  auto flush() -> void;
+
+  /**
+   * @brief Returns the number of messages discarded because the ring buffer
+   * was full.
+   */
+  [[nodiscard]] auto dropped() const noexcept -> std::uint64_t {
+    return dropped_total_.load(std::memory_order_relaxed) +
+           dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  logger_options options_;
+  std::atomic<severity> min_severity_;
+  mpsc_ring<log_record> ring_;
+  std::atomic<std::uint64_t> dropped_ = 0;
+  std::atomic<std::uint64_t> dropped_total_ = 0;
+  const std::int64_t epoch_ns_;
+
+  // Consumer side: only one thread drains the ring at a time
+  std::mutex consumer_mutex_;
+  std::vector<std::shared_ptr<log_sink>> sinks_;
+  std::string scratch_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable_any wake_;
+  std::jthread consumer_;
+
+  [[nodiscard]] auto now_ns() const noexcept -> std::int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+               .count() -
+           epoch_ns_;
+  }
+
+  [[nodiscard]] static auto thread_index() noexcept -> std::uint32_t;
+
+  /**
+   * @brief Formats every queued message and hands it to the sinks. Expects
+   * <code>consumer_mutex_</code> to be held.
+   */
+  auto drain() -> void;
+
+  auto dispatch(log_entry const& entry) -> void;
+
+  auto run(std::stop_token const& stop) -> void;
 };
 
 #endif  // LOGGER_H
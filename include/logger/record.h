@@ -0,0 +1,320 @@
+#ifndef LOGGER_RECORD_H
+#define LOGGER_RECORD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * @brief How important a log message is.
+ */
+enum class severity : std::uint8_t { debug, info, warning, error, off };
+
+/**
+ * @brief Returns a short, upper-case name for the severity.
+ */
+[[nodiscard]] constexpr auto severity_name(const severity s) noexcept
+    -> const char* {
+  switch (s) {
+    case severity::debug:
+      return "DEBUG";
+    case severity::info:
+      return "INFO";
+    case severity::warning:
+      return "WARN";
+    case severity::error:
+      return "ERROR";
+    case severity::off:
+      break;
+  }
+
+  return "";
+}
+
+namespace log_detail {
+/**
+ * @brief A string argument copied into the record, since the caller's string
+ * may be gone by the time the record is formatted. Longer strings are
+ * truncated.
+ */
+struct captured_string {
+  static constexpr std::size_t capacity = 96;
+  char data[capacity];
+
+  explicit captured_string(const std::string_view s) noexcept {
+    const auto n = std::min(s.size(), capacity - 1);
+    std::copy_n(s.data(), n, data);
+    data[n] = '\0';
+  }
+};
+
+/**
+ * @brief Copies arithmetic and enum arguments as they are, and strings into a
+ * <code>captured_string</code>.
+ */
+template <typename T>
+constexpr auto capture(T const& arg) noexcept {
+  using U = std::remove_cv_t<T>;
+  if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+    return captured_string{std::string_view{arg ? arg : "(null)"}};
+  } else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+    return captured_string{std::string_view{arg}};
+  } else if constexpr (std::is_same_v<U, std::filesystem::path>) {
+    return captured_string{arg.string()};
+  } else {
+    static_assert(std::is_arithmetic_v<U> || std::is_enum_v<U> ||
+                      std::is_pointer_v<U>,
+                  "log arguments must be numbers, pointers or strings");
+    return arg;
+  }
+}
+
+template <typename T>
+using captured_t = decltype(capture(std::declval<T const&>()));
+
+/**
+ * @brief Undoes <code>capture()</code> for passing to printf.
+ */
+template <typename T>
+constexpr auto unwrap(T const& arg) noexcept {
+  if constexpr (std::is_same_v<T, captured_string>) {
+    return static_cast<const char*>(arg.data);
+  } else if constexpr (std::is_enum_v<T>) {
+    return static_cast<long long>(arg);
+  } else {
+    return arg;
+  }
+}
+
+// What printf is handed for an argument, as far as checking a format goes
+enum class arg_kind : std::uint8_t { integer, floating, string, pointer };
+
+struct arg_type {
+  arg_kind kind = arg_kind::integer;
+  // Size after the default argument promotions
+  std::size_t size = 0;
+};
+
+template <typename T>
+consteval auto arg_type_of() -> arg_type {
+  using U = std::remove_cvref_t<decltype(unwrap(
+      std::declval<captured_t<T> const&>()))>;
+  if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+    return {arg_kind::string, sizeof(U)};
+  } else if constexpr (std::is_pointer_v<U>) {
+    return {arg_kind::pointer, sizeof(U)};
+  } else if constexpr (std::is_floating_point_v<U>) {
+    return {arg_kind::floating, std::max(sizeof(U), sizeof(double))};
+  } else {
+    return {arg_kind::integer, std::max(sizeof(U), sizeof(int))};
+  }
+}
+
+// Never defined: reaching it while checking a format stops compilation, and
+// the reason shows up in the error
+auto invalid_log_format(const char* reason) -> void;
+
+/**
+ * @brief Returns the size of the integer a length modifier asks for.
+ */
+consteval auto integer_size(const std::string_view length) -> std::size_t {
+  if (length == "l") return sizeof(long);
+  if (length == "ll") return sizeof(long long);
+  if (length == "z") return sizeof(std::size_t);
+  if (length == "j") return sizeof(std::intmax_t);
+  if (length == "t") return sizeof(std::ptrdiff_t);
+  if (length.empty() || length == "h" || length == "hh") return sizeof(int);
+  invalid_log_format("unsupported length modifier for an integer");
+  return 0;
+}
+
+/**
+ * @brief Checks, at compile time, that a printf format takes exactly the
+ * given arguments, each of a kind and size its conversion expects once
+ * captured, like <code>-Wformat</code> does for printf itself.
+ */
+template <typename... Args>
+consteval auto check_format(const std::string_view fmt) -> void {
+  const arg_type args[] = {arg_type_of<Args>()..., arg_type{}};
+  std::size_t next = 0;
+  const auto take = [&]() -> arg_type {
+    if (next == sizeof...(Args)) invalid_log_format("too few arguments");
+    return args[next++];
+  };
+
+  for (std::size_t i = 0; i < fmt.size(); ++i) {
+    if (fmt[i] != '%') continue;
+    if (++i < fmt.size() && fmt[i] == '%') continue;
+
+    // Flags, then the width and precision, either of which may be an int
+    // argument
+    while (i < fmt.size() &&
+           std::string_view{"-+ #0'"}.find(fmt[i]) != std::string_view::npos)
+      ++i;
+    for (auto field = 0; field < 2; ++field) {
+      if (field == 1) {
+        if (i >= fmt.size() || fmt[i] != '.') break;
+        ++i;
+      }
+      if (i < fmt.size() && fmt[i] == '*') {
+        const auto star = take();
+        if (star.kind != arg_kind::integer || star.size != sizeof(int))
+          invalid_log_format("'*' takes an int");
+        ++i;
+      }
+      while (i < fmt.size() && fmt[i] >= '0' && fmt[i] <= '9') ++i;
+    }
+
+    const auto start = i;
+    while (i < fmt.size() &&
+           std::string_view{"hljztL"}.find(fmt[i]) != std::string_view::npos)
+      ++i;
+    const auto length = fmt.substr(start, i - start);
+    if (i >= fmt.size()) invalid_log_format("incomplete conversion");
+
+    const auto conversion = fmt[i];
+    switch (conversion) {
+      case 'd':
+      case 'i':
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'c': {
+        const auto arg = take();
+        if (arg.kind != arg_kind::integer)
+          invalid_log_format("integer conversion of a non-integer");
+        if (arg.size != integer_size(conversion == 'c' ? "" : length))
+          invalid_log_format("integer of the wrong size");
+        break;
+      }
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        const auto arg = take();
+        if (arg.kind != arg_kind::floating)
+          invalid_log_format("floating-point conversion of a non-float");
+        if ((length == "L") != (arg.size != sizeof(double)))
+          invalid_log_format("floating-point value of the wrong size");
+        break;
+      }
+      case 's':
+        if (take().kind != arg_kind::string || !length.empty())
+          invalid_log_format("%s of a non-string");
+        break;
+      case 'p': {
+        const auto kind = take().kind;
+        if (kind != arg_kind::pointer && kind != arg_kind::string)
+          invalid_log_format("%p of a non-pointer");
+        break;
+      }
+      default:
+        invalid_log_format("unsupported conversion");
+    }
+  }
+
+  if (next != sizeof...(Args)) invalid_log_format("too many arguments");
+}
+}  // namespace log_detail
+
+/**
+ * @brief A format string checked against the types of its arguments when the
+ * call that passes it is compiled. Made implicitly from a string literal.
+ */
+template <typename... Args>
+class log_format {
+ public:
+  consteval log_format(const char* fmt) : fmt_{fmt} {
+    log_detail::check_format<Args...>(fmt);
+  }
+
+  [[nodiscard]] constexpr auto get() const noexcept -> const char* {
+    return fmt_;
+  }
+
+ private:
+  const char* fmt_;
+};
+
+// The format's argument types come from the arguments, not from the format
+template <typename... Args>
+using checked_format = log_format<std::type_identity_t<Args>...>;
+
+/**
+ * @brief A single log message as it travels through the ring buffer: a
+ * pointer to the format string, which must outlive the logger (i.e. a string
+ * literal), and a copy of the arguments. Formatting is left to the consumer,
+ * so logging only costs a copy.
+ */
+struct log_record {
+  static constexpr std::size_t payload_size = 208;
+
+  std::int64_t timestamp_ns = 0;
+  std::uint32_t thread = 0;
+  severity level = severity::info;
+  const char* fmt = nullptr;
+  // Formats the payload with fmt; set by the producer that knows its types
+  void (*format)(log_record const&, std::string&) = nullptr;
+  alignas(std::max_align_t) std::byte payload[payload_size];
+};
+
+namespace log_detail {
+template <typename... Captured>
+auto format_record(log_record const& r, std::string& out) -> void {
+  auto const& args = *std::launder(
+      reinterpret_cast<std::tuple<Captured...> const*>(r.payload));
+
+  // A checked format without arguments is plain text apart from "%%", and
+  // printing it directly would be flagged as a non-literal format
+  if constexpr (sizeof...(Captured) == 0) {
+    out.clear();
+    for (const auto* c = r.fmt; *c; ++c) {
+      if (*c == '%' && c[1] == '%') ++c;
+      out.push_back(*c);
+    }
+  } else {
+    std::apply(
+        [&](auto const&... a) {
+          const auto n = std::snprintf(nullptr, 0, r.fmt, unwrap(a)...);
+          if (n <= 0) {
+            out.clear();
+            return;
+          }
+
+          out.resize(static_cast<std::size_t>(n));
+          std::snprintf(out.data(), out.size() + 1, r.fmt, unwrap(a)...);
+        },
+        args);
+  }
+}
+
+/**
+ * @brief Writes the arguments into the record's payload.
+ */
+template <typename... Args>
+auto fill_record(log_record& r, Args const&... args) noexcept -> void {
+  using payload_t = std::tuple<captured_t<Args>...>;
+  static_assert(sizeof(payload_t) <= log_record::payload_size,
+                "too many or too long log arguments");
+  // Records are copied byte-wise through the ring buffer
+  static_assert((std::is_trivially_copyable_v<captured_t<Args>> && ...),
+                "log arguments must be trivially copyable");
+
+  ::new (static_cast<void*>(r.payload)) payload_t{capture(args)...};
+  r.format = &format_record<captured_t<Args>...>;
+}
+}  // namespace log_detail
+
+#endif  // LOGGER_RECORD_H
@@ -0,0 +1,113 @@
+#ifndef LOGGER_RING_BUFFER_H
+#define LOGGER_RING_BUFFER_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+/**
+ * @brief A bounded, lock-free queue for many producers and a single consumer.
+ *
+ * Each slot carries a sequence number that tells producers whether it is free
+ * and the consumer whether it has been published (D. Vyukov's bounded queue),
+ * so producers only contend on a single compare-and-swap and never wait for
+ * the consumer. Pushing to a full queue fails instead of blocking.
+ */
+template <typename T>
+class mpsc_ring {
+ public:
+  /**
+   * @brief Creates a queue with room for at least <code>capacity</code>
+   * items, rounded up to a power of two.
+   */
+  explicit mpsc_ring(const std::size_t capacity)
+      : capacity_{std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)},
+        mask_{capacity_ - 1},
+        slots_{std::make_unique<slot[]>(capacity_)} {
+    for (std::size_t i = 0; i < capacity_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  mpsc_ring(mpsc_ring const&) = delete;
+  mpsc_ring& operator=(mpsc_ring const&) = delete;
+
+  [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+    return capacity_;
+  }
+
+  /**
+   * @brief Claims a slot and calls <code>fill(T&)</code> to write the item in
+   * place. Safe to call from any number of threads.
+   * @return False, without calling <code>fill</code>, if the queue is full.
+   */
+  template <typename F>
+  auto try_push(F&& fill) noexcept -> bool {
+    auto pos = head_.load(std::memory_order_relaxed);
+
+    while (true) {
+      auto& s = slots_[pos & mask_];
+      const auto seq = s.sequence.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+      if (diff == 0) {
+        // The slot is free; claim it before another producer does
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          fill(s.value);
+          s.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // The consumer hasn't freed this slot yet
+        return false;
+      } else {
+        // Another producer claimed it first
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Moves the oldest published item into <code>out</code>. Must only
+   * be called by one thread at a time.
+   * @return False if there is nothing to consume.
+   */
+  auto try_pop(T& out) noexcept -> bool {
+    auto& s = slots_[tail_ & mask_];
+    const auto seq = s.sequence.load(std::memory_order_acquire);
+    if (static_cast<std::intptr_t>(seq) -
+            static_cast<std::intptr_t>(tail_ + 1) <
+        0) {
+      return false;
+    }
+
+    out = s.value;
+    s.sequence.store(tail_ + capacity_, std::memory_order_release);
+    ++tail_;
+
+    return true;
+  }
+
+ private:
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  static constexpr std::size_t cache_line = 64;
+
+  const std::size_t capacity_;
+  const std::size_t mask_;
+  std::unique_ptr<slot[]> slots_;
+
+  // Keep the producers' and consumer's positions on separate cache lines
+  alignas(cache_line) std::atomic<std::size_t> head_ = 0;
+  alignas(cache_line) std::size_t tail_ = 0;
+};
+
+#endif  // LOGGER_RING_BUFFER_H
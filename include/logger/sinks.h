@@ -0,0 +1,43 @@
+#ifndef LOGGER_SINKS_H
+#define LOGGER_SINKS_H
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "logger.h"
+
+/**
+ * @brief Writes each message to stderr, prefixed with its severity.
+ */
+class stderr_sink final : public log_sink {
+ public:
+  using log_sink::log_sink;
+
+  auto write(log_entry const& entry) -> void override;
+
+  auto flush() -> void override;
+};
+
+/**
+ * @brief Appends each message to a file, with a timestamp, thread and
+ * severity, so a long run can be inspected afterwards.
+ */
+class file_sink final : public log_sink {
+ public:
+  explicit file_sink(std::filesystem::path const& path,
+                     severity min_severity = severity::debug);
+
+  [[nodiscard]] auto is_open() const noexcept -> bool {
+    return out_.is_open();
+  }
+
+  auto write(log_entry const& entry) -> void override;
+
+  auto flush() -> void override;
+
+ private:
+  std::ofstream out_;
+};
+
+#endif  // LOGGER_SINKS_H
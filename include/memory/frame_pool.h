@@ -0,0 +1,126 @@
+#ifndef MEMORY_FRAME_POOL_H
+#define MEMORY_FRAME_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/core/mat.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace mem {
+/**
+ * @brief Tuning parameters for <code>frame_pool</code>.
+ */
+struct pool_options {
+  // Buffers smaller than this are left to OpenCV's own allocator, so only
+  // frame-sized buffers are pooled
+  std::size_t min_bytes = std::size_t{1} << 20;
+  // Most bytes of free buffers kept for reuse. Buffers freed beyond this go
+  // straight back to the OS.
+  std::size_t max_cached_bytes = std::size_t{512} << 20;
+  // Whether to ask the OS to back buffers with huge pages, which cuts page
+  // faults and TLB misses on large frames. Only Linux honours this.
+  bool huge_pages = true;
+};
+
+/**
+ * @brief Counters of a <code>frame_pool</code> since it was created.
+ */
+struct pool_stats {
+  // Pooled buffers handed out, and how many of those were recycled rather
+  // than mapped from the OS
+  std::uint64_t allocations = 0;
+  std::uint64_t reuses = 0;
+  // Buffers mapped from and returned to the OS
+  std::uint64_t os_allocations = 0;
+  std::uint64_t os_releases = 0;
+  // Bytes of buffers held by matrices, and free for reuse
+  std::size_t live_bytes = 0;
+  std::size_t cached_bytes = 0;
+  // Most bytes mapped at once, live and cached
+  std::size_t peak_bytes = 0;
+};
+
+/**
+ * @brief A <code>cv::MatAllocator</code> that recycles frame-sized buffers.
+ *
+ * Every stage of the pipeline allocates and frees buffers of the same few
+ * sizes for every frame, which costs a trip to the OS and a page fault for
+ * every page of every buffer. Once installed as OpenCV's default allocator,
+ * the pool keeps freed buffers in size classes, each an eighth of a power of
+ * two apart, and hands them back out to any matrix of a size in the same
+ * class, so a steady stream of frames maps no new memory. Buffers come
+ * straight from the OS, page aligned.
+ *
+ * All methods are thread-safe.
+ */
+class frame_pool final : public cv::MatAllocator {
+ public:
+  // Delete unused constructors and assignment operators
+  frame_pool(frame_pool const& other) = delete;
+  frame_pool(frame_pool&& other) = delete;
+  frame_pool& operator=(frame_pool const& other) = delete;
+  frame_pool& operator=(frame_pool&& other) = delete;
+
+  /**
+   * @brief Returns the pool shared by the whole process. It is never
+   * destroyed, so matrices may outlive <code>main()</code>.
+   */
+  static auto instance() -> frame_pool*;
+
+  /**
+   * @brief Makes the pool OpenCV's default allocator, so every matrix
+   * allocated from now on draws from it.
+   */
+  auto install() -> void;
+
+  auto set_options(pool_options const& options) -> void;
+
+  [[nodiscard]] auto options() const -> pool_options;
+
+  [[nodiscard]] auto stats() const -> pool_stats;
+
+  /**
+   * @brief Returns every free buffer to the OS.
+   */
+  auto trim() const -> void;
+
+  auto allocate(int dims, const int* sizes, int type, void* data,
+                std::size_t* step, cv::AccessFlag flags,
+                cv::UMatUsageFlags usage) const -> cv::UMatData* override;
+
+  auto allocate(cv::UMatData* data, cv::AccessFlag flags,
+                cv::UMatUsageFlags usage) const -> bool override;
+
+  auto deallocate(cv::UMatData* data) const -> void override;
+
+ private:
+  frame_pool() = default;
+  ~frame_pool() override = default;
+
+  // The allocator interface is const, since OpenCV shares allocators
+  // between matrices, so whatever it changes is mutable
+  mutable std::mutex mutex_;
+  pool_options options_;
+  // Copy of options_.min_bytes, read without the lock on every allocation
+  std::atomic<std::size_t> min_bytes_{pool_options{}.min_bytes};
+  mutable pool_stats stats_;
+  // Free buffers of each size class, most recently freed last
+  mutable std::unordered_map<std::size_t, std::vector<void*>> free_;
+
+  /**
+   * @brief Returns the size of the class a buffer of the given size falls
+   * in, which is what's actually mapped for it.
+   */
+  [[nodiscard]] static auto size_class(std::size_t bytes) noexcept
+      -> std::size_t;
+
+  [[nodiscard]] auto take(std::size_t bytes) const -> void*;
+
+  auto give_back(void* buffer, std::size_t bytes) const -> void;
+};
+}  // namespace mem
+
+#endif  // MEMORY_FRAME_POOL_H
@@ -0,0 +1,153 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mem {
+/**
+ * @brief Something that holds frames in memory and registers them with the
+ * <code>governor</code>.
+ *
+ * The governor calls these from whichever thread enforces the budget, so a
+ * tenant must synchronise them with its own use of its frames. It never
+ * calls them while the tenant is registering or leaving.
+ */
+class tenant {
+ public:
+  virtual ~tenant() = default;
+
+  /**
+   * @brief Returns a name for reports, such as the file the frames came
+   * from.
+   */
+  [[nodiscard]] virtual auto tenant_name() const -> std::string = 0;
+
+  /**
+   * @brief Returns the bytes of frames held in memory.
+   */
+  [[nodiscard]] virtual auto resident_bytes() const -> std::size_t = 0;
+
+  /**
+   * @brief Returns the bytes of frames moved out of memory, which are read
+   * back on demand.
+   */
+  [[nodiscard]] virtual auto spilled_bytes() const -> std::size_t = 0;
+
+  /**
+   * @brief Frees at least the given number of bytes if it can, by spilling
+   * or dropping frames, and returns how many it freed.
+   */
+  virtual auto release(std::size_t bytes) -> std::size_t = 0;
+
+ protected:
+  tenant() = default;
+  tenant(tenant const& other) = default;
+  tenant& operator=(tenant const& other) = default;
+};
+
+/**
+ * @brief What a single tenant holds, for reports.
+ */
+struct tenant_usage {
+  std::string name;
+  std::size_t resident_bytes = 0;
+  std::size_t spilled_bytes = 0;
+  bool cold = false;
+};
+
+/**
+ * @brief Accounts for every frame held by the process and keeps it under a
+ * budget.
+ *
+ * Frame containers register as tenants for as long as they live. A tenant
+ * whose owner no longer needs its frames close at hand, such as an original
+ * clip once it's been stabilized, is marked cold. Whenever the frames held by
+ * all tenants exceed the budget, cold tenants are asked to release frames,
+ * the one that went cold first going first, until the total fits. Frames of
+ * tenants that aren't cold are never touched, so the budget is a target
+ * rather than a hard limit; <code>run_batch()</code> also holds videos back
+ * until their frames fit.
+ *
+ * All methods are thread-safe.
+ */
+class governor {
+ public:
+  // Delete unused constructors and assignment operators
+  governor(governor const& other) = delete;
+  governor(governor&& other) = delete;
+  governor& operator=(governor const& other) = delete;
+  governor& operator=(governor&& other) = delete;
+
+  static auto instance() -> governor*;
+
+  /**
+   * @brief Sets the most bytes of frames to keep in memory, 0 for no limit,
+   * and enforces it right away.
+   */
+  auto set_budget(std::size_t bytes) -> void;
+
+  [[nodiscard]] auto budget() const -> std::size_t;
+
+  /**
+   * @brief Registers a tenant, which must leave before it's destroyed.
+   */
+  auto enroll(tenant* t) -> void;
+
+  /**
+   * @brief Unregisters a tenant. Waits for the governor to finish with it if
+   * it's releasing its frames.
+   */
+  auto leave(tenant* t) -> void;
+
+  /**
+   * @brief Marks a tenant as cold, so its frames may be released, or as in
+   * use again.
+   */
+  auto set_cold(tenant* t, bool cold) -> void;
+
+  /**
+   * @brief Releases frames of cold tenants until the total fits the budget,
+   * and returns the bytes still held. If any were released, the frame pool
+   * is trimmed, so their buffers go back to the OS. Tenants call this after
+   * taking on frames.
+   */
+  auto enforce() -> std::size_t;
+
+  /**
+   * @brief Returns the bytes of frames held by every tenant. Frames shared
+   * between tenants are counted once for each of them.
+   */
+  [[nodiscard]] auto resident_bytes() const -> std::size_t;
+
+  /**
+   * @brief Returns what each tenant holds, in the order they registered.
+   */
+  [[nodiscard]] auto report() const -> std::vector<tenant_usage>;
+
+ private:
+  struct entry {
+    tenant* t;
+    bool cold;
+    // When the tenant last went cold, so the coldest is released first
+    std::uint64_t cooled_at;
+  };
+
+  governor() = default;
+  ~governor() = default;
+
+  mutable std::mutex mutex_;
+  std::size_t budget_ = 0;
+  std::vector<entry> entries_;
+  std::uint64_t clock_ = 0;
+
+  [[nodiscard]] auto total_locked() const -> std::size_t;
+
+  auto enforce_locked() -> std::size_t;
+};
+}  // namespace mem
+
+#endif  // MEMORY_GOVERNOR_H
@@ -0,0 +1,199 @@
+#ifndef PROFILER_ALLOCATIONS_H
+#define PROFILER_ALLOCATIONS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace prof {
+class counting_allocator;
+
+/**
+ * @brief What was allocated while a stage of the pipeline ran.
+ *
+ * Heap bytes come from the global <code>operator new</code>, and frame bytes
+ * from OpenCV's default <code>cv::MatAllocator</code>. Peaks are the most
+ * bytes live in the whole process when an allocation made by the stage
+ * returned, so a stage that holds on to what earlier stages made shows it
+ * in its peak, but not in its allocations.
+ */
+struct stage_memory {
+  std::string name;
+  std::uint64_t heap_allocations = 0;
+  std::uint64_t heap_bytes = 0;
+  std::uint64_t frame_allocations = 0;
+  std::uint64_t frame_bytes = 0;
+  std::int64_t peak_frame_bytes = 0;
+  std::int64_t peak_total_bytes = 0;
+};
+
+/**
+ * @brief The memory of the process at a point in time.
+ */
+struct memory_sample {
+  double t_s = 0.0;
+  // The stage the process was in, as set by process-wide stages
+  std::string stage;
+  std::int64_t heap_bytes = 0;
+  std::int64_t frame_bytes = 0;
+  std::size_t rss_bytes = 0;
+};
+
+/**
+ * @brief Attributes every heap and frame allocation to the stage of the
+ * pipeline that made it, and samples the memory of the process over time,
+ * so the stage that drives the peak can be found.
+ *
+ * Stages are named with <code>memory_stage</code>. A process-wide stage
+ * covers every thread that hasn't named a stage of its own, such as the
+ * workers of a <code>thread_pool</code> running the stage's loop, and a
+ * thread stage covers the calling thread only, for stages that run at the
+ * same time. Process stages must nest: two that overlap otherwise, such as
+ * those of two videos stabilized at once, charge each other's allocations.
+ *
+ * Tracking costs a few atomic operations per allocation, so it's off unless
+ * started. Bytes freed that were allocated before it started are still
+ * subtracted, so it should be started before any frames are allocated.
+ */
+class memory_tracker {
+ public:
+  // Delete unused constructors and assignment operators
+  memory_tracker(memory_tracker const& other) = delete;
+  memory_tracker(memory_tracker&& other) = delete;
+  memory_tracker& operator=(memory_tracker const& other) = delete;
+  memory_tracker& operator=(memory_tracker&& other) = delete;
+
+  /**
+   * @brief Returns the tracker shared by the whole process. It is never
+   * destroyed, since memory is freed until the very end.
+   */
+  static auto instance() -> memory_tracker*;
+
+  /**
+   * @brief Starts tracking, wrapping OpenCV's current default allocator,
+   * and samples memory at the given interval. A frame pool should be
+   * installed before, so it's wrapped too.
+   */
+  auto start(std::chrono::milliseconds interval =
+                 std::chrono::milliseconds(50)) -> void;
+
+  /**
+   * @brief Stops sampling and attributing allocations. Frames allocated
+   * while tracking are still counted out as they're freed.
+   */
+  auto stop() -> void;
+
+  [[nodiscard]] auto enabled() const noexcept -> bool {
+    return active() == this;
+  }
+
+  /**
+   * @brief Returns the tracker if it's started, and null otherwise, without
+   * creating it, so the allocation hooks can call it while it's created.
+   */
+  [[nodiscard]] static auto active() noexcept -> memory_tracker* {
+    return active_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Returns what each stage allocated, in the order they first ran.
+   * Allocations made outside any stage are listed as "other".
+   */
+  [[nodiscard]] auto stages() const -> std::vector<stage_memory>;
+
+  [[nodiscard]] auto timeline() const -> std::vector<memory_sample>;
+
+  /**
+   * @brief Returns a table of what each stage allocated, and its peaks.
+   */
+  [[nodiscard]] auto summary() const -> std::string;
+
+  /**
+   * @brief Writes the stages and the timeline to the given CSV file.
+   */
+  [[nodiscard]] auto export_report(std::filesystem::path const& path) const
+      -> bool;
+
+  // Called by the allocation hooks, and never allocate
+  auto heap_allocated(std::size_t bytes) noexcept -> void;
+  auto heap_freed(std::size_t bytes) noexcept -> void;
+  auto frame_allocated(std::size_t bytes) noexcept -> void;
+  auto frame_freed(std::size_t bytes) noexcept -> void;
+
+ private:
+  friend class memory_stage;
+
+  // Stages are kept in a fixed table, so allocations never wait on a lock
+  // or allocate to find theirs. Slot 0 is for allocations outside any
+  // stage.
+  static constexpr int max_stages = 32;
+
+  struct stage_slot {
+    std::atomic<const char*> name = nullptr;
+    std::atomic<std::uint64_t> heap_allocations = 0;
+    std::atomic<std::uint64_t> heap_bytes = 0;
+    std::atomic<std::uint64_t> frame_allocations = 0;
+    std::atomic<std::uint64_t> frame_bytes = 0;
+    std::atomic<std::int64_t> peak_frame_bytes = 0;
+    std::atomic<std::int64_t> peak_total_bytes = 0;
+  };
+
+  // Constant initialized, so it's safe to read before main
+  static inline std::atomic<memory_tracker*> active_ = nullptr;
+
+  std::array<stage_slot, max_stages> stages_;
+  std::atomic<int> stage_count_ = 1;
+  std::atomic<int> process_stage_ = 0;
+  std::atomic<std::int64_t> heap_live_ = 0;
+  std::atomic<std::int64_t> frame_live_ = 0;
+
+  // Registers stages and guards the timeline
+  mutable std::mutex mutex_;
+  std::vector<memory_sample> timeline_;
+  std::chrono::steady_clock::time_point start_;
+  std::jthread sampler_;
+  std::unique_ptr<counting_allocator> allocator_;
+
+  memory_tracker();
+  ~memory_tracker() = default;
+
+  [[nodiscard]] auto stage_index(const char* name) -> int;
+  [[nodiscard]] auto current_stage() noexcept -> stage_slot&;
+  auto sample() -> void;
+};
+
+/**
+ * @brief Attributes allocations to the named stage, which must be a string
+ * literal, for the lifetime of this object. Does nothing if tracking is
+ * off when it's created.
+ */
+class memory_stage {
+ public:
+  enum class scope : std::uint8_t { process, thread };
+
+  explicit memory_stage(const char* name,
+                        scope kind = scope::process) noexcept;
+
+  ~memory_stage();
+
+  memory_stage(memory_stage const& other) = delete;
+  memory_stage& operator=(memory_stage const& other) = delete;
+
+ private:
+  scope scope_;
+  // Whether tracking was on when the stage began, and the stage it replaced,
+  // -1 if the thread had none
+  bool active_ = false;
+  int previous_ = 0;
+};
+}  // namespace prof
+
+#endif  // PROFILER_ALLOCATIONS_H
@@ -0,0 +1,20 @@
+#ifndef PROFILER_MEMORY_H
+#define PROFILER_MEMORY_H
+
+#include <cstddef>
+
+namespace prof {
+/**
+ * @brief Returns the peak resident set size of this process in bytes, or 0
+ * if the platform doesn't report it.
+ */
+[[nodiscard]] auto peak_rss_bytes() noexcept -> std::size_t;
+
+/**
+ * @brief Returns the current resident set size of this process in bytes, or
+ * 0 if the platform doesn't report it.
+ */
+[[nodiscard]] auto current_rss_bytes() noexcept -> std::size_t;
+}  // namespace prof
+
+#endif  // PROFILER_MEMORY_H
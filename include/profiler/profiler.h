@@ -0,0 +1,200 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace prof {
+/**
+ * @brief Returns the current time in nanoseconds on a monotonic clock.
+ */
+inline auto now_ns() noexcept -> std::int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief A log-linear latency histogram. Each power of two is split into
+ * <code>sub_buckets</code> linear buckets, which keeps the relative error of
+ * the reported percentiles below ~12% without allocating.
+ */
+class histogram {
+ public:
+  static constexpr int sub_buckets = 8;
+  static constexpr int octaves = 48;
+
+  auto add(std::int64_t ns) noexcept -> void;
+
+  auto merge(histogram const& other) noexcept -> void;
+
+  [[nodiscard]] auto count() const noexcept -> std::uint64_t { return count_; }
+
+  [[nodiscard]] auto total_ns() const noexcept -> std::int64_t {
+    return total_ns_;
+  }
+
+  [[nodiscard]] auto min_ns() const noexcept -> std::int64_t {
+    return count_ ? min_ns_ : 0;
+  }
+
+  [[nodiscard]] auto max_ns() const noexcept -> std::int64_t { return max_ns_; }
+
+  /**
+   * @brief Returns an approximation of the given percentile, in the range
+   * [0, 1], in nanoseconds.
+   */
+  [[nodiscard]] auto percentile(double p) const noexcept -> std::int64_t;
+
+ private:
+  std::uint64_t buckets_[octaves * sub_buckets]{};
+  std::uint64_t count_ = 0;
+  std::int64_t total_ns_ = 0;
+  std::int64_t min_ns_ = INT64_MAX;
+  std::int64_t max_ns_ = 0;
+
+  static auto bucket_of(std::int64_t ns) noexcept -> int;
+  static auto lower_bound_of(int bucket) noexcept -> std::int64_t;
+};
+
+/**
+ * @brief Collects timed spans and per-frame counters from any number of
+ * threads. Each thread writes into its own buffer, so recording never
+ * contends with other worker threads. Spans and counters can be exported as
+ * a Chrome-trace/Perfetto JSON file, or summarized as a plain-text table.
+ */
+class profiler {
+ public:
+  // Delete unused constructors and assignment operators
+  profiler(profiler const& other) = delete;
+  profiler(profiler&& other) = delete;
+  profiler& operator=(profiler const& other) = delete;
+  profiler& operator=(profiler&& other) = delete;
+
+  static auto instance() -> profiler*;
+
+  auto set_enabled(bool b) noexcept -> void { enabled_.store(b); }
+
+  [[nodiscard]] auto enabled() const noexcept -> bool {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Records a span named <code>name</code>, which must be a string
+   * literal, on the calling thread. The span is dropped if there's no memory
+   * left to store it.
+   */
+  auto record_span(const char* name, std::int64_t start_ns,
+                   std::int64_t end_ns) noexcept -> void;
+
+  /**
+   * @brief Records the value of the counter <code>name</code>, which must be
+   * a string literal, for the given frame.
+   */
+  auto record_counter(const char* name, int frame, double value) noexcept
+      -> void;
+
+  /**
+   * @brief Writes all recorded spans and counters to the given path in the
+   * Chrome trace event format, which can be opened in chrome://tracing or
+   * https://ui.perfetto.dev.
+   */
+  [[nodiscard]] auto export_trace(std::filesystem::path const& path) const
+      -> bool;
+
+  /**
+   * @brief Returns a table with the count, total, mean, p50, p95 and max time
+   * of every span, followed by the mean, min and max of every counter.
+   */
+  [[nodiscard]] auto summary() const -> std::string;
+
+  /**
+   * @brief Discards everything that has been recorded so far.
+   */
+  auto reset() -> void;
+
+ private:
+  // Upper bound on the number of raw trace events kept per thread, so long
+  // runs cannot grow memory without bound. Histograms are always updated.
+  static constexpr std::size_t max_events_per_thread = 1 << 20;
+
+  struct span_event {
+    const char* name;
+    std::int64_t start_ns;
+    std::int64_t end_ns;
+  };
+
+  struct counter_event {
+    const char* name;
+    std::int64_t ts_ns;
+    int frame;
+    double value;
+  };
+
+  struct named_histogram {
+    const char* name;
+    histogram hist;
+  };
+
+  struct thread_buffer {
+    // Only ever contended while exporting or resetting
+    mutable std::mutex mutex;
+    int tid = 0;
+    std::vector<span_event> spans;
+    std::vector<counter_event> counters;
+    std::vector<named_histogram> histograms;
+    std::uint64_t dropped = 0;
+  };
+
+  std::atomic<bool> enabled_ = false;
+  std::int64_t epoch_ns_ = now_ns();
+
+  mutable std::mutex buffers_mutex_;
+  std::vector<std::unique_ptr<thread_buffer>> buffers_;
+
+  profiler() = default;
+  ~profiler() = default;
+
+  auto local_buffer() -> thread_buffer*;
+};
+
+/**
+ * @brief Records a span covering the lifetime of this object. Does nothing
+ * if the profiler is disabled when the timer is created.
+ */
+class scoped_timer {
+ public:
+  explicit scoped_timer(const char* name) noexcept
+      : name_{name},
+        start_ns_{profiler::instance()->enabled() ? now_ns() : 0} {}
+
+  ~scoped_timer() {
+    if (start_ns_ != 0)
+      profiler::instance()->record_span(name_, start_ns_, now_ns());
+  }
+
+  scoped_timer(scoped_timer const& other) = delete;
+  scoped_timer& operator=(scoped_timer const& other) = delete;
+
+ private:
+  const char* name_;
+  std::int64_t start_ns_;
+};
+
+/**
+ * @brief Records the value of a per-frame counter if profiling is enabled.
+ */
+inline auto count(const char* name, const int frame, const double value)
+    -> void {
+  if (profiler::instance()->enabled())
+    profiler::instance()->record_counter(name, frame, value);
+}
+}  // namespace prof
+
+#endif  // PROFILER_H
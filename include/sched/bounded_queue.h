@@ -0,0 +1,300 @@
+#ifndef SCHED_BOUNDED_QUEUE_H
+#define SCHED_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace sched {
+namespace detail {
+/**
+ * @brief Lets threads sleep until a lock-free queue changes.
+ *
+ * Every push, pop and close bumps a counter. A thread that finds the queue
+ * full or empty reads the counter before trying, and sleeps only while it's
+ * unchanged, so a change between the try and the sleep is never missed.
+ */
+class queue_events {
+ public:
+  [[nodiscard]] auto seen() const noexcept -> std::uint32_t {
+    return count_.load(std::memory_order_acquire);
+  }
+
+  auto wait(const std::uint32_t seen) const noexcept -> void {
+    count_.wait(seen, std::memory_order_acquire);
+  }
+
+  auto notify() noexcept -> void {
+    count_.fetch_add(1, std::memory_order_release);
+    count_.notify_all();
+  }
+
+ private:
+  std::atomic<std::uint32_t> count_ = 0;
+};
+}  // namespace detail
+
+/**
+ * @brief A bounded, lock-free queue for any number of producers and
+ * consumers, to pass work between the stages of a <code>pipeline</code>.
+ *
+ * Slots carry sequence numbers as in <code>mpsc_ring</code> (D. Vyukov's
+ * bounded queue), so a push or pop is a single compare-and-swap. The blocking
+ * <code>push()</code> and <code>pop()</code> sleep while the queue is full or
+ * empty, which is what holds a fast stage back to the pace of a slow one and
+ * bounds the items in flight. Once closed, pushes fail and pops drain what's
+ * left.
+ */
+template <typename T>
+class bounded_queue {
+ public:
+  /**
+   * @brief Creates a queue with room for at least <code>capacity</code>
+   * items, rounded up to a power of two.
+   */
+  explicit bounded_queue(const std::size_t capacity)
+      : capacity_{std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)},
+        mask_{capacity_ - 1},
+        slots_{std::make_unique<slot[]>(capacity_)} {
+    for (std::size_t i = 0; i < capacity_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Delete unused constructors and assignment operators
+  bounded_queue(bounded_queue const& other) = delete;
+  bounded_queue(bounded_queue&& other) = delete;
+  bounded_queue& operator=(bounded_queue const& other) = delete;
+  bounded_queue& operator=(bounded_queue&& other) = delete;
+
+  [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+    return capacity_;
+  }
+
+  /**
+   * @brief Moves the item into the queue unless it's full.
+   */
+  auto try_push(T& value) -> bool {
+    auto pos = head_.load(std::memory_order_relaxed);
+
+    while (true) {
+      auto& s = slots_[pos & mask_];
+      const auto seq = s.sequence.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+      if (diff == 0) {
+        // The slot is free; claim it before another producer does
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          s.value = std::move(value);
+          s.sequence.store(pos + 1, std::memory_order_release);
+          events_.notify();
+          return true;
+        }
+      } else if (diff < 0) {
+        // A consumer hasn't freed this slot yet
+        return false;
+      } else {
+        // Another producer claimed it first
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Moves the oldest item out of the queue unless it's empty.
+   */
+  auto try_pop(T& out) -> bool {
+    auto pos = tail_.load(std::memory_order_relaxed);
+
+    while (true) {
+      auto& s = slots_[pos & mask_];
+      const auto seq = s.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos + 1);
+
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          out = std::move(s.value);
+          s.value = T{};
+          s.sequence.store(pos + capacity_, std::memory_order_release);
+          events_.notify();
+          return true;
+        }
+      } else if (diff < 0) {
+        // Nothing has been published in this slot yet
+        return false;
+      } else {
+        // Another consumer took it first
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Moves the item into the queue, sleeping while it's full.
+   * @return False, leaving the item alone, if the queue was closed.
+   */
+  auto push(T& value) -> bool {
+    while (true) {
+      const auto seen = events_.seen();
+      if (closed_.load(std::memory_order_acquire)) return false;
+      if (try_push(value)) return true;
+      events_.wait(seen);
+    }
+  }
+
+  auto push(T&& value) -> bool { return push(value); }
+
+  /**
+   * @brief Moves the oldest item out of the queue, sleeping while it's empty.
+   * @return False once the queue is closed and empty.
+   */
+  auto pop(T& out) -> bool {
+    while (true) {
+      const auto seen = events_.seen();
+      if (try_pop(out)) return true;
+      if (closed_.load(std::memory_order_acquire)) return false;
+      events_.wait(seen);
+    }
+  }
+
+  /**
+   * @brief Stops the queue taking items, and wakes every waiting thread.
+   */
+  auto close() noexcept -> void {
+    closed_.store(true, std::memory_order_release);
+    events_.notify();
+  }
+
+ private:
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  static constexpr std::size_t cache_line = 64;
+
+  const std::size_t capacity_;
+  const std::size_t mask_;
+  std::unique_ptr<slot[]> slots_;
+  std::atomic<bool> closed_ = false;
+  detail::queue_events events_;
+
+  // Keep the producers' and consumers' positions on separate cache lines
+  alignas(cache_line) std::atomic<std::size_t> head_ = 0;
+  alignas(cache_line) std::atomic<std::size_t> tail_ = 0;
+};
+
+/**
+ * @brief A bounded, lock-free queue that hands items to a single consumer in
+ * the order of their sequence numbers, whatever order they were put in.
+ *
+ * It joins the workers of a parallel stage back into order: item
+ * <code>i</code> goes in slot <code>i % capacity</code>, and its producer
+ * waits until the item a lap ahead of it has been taken. No worker can get
+ * more than a lap ahead of the consumer, so the reordering needs no buffer
+ * beyond the queue itself.
+ */
+template <typename T>
+class reorder_queue {
+ public:
+  /**
+   * @brief Creates a queue with room for at least <code>capacity</code>
+   * items, rounded up to a power of two.
+   */
+  explicit reorder_queue(const std::size_t capacity)
+      : capacity_{std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)},
+        mask_{capacity_ - 1},
+        slots_{std::make_unique<slot[]>(capacity_)} {
+    for (std::size_t i = 0; i < capacity_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Delete unused constructors and assignment operators
+  reorder_queue(reorder_queue const& other) = delete;
+  reorder_queue(reorder_queue&& other) = delete;
+  reorder_queue& operator=(reorder_queue const& other) = delete;
+  reorder_queue& operator=(reorder_queue&& other) = delete;
+
+  /**
+   * @brief Moves item <code>index</code> into the queue, sleeping while the
+   * consumer is a lap or more behind it. Safe to call from any number of
+   * threads, each index once.
+   * @return False, leaving the item alone, if the queue was closed.
+   */
+  auto put(const std::size_t index, T& value) -> bool {
+    auto& s = slots_[index & mask_];
+    while (true) {
+      const auto seen = events_.seen();
+      if (closed_.load(std::memory_order_acquire)) return false;
+      if (s.sequence.load(std::memory_order_acquire) == index) break;
+      events_.wait(seen);
+    }
+
+    s.value = std::move(value);
+    s.sequence.store(index + 1, std::memory_order_release);
+    events_.notify();
+
+    return true;
+  }
+
+  auto put(const std::size_t index, T&& value) -> bool {
+    return put(index, value);
+  }
+
+  /**
+   * @brief Moves the next item in sequence out of the queue, sleeping until
+   * it's been put. Must only be called by one thread at a time.
+   * @return False once the queue is closed and the next item isn't there.
+   */
+  auto take(T& out) -> bool {
+    auto& s = slots_[next_ & mask_];
+    while (true) {
+      const auto seen = events_.seen();
+      if (s.sequence.load(std::memory_order_acquire) == next_ + 1) break;
+      if (closed_.load(std::memory_order_acquire)) return false;
+      events_.wait(seen);
+    }
+
+    out = std::move(s.value);
+    s.value = T{};
+    s.sequence.store(next_ + capacity_, std::memory_order_release);
+    ++next_;
+    events_.notify();
+
+    return true;
+  }
+
+  /**
+   * @brief Stops the queue taking items, and wakes every waiting thread.
+   */
+  auto close() noexcept -> void {
+    closed_.store(true, std::memory_order_release);
+    events_.notify();
+  }
+
+ private:
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  const std::size_t capacity_;
+  const std::size_t mask_;
+  std::unique_ptr<slot[]> slots_;
+  std::atomic<bool> closed_ = false;
+  detail::queue_events events_;
+
+  // Sequence number of the next item to take
+  std::size_t next_ = 0;
+};
+}  // namespace sched
+
+#endif  // SCHED_BOUNDED_QUEUE_H
@@ -0,0 +1,168 @@
+#ifndef SCHED_FUTURE_H
+#define SCHED_FUTURE_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace sched {
+namespace detail {
+// Results of void tasks are stored as std::monostate, so one state serves
+// every result type
+template <typename T>
+using stored_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+struct shared_state {
+  std::mutex mutex;
+  std::condition_variable ready_cv;
+  bool ready = false;
+  std::optional<stored_t<T>> value;
+  std::exception_ptr error;
+  // Queued once the result is set, by the thread that sets it
+  std::vector<std::function<void()>> continuations;
+};
+
+/**
+ * @brief Runs <code>fn</code>, stores its result or exception in the state,
+ * then starts everything that was waiting on it.
+ */
+template <typename T, typename F>
+auto fulfil(shared_state<T>& state, F& fn) -> void {
+  std::optional<stored_t<T>> value;
+  std::exception_ptr error;
+  try {
+    if constexpr (std::is_void_v<T>) {
+      fn();
+      value.emplace();
+    } else {
+      value.emplace(fn());
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  std::vector<std::function<void()>> continuations;
+  {
+    std::lock_guard lock(state.mutex);
+    state.value = std::move(value);
+    state.error = error;
+    state.ready = true;
+    continuations.swap(state.continuations);
+  }
+  state.ready_cv.notify_all();
+
+  for (auto& continuation : continuations) continuation();
+}
+}  // namespace detail
+
+/**
+ * @brief The result of a task queued on an executor, such as a
+ * <code>thread_pool</code>, by <code>async()</code>.
+ *
+ * Unlike <code>std::future</code>, futures are shared, so any number of
+ * copies can wait on or read the same result, and work can be chained onto
+ * them with <code>then()</code> instead of blocking for them. An executor is
+ * anything with a <code>submit(int priority, std::function<void()>)</code>
+ * method, and must outlive every task queued on it.
+ */
+template <typename T>
+class future {
+ public:
+  future() = default;
+
+  /**
+   * @brief Wraps a shared state. Use <code>async()</code> to make futures.
+   */
+  explicit future(std::shared_ptr<detail::shared_state<T>> state)
+      : state_{std::move(state)} {}
+
+  /**
+   * @brief Returns whether the future refers to a task at all.
+   */
+  [[nodiscard]] auto valid() const noexcept -> bool {
+    return state_ != nullptr;
+  }
+
+  [[nodiscard]] auto ready() const -> bool {
+    std::lock_guard lock(state_->mutex);
+    return state_->ready;
+  }
+
+  auto wait() const -> void {
+    std::unique_lock lock(state_->mutex);
+    state_->ready_cv.wait(lock, [this]() { return state_->ready; });
+  }
+
+  /**
+   * @brief Waits for the task and returns a copy of its result, or rethrows
+   * its exception.
+   */
+  auto get() const -> T {
+    wait();
+    if (state_->error) std::rethrow_exception(state_->error);
+    if constexpr (!std::is_void_v<T>) return *state_->value;
+  }
+
+  /**
+   * @brief Queues <code>f(future)</code> on the given executor at the given
+   * priority once this future is ready, and returns the future of its
+   * result. The continuation gets this future rather than its value, so it
+   * also sees exceptions.
+   */
+  template <typename Executor, typename F>
+  auto then(Executor& executor, const int priority, F f) const
+      -> future<std::invoke_result_t<F&, future<T>>> {
+    using result = std::invoke_result_t<F&, future<T>>;
+
+    auto next = std::make_shared<detail::shared_state<result>>();
+    auto start = [&executor, priority, next, self = *this,
+                  f = std::move(f)]() mutable {
+      executor.submit(priority, [next, self, f]() mutable {
+        auto call = [&]() -> result { return f(self); };
+        detail::fulfil(*next, call);
+      });
+    };
+
+    {
+      std::lock_guard lock(state_->mutex);
+      if (!state_->ready) {
+        state_->continuations.emplace_back(std::move(start));
+        return future<result>{next};
+      }
+    }
+
+    start();
+    return future<result>{next};
+  }
+
+ private:
+  std::shared_ptr<detail::shared_state<T>> state_;
+};
+
+/**
+ * @brief Queues <code>f()</code> on the given executor at the given priority,
+ * and returns the future of its result.
+ */
+template <typename Executor, typename F>
+auto async(Executor& executor, const int priority, F f)
+    -> future<std::invoke_result_t<F&>> {
+  using result = std::invoke_result_t<F&>;
+
+  auto state = std::make_shared<detail::shared_state<result>>();
+  executor.submit(priority, [state, f = std::move(f)]() mutable {
+    detail::fulfil(*state, f);
+  });
+
+  return future<result>{state};
+}
+}  // namespace sched
+
+#endif  // SCHED_FUTURE_H
@@ -0,0 +1,187 @@
+#ifndef SCHED_PIPELINE_H
+#define SCHED_PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sched {
+/**
+ * @brief What a single stage of a <code>pipeline</code> did, for reports.
+ */
+struct stage_stats {
+  std::string name;
+  int workers = 0;
+  // Items the stage's workers timed, and the seconds they spent on them,
+  // added up over every worker
+  std::uint64_t items = 0;
+  double busy_s = 0.0;
+
+  /**
+   * @brief Returns how long the stage would take on its own, if its workers
+   * never waited.
+   */
+  [[nodiscard]] auto solo_s() const noexcept -> double {
+    return workers > 0 ? busy_s / workers : busy_s;
+  }
+};
+
+/**
+ * @brief Runs a graph of stages at once, each on its own threads, with work
+ * passed between them through bounded queues.
+ *
+ * Each stage has as many workers as its work can keep busy, and each worker
+ * loops over the stage's input until it's closed. The queues between stages
+ * are bounded, so a stage that runs ahead blocks once its output is full,
+ * which holds the items in flight to the sum of the queue capacities. Once
+ * every stage is busy, the wall time is close to that of the slowest stage
+ * rather than the sum of all of them.
+ *
+ * Workers get threads of their own rather than running on a
+ * <code>thread_pool</code>, since they block on each other's queues and a
+ * pool too small for all of them would deadlock.
+ */
+class pipeline {
+ public:
+  /**
+   * @brief What a stage's workers are handed: the pipeline's stop source and
+   * the counters of their stage.
+   */
+  class context {
+   public:
+    /**
+     * @brief Times an item of work, adding it to the stage's busy time.
+     */
+    class item_timer {
+     public:
+      explicit item_timer(context& ctx) noexcept
+          : ctx_{ctx}, start_{std::chrono::steady_clock::now()} {}
+
+      ~item_timer();
+
+      // Delete unused constructors and assignment operators
+      item_timer(item_timer const& other) = delete;
+      item_timer(item_timer&& other) = delete;
+      item_timer& operator=(item_timer const& other) = delete;
+      item_timer& operator=(item_timer&& other) = delete;
+
+     private:
+      context& ctx_;
+      std::chrono::steady_clock::time_point start_;
+    };
+
+    [[nodiscard]] auto stop_requested() const noexcept -> bool {
+      return source_.stop_requested();
+    }
+
+    [[nodiscard]] auto stop_token() const noexcept -> std::stop_token {
+      return source_.get_token();
+    }
+
+    /**
+     * @brief Stops the whole pipeline, such as when a stage can't go on.
+     */
+    auto request_stop() noexcept -> void { source_.request_stop(); }
+
+    /**
+     * @brief Returns a timer for the item about to be worked on. Time spent
+     * waiting on queues shouldn't be timed.
+     */
+    [[nodiscard]] auto time_item() noexcept -> item_timer {
+      return item_timer{*this};
+    }
+
+   private:
+    friend class pipeline;
+
+    context(std::stop_source source, std::atomic<std::uint64_t>& items,
+            std::atomic<std::int64_t>& busy_ns) noexcept
+        : source_{std::move(source)}, items_{items}, busy_ns_{busy_ns} {}
+
+    std::stop_source source_;
+    std::atomic<std::uint64_t>& items_;
+    std::atomic<std::int64_t>& busy_ns_;
+  };
+
+  /**
+   * @brief Creates a pipeline that stops once a stop is requested on the
+   * given token.
+   */
+  explicit pipeline(std::stop_token stop = {});
+
+  // Delete unused constructors and assignment operators
+  pipeline(pipeline const& other) = delete;
+  pipeline(pipeline&& other) = delete;
+  pipeline& operator=(pipeline const& other) = delete;
+  pipeline& operator=(pipeline&& other) = delete;
+
+  /**
+   * @brief Adds a stage run by <code>workers</code> threads, each calling
+   * <code>body(context&)</code> once. <code>done</code> is called once the
+   * last of them returns, whether the pipeline stopped or not, and should
+   * close the stage's output.
+   */
+  auto add_stage(std::string name, int workers,
+                 std::function<void(context&)> body,
+                 std::function<void()> done = {}) -> void;
+
+  /**
+   * @brief Calls <code>f</code> as soon as the pipeline stops early, to close
+   * every queue so no worker sleeps on one forever.
+   */
+  auto on_stop(std::function<void()> f) -> void;
+
+  /**
+   * @brief Runs every stage to completion, and returns false if a stop was
+   * requested, by the caller or by a worker. If a worker throws, the
+   * pipeline stops and the first exception is rethrown here once every
+   * worker has returned.
+   */
+  auto run() -> bool;
+
+  /**
+   * @brief Returns what each stage did in the last call to
+   * <code>run()</code>, in the order they were added.
+   */
+  [[nodiscard]] auto stats() const -> std::vector<stage_stats>;
+
+  /**
+   * @brief Returns the wall time of the last call to <code>run()</code>.
+   */
+  [[nodiscard]] auto wall_s() const noexcept -> double { return wall_s_; }
+
+ private:
+  struct stage {
+    std::string name;
+    int workers;
+    std::function<void(context&)> body;
+    std::function<void()> done;
+    std::atomic<int> running = 0;
+    std::atomic<std::uint64_t> items = 0;
+    std::atomic<std::int64_t> busy_ns = 0;
+  };
+
+  std::stop_token external_;
+  std::stop_source source_;
+  // Stages are never moved once added, since their counters are atomics
+  std::deque<stage> stages_;
+  std::vector<std::function<void()>> on_stop_;
+
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+
+  double wall_s_ = 0.0;
+
+  auto run_worker(stage& s) -> void;
+};
+}  // namespace sched
+
+#endif  // SCHED_PIPELINE_H
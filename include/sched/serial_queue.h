@@ -0,0 +1,66 @@
+#ifndef SCHED_SERIAL_QUEUE_H
+#define SCHED_SERIAL_QUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace sched {
+/**
+ * @brief Tasks queued from any thread and run, one after another, by the
+ * thread that drains the queue, such as a GUI's main loop.
+ *
+ * It's an executor like <code>thread_pool</code>, so continuations can hand
+ * results back to the one thread that owns some state instead of locking it.
+ * Tasks run in priority order, lower values first, and in the order they
+ * were submitted within a priority.
+ */
+class serial_queue {
+ public:
+  /**
+   * @brief Creates a queue that calls <code>wake</code>, from the submitting
+   * thread, whenever a task is queued, so a sleeping owner knows to drain it.
+   */
+  explicit serial_queue(std::function<void()> wake = {});
+
+  // Delete unused constructors and assignment operators
+  serial_queue(serial_queue const& other) = delete;
+  serial_queue(serial_queue&& other) = delete;
+  serial_queue& operator=(serial_queue const& other) = delete;
+  serial_queue& operator=(serial_queue&& other) = delete;
+
+  auto submit(int priority, std::function<void()> task) -> void;
+
+  /**
+   * @brief Runs every queued task on the calling thread, including any they
+   * queue themselves, and returns how many ran.
+   */
+  auto drain() -> int;
+
+  [[nodiscard]] auto empty() const -> bool;
+
+ private:
+  struct task {
+    int priority;
+    std::uint64_t seq;
+    std::function<void()> fn;
+  };
+
+  struct later {
+    auto operator()(task const& a, task const& b) const noexcept -> bool {
+      return a.priority != b.priority ? a.priority > b.priority
+                                      : a.seq > b.seq;
+    }
+  };
+
+  std::function<void()> wake_;
+
+  mutable std::mutex mutex_;
+  std::priority_queue<task, std::vector<task>, later> queue_;
+  std::uint64_t next_seq_ = 0;
+};
+}  // namespace sched
+
+#endif  // SCHED_SERIAL_QUEUE_H
@@ -0,0 +1,91 @@
+#ifndef SCHED_THREAD_POOL_H
+#define SCHED_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace sched {
+/**
+ * @brief A fixed-size pool of worker threads that runs tasks in priority
+ * order. Lower values run first, and tasks with equal priority run in the
+ * order they were submitted. The pool size is the CPU budget for everything
+ * that runs on it.
+ */
+class thread_pool {
+ public:
+  /**
+   * @brief Creates a pool with the given number of worker threads. A value
+   * less than 1 uses one thread per hardware thread.
+   */
+  explicit thread_pool(int threads = 0);
+
+  /**
+   * @brief Finishes all queued tasks, then joins the worker threads.
+   */
+  ~thread_pool();
+
+  // Delete unused constructors and assignment operators
+  thread_pool(thread_pool const& other) = delete;
+  thread_pool(thread_pool&& other) = delete;
+  thread_pool& operator=(thread_pool const& other) = delete;
+  thread_pool& operator=(thread_pool&& other) = delete;
+
+  [[nodiscard]] auto size() const noexcept -> int {
+    return static_cast<int>(workers_.size());
+  }
+
+  /**
+   * @brief Queues a task to run on one of the worker threads.
+   */
+  auto submit(int priority, std::function<void()> task) -> void;
+
+  /**
+   * @brief Calls <code>body(lo, hi)</code> for consecutive chunks of at most
+   * <code>grain</code> indices covering [begin, end), and returns once every
+   * chunk has run. Idle workers pick up chunks at the given priority, while
+   * the calling thread works through chunks itself, so this is safe to call
+   * from inside a task running on the pool. The first exception thrown by
+   * <code>body</code> is rethrown on the calling thread.
+   */
+  auto parallel_for(int begin, int end, int grain, int priority,
+                    std::function<void(int, int)> const& body) -> void;
+
+  /**
+   * @brief Blocks until the queue is empty and no task is running.
+   */
+  auto wait_idle() -> void;
+
+ private:
+  struct task {
+    int priority;
+    std::uint64_t seq;
+    std::function<void()> fn;
+  };
+
+  struct later {
+    auto operator()(task const& a, task const& b) const noexcept -> bool {
+      return a.priority != b.priority ? a.priority > b.priority
+                                      : a.seq > b.seq;
+    }
+  };
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  std::priority_queue<task, std::vector<task>, later> queue_;
+  std::uint64_t next_seq_ = 0;
+  int running_ = 0;
+  bool stopping_ = false;
+
+  std::vector<std::thread> workers_;
+
+  auto worker_loop() -> void;
+};
+}  // namespace sched
+
+#endif  // SCHED_THREAD_POOL_H
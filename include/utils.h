@@ -14,7 +14,8 @@
 #include <nfd_glfw3.h>
 
 #include <filesystem>
-#include <iostream>
+
+#include "logger/logger.h"
 
 namespace utils {
 
@@ -45,8 +46,7 @@ inline auto get_video_path(GLFWwindow* window, std::filesystem::path& path) -> b
     }
     case NFD_CANCEL: return false;
     case NFD_ERROR: {
-      // TODO: convert to debug log
-      std::cerr << "Error: " << NFD_GetError() << "\n";
+      logger::instance()->error("%s", NFD_GetError());
       return false;
     }
   }
@@ -66,8 +66,7 @@ inline auto get_save_directory(std::filesystem::path& out_dir) -> bool {
     }
     case NFD_CANCEL: return false;
     case NFD_ERROR: {
-      // TODO: convert to debug log
-      std::cerr << "Error: " << NFD_GetError() << "\n";
+      logger::instance()->error("%s", NFD_GetError());
 
       return false;
     }
@@ -75,11 +74,6 @@ inline auto get_save_directory(std::filesystem::path& out_dir) -> bool {
 
   return false;
 }
-
-static auto loading_dots() -> std::string {
-  const int n_dots = static_cast<int>(ImGui::GetTime() / 0.3f) & 3;
-  return std::string{"..."}.substr(0, n_dots);
-}
 }  // namespace utils
 
 #endif  // UTILS_H
@@ -0,0 +1,77 @@
+#ifndef VIDEO_BATCH_H
+#define VIDEO_BATCH_H
+
+#include <filesystem>
+#include <functional>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "sched/thread_pool.h"
+#include "stabilizer.h"
+
+namespace vid {
+/**
+ * @brief A single video to stabilize as part of a batch.
+ */
+struct batch_job {
+  std::filesystem::path input;
+  std::filesystem::path output;
+  int fourcc = 0;
+};
+
+/**
+ * @brief The outcome and timing of a single batch job. Times are wall-clock
+ * seconds, measured from the start of the batch for <code>started_s</code>
+ * and <code>finished_s</code>.
+ */
+struct batch_result {
+  batch_job job;
+  bool ok = false;
+  std::string error;
+  int frames = 0;
+  double started_s = 0.0;
+  double finished_s = 0.0;
+  double load_s = 0.0;
+  double stabilize_s = 0.0;
+  double export_s = 0.0;
+};
+
+struct batch_options {
+  stabilizer_options stabilizer;
+  // Maximum number of videos loaded at once. Running a couple of videos
+  // side by side keeps the pool busy while one of them is in a serial stage
+  // such as decoding or encoding, and capping it bounds memory use.
+  int max_in_flight = 2;
+  // Where to checkpoint each job, named after its input, so a batch that
+  // was interrupted resumes its unfinished jobs. Empty disables checkpoints.
+  std::filesystem::path checkpoint_dir;
+  // Format the frames are stored in while they're stabilized
+  img::pixel_format format = img::pixel_format::bgr;
+};
+
+/**
+ * @brief Stabilizes every job on the given pool, which sets the CPU budget
+ * for the whole batch. Work from all in-flight videos shares the pool, and
+ * work from videos that started earlier always runs first, so started jobs
+ * finish, and free their frames, before new ones are loaded. Blocks until
+ * every job has finished, calling <code>on_done</code> as each one does.
+ * Once a stop is requested, jobs in flight give up at the next frame and the
+ * rest fail without starting. Under a <code>mem::governor</code> budget, a
+ * video only starts once its estimated frames fit alongside those of the
+ * videos in flight. Must not be called from one of the pool's own threads.
+ */
+auto run_batch(std::vector<batch_job> const& jobs,
+               batch_options const& options, sched::thread_pool& pool,
+               std::function<void(batch_result const&)> const& on_done = {},
+               std::stop_token stop = {}) -> std::vector<batch_result>;
+
+/**
+ * @brief Writes a CSV report with one row per job.
+ */
+[[nodiscard]] auto write_batch_report(std::vector<batch_result> const& results,
+                                      std::filesystem::path const& path)
+    -> bool;
+}  // namespace vid
+
+#endif  // VIDEO_BATCH_H
@@ -0,0 +1,50 @@
+#ifndef VIDEO_CHECKPOINT_H
+#define VIDEO_CHECKPOINT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+#include "stabilizer.h"
+
+namespace vid {
+/**
+ * @brief The homographies an interrupted stabilization had already computed,
+ * so a restarted job can pick up where it left off.
+ */
+struct checkpoint {
+  // Identifies the frames and tracker settings the homographies belong to
+  std::uint64_t fingerprint = 0;
+  int frame_count = 0;
+  // Frame index of each homography, which maps frame i to frame i - 1
+  std::vector<int> indices;
+  std::vector<cv::Mat> h_mats;
+};
+
+/**
+ * @brief Returns a fingerprint of the frames, of every setting that affects
+ * the homographies and of the detection mask, so a checkpoint is never
+ * resumed against a different video or configuration.
+ */
+[[nodiscard]] auto checkpoint_fingerprint(std::vector<cv::Mat> const& frames,
+                                          stabilizer_options const& options,
+                                          cv::Mat const& mask)
+    -> std::uint64_t;
+
+/**
+ * @brief Writes the checkpoint to a temporary file and renames it over the
+ * given path, so a crash mid-write never leaves a corrupt checkpoint behind.
+ */
+[[nodiscard]] auto save_checkpoint(checkpoint const& cp,
+                                   std::filesystem::path const& path) -> bool;
+
+/**
+ * @brief Reads a checkpoint written by <code>save_checkpoint()</code>.
+ * @return False if the file doesn't exist or isn't a valid checkpoint.
+ */
+[[nodiscard]] auto load_checkpoint(std::filesystem::path const& path,
+                                   checkpoint& cp) -> bool;
+}  // namespace vid
+
+#endif  // VIDEO_CHECKPOINT_H
@@ -0,0 +1,193 @@
+#ifndef VIDEO_FRAME_SINK_H
+#define VIDEO_FRAME_SINK_H
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "image/yuv.h"
+#include "shm_ring.h"
+
+namespace vid {
+/**
+ * @brief Where finished frames are written, one at a time, as they're
+ * ready.
+ *
+ * A sink is opened with the size and rate of the frames once the first one
+ * is known, written to in order, then either closed or, if the job is given
+ * up, aborted so it leaves no partial file behind.
+ */
+class frame_sink {
+ public:
+  virtual ~frame_sink() = default;
+
+  // Delete unused constructors and assignment operators
+  frame_sink(frame_sink const& other) = delete;
+  frame_sink(frame_sink&& other) = delete;
+  frame_sink& operator=(frame_sink const& other) = delete;
+  frame_sink& operator=(frame_sink&& other) = delete;
+
+  /**
+   * @brief Returns the format the sink writes frames in, which saves a
+   * conversion if frames are already in it.
+   */
+  [[nodiscard]] virtual auto format() const -> img::pixel_format = 0;
+
+  /**
+   * @brief Starts writing pictures of the given size at the given rate.
+   */
+  virtual auto open(cv::Size size, double fps) -> bool = 0;
+
+  /**
+   * @brief Writes a frame in the sink's format.
+   */
+  virtual auto write(cv::Mat const& frame) -> bool = 0;
+
+  /**
+   * @brief Finishes the output, and returns whether all of it was written.
+   */
+  virtual auto close() -> bool = 0;
+
+  /**
+   * @brief Gives up on the output, removing what was written if it's a
+   * regular file.
+   */
+  virtual auto abort() -> void = 0;
+
+  /**
+   * @brief Writes a frame of the given format, converting it if needed.
+   */
+  auto put(cv::Mat const& frame, img::pixel_format format) -> bool;
+
+ protected:
+  frame_sink() = default;
+};
+
+/**
+ * @brief Frames encoded into a video container by
+ * <code>cv::VideoWriter</code>.
+ */
+class writer_sink final : public frame_sink {
+ public:
+  writer_sink(std::filesystem::path path, int fourcc)
+      : path_{std::move(path)}, fourcc_{fourcc} {}
+
+  [[nodiscard]] auto format() const -> img::pixel_format override {
+    return img::pixel_format::bgr;
+  }
+
+  auto open(cv::Size size, double fps) -> bool override;
+
+  auto write(cv::Mat const& frame) -> bool override;
+
+  auto close() -> bool override;
+
+  auto abort() -> void override;
+
+ private:
+  std::filesystem::path path_;
+  int fourcc_;
+  cv::VideoWriter writer_;
+};
+
+/**
+ * @brief Frames written to a file, a named pipe or stdout, without a
+ * container, as YUV4MPEG2 or as headerless raw frames.
+ *
+ * YUV4MPEG2 is what <code>ffmpeg -f yuv4mpegpipe</code> reads, so the
+ * stabilizer can sit in the middle of a pipe with no temporary files. Both
+ * write I420 frames, the Y, U and V planes one after another, with a single
+ * write per frame unless its rows aren't contiguous.
+ */
+class stream_sink final : public frame_sink {
+ public:
+  enum class container : std::uint8_t { y4m, raw };
+
+  /**
+   * @brief Writes to the given file, or stdout if the path is "-". The file
+   * is only created once the sink is opened.
+   */
+  stream_sink(std::filesystem::path path, container kind);
+
+  ~stream_sink() override;
+
+  [[nodiscard]] auto format() const -> img::pixel_format override {
+    return img::pixel_format::i420;
+  }
+
+  auto open(cv::Size size, double fps) -> bool override;
+
+  auto write(cv::Mat const& frame) -> bool override;
+
+  auto close() -> bool override;
+
+  auto abort() -> void override;
+
+ private:
+  std::filesystem::path path_;
+  container kind_;
+  std::FILE* file_ = nullptr;
+  bool failed_ = false;
+
+  [[nodiscard]] auto is_stdout() const -> bool { return path_ == "-"; }
+};
+
+/**
+ * @brief Frames published to another process on the same host through a
+ * ring in shared memory, which it reads in place with a
+ * <code>shm_reader</code>, so frames are copied once and never encoded.
+ *
+ * The ring is created once the size of the frames is known, under the
+ * given name, and removed when the sink is destroyed, so the reader should
+ * be started first. It waits for the ring to appear.
+ */
+class shm_sink final : public frame_sink {
+ public:
+  explicit shm_sink(std::string name,
+                    img::pixel_format format = img::pixel_format::bgr,
+                    shm_options const& options = {});
+
+  ~shm_sink() override;
+
+  [[nodiscard]] auto format() const -> img::pixel_format override {
+    return format_;
+  }
+
+  auto open(cv::Size size, double fps) -> bool override;
+
+  /**
+   * @brief Copies the frame into the next free slot and publishes it,
+   * waiting for the reader to free one if the ring is full, unless frames
+   * are dropped instead.
+   */
+  auto write(cv::Mat const& frame) -> bool override;
+
+  auto close() -> bool override;
+
+  auto abort() -> void override;
+
+ private:
+  std::string name_;
+  img::pixel_format format_;
+  shm_options options_;
+  std::unique_ptr<shm_ring> ring_;
+  double fps_ = 0.0;
+  // Frames written so far, including those dropped
+  std::int64_t index_ = 0;
+  bool failed_ = false;
+};
+
+/**
+ * @brief Returns the sink the given path names: a shared memory ring for
+ * <code>shm:name[:slots[:drop]]</code>, headerless I420 if <code>raw</code>
+ * is set, YUV4MPEG2 for "-" or a <code>.y4m</code> file, and otherwise a
+ * video container encoded with the given codec. "-" is stdout.
+ */
+[[nodiscard]] auto open_sink(std::filesystem::path const& path, int fourcc,
+                             bool raw = false) -> std::unique_ptr<frame_sink>;
+}  // namespace vid
+
+#endif  // VIDEO_FRAME_SINK_H
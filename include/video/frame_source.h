@@ -0,0 +1,319 @@
+#ifndef VIDEO_FRAME_SOURCE_H
+#define VIDEO_FRAME_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/videoio.hpp>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image/yuv.h"
+#include "sched/bounded_queue.h"
+
+namespace vid {
+/**
+ * @brief What a <code>frame_source</code> knows about its frames before
+ * reading any of them.
+ */
+struct source_info {
+  std::string name;
+  // Size of the pictures, and the format frames are read in
+  cv::Size size;
+  img::pixel_format format = img::pixel_format::bgr;
+  double fps = 0.0;
+  // Frames the source expects to yield, 0 if it can't tell. Containers only
+  // estimate it.
+  int frame_count = 0;
+  // Codec and bitrate of the original encoding, 0 if there's none
+  int fourcc = 0;
+  double bitrate = 0.0;
+};
+
+/**
+ * @brief Frames read one at a time, on demand, from wherever they come from.
+ *
+ * Nothing is decoded until it's asked for, so a consumer that only needs a
+ * few frames at once, such as <code>stabilizer::stabilize_stream()</code>,
+ * never holds the whole clip. Each frame is read into a buffer of its own,
+ * so consumers may keep it.
+ */
+class frame_source {
+ public:
+  virtual ~frame_source() = default;
+
+  // Delete unused constructors and assignment operators
+  frame_source(frame_source const& other) = delete;
+  frame_source(frame_source&& other) = delete;
+  frame_source& operator=(frame_source const& other) = delete;
+  frame_source& operator=(frame_source&& other) = delete;
+
+  [[nodiscard]] virtual auto info() const -> source_info = 0;
+
+  /**
+   * @brief Reads the next frame in the source's own format.
+   * @return False at the end of the frames, or if one couldn't be read.
+   */
+  virtual auto read(cv::Mat& frame) -> bool = 0;
+
+  /**
+   * @brief Reads the next frame, converted to the given format.
+   */
+  auto next(cv::Mat& frame, img::pixel_format format) -> bool;
+
+ protected:
+  frame_source() = default;
+};
+
+/**
+ * @brief Walks the frames of a source, in the source's own format, reading
+ * each one as it's reached.
+ */
+class frame_iterator {
+ public:
+  using value_type = cv::Mat;
+  using difference_type = std::ptrdiff_t;
+
+  frame_iterator() = default;
+
+  explicit frame_iterator(frame_source* source) : source_{source} {
+    ++*this;
+  }
+
+  auto operator*() const noexcept -> cv::Mat const& { return frame_; }
+
+  auto operator++() -> frame_iterator& {
+    frame_ = cv::Mat{};
+    if (source_ && !source_->read(frame_)) source_ = nullptr;
+    return *this;
+  }
+
+  auto operator++(int) -> void { ++*this; }
+
+  friend auto operator==(frame_iterator const& it, std::default_sentinel_t)
+      -> bool {
+    return it.source_ == nullptr;
+  }
+
+ private:
+  frame_source* source_ = nullptr;
+  cv::Mat frame_;
+};
+
+/**
+ * @brief Returns the frames left in the source as a single-pass range.
+ */
+[[nodiscard]] inline auto frames(frame_source& source) {
+  return std::ranges::subrange(frame_iterator{&source},
+                               std::default_sentinel);
+}
+
+/**
+ * @brief Frames decoded from a video container by
+ * <code>cv::VideoCapture</code>, which also reads numbered image files given
+ * a printf-style pattern.
+ */
+class capture_source final : public frame_source {
+ public:
+  explicit capture_source(std::filesystem::path const& path);
+
+  [[nodiscard]] auto opened() const -> bool { return capture_.isOpened(); }
+
+  [[nodiscard]] auto info() const -> source_info override { return info_; }
+
+  auto read(cv::Mat& frame) -> bool override;
+
+ private:
+  cv::VideoCapture capture_;
+  source_info info_;
+};
+
+/**
+ * @brief Frames read from a list of image files, in order.
+ */
+class image_sequence_source final : public frame_source {
+ public:
+  /**
+   * @brief Reads the given images, played back at the given rate. The first
+   * one is read straight away to find the size of the frames.
+   */
+  explicit image_sequence_source(std::vector<std::filesystem::path> paths,
+                                 double fps = 30.0);
+
+  /**
+   * @brief Returns the image files in the given directory, sorted by name.
+   */
+  [[nodiscard]] static auto list_images(std::filesystem::path const& dir)
+      -> std::vector<std::filesystem::path>;
+
+  [[nodiscard]] auto info() const -> source_info override { return info_; }
+
+  auto read(cv::Mat& frame) -> bool override;
+
+ private:
+  std::vector<std::filesystem::path> paths_;
+  std::size_t next_ = 0;
+  // The first image, read to find the frame size, until it's handed out
+  cv::Mat first_;
+  source_info info_;
+};
+
+/**
+ * @brief Headerless frames of a fixed size and format, read back to back
+ * from a file or a pipe, such as the output of another program on stdin.
+ */
+class raw_source final : public frame_source {
+ public:
+  /**
+   * @brief Reads frames from the given file, which is closed along with the
+   * source unless it's stdin. BGR frames are packed 8-bit triplets, and
+   * I420 frames are the Y, U and V planes one after another. Like
+   * <code>y4m_source</code>, each frame takes a single read.
+   */
+  raw_source(std::FILE* file, cv::Size size, img::pixel_format format,
+             double fps = 30.0, std::string name = "raw");
+
+  /**
+   * @brief Opens the given file, or stdin if the path is "-".
+   */
+  raw_source(std::filesystem::path const& path, cv::Size size,
+             img::pixel_format format, double fps = 30.0);
+
+  ~raw_source() override;
+
+  [[nodiscard]] auto opened() const -> bool { return file_ != nullptr; }
+
+  [[nodiscard]] auto info() const -> source_info override { return info_; }
+
+  auto read(cv::Mat& frame) -> bool override;
+
+ private:
+  std::FILE* file_ = nullptr;
+  source_info info_;
+};
+
+/**
+ * @brief YUV4MPEG2 frames read from a file or a pipe, such as the output of
+ * <code>ffmpeg -f yuv4mpegpipe -</code> on stdin.
+ *
+ * The stream header gives the size and rate of the frames, which must be
+ * 4:2:0. Each frame is read straight into a buffer of its own with a single
+ * read, in I420, so no copy or conversion is made, and with a
+ * <code>mem::frame_pool</code> installed the buffers are recycled rather
+ * than allocated.
+ */
+class y4m_source final : public frame_source {
+ public:
+  /**
+   * @brief Reads the stream header from the given file, which is closed
+   * along with the source unless it's stdin.
+   */
+  explicit y4m_source(std::FILE* file, std::string name = "y4m");
+
+  /**
+   * @brief Opens the given file, or stdin if the path is "-".
+   */
+  explicit y4m_source(std::filesystem::path const& path);
+
+  ~y4m_source() override;
+
+  /**
+   * @brief Returns whether the stream header was read and is supported.
+   */
+  [[nodiscard]] auto opened() const -> bool {
+    return file_ != nullptr && !info_.size.empty();
+  }
+
+  [[nodiscard]] auto info() const -> source_info override { return info_; }
+
+  auto read(cv::Mat& frame) -> bool override;
+
+ private:
+  std::FILE* file_ = nullptr;
+  source_info info_;
+
+  auto read_header() -> bool;
+};
+
+/**
+ * @brief A procedurally generated shaky clip, made one frame at a time, with
+ * the ground truth motion of every frame made so far. Nothing touches the
+ * disk, so benchmarks and regression runs can use it anywhere.
+ */
+class synthetic_source final : public frame_source {
+ public:
+  /**
+   * @brief Makes <code>frame_count</code> frames by shaking a textured still,
+   * as <code>synthetic::shaky_clip()</code> does.
+   */
+  synthetic_source(cv::Size size, int frame_count, std::uint64_t seed,
+                   double magnitude = 1.0, int jpeg_quality = 0);
+
+  [[nodiscard]] auto info() const -> source_info override;
+
+  auto read(cv::Mat& frame) -> bool override;
+
+  /**
+   * @brief Returns the homographies that map points in each frame made so
+   * far to the frame before it. The first entry is the identity matrix.
+   */
+  [[nodiscard]] auto h_mats() const noexcept -> std::vector<cv::Mat> const& {
+    return h_mats_;
+  }
+
+ private:
+  cv::Size size_;
+  int frame_count_;
+  double magnitude_;
+  int jpeg_quality_;
+  cv::Mat still_;
+  cv::RNG rng_;
+  cv::Mat previous_t_;
+  std::vector<cv::Mat> h_mats_;
+};
+
+/**
+ * @brief Reads ahead of its consumer on a thread of its own, so decoding
+ * overlaps with whatever is done with the frames read before.
+ */
+class prefetch_source final : public frame_source {
+ public:
+  /**
+   * @brief Reads up to <code>depth</code> frames ahead of the consumer.
+   */
+  prefetch_source(std::unique_ptr<frame_source> inner, int depth = 4);
+
+  /**
+   * @brief Stops reading ahead, dropping any frames read but not consumed.
+   */
+  ~prefetch_source() override;
+
+  [[nodiscard]] auto info() const -> source_info override { return info_; }
+
+  auto read(cv::Mat& frame) -> bool override;
+
+ private:
+  std::unique_ptr<frame_source> inner_;
+  source_info info_;
+  sched::bounded_queue<cv::Mat> queue_;
+  std::jthread thread_;
+};
+
+/**
+ * @brief Opens the frames named by the given string: YUV4MPEG2 on stdin for
+ * "-" or from a <code>.y4m</code> file, a directory of images,
+ * <code>synthetic:WxH:frames[:seed]</code> for a generated clip, or else a
+ * video file or image pattern for <code>cv::VideoCapture</code>.
+ * @return The source, or null if it couldn't be opened.
+ */
+[[nodiscard]] auto open_source(std::string const& spec)
+    -> std::unique_ptr<frame_source>;
+}  // namespace vid
+
+#endif  // VIDEO_FRAME_SOURCE_H
@@ -0,0 +1,130 @@
+#ifndef VIDEO_LRU_CACHE_H
+#define VIDEO_LRU_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace vid {
+/**
+ * @brief A thread-safe least-recently-used cache with a budget in bytes.
+ * Each entry is charged the size given when it is inserted, and the least
+ * recently used entries are evicted to make room for new ones.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class lru_cache {
+ public:
+  explicit lru_cache(const std::size_t capacity_bytes)
+      : capacity_{capacity_bytes} {}
+
+  /**
+   * @brief Returns the cached value and marks it as most recently used.
+   */
+  [[nodiscard]] auto get(Key const& key) -> std::optional<Value> {
+    std::lock_guard lock(mutex_);
+
+    const auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return std::nullopt;
+    }
+
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    return it->second->value;
+  }
+
+  [[nodiscard]] auto contains(Key const& key) const -> bool {
+    std::lock_guard lock(mutex_);
+    return index_.contains(key);
+  }
+
+  /**
+   * @brief Inserts or replaces a value, evicting the least recently used
+   * entries until it fits. Values larger than the whole cache aren't stored.
+   */
+  auto put(Key const& key, Value value, const std::size_t bytes) -> void {
+    std::lock_guard lock(mutex_);
+
+    if (const auto it = index_.find(key); it != index_.end()) {
+      bytes_ -= it->second->bytes;
+      entries_.erase(it->second);
+      index_.erase(it);
+    }
+    if (bytes > capacity_) return;
+
+    while (bytes_ + bytes > capacity_ && !entries_.empty()) {
+      auto const& last = entries_.back();
+      bytes_ -= last.bytes;
+      index_.erase(last.key);
+      entries_.pop_back();
+      ++evictions_;
+    }
+
+    entries_.push_front({key, std::move(value), bytes});
+    index_.emplace(key, entries_.begin());
+    bytes_ += bytes;
+  }
+
+  auto clear() -> void {
+    std::lock_guard lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    bytes_ = 0;
+  }
+
+  [[nodiscard]] auto size() const -> std::size_t {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+  }
+
+  [[nodiscard]] auto bytes() const -> std::size_t {
+    std::lock_guard lock(mutex_);
+    return bytes_;
+  }
+
+  [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+    return capacity_;
+  }
+
+  [[nodiscard]] auto hits() const -> std::uint64_t {
+    std::lock_guard lock(mutex_);
+    return hits_;
+  }
+
+  [[nodiscard]] auto misses() const -> std::uint64_t {
+    std::lock_guard lock(mutex_);
+    return misses_;
+  }
+
+  [[nodiscard]] auto evictions() const -> std::uint64_t {
+    std::lock_guard lock(mutex_);
+    return evictions_;
+  }
+
+ private:
+  struct entry {
+    Key key;
+    Value value;
+    std::size_t bytes;
+  };
+
+  const std::size_t capacity_;
+
+  mutable std::mutex mutex_;
+  // Most recently used first
+  std::list<entry> entries_;
+  std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index_;
+  std::size_t bytes_ = 0;
+  std::uint64_t hits_ = 0;
+  std::uint64_t misses_ = 0;
+  std::uint64_t evictions_ = 0;
+};
+}  // namespace vid
+
+#endif  // VIDEO_LRU_CACHE_H
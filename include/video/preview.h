@@ -0,0 +1,184 @@
+#ifndef VIDEO_PREVIEW_H
+#define VIDEO_PREVIEW_H
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <opencv2/core/mat.hpp>
+#include <thread>
+#include <vector>
+
+#include "image/yuv.h"
+#include "lru_cache.h"
+#include "vid.h"
+
+namespace vid {
+/**
+ * @brief The videos that can be previewed side by side.
+ */
+enum class track : std::uint8_t { original, stabilized, count };
+
+struct preview_options {
+  // Proxies are downscaled to at most this width, keeping the aspect ratio
+  int proxy_width = 480;
+  int thumbnail_width = 80;
+  int thumbnail_count = 12;
+  // Memory budget for proxy frames across both tracks
+  std::size_t cache_bytes = std::size_t{96} << 20;
+  // Frames built ahead of the playhead when prefetching
+  int prefetch_ahead = 30;
+};
+
+/**
+ * @brief A strip of evenly spaced thumbnails, packed side by side into a
+ * single image so it can be shown as a single texture.
+ */
+struct thumbnail_strip {
+  cv::Mat atlas;
+  cv::Size thumbnail_size;
+  // Frame shown by each thumbnail, from left to right
+  std::vector<int> frames;
+};
+
+/**
+ * @brief Downscaled proxies and thumbnails of a video, for responsive
+ * playback and scrubbing.
+ *
+ * Proxies are small RGBA frames, built on a background thread and kept in an
+ * LRU cache, so a front end only ever touches small, display-ready buffers.
+ * Everything but <code>frame()</code> returns immediately, so it can be called
+ * from a GUI thread; nothing here depends on a GUI, so the cache can also be
+ * driven headless.
+ */
+class preview {
+ public:
+  explicit preview(preview_options options = {});
+  ~preview();
+
+  preview(preview const&) = delete;
+  preview& operator=(preview const&) = delete;
+
+  /**
+   * @brief Replaces the video of the given track and starts building its
+   * thumbnails and first proxies in the background. The video is shared,
+   * not copied, and its frames must not be replaced while it's previewed.
+   * Frames are fetched one at a time as they're needed, so the video's
+   * frames may be spilled to disk while it's previewed.
+   */
+  auto set_source(track t, std::shared_ptr<video const> clip) -> void;
+
+  /**
+   * @brief Previews the given frames, shared rather than copied.
+   */
+  auto set_source(track t, std::vector<cv::Mat> frames, int fps,
+                  img::pixel_format format = img::pixel_format::bgr) -> void;
+
+  /**
+   * @brief Stops previewing the given track and lets go of its video.
+   */
+  auto clear(track t) -> void;
+
+  [[nodiscard]] auto frame_count(track t) const -> int;
+
+  [[nodiscard]] auto fps(track t) const -> int;
+
+  /**
+   * @brief Returns the proxy of the given frame if it's cached. Otherwise
+   * asks for it to be built and returns an empty matrix.
+   */
+  [[nodiscard]] auto try_frame(track t, int index) -> cv::Mat;
+
+  /**
+   * @brief Returns the proxy of the given frame, building it on the calling
+   * thread if it isn't cached.
+   */
+  [[nodiscard]] auto frame(track t, int index) -> cv::Mat;
+
+  /**
+   * @brief Asks for the proxies of the frames following <code>index</code> to
+   * be built, replacing any earlier requests for the track, so the frames
+   * around the playhead are always built first.
+   */
+  auto prefetch(track t, int index) -> void;
+
+  /**
+   * @brief Returns the thumbnails of the given track, which are empty until
+   * they have been built.
+   */
+  [[nodiscard]] auto thumbnails(track t) const -> thumbnail_strip;
+
+  /**
+   * @brief Returns a number that changes whenever the track's frames or
+   * thumbnails change, so a front end knows to refresh what it shows.
+   */
+  [[nodiscard]] auto version(track t) const -> std::uint64_t;
+
+  /**
+   * @brief Blocks until every requested proxy and thumbnail has been built.
+   */
+  auto wait_idle() -> void;
+
+  [[nodiscard]] auto cache() const noexcept
+      -> lru_cache<std::uint64_t, cv::Mat> const& {
+    return cache_;
+  }
+
+  /**
+   * @brief Returns a display-ready copy of the frame, stored in the given
+   * format: at most <code>max_width</code> wide and converted to RGBA.
+   */
+  [[nodiscard]] static auto make_proxy(
+      cv::Mat const& frame, int max_width,
+      img::pixel_format format = img::pixel_format::bgr) -> cv::Mat;
+
+ private:
+  struct source {
+    std::shared_ptr<video const> clip;
+    int frame_count = 0;
+    img::pixel_format format = img::pixel_format::bgr;
+    int fps = 0;
+    // Changes with every new set of frames, so stale proxies are never shown
+    std::uint64_t generation = 0;
+    std::uint64_t version = 0;
+    thumbnail_strip thumbnails;
+  };
+
+  struct job {
+    track t;
+    std::uint64_t generation;
+    // Frame to build a proxy of, or -1 to build the thumbnails
+    int index;
+  };
+
+  static constexpr auto track_count = static_cast<std::size_t>(track::count);
+
+  preview_options options_;
+  lru_cache<std::uint64_t, cv::Mat> cache_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable_any wake_;
+  std::condition_variable idle_;
+  std::array<source, track_count> sources_;
+  std::deque<job> jobs_;
+  std::uint64_t next_generation_ = 1;
+  bool busy_ = false;
+
+  std::jthread worker_;
+
+  [[nodiscard]] static auto key(std::uint64_t generation, int index) noexcept
+      -> std::uint64_t {
+    return generation << 32 | static_cast<std::uint32_t>(index);
+  }
+
+  auto build(job const& j) -> void;
+
+  auto build_thumbnails(job const& j) -> void;
+
+  auto run(std::stop_token const& stop) -> void;
+};
+}  // namespace vid
+
+#endif  // VIDEO_PREVIEW_H
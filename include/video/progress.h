@@ -0,0 +1,141 @@
+#ifndef VIDEO_PROGRESS_H
+#define VIDEO_PROGRESS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+namespace vid {
+/**
+ * @brief The stages of the video pipeline, in the order they run.
+ */
+enum class stage : std::uint8_t {
+  idle,
+  decode,
+  probe,
+  track,
+  accumulate,
+  smooth,
+  update,
+  crop,
+  warp,
+  encode,
+  count
+};
+
+/**
+ * @brief Returns a human-readable description of the given stage.
+ */
+[[nodiscard]] auto stage_name(stage s) noexcept -> std::string_view;
+
+/**
+ * @brief A consistent-enough view of a single stage's progress.
+ */
+struct progress_snapshot {
+  stage current = stage::idle;
+  int done = 0;
+  int total = 0;
+  // Seconds since the stage began, or its duration if it has finished
+  double elapsed_s = 0.0;
+  // Items completed per second since the stage began
+  double throughput = 0.0;
+
+  /**
+   * @brief Returns the completed fraction in [0, 1].
+   */
+  [[nodiscard]] auto fraction() const noexcept -> float {
+    return total > 0 ? static_cast<float>(done) / static_cast<float>(total)
+                     : 0.0f;
+  }
+};
+
+/**
+ * @brief Progress of the video pipeline, published by the pipeline and polled
+ * by a front end.
+ *
+ * Every stage has its own set of atomic counters, so publishing never takes
+ * a lock and never calls back into the front end: workers only bump a
+ * counter, and the GUI or CLI reads them at whatever rate it redraws.
+ */
+class progress {
+ public:
+  /**
+   * @brief Starts the given stage with <code>total</code> items of work, and
+   * makes it the current stage.
+   */
+  auto begin(stage s, int total) noexcept -> void;
+
+  /**
+   * @brief Marks <code>n</code> more items of the given stage as done. Safe
+   * to call from any number of threads at once.
+   */
+  auto advance(const stage s, const int n = 1) noexcept -> void {
+    counters_[index(s)].done.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Marks the given stage as complete.
+   */
+  auto finish(stage s) noexcept -> void;
+
+  /**
+   * @brief Returns to the idle stage, clearing all counters.
+   */
+  auto reset() noexcept -> void;
+
+  /**
+   * @brief Returns the stage that began most recently.
+   */
+  [[nodiscard]] auto current() const noexcept -> stage {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Returns the progress of the given stage.
+   */
+  [[nodiscard]] auto snapshot(stage s) const noexcept -> progress_snapshot;
+
+  /**
+   * @brief Returns the progress of the current stage.
+   */
+  [[nodiscard]] auto snapshot() const noexcept -> progress_snapshot {
+    return snapshot(current());
+  }
+
+ private:
+  struct counters {
+    std::atomic<int> done = 0;
+    std::atomic<int> total = 0;
+    std::atomic<std::int64_t> start_ns = 0;
+    std::atomic<std::int64_t> end_ns = 0;
+  };
+
+  std::atomic<stage> current_ = stage::idle;
+  std::array<counters, static_cast<std::size_t>(stage::count)> counters_;
+
+  static constexpr auto index(const stage s) noexcept -> std::size_t {
+    return static_cast<std::size_t>(s);
+  }
+};
+
+/**
+ * @brief Helpers for optional progress reporting, so pipeline code needn't
+ * check for a null pointer at every call.
+ */
+inline auto begin(progress* p, const stage s, const int total) noexcept
+    -> void {
+  if (p) p->begin(s, total);
+}
+
+inline auto advance(progress* p, const stage s, const int n = 1) noexcept
+    -> void {
+  if (p) p->advance(s, n);
+}
+
+inline auto finish(progress* p, const stage s) noexcept -> void {
+  if (p) p->finish(s);
+}
+}  // namespace vid
+
+#endif  // VIDEO_PROGRESS_H
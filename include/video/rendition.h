@@ -0,0 +1,141 @@
+#ifndef VIDEO_RENDITION_H
+#define VIDEO_RENDITION_H
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+#include <thread>
+#include <vector>
+
+#include "frame_sink.h"
+#include "image/yuv.h"
+#include "sched/bounded_queue.h"
+
+namespace vid {
+/**
+ * @brief One of the outputs a stabilized video is rendered to.
+ */
+struct rendition {
+  // Written as <code>open_sink()</code> makes of it
+  std::filesystem::path path;
+  // Size of the picture, empty for the size of the crop. A zero width or
+  // height follows the crop's aspect ratio.
+  cv::Size size;
+  int fourcc = 0;
+  // Whether to write headerless I420 frames
+  bool raw = false;
+};
+
+/**
+ * @brief Renders each stabilized frame to several outputs at once, each
+ * resampled straight from the source frame.
+ *
+ * Every rendition folds the update transformation, the crop and its own
+ * scale into a single homography, so no full-size stabilized frame is ever
+ * made. Renditions less than half the size of the source are resampled from
+ * a copy of the source halved, with an area filter, as many times as that
+ * takes, which the renditions of the frame share, so bilinear sampling
+ * doesn't skip pixels.
+ *
+ * The first rendition is encoded on the thread that writes the frames, and
+ * every other on a thread of its own, behind a short queue, so all of them
+ * are encoded at once.
+ */
+class rendition_writer {
+ public:
+  /**
+   * @brief Renders to a sink for each rendition, made by
+   * <code>open_sink()</code>.
+   */
+  explicit rendition_writer(std::vector<rendition> const& renditions);
+
+  /**
+   * @brief Renders a single output at the size of the crop to the given
+   * sink, which must outlive the writer.
+   */
+  explicit rendition_writer(frame_sink& sink);
+
+  // Aborts the outputs if they weren't closed
+  ~rendition_writer();
+
+  // Delete unused constructors and assignment operators
+  rendition_writer(rendition_writer const& other) = delete;
+  rendition_writer(rendition_writer&& other) = delete;
+  rendition_writer& operator=(rendition_writer const& other) = delete;
+  rendition_writer& operator=(rendition_writer&& other) = delete;
+
+  /**
+   * @brief Opens every output for frames of the given format and picture
+   * size, cropped to the given region, empty for all of it.
+   */
+  auto open(cv::Size picture, img::pixel_format format, cv::Rect crop,
+            double fps) -> bool;
+
+  /**
+   * @brief Returns the frame rendered for each output, in order. Safe to
+   * call from several threads at once, once the writer is open.
+   */
+  [[nodiscard]] auto render(cv::Mat const& frame, cv::Mat const& update) const
+      -> std::vector<cv::Mat>;
+
+  /**
+   * @brief Writes the frames one call to <code>render()</code> returned,
+   * waiting only if an output's encoder is a few frames behind.
+   */
+  auto write(std::vector<cv::Mat> frames) -> bool;
+
+  /**
+   * @brief Waits for every output to be encoded, finishes them, and returns
+   * whether all of them were written.
+   */
+  auto close() -> bool;
+
+  /**
+   * @brief Gives up on every output, removing those that are files.
+   */
+  auto abort() -> void;
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return outputs_.size();
+  }
+
+  /**
+   * @brief Returns the size the given output is rendered at, once open.
+   */
+  [[nodiscard]] auto picture_size(std::size_t output) const -> cv::Size {
+    return outputs_[output]->picture;
+  }
+
+ private:
+  struct output {
+    rendition spec;
+    std::unique_ptr<frame_sink> owned;
+    frame_sink* sink = nullptr;
+    cv::Size picture;
+    // Maps stabilized pixels of the whole picture to pixels of the output,
+    // and the level of the source it's resampled from
+    cv::Matx33d transform;
+    int level = 0;
+    // Frames waiting for the encoder, except for the first output
+    std::unique_ptr<sched::bounded_queue<cv::Mat>> queue;
+    std::jthread encoder;
+    std::atomic<bool> failed = false;
+  };
+
+  std::vector<std::unique_ptr<output>> outputs_;
+  img::pixel_format format_ = img::pixel_format::bgr;
+  // Picture size of the source, then of each halving of it the renditions
+  // need, and the maps from pixels of each level to pixels of the source
+  std::vector<cv::Size> levels_;
+  std::vector<cv::Matx33d> from_level_;
+  bool opened_ = false;
+  bool closed_ = false;
+
+  auto encode(output& out) -> void;
+  auto stop_encoders() -> void;
+};
+}  // namespace vid
+
+#endif  // VIDEO_RENDITION_H
@@ -0,0 +1,239 @@
+#ifndef VIDEO_SHM_RING_H
+#define VIDEO_SHM_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <opencv2/core/mat.hpp>
+#include <string>
+#include <utility>
+
+#include "image/yuv.h"
+
+namespace vid {
+/**
+ * @brief The layout of a ring of frames in POSIX shared memory, shared by
+ * the process that writes it and the one that reads it.
+ *
+ * The region starts with a <code>ring_header</code>, padded to a page,
+ * followed by <code>slot_count</code> slots of <code>slot_bytes</code>
+ * each. A slot is a <code>slot_header</code> followed, at
+ * <code>frame_offset</code>, by the pixels of one frame, whose rows are
+ * <code>row_bytes</code> apart: BGR frames are packed triplets, and I420
+ * frames the Y, U and V planes one after another.
+ *
+ * Frame <code>n</code> of the ring is in slot <code>n % slot_count</code>.
+ * The writer publishes it by raising <code>written</code> to
+ * <code>n + 1</code>, and the reader hands the slot back by raising
+ * <code>read</code>, so the writer never touches a slot the reader still
+ * holds. Every change to either counter also bumps an event word, which the
+ * other side sleeps on with a futex.
+ */
+namespace shm {
+// "VSRF", written last by the writer, once the rest of the header is set
+constexpr std::uint32_t ring_magic = 0x46525356;
+constexpr std::uint32_t ring_version = 1;
+
+enum class ring_state : std::uint32_t { open = 0, finished = 1, aborted = 2 };
+
+struct ring_header {
+  std::atomic<std::uint32_t> magic;
+  std::uint32_t version;
+  std::uint32_t slot_count;
+  // An img::pixel_format
+  std::uint32_t format;
+  std::int32_t width;
+  std::int32_t height;
+  std::uint64_t slot_bytes;
+  std::uint64_t frame_offset;
+  std::uint64_t frame_bytes;
+  std::uint64_t row_bytes;
+  double fps;
+  std::int64_t writer_pid;
+
+  // Written by the writer only
+  alignas(64) std::atomic<std::uint64_t> written;
+  std::atomic<std::uint32_t> written_event;
+  std::atomic<std::uint32_t> state;
+  // Frames the writer dropped because the ring was full
+  std::atomic<std::uint64_t> dropped;
+
+  // Written by the reader only
+  alignas(64) std::atomic<std::uint64_t> read;
+  std::atomic<std::uint32_t> read_event;
+};
+
+struct slot_header {
+  // Position of the frame in the ring, and in the stream, which differ once
+  // frames are dropped
+  std::uint64_t sequence;
+  std::int64_t index;
+  // When the frame is shown, from the frame rate, and when it was
+  // published, on the steady clock both processes share
+  std::int64_t timestamp_ns;
+  std::int64_t published_ns;
+};
+
+// Atomics are only safe to share between processes if they never lock
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+}  // namespace shm
+
+/**
+ * @brief Tuning parameters for <code>shm_sink</code>.
+ */
+struct shm_options {
+  // Frames the ring holds, which is how far the writer may run ahead
+  int slots = 8;
+  // Whether to drop frames while the ring is full, rather than wait for the
+  // reader to free a slot
+  bool drop_when_full = false;
+  // Longest wait for the reader to free a slot before giving up
+  std::chrono::milliseconds timeout{10000};
+};
+
+/**
+ * @brief A ring of frames mapped into this process, either created to write
+ * or opened to read. The writer removes the ring's name once it's done with
+ * it, but a reader keeps its mapping until it's destroyed.
+ *
+ * Shared memory is only supported on POSIX systems. Sleeping uses a futex
+ * on Linux, and short naps elsewhere.
+ */
+class shm_ring {
+ public:
+  ~shm_ring();
+
+  // Delete unused constructors and assignment operators
+  shm_ring(shm_ring const& other) = delete;
+  shm_ring(shm_ring&& other) = delete;
+  shm_ring& operator=(shm_ring const& other) = delete;
+  shm_ring& operator=(shm_ring&& other) = delete;
+
+  /**
+   * @brief Creates a ring of <code>slots</code> frames of the given size
+   * and format, replacing any left behind under the same name.
+   * @return The ring, or null if it couldn't be created.
+   */
+  [[nodiscard]] static auto create(std::string const& name, cv::Size size,
+                                   img::pixel_format format, double fps,
+                                   int slots) -> std::unique_ptr<shm_ring>;
+
+  /**
+   * @brief Opens a ring created by another process, if it's there and ready.
+   */
+  [[nodiscard]] static auto open(std::string const& name)
+      -> std::unique_ptr<shm_ring>;
+
+  [[nodiscard]] auto header() noexcept -> shm::ring_header& {
+    return *static_cast<shm::ring_header*>(base_);
+  }
+
+  [[nodiscard]] auto slot(std::uint64_t sequence) noexcept
+      -> shm::slot_header&;
+
+  /**
+   * @brief Returns the pixels of the slot that holds the given frame,
+   * without copying them.
+   */
+  [[nodiscard]] auto frame(std::uint64_t sequence) -> cv::Mat;
+
+  /**
+   * @brief Sleeps while the word is <code>seen</code>, for at most the
+   * given time, even if the other side is another process.
+   */
+  static auto wait(std::atomic<std::uint32_t>& word, std::uint32_t seen,
+                   std::chrono::milliseconds timeout) -> void;
+
+  /**
+   * @brief Bumps the word and wakes everyone sleeping on it.
+   */
+  static auto notify(std::atomic<std::uint32_t>& word) -> void;
+
+ private:
+  shm_ring(std::string name, void* base, std::size_t bytes, bool owner)
+      : name_{std::move(name)}, base_{base}, bytes_{bytes}, owner_{owner} {}
+
+  std::string name_;
+  void* base_;
+  std::size_t bytes_;
+  bool owner_;
+};
+
+/**
+ * @brief A frame read from a ring, whose pixels stay in the ring until it's
+ * released.
+ */
+struct shm_frame {
+  // A view of the slot, not a copy
+  cv::Mat frame;
+  img::pixel_format format = img::pixel_format::bgr;
+  std::uint64_t sequence = 0;
+  std::int64_t index = 0;
+  std::int64_t timestamp_ns = 0;
+  std::int64_t published_ns = 0;
+};
+
+/**
+ * @brief Reads the frames a <code>shm_sink</code> writes, in place, from
+ * another process. Only one reader may read a ring at a time.
+ */
+class shm_reader {
+ public:
+  enum class status : std::uint8_t { frame, timeout, finished, aborted };
+
+  explicit shm_reader(std::string name) : name_{std::move(name)} {}
+
+  // Delete unused constructors and assignment operators
+  shm_reader(shm_reader const& other) = delete;
+  shm_reader(shm_reader&& other) = delete;
+  shm_reader& operator=(shm_reader const& other) = delete;
+  shm_reader& operator=(shm_reader&& other) = delete;
+
+  /**
+   * @brief Waits up to the given time for the writer to create the ring,
+   * and maps it.
+   */
+  auto connect(std::chrono::milliseconds timeout) -> bool;
+
+  /**
+   * @brief Waits up to the given time for the next frame. Its pixels are
+   * valid until <code>release()</code>, and the writer can't reuse its slot
+   * until then.
+   */
+  auto acquire(shm_frame& frame, std::chrono::milliseconds timeout)
+      -> status;
+
+  /**
+   * @brief Hands the last frame acquired back to the writer.
+   */
+  auto release() -> void;
+
+  [[nodiscard]] auto size() const noexcept -> cv::Size { return size_; }
+
+  [[nodiscard]] auto format() const noexcept -> img::pixel_format {
+    return format_;
+  }
+
+  [[nodiscard]] auto fps() const noexcept -> double { return fps_; }
+
+  /**
+   * @brief Returns the frames the writer has dropped so far.
+   */
+  [[nodiscard]] auto dropped() const noexcept -> std::uint64_t;
+
+ private:
+  std::string name_;
+  std::unique_ptr<shm_ring> ring_;
+  cv::Size size_;
+  img::pixel_format format_ = img::pixel_format::bgr;
+  double fps_ = 0.0;
+  // The next frame to read, and whether it's been acquired
+  std::uint64_t next_ = 0;
+  bool held_ = false;
+};
+}  // namespace vid
+
+#endif  // VIDEO_SHM_RING_H
@@ -1,40 +1,322 @@
 #ifndef VIDEO_STABILIZER_H
 #define VIDEO_STABILIZER_H
 
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
 #include <opencv2/core/mat.hpp>
+#include <stop_token>
 
+#include "frame_sink.h"
+#include "frame_source.h"
 #include "vid.h"
+#include "image/detection_mask.h"
 #include "image/feature_tracker.h"
+#include "image/keyframes.h"
+#include "image/phase_tracker.h"
+#include "image/yuv.h"
+#include "progress.h"
+#include "rendition.h"
+#include "sched/pipeline.h"
+#include "sched/thread_pool.h"
+
+namespace vid::detail {
+struct stabilizer_stages;
+}
 
 namespace vid {
+/**
+ * @brief Tuning parameters for <code>stabilizer</code>.
+ */
+struct stabilizer_options {
+  // How the motion between tracked frames is estimated
+  img::estimator estimator = img::estimator::features;
+  img::tracker_options tracker;
+  img::phase_options phase;
+  // Which frame pairs to track, the rest being interpolated
+  img::keyframe_options keyframes;
+  // Whether to keep features off letterbox bars and static overlays, found
+  // from a sample of the frames before tracking
+  bool auto_mask = true;
+  img::mask_options mask;
+  // Optional 8-bit mask of where features may be detected, combined with
+  // the automatic one. Non-zero pixels allow detection.
+  cv::Mat feature_mask;
+  // Weights of the local filter used to smooth the camera trajectory. The
+  // filter is centred on each frame, so it should have an odd length.
+  std::vector<double> smoothing_weights{0.1, 0.3, 0.5, 0.3, 0.1};
+  // Whether to crop the stabilized frames to hide the introduced borders
+  bool crop = true;
+  // Where to checkpoint the homographies while tracking, so an interrupted
+  // job can resume from there. Empty disables checkpoints.
+  std::filesystem::path checkpoint_path;
+  // Frames tracked between checkpoints
+  int checkpoint_interval = 100;
+};
+
+/**
+ * @brief Tuning parameters for <code>stabilizer::stabilize_stream()</code>.
+ */
+struct stream_options {
+  // Format frames are kept in between decoding and encoding
+  img::pixel_format format = img::pixel_format::bgr;
+  // Frames each queue between two stages holds. Together with the smoothing
+  // window and the frames the workers hold, this bounds the frames in
+  // memory.
+  int queue_frames = 8;
+  // Threads tracking and warping frames, 0 to split the hardware threads
+  // between them
+  int track_workers = 0;
+  int warp_workers = 0;
+  // Fraction of the picture cropped off each edge. A crop fitted to the
+  // motion of every frame would need every frame before writing the first.
+  double crop_margin = 0.1;
+};
+
 class stabilizer {
+  // Runs each stage on its own, see stabilizer_stages.h
+  friend struct detail::stabilizer_stages;
+
  public:
-  explicit stabilizer() = default;
+  explicit stabilizer(stabilizer_options options = {})
+      : options_{std::move(options)} {}
+
+  /**
+   * @brief Publishes the progress of each stage to the given counters,
+   * which must outlive any call to <code>stabilize()</code>.
+   */
+  auto set_progress(progress* progress) noexcept -> void {
+    progress_ = progress;
+  }
+
+  /**
+   * @brief Runs the per-frame work of each stage on the given pool, at the
+   * given priority. Without a pool, every stage runs on the calling thread.
+   */
+  auto set_thread_pool(sched::thread_pool* pool, int priority = 0) noexcept
+      -> void {
+    pool_ = pool;
+    priority_ = priority;
+  }
+
+  /**
+   * @brief Checkpoints the homographies to the given file while tracking.
+   * Empty disables checkpoints.
+   */
+  auto set_checkpoint_path(std::filesystem::path path) -> void {
+    options_.checkpoint_path = std::move(path);
+  }
 
   /**
    * @brief Stabilizes the video frames.
+   *
+   * Every stage checks <code>stop</code> between frames and gives up as soon
+   * as a stop is requested, returning false. If a checkpoint path is set,
+   * tracking resumes from the checkpoint of an earlier, interrupted call on
+   * the same frames, and the checkpoint is removed once the call succeeds.
+   */
+  auto stabilize(video const* in, video* out, std::stop_token stop = {})
+      noexcept -> bool;
+
+  /**
+   * @brief Stabilizes the video straight into the outputs of the writer,
+   * which it opens, then closes, or aborts if the call fails.
+   *
+   * Motion is found as by <code>stabilize()</code>, then each frame is
+   * resampled once per output, in parallel a few frames at a time, and
+   * written as soon as it's rendered. No stabilized video is kept.
+   */
+  auto render(video const* in, rendition_writer& output,
+              std::stop_token stop = {}) noexcept -> bool;
+
+  /**
+   * @brief Stabilizes the frames of a source into a video file as they're
+   * read, without holding more than a few frames in memory.
+   *
+   * Decoding, tracking, smoothing, warping and encoding run at once, as the
+   * stages of a <code>sched::pipeline</code>: frames are tracked as they're
+   * decoded, each update transformation is emitted as soon as the smoothing
+   * window around its frame is full, and warped frames are encoded as they
+   * arrive. Tracking and warping run on several workers each.
+   *
+   * Unlike <code>stabilize()</code>, every frame pair is tracked, since
+   * keyframes are picked from runs of frames ahead of the one being
+   * tracked. The automatic feature mask is built from the first frames
+   * only, and the crop is a fixed margin rather than one fitted to the
+   * motion. Checkpoints aren't written. A cancelled or failed call aborts
+   * the output, which removes it if it's a file.
+   *
+   * Frames are pulled from the source only as fast as the slowest stage
+   * takes them, and written to the sink as soon as they're warped.
    */
-  auto stabilize(video const* in, video* out) noexcept -> bool;
+  auto stabilize_stream(frame_source& input, frame_sink& output,
+                        stream_options const& stream = {},
+                        std::stop_token stop = {}) noexcept -> bool;
+
+  /**
+   * @brief Streams the frames of a source into every output of the writer
+   * at once, as above. Each frame is resampled straight into every output,
+   * on the warping workers, and the outputs are encoded concurrently.
+   */
+  auto stabilize_stream(frame_source& input, rendition_writer& output,
+                        stream_options const& stream = {},
+                        std::stop_token stop = {}) noexcept -> bool;
+
+  /**
+   * @brief Streams the frames of a video file into another, encoded with
+   * the given codec, as above.
+   */
+  auto stabilize_stream(std::filesystem::path const& input,
+                        std::filesystem::path const& output, int fourcc,
+                        stream_options const& stream = {},
+                        std::stop_token stop = {}) noexcept -> bool;
+
+  /**
+   * @brief Returns what each stage of the last call to
+   * <code>stabilize_stream()</code> did, in pipeline order.
+   */
+  [[nodiscard]] auto stream_stats() const noexcept
+      -> std::vector<sched::stage_stats> const& {
+    return stream_stats_;
+  }
+
+  /**
+   * @brief Returns the homography matrices computed by the last call to
+   * <code>stabilize()</code>, where entry i maps points in frame i to frame
+   * i - 1. The first entry is the identity matrix.
+   */
+  [[nodiscard]] auto h_mats() const noexcept -> std::vector<cv::Mat> const& {
+    return h_mats_;
+  }
 
  private:
-  // Original and stabilized frames
+  stabilizer_options options_;
+  progress* progress_ = nullptr;
+
+  sched::thread_pool* pool_ = nullptr;
+  int priority_ = 0;
+
+  // Original and stabilized frames, and the format both are stored in
   std::vector<cv::Mat> frames_;
   std::vector<cv::Mat> stabilized_frames_;
+  img::pixel_format format_ = img::pixel_format::bgr;
 
-  // Feature Tracker and H Transforms
-  img::feature_tracker ft_;
+  // The images motion is measured on, sharing the original frames' data: the
+  // frames themselves, or the Y planes of YUV frames
+  std::vector<cv::Mat> track_frames_;
 
+  // H Transforms
   std::vector<cv::Mat> h_mats_;
   std::vector<cv::Mat> h_tilde_;
 
-  // Local filter window
-  std::vector<double> weight_list_{0.1, 0.3, 0.5, 0.3, 0.1};
   std::vector<cv::Mat> h_tilde_prime_;
 
   std::vector<cv::Mat> update_transforms_;
 
+  // Region of the stabilized frames that's kept, empty for all of it
+  cv::Rect crop_;
+
+  // Where features are detected, and the picture inside any letterboxing
+  cv::Mat feature_mask_;
+  cv::Rect content_;
+
+  // Cancellation of the running call to stabilize()
+  std::stop_token stop_;
+
+  // Which entries of h_mats_ have been computed, and how many since the last
+  // checkpoint, guarded by checkpoint_mutex_
+  std::mutex checkpoint_mutex_;
+  std::vector<std::uint8_t> h_done_;
+  int since_checkpoint_ = 0;
+  std::uint64_t fingerprint_ = 0;
+
+  // Stages of the last streamed run
+  std::vector<sched::stage_stats> stream_stats_;
+
+  [[nodiscard]] auto cancelled() const noexcept -> bool {
+    return stop_.stop_requested();
+  }
+
+  [[nodiscard]] auto checkpointing() const noexcept -> bool {
+    return !options_.checkpoint_path.empty();
+  }
+
+  /**
+   * @brief Runs every stage of <code>stabilize()</code>.
+   */
+  auto run(video const* in, video* out) noexcept -> bool;
+
+  /**
+   * @brief Takes the frames to stabilize from the video, and the images
+   * motion is measured on from them.
+   * @return False if the video's frames couldn't be read back from disk.
+   */
+  [[nodiscard]] auto load_frames(video const& in) noexcept -> bool;
+
+  /**
+   * @brief Runs every stage of <code>stabilize()</code> that finds the
+   * update transformations and the crop.
+   * @return False if cancelled.
+   */
+  auto analyse() noexcept -> bool;
+
+  /**
+   * @brief Renders every frame into the outputs of the writer, at the
+   * given rate, and closes them.
+   */
+  auto render_frames(rendition_writer& output, double fps) noexcept -> bool;
+
+  /**
+   * @brief Lets go of the frames of the last call, keeping what it tracked.
+   */
+  auto release_frames() noexcept -> void;
+
+  /**
+   * @brief Restores the homographies saved by an earlier, interrupted run on
+   * the same frames.
+   * @return The number of homographies restored.
+   */
+  auto resume_h_mats() noexcept -> int;
+
+  /**
+   * @brief Marks entry i of h_mats_ as computed, writing a checkpoint every
+   * <code>checkpoint_interval</code> entries.
+   */
+  auto mark_h_mat_done(int i) noexcept -> void;
+
+  /**
+   * @brief Writes every computed entry of h_mats_ to the checkpoint file.
+   * Expects checkpoint_mutex_ to be held.
+   */
+  auto write_checkpoint() noexcept -> void;
+
+  /**
+   * @brief Builds the mask of where to detect features, from the automatic
+   * mask and the user's mask, and finds the picture inside any letterboxing.
+   */
+  auto build_feature_mask() noexcept -> void;
+
+  /**
+   * @brief Measures the motion from <code>image</code> back to
+   * <code>previous</code> with the estimator the options pick, and records
+   * the tracker's counters under frame <code>index</code>. If tracking
+   * fails, the camera is assumed not to have moved.
+   */
+  [[nodiscard]] auto track_pair(img::feature_tracker& ft,
+                                img::phase_tracker& pt, cv::Mat const& image,
+                                cv::Mat const& previous, int index) const
+      -> cv::Mat;
+
   /**
-   * @brief Generates the homography matrices for all frame pairs.
+   * @brief Returns the frames to track between, from a cheap measurement of
+   * the motion of every frame: every frame if keyframes are disabled.
+   */
+  [[nodiscard]] auto select_keyframes() noexcept -> std::vector<int>;
+
+  /**
+   * @brief Generates the homography matrices for all frame pairs, tracking
+   * keyframes and interpolating the frames in between.
    */
   auto generate_h_mats() noexcept -> void;
 
@@ -54,15 +336,31 @@ class stabilizer {
   auto compute_update_transforms() noexcept -> void;
 
   /**
-   * @brief Stabilizes the frames using the update transformation matrices.
+   * @brief Finds the crop that removes the borders the update
+   * transformation matrices introduce, including any letterboxing, from
+   * the outline of the picture alone.
+   */
+  auto find_crop() noexcept -> void;
+
+  /**
+   * @brief Stabilizes the frames using the update transformation matrices,
+   * computing only the pixels inside the crop, if one has been found.
    */
   auto stabilize_frames() noexcept -> void;
 
   /**
-   * @brief Crops the stabilized frames to remove borders. Assumes that
-   * <code>stabilize()</code> has been called.
+   * @brief Returns how many consecutive frames to hand to each worker when
+   * splitting <code>n</code> frames between the pool's workers.
+   */
+  [[nodiscard]] auto chunk_size(int n) const noexcept -> int;
+
+  /**
+   * @brief Calls <code>body(lo, hi)</code> for chunks of at most
+   * <code>grain</code> frames covering [begin, end), in parallel if a thread
+   * pool is set.
    */
-  auto crop_frames() noexcept -> void;
+  auto for_each_chunk(int begin, int end, int grain,
+                      std::function<void(int, int)> const& body) -> void;
 };
 }  // namespace vid
 
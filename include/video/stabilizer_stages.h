@@ -0,0 +1,71 @@
+#ifndef VIDEO_STABILIZER_STAGES_H
+#define VIDEO_STABILIZER_STAGES_H
+
+#include <utility>
+#include <vector>
+
+#include "stabilizer.h"
+
+// Internal to the stabilizer and its benchmarks: runs the stages of
+// vid::stabilizer::stabilize() one at a time, on state set up directly
+// rather than by the stages before them, so each can be timed on its own.
+// Nothing here is part of the public API.
+
+namespace vid::detail {
+/**
+ * @brief The individual stages of <code>stabilizer::stabilize()</code>.
+ */
+struct stabilizer_stages {
+  /**
+   * @brief Gives the stabilizer frames stored in the given format, and the
+   * update transformation of each, as if the analysis stages had run.
+   * Forgets any crop.
+   */
+  static auto load(stabilizer& s, std::vector<cv::Mat> frames,
+                   img::pixel_format format,
+                   std::vector<cv::Mat> update_transforms) -> void {
+    s.frames_ = std::move(frames);
+    s.format_ = format;
+    s.update_transforms_ = std::move(update_transforms);
+    s.crop_ = cv::Rect{};
+  }
+
+  /**
+   * @brief Gives the stabilizer a camera trajectory to smooth, as computed
+   * by <code>compute_h_tilde()</code>.
+   */
+  static auto load_trajectory(stabilizer& s, std::vector<cv::Mat> h_tilde)
+      -> void {
+    s.h_tilde_ = std::move(h_tilde);
+  }
+
+  /**
+   * @brief Smooths the camera trajectory.
+   */
+  static auto compute_h_tilde_prime(stabilizer& s) noexcept -> void {
+    s.compute_h_tilde_prime();
+  }
+
+  /**
+   * @brief Finds the crop of the loaded update transformations.
+   */
+  static auto find_crop(stabilizer& s) noexcept -> void { s.find_crop(); }
+
+  /**
+   * @brief Returns the crop found by <code>find_crop()</code>, empty if
+   * there is none.
+   */
+  [[nodiscard]] static auto crop(stabilizer const& s) noexcept -> cv::Rect {
+    return s.crop_;
+  }
+
+  /**
+   * @brief Warps the loaded frames, inside the crop if one has been found.
+   */
+  static auto stabilize_frames(stabilizer& s) noexcept -> void {
+    s.stabilize_frames();
+  }
+};
+}  // namespace vid::detail
+
+#endif  // VIDEO_STABILIZER_STAGES_H
@@ -0,0 +1,59 @@
+#ifndef VIDEO_SYNTHETIC_H
+#define VIDEO_SYNTHETIC_H
+
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+#include <vector>
+
+namespace vid::synthetic {
+/**
+ * @brief Generates a procedurally textured BGR frame of the given size. The
+ * texture mixes smooth noise with randomly placed shapes so it has plenty of
+ * corners and blobs for SIFT to lock on to. The same seed always produces
+ * the same frame.
+ */
+[[nodiscard]] auto textured_frame(cv::Size size, std::uint64_t seed)
+    -> cv::Mat;
+
+/**
+ * @brief Returns a random homography that models a small hand-held camera
+ * shake for a frame of the given size: a translation of up to
+ * <code>magnitude</code> percent of the frame width, a rotation of up to
+ * <code>magnitude</code> tenths of a degree, and a matching zoom, all about
+ * the centre of the frame.
+ */
+[[nodiscard]] auto shake_homography(cv::RNG& rng, cv::Size size,
+                                    double magnitude = 1.0) -> cv::Mat;
+/**
+ * @brief A synthetic shaky clip together with its ground truth motion.
+ */
+struct clip {
+  std::vector<cv::Mat> frames;
+  // Ground truth homographies that map points in frame i to frame i - 1,
+  // following the same convention as <code>stabilizer::h_mats()</code>. The
+  // first entry is the identity matrix.
+  std::vector<cv::Mat> h_mats;
+};
+
+/**
+ * @brief Generates a clip of <code>frame_count</code> frames by shaking a
+ * single textured still with a random camera trajectory. If
+ * <code>jpeg_quality</code> is in the range [1, 100], each frame is
+ * round-tripped through a JPEG encoder at that quality to simulate
+ * compression artefacts.
+ */
+[[nodiscard]] auto shaky_clip(cv::Size size, int frame_count,
+                              std::uint64_t seed, double magnitude = 1.0,
+                              int jpeg_quality = 0) -> clip;
+
+/**
+ * @brief Returns the mean distance, in pixels, between the four corners of a
+ * frame of the given size when transformed by <code>h_estimated</code> and by
+ * <code>h_truth</code>.
+ */
+[[nodiscard]] auto corner_error(cv::Mat const& h_estimated,
+                                cv::Mat const& h_truth, cv::Size size)
+    -> double;
+}  // namespace vid::synthetic
+
+#endif  // VIDEO_SYNTHETIC_H
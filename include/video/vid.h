@@ -2,28 +2,109 @@
 #define VIDEO_H
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <opencv2/videoio.hpp>
 #include <opencv2/core/mat.hpp>
+#include <stop_token>
+
+#include "image/yuv.h"
+#include "memory/governor.h"
+#include "progress.h"
 
 namespace vid {
-class video {
+class frame_sink;
+class frame_source;
+
+/**
+ * @brief The frames of a clip, held in memory and registered with
+ * <code>mem::governor</code> for as long as the video lives.
+ *
+ * Once marked cold, the governor may spill frames to a temporary file when
+ * the process is over its memory budget. Spilled frames are read back one at
+ * a time by <code>frame()</code>, and all at once by anything that needs
+ * every frame, such as <code>frames()</code> and <code>clone()</code>. Only
+ * frames no one else shares are spilled, since spilling the others would
+ * free nothing.
+ */
+class video : public mem::tenant {
  public:
   video();
   explicit video(std::filesystem::path const& video_file_path);
+  video(std::vector<cv::Mat> frames, int fps,
+        img::pixel_format format = img::pixel_format::bgr);
   video(video const& other);      // Copy Constructor
   video(video&& other) noexcept;  // Move Constructor
-  ~video() = default;
+  ~video() override;
+
+  video& operator=(video const& other);  // Copy-Assignment Operator
+
+  /**
+   * @brief Decodes every frame of the given file, publishing the decode
+   * stage to <code>progress</code> if given. If a stop is requested, stops
+   * decoding and leaves the video empty.
+   */
+  auto load_video_from_file(std::filesystem::path const& video_file_path,
+                            progress* progress = nullptr,
+                            std::stop_token stop = {}) noexcept -> void;
+
+  /**
+   * @brief Reads every frame of the given source, publishing the decode
+   * stage to <code>progress</code> if given. If a stop is requested, stops
+   * reading and leaves the video empty.
+   */
+  auto load_from_source(frame_source& source, progress* progress = nullptr,
+                        std::stop_token stop = {}) noexcept -> void;
+
+  /**
+   * @brief Exports the stabilized video to the given directory.
+   */
+  [[nodiscard]] auto export_to_file(std::string const& save_dir,
+                                    progress* progress = nullptr,
+                                    std::stop_token stop = {}) const
+      noexcept -> bool;
+
+  /**
+   * @brief Exports the video to the given file, encoded with the given
+   * FOURCC codec, publishing the encode stage to <code>progress</code> if
+   * given. If a stop is requested, removes the partly written file and
+   * returns false.
+   */
+  [[nodiscard]] auto export_to_path(std::filesystem::path const& file_path,
+                                    int fourcc,
+                                    progress* progress = nullptr,
+                                    std::stop_token stop = {}) const
+      noexcept -> bool;
 
-  video& operator=(video const& other) = default;  // Copy-Assignment Operator
+  /**
+   * @brief Writes every frame to the given sink, then closes it, publishing
+   * the encode stage to <code>progress</code> if given. If a stop is
+   * requested, aborts the sink and returns false.
+   */
+  [[nodiscard]] auto export_to_sink(frame_sink& sink,
+                                    progress* progress = nullptr,
+                                    std::stop_token stop = {}) const
+      noexcept -> bool;
 
-  auto load_video_from_file(
-      std::filesystem::path const& video_file_path) noexcept -> void;
+  /**
+   * @brief Sets the format later loads store frames in. Frames whose size
+   * doesn't fit I420 are stored as BGR regardless.
+   */
+  auto set_load_format(const img::pixel_format format) noexcept -> void {
+    load_format_ = format;
+  }
 
   /**
-   * @brief Exports the stabilized video to the given file path.
+   * @brief Returns the format the frames are stored in.
    */
-  [[nodiscard]] auto export_to_file(std::string const& save_dir) const noexcept
-      -> bool;
+  [[nodiscard]] auto format() const noexcept -> img::pixel_format {
+    return format_;
+  }
+
+  /**
+   * @brief Returns the size of the pictures the frames hold.
+   */
+  [[nodiscard]] auto size() const noexcept -> cv::Size { return size_; }
 
   [[nodiscard]] auto empty() const noexcept -> bool {
     return frame_count_ == 0;
@@ -39,32 +120,92 @@ class video {
     return frame_count_;
   }
 
-  [[nodiscard]] auto frames() const noexcept -> std::vector<cv::Mat> {
-    return frames_;
-  }
+  /**
+   * @brief Returns every frame, reading spilled frames back into memory, or
+   * no frames if any of them can't be read back.
+   */
+  [[nodiscard]] auto frames() const noexcept -> std::vector<cv::Mat>;
 
-  auto frames(std::vector<cv::Mat> const& new_frames) noexcept -> void {
-    frames_ = new_frames;
-    frame_count_ = static_cast<int>(frames_.size());
-    size_ = frames_[0].size();
-  }
+  auto frames(std::vector<cv::Mat> const& new_frames) noexcept -> void;
+
+  /**
+   * @brief Returns the given frame, read from disk without being kept in
+   * memory if it was spilled, or an empty matrix if there's no such frame
+   * or it can't be read back.
+   */
+  [[nodiscard]] auto frame(int index) const noexcept -> cv::Mat;
 
   [[nodiscard]] auto clone() const noexcept -> video;
 
+  [[nodiscard]] auto name() const -> std::string;
+
+  auto set_name(std::string name) -> void;
+
+  /**
+   * @brief Marks the frames as no longer needed close at hand, so they may
+   * be spilled when over budget, or as in use again. Marking them cold
+   * enforces the budget right away.
+   */
+  auto set_cold(bool cold) -> void;
+
+  [[nodiscard]] auto tenant_name() const -> std::string override;
+
+  [[nodiscard]] auto resident_bytes() const -> std::size_t override;
+
+  [[nodiscard]] auto spilled_bytes() const -> std::size_t override;
+
+  /**
+   * @brief Spills frames to disk, latest first, until the given number of
+   * bytes has been freed or no more frames can be.
+   */
+  auto release(std::size_t bytes) -> std::size_t override;
+
  private:
+  // Guards the frames and the spill file against the governor, which spills
+  // them from whichever thread enforces the budget
+  std::unique_ptr<std::mutex> mutex_ = std::make_unique<std::mutex>();
   std::string file_name_;
-  std::vector<cv::Mat> frames_{};
+  // Spilled frames are empty, and read back from their slot in the file
+  mutable std::vector<cv::Mat> frames_{};
+  mutable std::vector<bool> spilled_{};
+  std::filesystem::path spill_path_;
+  // Shape of every slot in the spill file, taken from the first frame
+  cv::Size slot_size_;
+  int slot_type_ = -1;
   double bitrate_ = 0;
   int fourcc_ = 0;
   int fps_ = 0;
   int frame_count_ = 0;
   cv::Size size_;
+  img::pixel_format format_ = img::pixel_format::bgr;
+  img::pixel_format load_format_ = img::pixel_format::bgr;
+
+  /**
+   * @brief Decodes the frames of the source into memory, in the load
+   * format, expecting about the given number of them.
+   */
+  auto process_source(frame_source& source, int expected_frames,
+                      progress* progress,
+                      std::stop_token const& stop) noexcept -> void;
+
+  [[nodiscard]] auto slot_bytes() const noexcept -> std::size_t;
 
-  auto process_video(std::filesystem::path const& video_file_path) noexcept -> void;
+  /**
+   * @brief Reads a spilled frame back from its slot. Expects the lock.
+   */
+  [[nodiscard]] auto read_slot(std::size_t index) const noexcept -> cv::Mat;
 
-  auto load_frames(std::vector<std::string> const& frames_file_paths) noexcept -> void;
+  /**
+   * @brief Reads every spilled frame back into memory. Expects the lock.
+   * @return False if any frame couldn't be read back, and is still spilled.
+   */
+  [[nodiscard]] auto restore_locked() const noexcept -> bool;
 
-  static auto padded_string(int n, int frame_count) noexcept -> std::string;
+  /**
+   * @brief Forgets spilled frames and removes the spill file, once the
+   * frames are replaced. Expects the lock.
+   */
+  auto drop_spill_locked() noexcept -> void;
 };
 }  // namespace vid
 
@@ -35,6 +35,7 @@
 
 #include "app/gui.h"
 #include "app/shader.h"
+#include "memory/frame_pool.h"
 
 #ifdef WIN32
 auto APIENTRY WinMain(HINSTANCE, HINSTANCE, LPSTR, int) -> int {
@@ -43,11 +44,19 @@ auto APIENTRY WinMain(HINSTANCE, HINSTANCE, LPSTR, int) -> int {
 #ifndef WIN32
 auto main() -> int {
 #endif
+    //--------------------------------------------------- Initialize Logs --//
+    // Show the log in the main window as well as on stderr
+    logger::instance()->add_sink(app::panel);
+
+    //-------------------------------------------- Initialize Frame Buffers --//
+    // Frame buffers are recycled between frames, stages and videos
+    mem::frame_pool::instance()->install();
+
     //--------------------------------------------- Initialize GLFW system --//
     // TODO: Create error codes to handle initialization errors
     if (!app::init_glfw()) {
-      // TODO: convert to debug log statement
-      std::cerr << "Error: Could not initialize GLFW\n";
+      logger::instance()->error("Could not initialize GLFW");
+      logger::instance()->flush();
       abort();
     }
 
@@ -59,8 +68,8 @@ auto main() -> int {
                                    "Video Stabilizer", nullptr, nullptr);
 
     if (!app::window) {
-      // TODO: convert to debug log statement
-      std::cerr << "Error: Could not create GLFW window\n";
+      logger::instance()->error("Could not create GLFW window");
+      logger::instance()->flush();
       abort();
     }
 
@@ -71,8 +80,8 @@ auto main() -> int {
 
     //--------------------------------------------- Initialize GLAD system --//
     if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
-      // TODO: convert to debug log statement
-      std::cerr << "Error: Could not initialize GLAD\n";
+      logger::instance()->error("Could not initialize GLAD");
+      logger::instance()->flush();
       abort();
     }
 
@@ -81,14 +90,17 @@ auto main() -> int {
     glDebugMessageCallback(app::debug_cb, nullptr);
 
     //------------------------------ Log dependency versions to debug logs --//
-    // TODO: add support for debug logs
-    // int glfw_major, glfw_minor, glfw_revision;
-    // glfwGetVersion(&glfw_major, &glfw_minor, &glfw_revision);
-
-    // "Using OpenGL %s\n", glGetString(GL_VERSION)
-    // "Using GLAD %s.%s\n", GLVersion.major, GLVersion.minor
-    // "Using GLFW %s.%s.%s\n", glfw_major, glfw_minor, glfw_revision
-    // "Using ImGui %s\n", IMGUI_VERSION
+    int glfw_major, glfw_minor, glfw_revision;
+    glfwGetVersion(&glfw_major, &glfw_minor, &glfw_revision);
+
+    logger::instance()->debug(
+        "Using OpenGL %s",
+        reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+    logger::instance()->debug("Using GLAD %d.%d", GLVersion.major,
+                              GLVersion.minor);
+    logger::instance()->debug("Using GLFW %d.%d.%d", glfw_major, glfw_minor,
+                              glfw_revision);
+    logger::instance()->debug("Using ImGui %s", IMGUI_VERSION);
 
     //--------------------------------------------------- Initialize ImGui --//
     // This handles all the verbose setup code for our ImGui window
@@ -136,21 +148,41 @@ void main() {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
     // Add initial message to log
-    logger::instance()->add_log(
+    logger::instance()->info(
         "Welcome! To learn how to use this program, click the \"Help\" "
-        "button!\n");
+        "button!");
 
     // TODO: create a close callback to handle cleaning up
+    auto settle_frames = 0;
     while (!glfwWindowShouldClose(app::window)) {
-      glfwPollEvents();
+      // Only redraw when something happens, so the GUI doesn't compete with
+      // the jobs for CPU. While a job is running, redraw a few times a
+      // second to show its progress; finished jobs also wake us up.
+      // The preview redraws at the video's frame rate while it plays.
+      // ImGui reacts to some input a frame late (e.g. opening popups), so a
+      // few more frames are drawn after each wake-up.
+      if (settle_frames > 0) {
+        glfwPollEvents();
+        --settle_frames;
+      } else {
+        if (app::preview_view.animating()) {
+          glfwWaitEventsTimeout(app::preview_view.redraw_interval_s());
+        } else if (!app::mod.idle()) {
+          glfwWaitEventsTimeout(app::busy_redraw_interval_s);
+        } else {
+          glfwWaitEvents();
+        }
+        settle_frames = app::settle_frame_count;
+      }
+
+      // Finish jobs that have handed their results back to the GUI
+      app::gui_queue.drain();
 
       gui::render();
 
       // Swap the front and back buffers
       glfwSwapBuffers(app::window);
       glClear(GL_COLOR_BUFFER_BIT);
-
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
     // Happy path: clean up and exit
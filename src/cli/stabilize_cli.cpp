@@ -0,0 +1,1020 @@
+/// PROJECT: Video Stabilizer
+/// DESCRIPTION: Headless command-line front end for the stabilizer.
+///
+/// Runs the full pipeline without a display, OpenGL context or file dialogs,
+/// so it can be used on render servers and in scripts. Progress is reported
+/// on stderr and the exit code reports success or the kind of failure.
+///
+/// In batch mode, every video listed in a manifest or found in a directory
+/// is stabilized on one shared thread pool, so the whole batch stays within
+/// a single CPU budget.
+///
+/// With --stream, frames are stabilized as they're decoded and written as
+/// soon as they're warped, so only a few frames are ever held in memory.
+///
+/// Each --rendition adds an output at another size, resampled from the
+/// source in the same pass as the main one and encoded alongside it.
+///
+/// "-" reads YUV4MPEG2 frames from stdin or writes them to stdout, so the
+/// stabilizer can run as a filter between two ffmpeg processes.
+///
+/// Ctrl-C stops the pipeline at the next frame. With --checkpoint, the
+/// homographies tracked so far are saved, and running the same command again
+/// resumes tracking from where it stopped.
+///
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <opencv2/imgcodecs.hpp>
+#include <sstream>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "logger/logger.h"
+#include "logger/sinks.h"
+#include "memory/frame_pool.h"
+#include "memory/governor.h"
+#include "profiler/allocations.h"
+#include "profiler/profiler.h"
+#include "sched/thread_pool.h"
+#include "video/batch.h"
+#include "video/frame_sink.h"
+#include "video/frame_source.h"
+#include "video/rendition.h"
+#include "video/stabilizer.h"
+#include "video/vid.h"
+
+namespace {
+enum exit_code : int {
+  success = 0,
+  load_failed = 1,
+  stabilize_failed = 2,
+  export_failed = 3,
+  batch_failed = 4,
+  bad_usage = 64,
+  // As if killed by SIGINT, which is what a shell expects after Ctrl-C
+  cancelled = 130
+};
+
+struct options {
+  std::filesystem::path input;
+  std::filesystem::path output;
+  std::string codec;
+  std::string trace_path;
+  std::filesystem::path memory_report;
+  std::filesystem::path log_path;
+  std::filesystem::path checkpoint;
+  // Size of headerless I420 input frames, empty unless the input is raw,
+  // and the rate to play them back at
+  cv::Size raw_input;
+  double input_fps = 30.0;
+  bool raw_output = false;
+  // Outputs rendered alongside the main one, at other sizes
+  std::vector<vid::rendition> renditions;
+  bool quiet = false;
+  bool verbose = false;
+  int threads = 0;
+  // Most megabytes of frames to keep in memory, 0 for no limit
+  int memory_budget_mb = 0;
+  img::pixel_format format = img::pixel_format::bgr;
+  vid::stabilizer_options stabilizer;
+
+  // Streaming mode
+  bool streaming = false;
+  vid::stream_options stream;
+
+  // Batch mode
+  std::filesystem::path batch;
+  std::filesystem::path output_dir;
+  std::filesystem::path report_path;
+  int jobs = 2;
+};
+
+auto print_usage() -> void {
+  std::cerr
+      << "Usage: stabilize_cli [options] <input> <output>\n"
+         "       stabilize_cli [options] --batch <manifest|dir> "
+         "--output-dir <dir>\n"
+         "\n"
+         "<input> is a video file, an image pattern such as "
+         "frame_%04d.png, a\n"
+         "directory of images, a .y4m file, - for YUV4MPEG2 on stdin, or\n"
+         "synthetic:WxH:frames[:seed] for a generated clip. <output> is a "
+         "video\n"
+         "file, a .y4m file, or - for YUV4MPEG2 on stdout, such as\n"
+         "\n"
+         "  ffmpeg -i in.mp4 -f yuv4mpegpipe - | stabilize_cli --stream - - "
+         "|\n"
+         "      ffmpeg -f yuv4mpegpipe -i - out.mp4\n"
+         "\n"
+         "or shm:<name>[:slots[:drop]] to hand BGR frames to another process "
+         "on this\n"
+         "host through a ring in shared memory, read with shm_consumer or\n"
+         "vid::shm_reader. With :drop, frames are dropped rather than waited "
+         "on\n"
+         "while the ring is full.\n"
+         "\n"
+         "Options:\n"
+         "  --codec <fourcc>           Output codec (default: mp4v for\n"
+         "                             .mp4/.mov/.m4v, DIVX otherwise)\n"
+         "  --estimator <name>         features, or phase for fast "
+         "translation-only\n"
+         "                             phase correlation (default "
+         "features)\n"
+         "  --rotation-scale           Also estimate rotation and scale with "
+         "the\n"
+         "                             phase estimator\n"
+         "  --ransac-iterations <n>    Most RANSAC iterations per frame pair "
+         "(default 1000)\n"
+         "  --ransac-epsilon <px>      RANSAC inlier threshold (default 10)\n"
+         "  --ransac-confidence <p>    Confidence at which RANSAC stops "
+         "early, 1 to run\n"
+         "                             every iteration (default 0.99)\n"
+         "  --max-features <n>         Max SIFT features per frame, 0 for "
+         "all (default 0)\n"
+         "  --search-radius <px>       Radius around each feature's predicted "
+         "position\n"
+         "                             its match is searched in (default 32)\n"
+         "  --no-guided-matching       Match every feature to every other, "
+         "without\n"
+         "                             predicting where they moved\n"
+         "  --smoothing <w,w,...>      Trajectory filter weights\n"
+         "                             (default 0.1,0.3,0.5,0.3,0.1)\n"
+         "  --no-crop                  Keep the borders introduced by "
+         "stabilization\n"
+         "  --yuv                      Keep frames in YUV 4:2:0 rather than "
+         "BGR, which\n"
+         "                             halves their memory\n"
+         "  --mask <image>             Only detect features where the image "
+         "is non-zero\n"
+         "  --no-auto-mask             Detect features on letterboxing and "
+         "static overlays\n"
+         "  --max-keyframe-gap <n>     Most frames interpolated between "
+         "tracked frames\n"
+         "                             (default 10)\n"
+         "  --no-keyframes             Track every frame pair instead of "
+         "interpolating\n"
+         "                             steady motion\n"
+         "  --stream                   Decode, stabilize and encode at once, "
+         "holding\n"
+         "                             only a few frames in memory; tracks "
+         "every pair\n"
+         "                             and crops a fixed margin\n"
+         "  --crop-margin <f>          Fraction cropped off each edge when "
+         "streaming\n"
+         "                             (default 0.1)\n"
+         "  --raw-input <WxH>          Read headerless I420 frames of the "
+         "given size\n"
+         "  --fps <n>                  Frame rate of raw input (default 30)\n"
+         "  --raw-output               Write headerless I420 frames\n"
+         "  --rendition <WxH>[:fourcc]=<path>\n"
+         "                             Also write the video at the given "
+         "size, in the\n"
+         "                             same pass; 0 for a width or height "
+         "keeps the\n"
+         "                             crop's aspect ratio. May be "
+         "repeated.\n"
+         "  --trace <file>             Write a Chrome trace and print a "
+         "timing summary\n"
+         "  --memory-report <file>     Write each stage's allocations and "
+         "peaks, and a\n"
+         "                             memory timeline, as CSV and print a "
+         "summary;\n"
+         "                             not available in batch mode\n"
+         "  --threads <n>              Worker threads, 0 for one per core "
+         "(default 0)\n"
+         "  --memory-budget <MB>       Most frames to keep in memory; the "
+         "original is\n"
+         "                             spilled to disk once stabilized, and "
+         "batch jobs\n"
+         "                             wait for room (default 0, no limit)\n"
+         "  --log <file>               Append a debug log to the given file\n"
+         "  --checkpoint <path>        Save tracking progress to the given "
+         "file, or\n"
+         "                             one file per video in the given "
+         "directory in\n"
+         "                             batch mode, and resume from it when "
+         "run again\n"
+         "  --verbose                  Print debug messages on stderr\n"
+         "  --quiet                    Don't report progress, and only print "
+         "errors\n"
+         "  -h, --help                 Show this message\n"
+         "\n"
+         "Batch mode:\n"
+         "  --batch <manifest|dir>     Stabilize every video in a directory, "
+         "or every\n"
+         "                             line of a manifest: an input path, "
+         "optionally\n"
+         "                             followed by a tab and an output path\n"
+         "  --output-dir <dir>         Where to write outputs not named in "
+         "the manifest\n"
+         "  --jobs <n>                 Videos in flight at once (default 2)\n"
+         "  --report <file>            Per-job CSV report (default\n"
+         "                             <output-dir>/batch_report.csv)\n";
+}
+
+auto parse_weights(const std::string_view list, std::vector<double>& weights)
+    -> bool {
+  weights.clear();
+  std::stringstream stream{std::string{list}};
+  std::string weight;
+  while (std::getline(stream, weight, ',')) {
+    char* end = nullptr;
+    const auto w = std::strtod(weight.c_str(), &end);
+    if (end == weight.c_str() || w < 0.0) return false;
+    weights.push_back(w);
+  }
+
+  return !weights.empty() && weights.size() % 2 == 1;
+}
+
+/**
+ * @brief Parses <code>WxH</code>.
+ */
+auto parse_size(const std::string_view text, cv::Size& size) -> bool {
+  const std::string copy{text};
+  char* end = nullptr;
+  size.width = static_cast<int>(std::strtol(copy.c_str(), &end, 10));
+  if (*end != 'x') return false;
+  size.height = static_cast<int>(std::strtol(end + 1, &end, 10));
+
+  return *end == '\0' && size.width > 0 && size.height > 0;
+}
+
+/**
+ * @brief Parses <code>WxH[:fourcc]=path</code>, where either the width or
+ * the height may be 0 to follow the aspect ratio of the crop. The codec is
+ * left 0 if it isn't given.
+ */
+auto parse_rendition(const std::string_view text, vid::rendition& rendition)
+    -> bool {
+  const auto equals = text.find('=');
+  if (equals == std::string_view::npos || equals + 1 == text.size()) {
+    return false;
+  }
+  rendition.path = std::string{text.substr(equals + 1)};
+
+  auto spec = std::string{text.substr(0, equals)};
+  if (const auto colon = spec.find(':'); colon != std::string::npos) {
+    const auto codec = spec.substr(colon + 1);
+    if (codec.size() != 4) return false;
+    rendition.fourcc =
+        cv::VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]);
+    spec.resize(colon);
+  }
+
+  char* end = nullptr;
+  rendition.size.width = static_cast<int>(std::strtol(spec.c_str(), &end, 10));
+  if (end == spec.c_str() || *end != 'x') return false;
+  const auto* const height = end + 1;
+  rendition.size.height = static_cast<int>(std::strtol(height, &end, 10));
+
+  return end != height && *end == '\0' && rendition.size.width >= 0 &&
+         rendition.size.height >= 0 &&
+         rendition.size.width + rendition.size.height > 0;
+}
+
+/**
+ * @brief Returns the extension of the path in lower case, so it can be
+ * compared whatever case the file was named in.
+ */
+auto lower_extension(std::filesystem::path const& path) -> std::string {
+  auto ext = path.extension().string();
+  std::ranges::transform(ext, ext.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+
+  return ext;
+}
+
+/**
+ * @brief Returns whether the path is stdin or stdout, or a YUV4MPEG2 file.
+ */
+auto is_yuv_stream(std::filesystem::path const& path) -> bool {
+  return path == "-" || lower_extension(path) == ".y4m";
+}
+
+auto parse_args(const int argc, char** argv, options& opts) -> bool {
+  std::vector<std::string_view> positional;
+
+  for (auto i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+
+    // Flags without values
+    if (arg == "--no-crop") {
+      opts.stabilizer.crop = false;
+      continue;
+    }
+    if (arg == "--yuv") {
+      opts.format = img::pixel_format::i420;
+      continue;
+    }
+    if (arg == "--no-keyframes") {
+      opts.stabilizer.keyframes.enabled = false;
+      continue;
+    }
+    if (arg == "--no-guided-matching") {
+      opts.stabilizer.tracker.guided_matching = false;
+      continue;
+    }
+    if (arg == "--rotation-scale") {
+      opts.stabilizer.phase.rotation_scale = true;
+      continue;
+    }
+    if (arg == "--no-auto-mask") {
+      opts.stabilizer.auto_mask = false;
+      continue;
+    }
+    if (arg == "--stream") {
+      opts.streaming = true;
+      continue;
+    }
+    if (arg == "--raw-output") {
+      opts.raw_output = true;
+      continue;
+    }
+    if (arg == "--quiet") {
+      opts.quiet = true;
+      continue;
+    }
+    if (arg == "--verbose") {
+      opts.verbose = true;
+      continue;
+    }
+    if (arg == "-h" || arg == "--help") return false;
+
+    // A lone "-" is stdin or stdout
+    if (!arg.starts_with("--")) {
+      positional.push_back(arg);
+      continue;
+    }
+
+    // Flags with values
+    if (i + 1 >= argc) return false;
+    const std::string_view value = argv[++i];
+    auto& tracker = opts.stabilizer.tracker;
+
+    if (arg == "--codec") {
+      if (value.size() != 4) return false;
+      opts.codec = value;
+    } else if (arg == "--estimator") {
+      if (value == "features") {
+        opts.stabilizer.estimator = img::estimator::features;
+      } else if (value == "phase") {
+        opts.stabilizer.estimator = img::estimator::phase;
+      } else {
+        return false;
+      }
+    } else if (arg == "--ransac-iterations") {
+      tracker.ransac_iterations = std::atoi(value.data());
+      if (tracker.ransac_iterations <= 0) return false;
+    } else if (arg == "--ransac-epsilon") {
+      tracker.ransac_epsilon = static_cast<float>(std::atof(value.data()));
+      if (tracker.ransac_epsilon <= 0.0f) return false;
+    } else if (arg == "--ransac-confidence") {
+      tracker.ransac_confidence = static_cast<float>(std::atof(value.data()));
+      if (tracker.ransac_confidence <= 0.0f ||
+          tracker.ransac_confidence > 1.0f) {
+        return false;
+      }
+    } else if (arg == "--max-features") {
+      tracker.max_features = std::atoi(value.data());
+      if (tracker.max_features < 0) return false;
+    } else if (arg == "--search-radius") {
+      tracker.search_radius = static_cast<float>(std::atof(value.data()));
+      if (tracker.search_radius <= 0.0f) return false;
+    } else if (arg == "--smoothing") {
+      if (!parse_weights(value, opts.stabilizer.smoothing_weights))
+        return false;
+    } else if (arg == "--max-keyframe-gap") {
+      opts.stabilizer.keyframes.max_gap = std::atoi(value.data());
+      if (opts.stabilizer.keyframes.max_gap < 1) return false;
+    } else if (arg == "--mask") {
+      opts.stabilizer.feature_mask =
+          cv::imread(std::string{value}, cv::IMREAD_GRAYSCALE);
+      if (opts.stabilizer.feature_mask.empty()) {
+        std::cerr << "Error: could not read mask " << value << "\n";
+        return false;
+      }
+    } else if (arg == "--crop-margin") {
+      opts.stream.crop_margin = std::atof(value.data());
+      if (opts.stream.crop_margin < 0.0 || opts.stream.crop_margin >= 0.5)
+        return false;
+    } else if (arg == "--raw-input") {
+      if (!parse_size(value, opts.raw_input) ||
+          !img::fits_i420(opts.raw_input))
+        return false;
+    } else if (arg == "--fps") {
+      opts.input_fps = std::atof(value.data());
+      if (opts.input_fps <= 0.0) return false;
+    } else if (arg == "--rendition") {
+      vid::rendition rendition;
+      if (!parse_rendition(value, rendition)) return false;
+      opts.renditions.push_back(std::move(rendition));
+    } else if (arg == "--trace") {
+      opts.trace_path = value;
+    } else if (arg == "--memory-report") {
+      opts.memory_report = value;
+    } else if (arg == "--log") {
+      opts.log_path = value;
+    } else if (arg == "--checkpoint") {
+      opts.checkpoint = value;
+    } else if (arg == "--threads") {
+      opts.threads = std::atoi(value.data());
+      if (opts.threads < 0) return false;
+    } else if (arg == "--memory-budget") {
+      opts.memory_budget_mb = std::atoi(value.data());
+      if (opts.memory_budget_mb < 0) return false;
+    } else if (arg == "--batch") {
+      opts.batch = value;
+    } else if (arg == "--output-dir") {
+      opts.output_dir = value;
+    } else if (arg == "--jobs") {
+      opts.jobs = std::atoi(value.data());
+      if (opts.jobs < 1) return false;
+    } else if (arg == "--report") {
+      opts.report_path = value;
+    } else {
+      std::cerr << "Error: unknown option " << arg << "\n";
+      return false;
+    }
+  }
+
+  if (!opts.batch.empty()) {
+    // Stages are attributed process-wide, which overlapping jobs would mix up
+    if (!opts.memory_report.empty()) {
+      std::cerr << "Error: --memory-report isn't supported in batch mode\n";
+      return false;
+    }
+    if (!positional.empty() || opts.output_dir.empty() || opts.streaming ||
+        !opts.renditions.empty() || opts.raw_input.area() > 0 ||
+        opts.raw_output)
+      return false;
+    if (opts.report_path.empty())
+      opts.report_path = opts.output_dir / "batch_report.csv";
+
+    return true;
+  }
+
+  if (positional.size() != 2) return false;
+  opts.input = positional[0];
+  opts.output = positional[1];
+  opts.stabilizer.checkpoint_path = opts.checkpoint;
+
+  // Frames piped in or out are already YUV, so keep them that way rather
+  // than converting every one of them twice
+  if (is_yuv_stream(opts.input) || is_yuv_stream(opts.output) ||
+      opts.raw_input.area() > 0 || opts.raw_output) {
+    opts.format = img::pixel_format::i420;
+  }
+  opts.stream.format = opts.format;
+
+  // Split the threads between the stages that run on several
+  if (opts.threads > 0) {
+    opts.stream.track_workers = std::max(1, opts.threads * 2 / 3);
+    opts.stream.warp_workers =
+        std::max(1, opts.threads - opts.stream.track_workers);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the codec to write the given file with: the one given on the
+ * command line, or a sensible default for the file extension.
+ */
+auto fourcc_for(std::filesystem::path const& output, options const& opts)
+    -> int {
+  auto codec = opts.codec;
+  if (codec.empty()) {
+    const auto ext = lower_extension(output);
+    codec = ext == ".mp4" || ext == ".mov" || ext == ".m4v" ? "mp4v" : "DIVX";
+  }
+
+  return cv::VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]);
+}
+
+auto is_video_file(std::filesystem::path const& path) -> bool {
+  static const std::vector<std::string> extensions{".mov", ".mp4", ".mpeg4",
+                                                   ".wmv", ".avi", ".flv",
+                                                   ".mkv", ".m4v"};
+  return std::ranges::find(extensions, lower_extension(path)) !=
+         extensions.end();
+}
+
+/**
+ * @brief Opens the input: headerless frames if their size was given, and
+ * whatever <code>vid::open_source()</code> makes of it otherwise.
+ */
+auto open_input(options const& opts) -> std::unique_ptr<vid::frame_source> {
+  if (opts.raw_input.area() == 0) return vid::open_source(opts.input.string());
+
+  auto source = std::make_unique<vid::raw_source>(
+      opts.input, opts.raw_input, img::pixel_format::i420, opts.input_fps);
+  if (!source->opened()) return nullptr;
+
+  return source;
+}
+
+auto open_output(options const& opts) -> std::unique_ptr<vid::frame_sink> {
+  return vid::open_sink(opts.output, fourcc_for(opts.output, opts),
+                        opts.raw_output);
+}
+
+/**
+ * @brief Returns every output to render: the main one, at the size of the
+ * crop, then each rendition, in the codec given for it or for its file.
+ */
+auto all_renditions(options const& opts) -> std::vector<vid::rendition> {
+  std::vector<vid::rendition> renditions{
+      {opts.output, {}, fourcc_for(opts.output, opts), opts.raw_output}};
+  for (auto rendition : opts.renditions) {
+    if (rendition.fourcc == 0) {
+      rendition.fourcc = fourcc_for(rendition.path, opts);
+    }
+    renditions.push_back(std::move(rendition));
+  }
+
+  return renditions;
+}
+
+/**
+ * @brief Collects the batch jobs from a directory of videos or a manifest.
+ */
+auto collect_jobs(options const& opts, std::vector<vid::batch_job>& jobs)
+    -> bool {
+  const auto default_output = [&](std::filesystem::path const& input) {
+    auto name = input.stem().string() + "_stabilized";
+    return opts.output_dir / (name + input.extension().string());
+  };
+
+  std::error_code error;
+  if (std::filesystem::is_directory(opts.batch, error)) {
+    for (auto const& entry :
+         std::filesystem::directory_iterator(opts.batch, error)) {
+      if (entry.is_regular_file() && is_video_file(entry.path())) {
+        jobs.push_back({entry.path(), default_output(entry.path())});
+      }
+    }
+
+    // Directory order is unspecified, so sort for a repeatable schedule
+    std::ranges::sort(jobs, {}, &vid::batch_job::input);
+  } else {
+    std::ifstream manifest(opts.batch);
+    if (!manifest) return false;
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (line.empty() || line.front() == '#') continue;
+
+      const auto tab = line.find('\t');
+      const std::filesystem::path input = line.substr(0, tab);
+      auto output = tab == std::string::npos
+                        ? default_output(input)
+                        : std::filesystem::path(line.substr(tab + 1));
+      jobs.push_back({input, std::move(output)});
+    }
+  }
+
+  for (auto& job : jobs) job.fourcc = fourcc_for(job.output, opts);
+
+  return !error;
+}
+
+/**
+ * @brief Polls the pipeline's progress from a background thread for as long
+ * as it lives, printing the current stage on a single, updating line. The
+ * pipeline never waits on the terminal.
+ */
+class progress_printer {
+ public:
+  progress_printer(vid::progress const& progress, const bool quiet) {
+    if (quiet) return;
+    thread_ = std::jthread([&progress](const std::stop_token stop) {
+      poll(progress, stop);
+    });
+  }
+
+ private:
+  std::jthread thread_;
+
+  static auto print(vid::progress_snapshot const& snap, const bool last)
+      -> void {
+    std::cerr << "\r" << vid::stage_name(snap.current) << ": "
+              << static_cast<int>(snap.fraction() * 100.0f) << "% ("
+              << static_cast<int>(snap.throughput) << "/s)   "
+              << (last ? "\n" : "") << std::flush;
+  }
+
+  static auto poll(vid::progress const& progress, const std::stop_token stop)
+      -> void {
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    auto shown = vid::stage::idle;
+
+    while (true) {
+      const auto stopping = stop.stop_requested();
+
+      // Finish the line of a stage that has just ended
+      const auto snap = progress.snapshot();
+      if (snap.current != shown && shown != vid::stage::idle) {
+        print(progress.snapshot(shown), true);
+      }
+      shown = snap.current;
+      if (shown != vid::stage::idle) print(snap, stopping);
+      if (stopping) return;
+
+      std::unique_lock lock(mutex);
+      wake.wait_for(lock, stop, std::chrono::milliseconds(100),
+                    []() { return false; });
+    }
+  }
+};
+
+auto seconds_since(const std::chrono::steady_clock::time_point start)
+    -> double {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Set by the SIGINT handler. Only lock-free atomics are safe to touch there.
+std::atomic<bool> interrupted = false;
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+auto on_interrupt(int) -> void {
+  interrupted.store(true, std::memory_order_relaxed);
+  // A second Ctrl-C kills the process as usual
+  std::signal(SIGINT, SIG_DFL);
+}
+
+/**
+ * @brief Turns Ctrl-C into a stop request for the pipeline, for as long as it
+ * lives. The signal handler only sets a flag, so the stop callbacks run on an
+ * ordinary thread instead of inside the handler.
+ */
+class interrupt_watcher {
+ public:
+  explicit interrupt_watcher(std::stop_source source) {
+    std::signal(SIGINT, on_interrupt);
+    thread_ = std::jthread([source](const std::stop_token stop) mutable {
+      std::mutex mutex;
+      std::condition_variable_any wake;
+      std::unique_lock lock(mutex);
+      while (!stop.stop_requested()) {
+        if (interrupted.load(std::memory_order_relaxed)) {
+          std::cerr << "\nCancelling...\n";
+          source.request_stop();
+          return;
+        }
+        wake.wait_for(lock, stop, std::chrono::milliseconds(50),
+                      []() { return false; });
+      }
+    });
+  }
+
+  ~interrupt_watcher() { std::signal(SIGINT, SIG_DFL); }
+
+  interrupt_watcher(interrupt_watcher const&) = delete;
+  interrupt_watcher& operator=(interrupt_watcher const&) = delete;
+
+ private:
+  std::jthread thread_;
+};
+
+/**
+ * @brief Reports a cancelled run, and how to resume it if it was
+ * checkpointed.
+ */
+auto report_cancelled(options const& opts) -> int {
+  std::cerr << "Cancelled";
+  if (!opts.checkpoint.empty()) {
+    std::cerr << "; run the same command again to resume from "
+              << opts.checkpoint.string();
+  }
+  std::cerr << "\n";
+
+  return cancelled;
+}
+
+/**
+ * @brief Logs the frames each video holds in memory and on disk.
+ */
+auto log_memory() -> void {
+  for (auto const& usage : mem::governor::instance()->report()) {
+    logger::instance()->debug("%s: %zu MB in memory, %zu MB on disk%s",
+                              usage.name, usage.resident_bytes >> 20,
+                              usage.spilled_bytes >> 20,
+                              usage.cold ? " (cold)" : "");
+  }
+}
+
+/**
+ * @brief Stabilizes a single video, using the given pool for the parallel
+ * stages. Stops at the next frame once a stop is requested.
+ */
+auto run_single(options const& opts, sched::thread_pool& pool,
+                std::stop_token const& stop) -> int {
+  vid::progress progress;
+
+  //------------------------------------------------------------ Load --//
+  auto start = std::chrono::steady_clock::now();
+  vid::video in;
+  if (auto source = open_input(opts)) {
+    // Decoding runs ahead while the frames read so far are converted
+    vid::prefetch_source prefetch{std::move(source)};
+    progress_printer printer{progress, opts.quiet};
+    in.set_load_format(opts.format);
+    in.load_from_source(prefetch, &progress, stop);
+  }
+  if (stop.stop_requested()) return report_cancelled(opts);
+  if (in.empty()) {
+    std::cerr << "Error: could not load " << opts.input << "\n";
+    return load_failed;
+  }
+  if (!opts.quiet) {
+    std::cerr << "Loaded " << in.frame_count() << " frames in "
+              << seconds_since(start) << " s\n";
+  }
+
+  //------------------------------------------------------- Stabilize --//
+  start = std::chrono::steady_clock::now();
+  vid::stabilizer stabilizer{opts.stabilizer};
+  stabilizer.set_progress(&progress);
+  stabilizer.set_thread_pool(&pool);
+
+  // Every output is rendered straight from the loaded frames, in one pass
+  if (!opts.renditions.empty()) {
+    vid::rendition_writer writer{all_renditions(opts)};
+    auto rendered = false;
+    {
+      progress_printer printer{progress, opts.quiet};
+      rendered = stabilizer.render(&in, writer, stop);
+    }
+    if (stop.stop_requested()) return report_cancelled(opts);
+    if (!rendered) {
+      std::cerr << "Error: could not render " << opts.input << "\n";
+      return export_failed;
+    }
+    if (!opts.quiet) {
+      std::cerr << "Stabilized and rendered " << writer.size()
+                << " outputs in " << seconds_since(start) << " s\n";
+    }
+
+    return success;
+  }
+
+  vid::video out;
+  auto stabilized = false;
+  {
+    progress_printer printer{progress, opts.quiet};
+    stabilized = stabilizer.stabilize(&in, &out, stop);
+  }
+  if (stop.stop_requested()) return report_cancelled(opts);
+  if (!stabilized) {
+    std::cerr << "Error: could not stabilize " << opts.input << "\n";
+    return stabilize_failed;
+  }
+  if (!opts.quiet) {
+    std::cerr << "Stabilized in " << seconds_since(start) << " s\n";
+  }
+
+  // Only the stabilized frames are needed from here on
+  in.set_cold(true);
+  log_memory();
+
+  //---------------------------------------------------------- Export --//
+  start = std::chrono::steady_clock::now();
+  auto exported = false;
+  {
+    progress_printer printer{progress, opts.quiet};
+    const auto sink = open_output(opts);
+    exported = out.export_to_sink(*sink, &progress, stop);
+  }
+  if (stop.stop_requested()) return report_cancelled(opts);
+  if (!exported) {
+    std::cerr << "Error: could not write " << opts.output << "\n";
+    return export_failed;
+  }
+  if (!opts.quiet) {
+    std::cerr << "Exported in " << seconds_since(start) << " s\n";
+  }
+
+  return success;
+}
+
+/**
+ * @brief Stabilizes a single video as it's decoded, encoding each frame as
+ * soon as it's warped. Stops at the next frame once a stop is requested.
+ */
+auto run_stream(options const& opts, std::stop_token const& stop) -> int {
+  vid::progress progress;
+
+  const auto start = std::chrono::steady_clock::now();
+  vid::stabilizer stabilizer{opts.stabilizer};
+  stabilizer.set_progress(&progress);
+
+  if (!opts.checkpoint.empty()) {
+    logger::instance()->warn("Checkpoints aren't written when streaming");
+  }
+
+  auto source = open_input(opts);
+  if (!source) {
+    std::cerr << "Error: could not load " << opts.input << "\n";
+    return load_failed;
+  }
+
+  auto stabilized = false;
+  {
+    progress_printer printer{progress, opts.quiet};
+    if (opts.renditions.empty()) {
+      const auto sink = open_output(opts);
+      stabilized = stabilizer.stabilize_stream(*source, *sink, opts.stream,
+                                               stop);
+    } else {
+      vid::rendition_writer writer{all_renditions(opts)};
+      stabilized = stabilizer.stabilize_stream(*source, writer, opts.stream,
+                                               stop);
+    }
+  }
+  if (stop.stop_requested()) return report_cancelled(opts);
+  if (!stabilized) {
+    std::cerr << "Error: could not stabilize " << opts.input << " into "
+              << opts.output << "\n";
+    return stabilize_failed;
+  }
+
+  if (!opts.quiet) {
+    // The pipeline is as fast as its slowest stage, if it's kept busy
+    auto slowest = 0.0;
+    for (auto const& s : stabilizer.stream_stats()) {
+      slowest = std::max(slowest, s.solo_s());
+    }
+    std::cerr << "Stabilized and exported in " << seconds_since(start)
+              << " s (slowest stage " << slowest << " s)\n";
+  }
+
+  return success;
+}
+
+/**
+ * @brief Stabilizes every video in the batch on a shared thread pool, and
+ * writes a report with the result and timing of each one.
+ */
+auto run_batch(options const& opts, sched::thread_pool& pool,
+               std::stop_token const& stop) -> int {
+  std::vector<vid::batch_job> jobs;
+  if (!collect_jobs(opts, jobs)) {
+    std::cerr << "Error: could not read " << opts.batch << "\n";
+    return load_failed;
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(opts.output_dir, error);
+  if (!opts.checkpoint.empty()) {
+    std::filesystem::create_directories(opts.checkpoint, error);
+  }
+
+  if (!opts.quiet) {
+    std::cerr << "Stabilizing " << jobs.size() << " videos on "
+              << pool.size() << " threads, " << opts.jobs
+              << " at a time\n";
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  auto done = 0;
+  const auto results = vid::run_batch(
+      jobs, {opts.stabilizer, opts.jobs, opts.checkpoint, opts.format}, pool,
+      [&](vid::batch_result const& r) {
+        if (opts.quiet) return;
+        std::cerr << "[" << ++done << "/" << jobs.size() << "] "
+                  << r.job.input.string() << ": "
+                  << (r.ok ? "ok" : r.error) << " ("
+                  << r.finished_s - r.started_s << " s)\n";
+      },
+      stop);
+  const auto wall_s = seconds_since(start);
+
+  if (!vid::write_batch_report(results, opts.report_path)) {
+    std::cerr << "Error: could not write report to " << opts.report_path
+              << "\n";
+  }
+
+  // Compare the time the jobs were busy with the wall time of the batch
+  auto job_s = 0.0;
+  auto failed = 0;
+  for (auto const& r : results) {
+    job_s += r.finished_s - r.started_s;
+    if (!r.ok) ++failed;
+  }
+
+  if (!opts.quiet) {
+    std::cerr << "Finished " << results.size() - failed << "/"
+              << results.size() << " videos in " << wall_s << " s ("
+              << job_s / std::max(wall_s, 1e-9)
+              << " videos in flight on average)\n"
+              << "Report written to " << opts.report_path.string() << "\n";
+  }
+
+  if (stop.stop_requested()) return report_cancelled(opts);
+
+  return failed == 0 ? success : batch_failed;
+}
+}  // namespace
+
+auto main(const int argc, char** argv) -> int {
+  options opts;
+  if (!parse_args(argc, argv, opts)) {
+    print_usage();
+    return bad_usage;
+  }
+
+  // Pipeline messages go to stderr, and everything to the log file if any
+  logger_options log_options;
+  log_options.stderr_severity = opts.quiet     ? severity::error
+                                : opts.verbose ? severity::debug
+                                               : severity::warning;
+  log_options.min_severity = opts.verbose || !opts.log_path.empty()
+                                 ? severity::debug
+                                 : log_options.stderr_severity;
+  logger::configure(log_options);
+  if (!opts.log_path.empty()) {
+    const auto file = std::make_shared<file_sink>(opts.log_path);
+    if (!file->is_open()) {
+      std::cerr << "Error: could not open " << opts.log_path << "\n";
+      return bad_usage;
+    }
+    logger::instance()->add_sink(file);
+  }
+
+  if (!opts.trace_path.empty()) prof::profiler::instance()->set_enabled(true);
+
+  // Frame buffers are recycled between frames, stages and videos
+  mem::frame_pool::instance()->install();
+  mem::governor::instance()->set_budget(
+      static_cast<std::size_t>(opts.memory_budget_mb) << 20);
+
+  // Started after the pool is installed, so the pool's frames are counted
+  if (!opts.memory_report.empty()) prof::memory_tracker::instance()->start();
+
+  // Everything runs within the budget of this one pool
+  sched::thread_pool pool{opts.threads};
+
+  std::stop_source stop;
+  int result = success;
+  {
+    interrupt_watcher watcher{stop};
+    if (!opts.batch.empty()) {
+      result = run_batch(opts, pool, stop.get_token());
+    } else if (opts.streaming) {
+      result = run_stream(opts, stop.get_token());
+    } else {
+      result = run_single(opts, pool, stop.get_token());
+    }
+  }
+
+  if (!opts.trace_path.empty()) {
+    std::cerr << prof::profiler::instance()->summary();
+    if (!prof::profiler::instance()->export_trace(opts.trace_path)) {
+      std::cerr << "Error: could not write trace to " << opts.trace_path
+                << "\n";
+    }
+  }
+
+  if (!opts.memory_report.empty()) {
+    auto* const tracker = prof::memory_tracker::instance();
+    tracker->stop();
+    std::cerr << tracker->summary();
+    if (!tracker->export_report(opts.memory_report)) {
+      std::cerr << "Error: could not write memory report to "
+                << opts.memory_report << "\n";
+    }
+  }
+
+  const auto pool_stats = mem::frame_pool::instance()->stats();
+  logger::instance()->debug("Frame pool reused %llu of %llu buffers, peak "
+                            "%zu MB",
+                            static_cast<unsigned long long>(pool_stats.reuses),
+                            static_cast<unsigned long long>(
+                                pool_stats.allocations),
+                            pool_stats.peak_bytes >> 20);
+
+  logger::instance()->flush();
+
+  return result;
+}
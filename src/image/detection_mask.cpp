@@ -0,0 +1,158 @@
+#include "image/detection_mask.h"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <utility>
+
+#include "profiler/profiler.h"
+
+namespace img {
+namespace {
+auto to_grey(cv::Mat const& frame) -> cv::Mat {
+  cv::Mat grey;
+  switch (frame.channels()) {
+    case 1:
+      grey = frame;
+      break;
+    case 4:
+      cv::cvtColor(frame, grey, cv::COLOR_BGRA2GRAY);
+      break;
+    default:
+      cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+      break;
+  }
+
+  return grey;
+}
+
+/**
+ * \brief Returns how many lines, counted in from each end, are bar lines.
+ * <code>coverage</code> holds the mean of the bar mask along each line.
+ */
+auto bar_depth(cv::Mat const& coverage) -> std::pair<int, int> {
+  // Allow a few stray pixels, such as a channel logo overlapping a bar
+  constexpr auto min_coverage = 0.98f * 255.0f;
+
+  const auto n = static_cast<int>(coverage.total());
+  const auto* c = coverage.ptr<float>();
+
+  auto front = 0;
+  while (front < n && c[front] >= min_coverage) ++front;
+  auto back = 0;
+  while (back < n - front && c[n - 1 - back] >= min_coverage) ++back;
+
+  return {front, back};
+}
+}  // namespace
+
+auto build_detection_mask(std::vector<cv::Mat> const& frames,
+                          mask_options const& options) -> detection_mask {
+  prof::scoped_timer timer{"detection_mask"};
+
+  detection_mask result;
+  const auto count = static_cast<int>(frames.size());
+  if (count == 0 || frames[0].empty()) return result;
+
+  const auto size = frames[0].size();
+  result.content = cv::Rect({0, 0}, size);
+
+  // Variance can't be measured from a single frame
+  const auto n = std::min(options.sample_count, count);
+  if (n < 2) return result;
+
+  //---------------------------------------------------- Temporal stats --//
+  cv::Mat sum = cv::Mat::zeros(size, CV_32FC1);
+  cv::Mat sum_sq = cv::Mat::zeros(size, CV_32FC1);
+  for (auto i = 0; i < n; ++i) {
+    auto const& frame = frames[i * (count - 1) / (n - 1)];
+    if (frame.size() != size) return result;
+
+    const auto grey = to_grey(frame);
+    cv::accumulate(grey, sum);
+    cv::accumulateSquare(grey, sum_sq);
+  }
+
+  cv::Mat mean = sum / n;
+  cv::Mat variance = sum_sq / n - mean.mul(mean);
+  cv::Mat stddev;
+  cv::sqrt(cv::max(variance, 0.0), stddev);
+
+  cv::Mat still = stddev < options.static_stddev;
+
+  //-------------------------------------------------------- Letterbox --//
+  cv::Mat bars = still & (mean < options.letterbox_luma);
+
+  cv::Mat row_coverage, col_coverage;
+  cv::reduce(bars, row_coverage, 1, cv::REDUCE_AVG, CV_32F);
+  cv::reduce(bars, col_coverage, 0, cv::REDUCE_AVG, CV_32F);
+  const auto [top, bottom] = bar_depth(row_coverage);
+  const auto [left, right] = bar_depth(col_coverage);
+
+  // A picture that's mostly "bars" is a dark or faded-out video rather than
+  // a letterboxed one
+  const cv::Rect content(left, top, size.width - left - right,
+                         size.height - top - bottom);
+  if (content.width >= size.width / 2 && content.height >= size.height / 2) {
+    result.content = content;
+  }
+
+  //--------------------------------------------------------- Overlays --//
+  // Only textured static pixels produce features, so flat regions are left
+  // alone
+  cv::Mat grad_x, grad_y, gradient;
+  cv::Sobel(mean, grad_x, CV_32F, 1, 0);
+  cv::Sobel(mean, grad_y, CV_32F, 0, 1);
+  cv::magnitude(grad_x, grad_y, gradient);
+
+  cv::Mat overlays = cv::Mat::zeros(size, CV_8UC1);
+  const auto content_area = static_cast<double>(result.content.area());
+  const auto still_fraction =
+      cv::countNonZero(still(result.content)) / content_area;
+  if (still_fraction <= options.max_overlay_fraction) {
+    cv::Mat textured = still & (gradient >= options.overlay_gradient);
+    textured(result.content).copyTo(overlays(result.content));
+
+    // Drop isolated pixels that just happened to hold still, then grow the
+    // overlays to cover their edges
+    cv::morphologyEx(overlays, overlays, cv::MORPH_OPEN,
+                     cv::getStructuringElement(cv::MORPH_RECT, {3, 3}));
+    const auto margin = std::max(options.overlay_margin, 0);
+    cv::dilate(overlays, overlays,
+               cv::getStructuringElement(
+                   cv::MORPH_ELLIPSE, {2 * margin + 1, 2 * margin + 1}));
+
+    result.overlay_fraction =
+        cv::countNonZero(overlays(result.content)) / content_area;
+  }
+
+  //------------------------------------------------------------- Mask --//
+  // Leave the mask empty when there's nothing to mask, so detection doesn't
+  // pay for it
+  if (result.content.area() == size.area() && result.overlay_fraction == 0.0) {
+    return result;
+  }
+
+  result.mask = cv::Mat::zeros(size, CV_8UC1);
+  result.mask(result.content).setTo(255);
+  result.mask.setTo(0, overlays);
+
+  return result;
+}
+
+auto combine_masks(cv::Mat const& automatic, cv::Mat const& user,
+                   const cv::Size frame_size) -> cv::Mat {
+  if (user.empty()) return automatic;
+
+  cv::Mat resized;
+  if (user.size() != frame_size) {
+    cv::resize(user, resized, frame_size, 0.0, 0.0, cv::INTER_NEAREST);
+  } else {
+    resized = user;
+  }
+
+  cv::Mat allowed = to_grey(resized) > 0;
+  if (automatic.empty()) return allowed;
+
+  return automatic & allowed;
+}
+}  // namespace img
@@ -2,25 +2,62 @@
 
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
 #include <opencv2/calib3d.hpp>
+#include <opencv2/core/hal/hal.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "image/warp.h"
+#include "profiler/profiler.h"
+
 namespace img {
+namespace {
+// Fewest of the guided matches that must be inliers of the homography they
+// give for the prediction to be trusted
+constexpr double min_guided_inlier_ratio = 0.5;
+
+/**
+ * \brief Returns the number of random samples of four matches needed to
+ * draw one made only of inliers with the given confidence, when the given
+ * share of the matches are inliers.
+ */
+auto required_iterations(const double inlier_ratio, const double confidence)
+    -> int {
+  if (confidence >= 1.0) return std::numeric_limits<int>::max();
+
+  const auto all_inliers = std::pow(inlier_ratio, 4.0);
+  if (all_inliers >= 1.0) return 0;
+  if (all_inliers <= 0.0) return std::numeric_limits<int>::max();
+
+  const auto n = std::ceil(std::log(1.0 - confidence) /
+                           std::log(1.0 - all_inliers));
+  return n < static_cast<double>(std::numeric_limits<int>::max())
+             ? static_cast<int>(n)
+             : std::numeric_limits<int>::max();
+}
+}  // namespace
+
 const cv::Scalar feature_tracker::match_color{0.0, 255.0, 0.0};
 const cv::Scalar feature_tracker::inlier_color{0.0, 255.0, 0.0};
 const cv::Scalar feature_tracker::outlier_color{0.0, 0.0, 255.0};
 const cv::Scalar feature_tracker::border_color{155.0, 155.0, 155.0};
 
 auto feature_tracker::detect_features() noexcept -> void {
+  prof::scoped_timer timer{"detect"};
+
   // Clear the key points and descriptors
   key_points_1_.clear();
   key_points_2_.clear();
   descriptors_1_ = cv::Mat::zeros(0, 0, CV_32F);
   descriptors_2_ = cv::Mat::zeros(0, 0, CV_32F);
 
-  // Detect the key points in the images
-  sift_->detect(img_1_, key_points_1_);
-  sift_->detect(img_2_, key_points_2_);
+  // Detect the key points in the images, skipping masked out regions such as
+  // letterboxing and overlays
+  sift_->detect(img_1_, key_points_1_, mask_);
+  sift_->detect(img_2_, key_points_2_, mask_);
 
   // Compute the descriptors for the key points
   sift_->compute(img_1_, key_points_1_, descriptors_1_);
@@ -28,9 +65,114 @@ auto feature_tracker::detect_features() noexcept -> void {
 }
 
 auto feature_tracker::match_features() noexcept -> void {
+  prof::scoped_timer timer{"match"};
+
+  guided_ = false;
+  if (options_.guided_matching && !prediction_.empty()) {
+    match_guided_features();
+
+    // Too few matches near the predicted positions means the features moved
+    // further than the prediction allows for
+    const auto min_matches = std::max(options_.min_guided_matches, 4);
+    if (matches_.size() >= static_cast<std::size_t>(min_matches)) {
+      guided_ = true;
+      return;
+    }
+  }
+
   matcher_->match(descriptors_1_, descriptors_2_, matches_);
 }
 
+auto feature_tracker::match_guided_features() noexcept -> void {
+  assert(prediction_.type() == CV_64FC1);
+
+  matches_.clear();
+  if (descriptors_1_.empty() || descriptors_2_.empty()) return;
+
+  // Bucket the features of the second image in a grid of cells as wide as
+  // the search radius, so each search only looks at the cells around it
+  const auto radius = std::max(options_.search_radius, 1.0f);
+  const auto cols = std::max(static_cast<int>(std::ceil(img_2_.cols / radius)),
+                             1);
+  const auto rows = std::max(static_cast<int>(std::ceil(img_2_.rows / radius)),
+                             1);
+  const auto cell_of = [&](cv::Point2f const& pt) {
+    const auto x = std::clamp(static_cast<int>(pt.x / radius), 0, cols - 1);
+    const auto y = std::clamp(static_cast<int>(pt.y / radius), 0, rows - 1);
+    return y * cols + x;
+  };
+
+  grid_starts_.assign(static_cast<std::size_t>(cols * rows) + 1, 0);
+  for (auto const& kp : key_points_2_) ++grid_starts_[cell_of(kp.pt) + 1];
+  for (std::size_t c = 1; c < grid_starts_.size(); ++c)
+    grid_starts_[c] += grid_starts_[c - 1];
+
+  grid_order_.resize(key_points_2_.size());
+  auto next = grid_starts_;
+  for (auto j = 0; j < static_cast<int>(key_points_2_.size()); ++j)
+    grid_order_[next[cell_of(key_points_2_[j].pt)]++] = j;
+
+  // The closest feature of the second image to each feature of the first
+  // within its search radius, and the other way around
+  struct candidate {
+    int index = -1;
+    float distance = std::numeric_limits<float>::max();
+  };
+  std::vector<candidate> best_2(key_points_1_.size());
+  std::vector<candidate> best_1(key_points_2_.size());
+
+  const cv::Matx33d h(prediction_.ptr<double>());
+  const auto length = descriptors_1_.cols;
+  const auto radius_sq = radius * radius;
+  for (auto i = 0; i < static_cast<int>(key_points_1_.size()); ++i) {
+    const auto& p = key_points_1_[i].pt;
+    const auto w = h(2, 0) * p.x + h(2, 1) * p.y + h(2, 2);
+    if (w <= 0.0) continue;
+
+    const cv::Point2f q(
+        static_cast<float>((h(0, 0) * p.x + h(0, 1) * p.y + h(0, 2)) / w),
+        static_cast<float>((h(1, 0) * p.x + h(1, 1) * p.y + h(1, 2)) / w));
+
+    // Predicted out of the picture, where nothing can match it
+    if (!(q.x > -radius && q.y > -radius && q.x < img_2_.cols + radius &&
+          q.y < img_2_.rows + radius)) {
+      continue;
+    }
+
+    const auto x_0 = std::max(static_cast<int>((q.x - radius) / radius), 0);
+    const auto x_1 = std::min(static_cast<int>((q.x + radius) / radius),
+                              cols - 1);
+    const auto y_0 = std::max(static_cast<int>((q.y - radius) / radius), 0);
+    const auto y_1 = std::min(static_cast<int>((q.y + radius) / radius),
+                              rows - 1);
+
+    const auto* const d_1 = descriptors_1_.ptr<float>(i);
+    for (auto y = y_0; y <= y_1; ++y) {
+      for (auto x = x_0; x <= x_1; ++x) {
+        const auto cell = y * cols + x;
+        for (auto k = grid_starts_[cell]; k < grid_starts_[cell + 1]; ++k) {
+          const auto j = grid_order_[k];
+          const auto offset = key_points_2_[j].pt - q;
+          if (offset.dot(offset) > radius_sq) continue;
+
+          const auto distance = cv::hal::normL2Sqr_(
+              d_1, descriptors_2_.ptr<float>(j), length);
+          if (distance < best_2[i].distance) best_2[i] = {j, distance};
+          if (distance < best_1[j].distance) best_1[j] = {i, distance};
+        }
+      }
+    }
+  }
+
+  // Cross-checked, like the matcher used without a prediction
+  for (auto i = 0; i < static_cast<int>(best_2.size()); ++i) {
+    const auto j = best_2[i].index;
+    if (j >= 0 && best_1[j].index == i) {
+      matches_.emplace_back(i, j, std::sqrt(best_2[i].distance));
+    }
+  }
+}
+
 auto feature_tracker::track() noexcept -> void {
   // Don't do anything if the images are empty.
   if (img_1_.empty() || img_2_.empty()) return;
@@ -43,6 +185,22 @@ auto feature_tracker::track() noexcept -> void {
 
   // Compute the best homography matrix
   find_best_homography();
+
+  // A wrong prediction still finds matches near where it pointed, but few of
+  // them agree on a homography, so every feature is matched instead
+  if (guided_ && static_cast<double>(inlier_count_) <
+                     min_guided_inlier_ratio *
+                         static_cast<double>(matches_.size())) {
+    const auto iterations = ransac_iterations_;
+    reset_prediction();
+    match_features();
+    find_best_homography();
+    ransac_iterations_ += iterations;
+  }
+
+  // The next pair is expected to move as this one did
+  previous_prediction_ = prediction_;
+  prediction_ = h_mat_;
 }
 
 auto feature_tracker::contains_match(std::vector<cv::DMatch> const& matches,
@@ -59,13 +217,50 @@ auto feature_tracker::contains_match(std::vector<cv::DMatch> const& matches,
 }
 
 auto feature_tracker::find_best_homography() noexcept -> void {
-  // Estimate hessian matrix for random points
+  prof::scoped_timer timer{"ransac"};
+
+  h_mat_ = cv::Mat{};
+  inlier_count_ = 0;
+  ransac_iterations_ = 0;
+
+  // Four matches are needed for a homography
+  constexpr auto num_matches = 4;
+  if (matches_.size() < num_matches) return;
+
+  // Keeps the hypothesis if it has more inliers than the best one so far, and
+  // lowers the number of iterations to what's needed to be confident no
+  // better one is left to find
   std::vector<cv::DMatch> best_inliers;
+  std::vector<cv::DMatch> inliers;
+  auto iterations = options_.ransac_iterations;
+  const auto score = [&](cv::Mat const& h_mat) {
+    ++ransac_iterations_;
+    find_inliers(h_mat, inliers);
+    if (inliers.size() <= best_inliers.size()) return;
+
+    h_mat_ = h_mat;
+    std::swap(best_inliers, inliers);
+    iterations = std::min(
+        iterations,
+        required_iterations(static_cast<double>(best_inliers.size()) /
+                                static_cast<double>(matches_.size()),
+                            options_.ransac_confidence));
+  };
+
+  // The previous pair's homography, and the same motion again on top of it,
+  // usually describe this pair's well enough to end the search early
+  if (!prediction_.empty()) {
+    score(prediction_);
+    if (!previous_prediction_.empty()) {
+      score(cv::Mat(prediction_ * previous_prediction_.inv() * prediction_));
+    }
+  }
+
+  // Estimate hessian matrix for random points
   cv::RNG rng;
-  for (auto i = 0; i < 1000; ++i) {
+  for (auto i = 0; i < iterations; ++i) {
     // Select four random pairs of matches
     std::vector<cv::DMatch> random_matches;
-    constexpr auto num_matches = 4;
     for (auto j = 0; j < num_matches; ++j) {
       const int random_idx = rng.uniform(0, static_cast<int>(matches_.size()));
       const auto& random_match = matches_[random_idx];
@@ -77,44 +272,50 @@ auto feature_tracker::find_best_homography() noexcept -> void {
       }
     }
 
-    // Extract source and destination points from the matches
-    std::vector<cv::Point2f> src_pts;
-    std::vector<cv::Point2f> dst_pts;
-    for (const auto& m : random_matches) {
-      src_pts.push_back(key_points_1_[m.queryIdx].pt);
-      dst_pts.push_back(key_points_2_[m.trainIdx].pt);
-    }
-
     // Find the homography matrix for the pairs
-    auto h_mat = cv::findHomography(src_pts, dst_pts);
-
-    // Compute inlier pairs amongst all pairs, where the mapping error of the
-    // transformed point q with the target position p is less than some epsilon
-    // |p_i - H * q_i| < epsilon
-    std::vector<cv::DMatch> inliers;
-    for (const auto& m : matches_) {
-      // If the error is less than epsilon, add the match to the inliers
-      if (calc_error(h_mat, m) < epsilon) inliers.push_back(m);
-    }
+    score(fit_homography(random_matches));
+  }
 
-    // If the number of inlier pairs is greater than the previous iteration's,
-    // save the homography transform and the list of best inliers
-    if (inliers.size() > best_inliers.size()) {
-      h_mat_ = h_mat;
-      best_inliers = inliers;
-    }
+  // Compute the final homography on the best matches, and once more on the
+  // inliers of that one if it has more
+  if (best_inliers.size() < num_matches) return;
+  h_mat_ = fit_homography(best_inliers);
+  find_inliers(h_mat_, inliers);
+  if (inliers.size() > best_inliers.size()) {
+    std::swap(best_inliers, inliers);
+    h_mat_ = fit_homography(best_inliers);
+  }
+  inlier_count_ = best_inliers.size();
+}
+
+auto feature_tracker::find_inliers(cv::Mat const& h_mat,
+                                   std::vector<cv::DMatch>& inliers) const
+    noexcept -> void {
+  inliers.clear();
+  if (h_mat.empty()) return;
+
+  // Compute inlier pairs amongst all pairs, where the mapping error of the
+  // transformed point q with the target position p is less than some epsilon
+  // |p_i - H * q_i| < epsilon
+  for (const auto& m : matches_) {
+    // If the error is less than epsilon, add the match to the inliers
+    if (calc_error(h_mat, m) < options_.ransac_epsilon) inliers.push_back(m);
   }
+}
 
-  // Compute the final homography on the best matches
+auto feature_tracker::fit_homography(std::vector<cv::DMatch> const& matches)
+    const -> cv::Mat {
+  // Extract source and destination points from the matches
   std::vector<cv::Point2f> src_pts;
   std::vector<cv::Point2f> dst_pts;
-  for (const auto& m : best_inliers) {
+  for (const auto& m : matches) {
     src_pts.push_back(key_points_1_[m.queryIdx].pt);
     dst_pts.push_back(key_points_2_[m.trainIdx].pt);
   }
 
-  // Set the homography matrix to the best homography matrix
-  h_mat_ = cv::findHomography(src_pts, dst_pts);
+  // A least-squares fit, refined with Levenberg-Marquardt for more than four
+  // points. Empty if the points are degenerate.
+  return cv::findHomography(src_pts, dst_pts);
 }
 
 auto feature_tracker::calc_error(const cv::Mat& h_mat,
@@ -129,7 +330,7 @@ auto feature_tracker::calc_error(const cv::Mat& h_mat,
 
   // Compute the error between the transformed point and the target point,
   // i.e. the distance between them
-  return static_cast<float>(cv::norm(cv::Mat(q_prime), cv::Mat(q)));
+  return static_cast<float>(cv::norm(q_prime - q));
 }
 
 auto feature_tracker::h_transform(cv::Mat const& h,
@@ -137,14 +338,22 @@ auto feature_tracker::h_transform(cv::Mat const& h,
     -> cv::Point2f {
   assert(h.type() == CV_64FC1);
 
-  const auto p = cv::Vec3d(point.x, point.y, 1.0);
-  const auto q = cv::Mat(h * cv::Mat(p));
+  // Read in place, since this runs for every match of every hypothesis
+  const auto* const m = h.ptr<double>();
+  const auto x = m[0] * point.x + m[1] * point.y + m[2];
+  const auto y = m[3] * point.x + m[4] * point.y + m[5];
+  const auto w = m[6] * point.x + m[7] * point.y + m[8];
+  if (w == 0.0) {
+    return {std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max()};
+  }
 
-  return {static_cast<float>(q.at<double>(0, 0)),
-          static_cast<float>(q.at<double>(1, 0))};
+  return {static_cast<float>(x / w), static_cast<float>(y / w)};
 }
 
 auto feature_tracker::warp_image() const noexcept -> cv::Mat {
+  prof::scoped_timer timer{"warp_image"};
+
   cv::Mat img_1_border;
   cv::copyMakeBorder(img_1_, img_1_border, border_size, border_size,
                      border_size, border_size, cv::BORDER_CONSTANT,
@@ -155,10 +364,8 @@ auto feature_tracker::warp_image() const noexcept -> cv::Mat {
                      border_size, border_size, cv::BORDER_CONSTANT,
                      border_color);
 
-  cv::Mat warped_img = img_2_border.clone();
-
-  cv::warpPerspective(img_1_border, warped_img, h_mat_, warped_img.size(), 1,
-                      cv::BORDER_CONSTANT, border_color);
+  cv::Mat warped_img;
+  warp_perspective(img_1_border, warped_img, h_mat_, {}, border_color);
 
   const cv::Vec3b color{static_cast<uchar>(border_color[0]),
                         static_cast<uchar>(border_color[1]),
@@ -0,0 +1,118 @@
+#include "image/homography.h"
+
+#include <cmath>
+
+namespace img {
+namespace {
+const cv::Matx33d identity = cv::Matx33d::eye();
+
+auto is_finite(cv::Matx33d const& m) -> bool {
+  for (const auto v : m.val) {
+    if (!std::isfinite(v)) return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Returns the principal square root of the matrix, using the
+ * Denman-Beavers iteration.
+ */
+auto square_root(cv::Matx33d const& a, bool& ok) -> cv::Matx33d {
+  auto y = a;
+  auto z = identity;
+  for (auto i = 0; i < 64; ++i) {
+    if (std::abs(cv::determinant(y)) < 1e-12 ||
+        std::abs(cv::determinant(z)) < 1e-12) {
+      ok = false;
+      return y;
+    }
+
+    const cv::Matx33d y_next = 0.5 * (y + z.inv());
+    const cv::Matx33d z_next = 0.5 * (z + y.inv());
+    const auto step = cv::norm(y_next - y);
+    y = y_next;
+    z = z_next;
+    if (step <= 1e-13 * cv::norm(y)) return y;
+  }
+
+  ok = is_finite(y);
+  return y;
+}
+}  // namespace
+
+auto homography_log(cv::Matx33d const& h, bool* ok) -> cv::Matx33d {
+  auto success = true;
+  const auto det = cv::determinant(h);
+  if (det <= 0.0 || !is_finite(h)) {
+    if (ok) *ok = false;
+    return {};
+  }
+
+  // Take square roots until the series for log(I + X) converges quickly,
+  // then undo them: log(A) = 2^k log(A^(1/2^k))
+  auto a = h * (1.0 / std::cbrt(det));
+  auto k = 0;
+  while (cv::norm(a - identity) > 0.25 && k < 20 && success) {
+    a = square_root(a, success);
+    ++k;
+  }
+
+  const auto x = a - identity;
+  cv::Matx33d term = x;
+  cv::Matx33d series;
+  for (auto n = 1; n <= 18; ++n) {
+    series += term * ((n % 2 == 1 ? 1.0 : -1.0) / n);
+    term = term * x;
+  }
+  series *= std::ldexp(1.0, k);
+
+  success = success && is_finite(series);
+  if (ok) *ok = success;
+
+  return series;
+}
+
+auto homography_exp(cv::Matx33d const& l) -> cv::Matx33d {
+  // Scale down until the Taylor series converges quickly, then square back
+  // up: exp(L) = exp(L / 2^s)^(2^s)
+  const auto norm = cv::norm(l);
+  const auto s =
+      norm > 0.5 ? static_cast<int>(std::ceil(std::log2(norm))) + 1 : 0;
+  const auto x = l * std::ldexp(1.0, -s);
+
+  auto series = identity;
+  auto term = identity;
+  for (auto n = 1; n <= 14; ++n) {
+    term = term * x * (1.0 / n);
+    series += term;
+  }
+  for (auto i = 0; i < s; ++i) series = series * series;
+
+  return series;
+}
+
+auto interpolate_homography(cv::Mat const& h, const double t) -> cv::Mat {
+  cv::Mat h_64;
+  h.convertTo(h_64, CV_64FC1);
+  auto m = cv::Matx33d(h_64.ptr<double>());
+  m *= 1.0 / m(2, 2);
+
+  auto ok = false;
+  const auto l = homography_log(m, &ok);
+  auto result = ok ? homography_exp(l * t) : identity;
+
+  // Blend entry by entry if the motion is too far from the identity for the
+  // logarithm, which is still a fair approximation for small steps
+  if (!ok || !is_finite(result)) result = identity + (m - identity) * t;
+  result *= 1.0 / result(2, 2);
+
+  return cv::Mat(result, true);
+}
+
+auto homography_root(cv::Mat const& h, const int n) -> cv::Mat {
+  if (n <= 1) return h.clone();
+
+  return interpolate_homography(h, 1.0 / n);
+}
+}  // namespace img
@@ -0,0 +1,141 @@
+#include "image/keyframes.h"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+#include "profiler/profiler.h"
+
+namespace img {
+auto keyframe_selector::start(const int index, cv::Mat const& frame) -> void {
+  key_proxy_ = make_proxy(frame);
+  last_proxy_ = key_proxy_;
+  last_index_ = index;
+  path_.assign(1, tile_points{});
+
+  if (keyframes_.empty() || keyframes_.back() != index) {
+    keyframes_.push_back(index);
+  }
+}
+
+auto keyframe_selector::add(const int index, cv::Mat const& frame) -> void {
+  prof::scoped_timer timer{"probe"};
+
+  auto proxy = make_proxy(frame);
+
+  // Motion of each tile from the previous frame, scaled back up to full
+  // resolution
+  auto response = 1.0;
+  auto position = path_.back();
+  for (auto t = 0; t < tile_count; ++t) {
+    auto tile_response = 0.0;
+    const auto shift = cv::phaseCorrelate(tile(last_proxy_, t), tile(proxy, t),
+                                          tile_window_, &tile_response);
+    position[t] += shift * scale_;
+    response = std::min(response, tile_response);
+  }
+  path_.push_back(position);
+
+  // Consecutive frames are always tracked directly, so there's nothing to
+  // decide until a frame could be interpolated
+  const auto gap = static_cast<int>(path_.size()) - 1;
+  if (gap >= 2) {
+    // Comparing with the keyframe catches changes that build up too slowly
+    // to show between consecutive frames
+    auto key_response = 0.0;
+    cv::phaseCorrelate(key_proxy_, proxy, frame_window_, &key_response);
+
+    const auto interpolate = gap <= options_.max_gap &&
+                             response >= options_.min_response &&
+                             key_response >= options_.min_response &&
+                             is_linear();
+    if (!interpolate) {
+      // End the run at the previous frame, so this one starts the next
+      keyframes_.push_back(last_index_);
+      key_proxy_ = last_proxy_;
+
+      tile_points step;
+      for (auto t = 0; t < tile_count; ++t) {
+        step[t] = path_[gap][t] - path_[gap - 1][t];
+      }
+      path_ = {tile_points{}, step};
+    }
+  }
+
+  last_proxy_ = std::move(proxy);
+  last_index_ = index;
+}
+
+auto keyframe_selector::finish() -> void {
+  if (last_index_ >= 0 &&
+      (keyframes_.empty() || keyframes_.back() != last_index_)) {
+    keyframes_.push_back(last_index_);
+  }
+
+  key_proxy_.release();
+  last_proxy_.release();
+  path_.clear();
+  last_index_ = -1;
+}
+
+auto keyframe_selector::tile(cv::Mat const& proxy, const int t) -> cv::Mat {
+  const auto width = proxy.cols / 2;
+  const auto height = proxy.rows / 2;
+
+  return proxy(cv::Rect(t % 2 * width, t / 2 * height, width, height));
+}
+
+auto keyframe_selector::make_proxy(cv::Mat const& frame) -> cv::Mat {
+  cv::Mat grey;
+  switch (frame.channels()) {
+    case 1:
+      grey = frame;
+      break;
+    case 4:
+      cv::cvtColor(frame, grey, cv::COLOR_BGRA2GRAY);
+      break;
+    default:
+      cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+      break;
+  }
+
+  // Area interpolation averages away noise that would blur the correlation
+  // peak
+  cv::Mat small;
+  if (grey.cols > options_.probe_width && options_.probe_width > 0) {
+    scale_ = static_cast<double>(grey.cols) / options_.probe_width;
+    cv::resize(grey, small, cv::Size(), 1.0 / scale_, 1.0 / scale_,
+               cv::INTER_AREA);
+  } else {
+    scale_ = 1.0;
+    small = grey;
+  }
+
+  cv::Mat proxy;
+  small.convertTo(proxy, CV_32F);
+
+  if (frame_window_.size() != proxy.size()) {
+    cv::createHanningWindow(frame_window_, proxy.size(), CV_32F);
+    cv::createHanningWindow(tile_window_,
+                            cv::Size(proxy.cols / 2, proxy.rows / 2), CV_32F);
+  }
+
+  return proxy;
+}
+
+auto keyframe_selector::is_linear() const noexcept -> bool {
+  const auto gap = static_cast<int>(path_.size()) - 1;
+  auto const& end = path_.back();
+
+  for (auto i = 1; i < gap; ++i) {
+    const auto fraction = static_cast<double>(i) / gap;
+    for (auto t = 0; t < tile_count; ++t) {
+      const auto expected = end[t] * fraction;
+      if (cv::norm(path_[i][t] - expected) > options_.max_deviation) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+}  // namespace img
@@ -0,0 +1,252 @@
+#include "image/phase_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <opencv2/imgproc.hpp>
+
+#include "profiler/profiler.h"
+
+namespace img {
+namespace {
+/**
+ * \brief Swaps the quadrants of the spectrum, so the zero frequency is at
+ * the centre.
+ */
+auto shift_spectrum(cv::Mat& spectrum) -> void {
+  const auto cx = spectrum.cols / 2;
+  const auto cy = spectrum.rows / 2;
+  cv::Mat q0(spectrum, cv::Rect(0, 0, cx, cy));
+  cv::Mat q1(spectrum, cv::Rect(cx, 0, cx, cy));
+  cv::Mat q2(spectrum, cv::Rect(0, cy, cx, cy));
+  cv::Mat q3(spectrum, cv::Rect(cx, cy, cx, cy));
+
+  cv::Mat tmp;
+  q0.copyTo(tmp);
+  q3.copyTo(q0);
+  tmp.copyTo(q3);
+  q1.copyTo(tmp);
+  q2.copyTo(q1);
+  tmp.copyTo(q2);
+}
+}  // namespace
+
+auto phase_tracker::set_mask(cv::Mat const& mask) -> void {
+  cache_ = {};
+  proxy_size_ = {};
+  roi_ = {};
+  roi_mask_.release();
+  if (mask.empty()) return;
+
+  // An empty bounding box means everything is masked, which leaves nothing
+  // better to correlate than the whole frame
+  roi_ = cv::boundingRect(mask);
+  if (roi_.empty()) return;
+
+  if (cv::countNonZero(mask(roi_)) < roi_.area()) roi_mask_ = mask(roi_);
+}
+
+auto phase_tracker::track() noexcept -> void {
+  h_mat_.release();
+  response_ = 0.0;
+
+  // Don't do anything if the images are empty or don't match
+  if (img_1_.empty() || img_2_.empty() || img_1_.size() != img_2_.size()) {
+    return;
+  }
+
+  prof::scoped_timer timer{"phase_correlate"};
+
+  auto const& frame_1 = prepare(img_1_);
+  auto const& frame_2 = prepare(img_2_);
+
+  // Motion in proxy coordinates, mapping points of the first frame to the
+  // second
+  auto motion = cv::Matx33d::eye();
+  auto response = 1.0;
+  cv::Mat proxy_1 = frame_1.proxy;
+
+  //---------------------------------------------------- Rotation, scale --//
+  if (options_.rotation_scale) {
+    auto polar_response = 0.0;
+    const auto shift = cv::phaseCorrelate(
+        frame_1.log_polar, frame_2.log_polar, cv::noArray(), &polar_response);
+
+    // Columns are log-radius, rows are angle. The magnitude spectrum of a
+    // real image is symmetric, so the angle is only known up to half a
+    // turn, and the smaller one is the likelier.
+    const auto radius = square_window_.rows / 2.0;
+    const auto scale =
+        std::exp(-shift.x * std::log(radius) / frame_1.log_polar.cols);
+    auto angle = -shift.y * 360.0 / frame_1.log_polar.rows;
+    angle -= 180.0 * std::round(angle / 180.0);
+
+    // Undo the rotation and scale, so only the translation is left to find.
+    // Without a confident peak, assume there was none.
+    if (polar_response >= options_.min_response) {
+      const cv::Point2f centre((proxy_1.cols - 1) * 0.5f,
+                               (proxy_1.rows - 1) * 0.5f);
+      const cv::Matx23d similarity =
+          cv::getRotationMatrix2D(centre, angle, scale);
+
+      // Into a new matrix, since the proxy is still cached
+      cv::Mat rotated;
+      cv::warpAffine(frame_1.proxy, rotated, similarity, proxy_1.size());
+      proxy_1 = rotated;
+
+      for (auto r = 0; r < 2; ++r) {
+        for (auto c = 0; c < 3; ++c) motion(r, c) = similarity(r, c);
+      }
+      response = polar_response;
+    }
+  }
+
+  //--------------------------------------------------------- Translation --//
+  auto shift_response = 0.0;
+  const auto shift =
+      cv::phaseCorrelate(proxy_1, frame_2.proxy, window_, &shift_response);
+  motion(0, 2) += shift.x;
+  motion(1, 2) += shift.y;
+
+  response_ = std::min(response, shift_response);
+  if (response_ < options_.min_response) return;
+
+  // Express the motion in full-resolution coordinates. Pixel centres line
+  // up after area downscaling, rather than pixel corners.
+  const auto offset_x = (0.5 - roi_.x) / scale_ - 0.5;
+  const auto offset_y = (0.5 - roi_.y) / scale_ - 0.5;
+  const cv::Matx33d to_proxy(1.0 / scale_, 0.0, offset_x,
+                             0.0, 1.0 / scale_, offset_y,
+                             0.0, 0.0, 1.0);
+  const cv::Matx33d h = to_proxy.inv() * motion * to_proxy;
+
+  h_mat_ = cv::Mat(h, true);
+}
+
+auto phase_tracker::prepare(cv::Mat const& frame) -> prepared const& {
+  for (auto i = 0u; i < cache_.size(); ++i) {
+    const auto& cached = cache_[i].frame;
+    if (cached.data == frame.data && cached.size == frame.size &&
+        cached.type() == frame.type() && !cache_[i].proxy.empty()) {
+      // Keep it until another frame has been prepared
+      cache_next_ = 1 - i;
+      return cache_[i];
+    }
+  }
+
+  auto& entry = cache_[cache_next_];
+  cache_next_ = 1 - cache_next_;
+
+  entry.frame = frame;
+  entry.proxy = make_proxy(frame);
+  entry.log_polar =
+      options_.rotation_scale ? make_log_polar(entry.proxy) : cv::Mat{};
+
+  return entry;
+}
+
+auto phase_tracker::make_proxy(cv::Mat const& frame) -> cv::Mat {
+  const cv::Rect whole({0, 0}, frame.size());
+  const auto region = roi_.empty() ? whole : roi_ & whole;
+
+  cv::Mat grey;
+  switch (frame.channels()) {
+    case 1:
+      grey = frame(region);
+      break;
+    case 4:
+      cv::cvtColor(frame(region), grey, cv::COLOR_BGRA2GRAY);
+      break;
+    default:
+      cv::cvtColor(frame(region), grey, cv::COLOR_BGR2GRAY);
+      break;
+  }
+
+  // Area interpolation averages away noise that would blur the correlation
+  // peak
+  cv::Mat small;
+  if (grey.cols > options_.width && options_.width > 0) {
+    scale_ = static_cast<double>(grey.cols) / options_.width;
+    cv::resize(grey, small, cv::Size(), 1.0 / scale_, 1.0 / scale_,
+               cv::INTER_AREA);
+  } else {
+    scale_ = 1.0;
+    small = grey;
+  }
+
+  cv::Mat proxy;
+  small.convertTo(proxy, CV_32F);
+
+  if (proxy.size() != proxy_size_) resize_windows(proxy.size());
+
+  // Flatten masked out regions, so their edges are all that's left of them
+  if (!fill_mask_.empty()) {
+    const auto mean = cv::mean(proxy, ~fill_mask_);
+    proxy.setTo(mean, fill_mask_);
+  }
+
+  return proxy;
+}
+
+auto phase_tracker::make_log_polar(cv::Mat const& proxy) const -> cv::Mat {
+  const auto n = square_window_.rows;
+  const cv::Rect square((proxy.cols - n) / 2, (proxy.rows - n) / 2, n, n);
+
+  cv::Mat spectrum;
+  cv::dft(proxy(square).mul(square_window_), spectrum,
+          cv::DFT_COMPLEX_OUTPUT);
+
+  cv::Mat planes[2];
+  cv::split(spectrum, planes);
+  cv::Mat magnitude;
+  cv::magnitude(planes[0], planes[1], magnitude);
+  shift_spectrum(magnitude);
+
+  // Low frequencies dominate the spectrum but carry little of its angle
+  magnitude = magnitude.mul(high_pass_);
+  cv::log(magnitude + 1.0, magnitude);
+
+  // Rotation becomes a shift along the rows and scale a shift along the
+  // columns. Sampling finer than the spectrum keeps small proxies from
+  // biasing the scale.
+  cv::Mat log_polar;
+  const auto radius = n / 2.0;
+  cv::warpPolar(magnitude, log_polar, cv::Size(2 * n, 4 * n),
+                cv::Point2f(static_cast<float>(radius),
+                            static_cast<float>(radius)),
+                radius, cv::INTER_LINEAR | cv::WARP_POLAR_LOG);
+
+  return log_polar;
+}
+
+auto phase_tracker::resize_windows(const cv::Size size) -> void {
+  proxy_size_ = size;
+  cv::createHanningWindow(window_, size, CV_32F);
+
+  if (roi_mask_.empty()) {
+    fill_mask_.release();
+  } else {
+    cv::Mat coverage;
+    cv::resize(roi_mask_, coverage, size, 0.0, 0.0, cv::INTER_AREA);
+    fill_mask_ = coverage < 128;
+  }
+
+  if (!options_.rotation_scale) return;
+
+  // The spectrum's quadrants are swapped around its centre, so it needs an
+  // even size
+  const auto n = std::min(size.width, size.height) / 2 * 2;
+  cv::createHanningWindow(square_window_, cv::Size(n, n), CV_32F);
+
+  high_pass_.create(n, n, CV_32F);
+  for (auto y = 0; y < n; ++y) {
+    auto* row = high_pass_.ptr<float>(y);
+    const auto fy = std::cos(std::numbers::pi * (y - n / 2) / n);
+    for (auto x = 0; x < n; ++x) {
+      const auto fx = std::cos(std::numbers::pi * (x - n / 2) / n);
+      const auto c = fx * fy;
+      row[x] = static_cast<float>((1.0 - c) * (2.0 - c));
+    }
+  }
+}
+}  // namespace img
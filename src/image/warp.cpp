@@ -0,0 +1,172 @@
+#include "image/warp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "warp_kernels.h"
+
+namespace img {
+namespace {
+enum class warp_kind : std::uint8_t { translation, affine, perspective };
+
+// Largest distance, in pixels, between where a homography maps a point and
+// where a cheaper kernel would, for that kernel to be used instead
+constexpr double kind_tolerance = 1.0 / 64.0;
+
+// Translations beyond this are left to the affine kernel, so pixel positions
+// can be added to the fixed-point offset without overflowing
+constexpr double max_translation = 1 << 20;
+
+auto supported(const warp_isa isa) noexcept -> bool {
+  switch (isa) {
+    case warp_isa::scalar:
+      return true;
+    case warp_isa::sse4:
+      return cv::checkHardwareSupport(CV_CPU_SSE4_1);
+    case warp_isa::avx2:
+      return cv::checkHardwareSupport(CV_CPU_AVX2);
+    case warp_isa::avx512:
+      return cv::checkHardwareSupport(CV_CPU_AVX_512F) &&
+             cv::checkHardwareSupport(CV_CPU_AVX_512BW);
+  }
+
+  return false;
+}
+
+auto kernels_for(const warp_isa isa) noexcept -> detail::warp_kernels {
+  switch (isa) {
+    case warp_isa::sse4:
+      return detail::sse4_kernels();
+    case warp_isa::avx2:
+      return detail::avx2_kernels();
+    case warp_isa::avx512:
+      return detail::avx512_kernels();
+    case warp_isa::scalar:
+      break;
+  }
+
+  return detail::scalar_kernels();
+}
+
+/**
+ * \brief Returns the cheapest kind of kernel that reproduces the map, from
+ * output to source pixels, over a region of the given size. The error of
+ * each kind is measured at the corners of the region.
+ */
+auto classify(cv::Matx33d const& m, const cv::Size size) noexcept
+    -> warp_kind {
+  auto affine_error = 0.0;
+  auto translation_error = 0.0;
+  for (const auto x : {0.0, size.width - 1.0}) {
+    for (const auto y : {0.0, size.height - 1.0}) {
+      const auto w = m(2, 0) * x + m(2, 1) * y + m(2, 2);
+      if (w <= 0.0) return warp_kind::perspective;
+
+      const auto ax = m(0, 0) * x + m(0, 1) * y + m(0, 2);
+      const auto ay = m(1, 0) * x + m(1, 1) * y + m(1, 2);
+      const auto px = ax / w;
+      const auto py = ay / w;
+      affine_error = std::max(affine_error, std::hypot(px - ax, py - ay));
+      translation_error =
+          std::max(translation_error,
+                   std::hypot(px - (x + m(0, 2)), py - (y + m(1, 2))));
+    }
+  }
+
+  if (translation_error <= kind_tolerance &&
+      std::abs(m(0, 2)) < max_translation &&
+      std::abs(m(1, 2)) < max_translation) {
+    return warp_kind::translation;
+  }
+
+  return affine_error <= kind_tolerance ? warp_kind::affine
+                                        : warp_kind::perspective;
+}
+}  // namespace
+
+auto best_warp_isa() noexcept -> warp_isa {
+  static const auto best = [] {
+    for (const auto isa : {warp_isa::avx512, warp_isa::avx2, warp_isa::sse4}) {
+      if (supported(isa)) return isa;
+    }
+    return warp_isa::scalar;
+  }();
+
+  return best;
+}
+
+auto warp_isa_name(const warp_isa isa) noexcept -> std::string_view {
+  switch (isa) {
+    case warp_isa::scalar:
+      return "scalar";
+    case warp_isa::sse4:
+      return "SSE4.1";
+    case warp_isa::avx2:
+      return "AVX2";
+    case warp_isa::avx512:
+      return "AVX-512";
+  }
+
+  return "unknown";
+}
+
+auto warp_perspective(cv::Mat const& src, cv::Mat& dst, cv::Mat const& h,
+                      cv::Rect region, cv::Scalar const& border,
+                      const warp_isa isa) -> void {
+  CV_Assert(h.rows == 3 && h.cols == 3 && h.channels() == 1);
+  if (region.empty()) region = cv::Rect({0, 0}, src.size());
+
+  // Map from pixels of the region back to pixels of the source
+  cv::Mat h_64;
+  h.convertTo(h_64, CV_64FC1);
+  const cv::Matx33d offset(1.0, 0.0, region.x, 0.0, 1.0, region.y, 0.0, 0.0,
+                           1.0);
+  auto m = cv::Matx33d(h_64.ptr<double>()).inv() * offset;
+
+  if (src.empty() || src.type() != CV_8UC3 || m(2, 2) == 0.0) {
+    cv::warpPerspective(src, dst, m, region.size(),
+                        cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                        cv::BORDER_CONSTANT, border);
+    return;
+  }
+  m *= 1.0 / m(2, 2);
+
+  // The kernels can't work in place
+  cv::Mat out = dst.data == src.data ? cv::Mat{} : dst;
+  out.create(region.size(), CV_8UC3);
+
+  detail::warp_job job;
+  job.src = src.data;
+  job.src_step = static_cast<std::ptrdiff_t>(src.step);
+  job.src_cols = src.cols;
+  job.src_rows = src.rows;
+  job.dst = out.data;
+  job.dst_step = static_cast<std::ptrdiff_t>(out.step);
+  job.dst_cols = out.cols;
+  job.dst_rows = out.rows;
+  std::copy(std::begin(m.val), std::end(m.val), std::begin(job.map));
+  for (auto c = 0; c < 3; ++c) {
+    job.border[c] = cv::saturate_cast<std::uint8_t>(border[c]);
+  }
+
+  const auto kernels = kernels_for(std::min(isa, best_warp_isa()));
+  switch (classify(m, region.size())) {
+    case warp_kind::translation:
+      kernels.translation(job);
+      break;
+    case warp_kind::affine:
+      job.map[6] = 0.0;
+      job.map[7] = 0.0;
+      job.map[8] = 1.0;
+      kernels.affine(job);
+      break;
+    case warp_kind::perspective:
+      kernels.perspective(job);
+      break;
+  }
+
+  dst = out;
+}
+}  // namespace img
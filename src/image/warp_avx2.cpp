@@ -0,0 +1,176 @@
+#include <immintrin.h>
+
+#include "warp_kernels.h"
+
+namespace img::detail {
+namespace {
+/**
+ * \brief <code>blend()</code> on sixteen 16-bit values at once.
+ */
+inline auto blend_lanes(const __m256i p00, const __m256i p01,
+                        const __m256i p10, const __m256i p11,
+                        const __m256i fx, const __m256i fy) noexcept
+    -> __m256i {
+  const auto h0 = _mm256_add_epi16(
+      _mm256_slli_epi16(p00, sub_bits),
+      _mm256_mullo_epi16(_mm256_sub_epi16(p01, p00), fx));
+  const auto h1 = _mm256_add_epi16(
+      _mm256_slli_epi16(p10, sub_bits),
+      _mm256_mullo_epi16(_mm256_sub_epi16(p11, p10), fx));
+  const auto v = _mm256_add_epi16(
+      h0, _mm256_mulhrs_epi16(_mm256_sub_epi16(h1, h0),
+                              _mm256_slli_epi16(fy, 10)));
+
+  return _mm256_srli_epi16(
+      _mm256_add_epi16(v, _mm256_set1_epi16(sub_size / 2)), sub_bits);
+}
+
+/**
+ * \brief Packs two vectors of 16-bit values to bytes, in order. The pack
+ * works within each 128-bit half, so the halves are put back in order after.
+ */
+inline auto pack(const __m256i lo, const __m256i hi) noexcept -> __m256i {
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+inline auto low(const __m256i v) noexcept -> __m256i {
+  return _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+}
+
+inline auto high(const __m256i v) noexcept -> __m256i {
+  return _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+}
+
+auto blend_bytes(const std::uint8_t* a, const std::uint8_t* b,
+                 std::uint8_t* out, const int count, const int fx,
+                 const int fy) noexcept -> void {
+  const auto wx = _mm256_set1_epi16(static_cast<short>(fx));
+  const auto wy = _mm256_set1_epi16(static_cast<short>(fy));
+
+  const auto load = [](const std::uint8_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  };
+
+  auto k = 0;
+  for (; k + 32 <= count; k += 32) {
+    const auto a0 = load(a + k);
+    const auto a1 = load(a + k + 3);
+    const auto b0 = load(b + k);
+    const auto b1 = load(b + k + 3);
+
+    const auto lo = blend_lanes(low(a0), low(a1), low(b0), low(b1), wx, wy);
+    const auto hi =
+        blend_lanes(high(a0), high(a1), high(b0), high(b1), wx, wy);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), pack(lo, hi));
+  }
+
+  blend_bytes_scalar(a + k, b + k, out + k, count - k, fx, fy);
+}
+
+template <bool perspective>
+auto warp_avx2(warp_job const& job) noexcept -> void {
+  const auto lane =
+      _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+  const auto scale = _mm256_set1_ps(static_cast<float>(sub_size));
+  const auto upper = _mm256_set1_ps(fixed_limit);
+  const auto lower = _mm256_set1_ps(-fixed_limit);
+  const auto to_fixed_lanes = [&](const __m256 v) {
+    return _mm256_cvtps_epi32(_mm256_min_ps(
+        _mm256_max_ps(_mm256_mul_ps(v, scale), lower), upper));
+  };
+
+  // Each neighbour is gathered as 4 bytes, so the right-hand one reads a
+  // byte of the pixel after it, which must be in the same row
+  const auto none = _mm256_set1_epi32(-1);
+  const auto max_x = _mm256_set1_epi32(job.src_cols - 2);
+  const auto max_y = _mm256_set1_epi32(job.src_rows - 1);
+  const auto step = _mm256_set1_epi32(static_cast<int>(job.src_step));
+  const auto mask = _mm256_set1_epi32(sub_mask);
+  const auto low_pixels = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const auto high_pixels = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+  const auto drop_fourth = _mm256_setr_epi8(
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,  //
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  const auto join_halves = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+  const auto six_words = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+  const auto* src = reinterpret_cast<const int*>(job.src);
+
+  remap<perspective, 8>(job, [&](map_row const& r, const int x,
+                                 std::uint8_t* row) {
+    const auto xs =
+        _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane);
+    auto sx = _mm256_add_ps(_mm256_set1_ps(r.x),
+                            _mm256_mul_ps(_mm256_set1_ps(r.m0), xs));
+    auto sy = _mm256_add_ps(_mm256_set1_ps(r.y),
+                            _mm256_mul_ps(_mm256_set1_ps(r.m3), xs));
+    if constexpr (perspective) {
+      const auto w = _mm256_add_ps(_mm256_set1_ps(r.w),
+                                   _mm256_mul_ps(_mm256_set1_ps(r.m6), xs));
+      sx = _mm256_div_ps(sx, w);
+      sy = _mm256_div_ps(sy, w);
+    }
+    const auto fx = to_fixed_lanes(sx);
+    const auto fy = to_fixed_lanes(sy);
+    const auto ix = _mm256_srai_epi32(fx, sub_bits);
+    const auto iy = _mm256_srai_epi32(fy, sub_bits);
+    auto* out = row + x * 3;
+
+    const auto inside = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(ix, none),
+                         _mm256_cmpgt_epi32(max_x, ix)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(iy, none),
+                         _mm256_cmpgt_epi32(max_y, iy)));
+    if (_mm256_movemask_ps(_mm256_castsi256_ps(inside)) != 0xFF) {
+      alignas(32) int xs_fixed[8];
+      alignas(32) int ys_fixed[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(xs_fixed), fx);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(ys_fixed), fy);
+      for (auto k = 0; k < 8; ++k) {
+        sample(job, xs_fixed[k], ys_fixed[k], out + k * 3);
+      }
+      return;
+    }
+
+    const auto offsets = _mm256_add_epi32(
+        _mm256_mullo_epi32(iy, step),
+        _mm256_add_epi32(ix, _mm256_add_epi32(ix, ix)));
+    const auto gather = [&](const int delta) {
+      return _mm256_i32gather_epi32(
+          src, _mm256_add_epi32(offsets, _mm256_set1_epi32(delta)), 1);
+    };
+    const auto g00 = gather(0);
+    const auto g01 = gather(3);
+    const auto g10 = gather(static_cast<int>(job.src_step));
+    const auto g11 = gather(static_cast<int>(job.src_step) + 3);
+
+    // One weight per channel of each pixel
+    const auto wx = _mm256_and_si256(fx, mask);
+    const auto wy = _mm256_and_si256(fy, mask);
+    const auto wx_pair = _mm256_or_si256(wx, _mm256_slli_epi32(wx, 16));
+    const auto wy_pair = _mm256_or_si256(wy, _mm256_slli_epi32(wy, 16));
+
+    const auto lo =
+        blend_lanes(low(g00), low(g01), low(g10), low(g11),
+                    _mm256_permutevar8x32_epi32(wx_pair, low_pixels),
+                    _mm256_permutevar8x32_epi32(wy_pair, low_pixels));
+    const auto hi =
+        blend_lanes(high(g00), high(g01), high(g10), high(g11),
+                    _mm256_permutevar8x32_epi32(wx_pair, high_pixels),
+                    _mm256_permutevar8x32_epi32(wy_pair, high_pixels));
+
+    const auto pixels = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(pack(lo, hi), drop_fourth), join_halves);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(out), six_words, pixels);
+  });
+}
+
+auto translate_avx2(warp_job const& job) noexcept -> void {
+  translate(job, blend_bytes);
+}
+}  // namespace
+
+auto avx2_kernels() noexcept -> warp_kernels {
+  return {translate_avx2, warp_avx2<false>, warp_avx2<true>};
+}
+}  // namespace img::detail
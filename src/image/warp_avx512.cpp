@@ -0,0 +1,174 @@
+#include <immintrin.h>
+
+#include "warp_kernels.h"
+
+namespace img::detail {
+namespace {
+/**
+ * \brief <code>blend()</code> on thirty-two 16-bit values at once.
+ */
+inline auto blend_lanes(const __m512i p00, const __m512i p01,
+                        const __m512i p10, const __m512i p11,
+                        const __m512i fx, const __m512i fy) noexcept
+    -> __m512i {
+  const auto h0 = _mm512_add_epi16(
+      _mm512_slli_epi16(p00, sub_bits),
+      _mm512_mullo_epi16(_mm512_sub_epi16(p01, p00), fx));
+  const auto h1 = _mm512_add_epi16(
+      _mm512_slli_epi16(p10, sub_bits),
+      _mm512_mullo_epi16(_mm512_sub_epi16(p11, p10), fx));
+  const auto v = _mm512_add_epi16(
+      h0, _mm512_mulhrs_epi16(_mm512_sub_epi16(h1, h0),
+                              _mm512_slli_epi16(fy, 10)));
+
+  return _mm512_srli_epi16(
+      _mm512_add_epi16(v, _mm512_set1_epi16(sub_size / 2)), sub_bits);
+}
+
+/**
+ * \brief Packs two vectors of 16-bit values to bytes, in order. The pack
+ * works within each 128-bit quarter, so the quarters are put back in order
+ * after.
+ */
+inline auto pack(const __m512i lo, const __m512i hi) noexcept -> __m512i {
+  return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7),
+                                  _mm512_packus_epi16(lo, hi));
+}
+
+inline auto low(const __m512i v) noexcept -> __m512i {
+  return _mm512_cvtepu8_epi16(_mm512_castsi512_si256(v));
+}
+
+inline auto high(const __m512i v) noexcept -> __m512i {
+  return _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, 1));
+}
+
+auto blend_bytes(const std::uint8_t* a, const std::uint8_t* b,
+                 std::uint8_t* out, const int count, const int fx,
+                 const int fy) noexcept -> void {
+  const auto wx = _mm512_set1_epi16(static_cast<short>(fx));
+  const auto wy = _mm512_set1_epi16(static_cast<short>(fy));
+
+  auto k = 0;
+  for (; k + 64 <= count; k += 64) {
+    const auto a0 = _mm512_loadu_si512(a + k);
+    const auto a1 = _mm512_loadu_si512(a + k + 3);
+    const auto b0 = _mm512_loadu_si512(b + k);
+    const auto b1 = _mm512_loadu_si512(b + k + 3);
+
+    const auto lo = blend_lanes(low(a0), low(a1), low(b0), low(b1), wx, wy);
+    const auto hi =
+        blend_lanes(high(a0), high(a1), high(b0), high(b1), wx, wy);
+    _mm512_storeu_si512(out + k, pack(lo, hi));
+  }
+
+  blend_bytes_scalar(a + k, b + k, out + k, count - k, fx, fy);
+}
+
+template <bool perspective>
+auto warp_avx512(warp_job const& job) noexcept -> void {
+  const auto lane =
+      _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f,
+                     9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+  const auto scale = _mm512_set1_ps(static_cast<float>(sub_size));
+  const auto upper = _mm512_set1_ps(fixed_limit);
+  const auto lower = _mm512_set1_ps(-fixed_limit);
+  const auto to_fixed_lanes = [&](const __m512 v) {
+    return _mm512_cvtps_epi32(_mm512_min_ps(
+        _mm512_max_ps(_mm512_mul_ps(v, scale), lower), upper));
+  };
+
+  // Each neighbour is gathered as 4 bytes, so the right-hand one reads a
+  // byte of the pixel after it, which must be in the same row
+  const auto none = _mm512_set1_epi32(-1);
+  const auto max_x = _mm512_set1_epi32(job.src_cols - 2);
+  const auto max_y = _mm512_set1_epi32(job.src_rows - 1);
+  const auto step = _mm512_set1_epi32(static_cast<int>(job.src_step));
+  const auto mask = _mm512_set1_epi32(sub_mask);
+  const auto low_pixels =
+      _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+  const auto high_pixels = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12,
+                                             12, 13, 13, 14, 14, 15, 15);
+  const auto drop_fourth = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+  const auto join_quarters = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                               12, 13, 14, 15, 15, 15, 15);
+  constexpr __mmask16 twelve_words = 0x0FFF;
+
+  remap<perspective, 16>(job, [&](map_row const& r, const int x,
+                                  std::uint8_t* row) {
+    const auto xs =
+        _mm512_add_ps(_mm512_set1_ps(static_cast<float>(x)), lane);
+    auto sx = _mm512_add_ps(_mm512_set1_ps(r.x),
+                            _mm512_mul_ps(_mm512_set1_ps(r.m0), xs));
+    auto sy = _mm512_add_ps(_mm512_set1_ps(r.y),
+                            _mm512_mul_ps(_mm512_set1_ps(r.m3), xs));
+    if constexpr (perspective) {
+      const auto w = _mm512_add_ps(_mm512_set1_ps(r.w),
+                                   _mm512_mul_ps(_mm512_set1_ps(r.m6), xs));
+      sx = _mm512_div_ps(sx, w);
+      sy = _mm512_div_ps(sy, w);
+    }
+    const auto fx = to_fixed_lanes(sx);
+    const auto fy = to_fixed_lanes(sy);
+    const auto ix = _mm512_srai_epi32(fx, sub_bits);
+    const auto iy = _mm512_srai_epi32(fy, sub_bits);
+    auto* out = row + x * 3;
+
+    const auto inside = _mm512_cmpgt_epi32_mask(ix, none) &
+                        _mm512_cmpgt_epi32_mask(max_x, ix) &
+                        _mm512_cmpgt_epi32_mask(iy, none) &
+                        _mm512_cmpgt_epi32_mask(max_y, iy);
+    if (inside != 0xFFFF) {
+      alignas(64) int xs_fixed[16];
+      alignas(64) int ys_fixed[16];
+      _mm512_store_si512(xs_fixed, fx);
+      _mm512_store_si512(ys_fixed, fy);
+      for (auto k = 0; k < 16; ++k) {
+        sample(job, xs_fixed[k], ys_fixed[k], out + k * 3);
+      }
+      return;
+    }
+
+    const auto offsets = _mm512_add_epi32(
+        _mm512_mullo_epi32(iy, step),
+        _mm512_add_epi32(ix, _mm512_add_epi32(ix, ix)));
+    const auto gather = [&](const int delta) {
+      return _mm512_i32gather_epi32(
+          _mm512_add_epi32(offsets, _mm512_set1_epi32(delta)), job.src, 1);
+    };
+    const auto g00 = gather(0);
+    const auto g01 = gather(3);
+    const auto g10 = gather(static_cast<int>(job.src_step));
+    const auto g11 = gather(static_cast<int>(job.src_step) + 3);
+
+    // One weight per channel of each pixel
+    const auto wx = _mm512_and_si512(fx, mask);
+    const auto wy = _mm512_and_si512(fy, mask);
+    const auto wx_pair = _mm512_or_si512(wx, _mm512_slli_epi32(wx, 16));
+    const auto wy_pair = _mm512_or_si512(wy, _mm512_slli_epi32(wy, 16));
+
+    const auto lo =
+        blend_lanes(low(g00), low(g01), low(g10), low(g11),
+                    _mm512_permutexvar_epi32(low_pixels, wx_pair),
+                    _mm512_permutexvar_epi32(low_pixels, wy_pair));
+    const auto hi =
+        blend_lanes(high(g00), high(g01), high(g10), high(g11),
+                    _mm512_permutexvar_epi32(high_pixels, wx_pair),
+                    _mm512_permutexvar_epi32(high_pixels, wy_pair));
+
+    const auto pixels = _mm512_permutexvar_epi32(
+        join_quarters, _mm512_shuffle_epi8(pack(lo, hi), drop_fourth));
+    _mm512_mask_storeu_epi32(out, twelve_words, pixels);
+  });
+}
+
+auto translate_avx512(warp_job const& job) noexcept -> void {
+  translate(job, blend_bytes);
+}
+}  // namespace
+
+auto avx512_kernels() noexcept -> warp_kernels {
+  return {translate_avx512, warp_avx512<false>, warp_avx512<true>};
+}
+}  // namespace img::detail
@@ -0,0 +1,21 @@
+#include "warp_kernels.h"
+
+namespace img::detail {
+namespace {
+template <bool perspective>
+auto warp_scalar(warp_job const& job) noexcept -> void {
+  remap<perspective, 1>(job, [&](map_row const& r, const int x,
+                                 std::uint8_t* row) {
+    remap_pixels<perspective>(job, r, x, x + 1, row);
+  });
+}
+
+auto translate_scalar(warp_job const& job) noexcept -> void {
+  translate(job, blend_bytes_scalar);
+}
+}  // namespace
+
+auto scalar_kernels() noexcept -> warp_kernels {
+  return {translate_scalar, warp_scalar<false>, warp_scalar<true>};
+}
+}  // namespace img::detail
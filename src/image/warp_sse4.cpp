@@ -0,0 +1,165 @@
+#include <smmintrin.h>
+
+#include "warp_kernels.h"
+
+namespace img::detail {
+namespace {
+/**
+ * \brief <code>blend()</code> on eight 16-bit values at once.
+ */
+inline auto blend_lanes(const __m128i p00, const __m128i p01,
+                        const __m128i p10, const __m128i p11,
+                        const __m128i fx, const __m128i fy) noexcept
+    -> __m128i {
+  const auto h0 = _mm_add_epi16(_mm_slli_epi16(p00, sub_bits),
+                                _mm_mullo_epi16(_mm_sub_epi16(p01, p00), fx));
+  const auto h1 = _mm_add_epi16(_mm_slli_epi16(p10, sub_bits),
+                                _mm_mullo_epi16(_mm_sub_epi16(p11, p10), fx));
+  const auto v = _mm_add_epi16(
+      h0, _mm_mulhrs_epi16(_mm_sub_epi16(h1, h0), _mm_slli_epi16(fy, 10)));
+
+  return _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(sub_size / 2)),
+                        sub_bits);
+}
+
+auto blend_bytes(const std::uint8_t* a, const std::uint8_t* b,
+                 std::uint8_t* out, const int count, const int fx,
+                 const int fy) noexcept -> void {
+  const auto wx = _mm_set1_epi16(static_cast<short>(fx));
+  const auto wy = _mm_set1_epi16(static_cast<short>(fy));
+
+  const auto load = [](const std::uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  };
+  const auto low = [](const __m128i v) { return _mm_cvtepu8_epi16(v); };
+  const auto high = [](const __m128i v) {
+    return _mm_cvtepu8_epi16(_mm_srli_si128(v, 8));
+  };
+
+  auto k = 0;
+  for (; k + 16 <= count; k += 16) {
+    const auto a0 = load(a + k);
+    const auto a1 = load(a + k + 3);
+    const auto b0 = load(b + k);
+    const auto b1 = load(b + k + 3);
+
+    const auto lo = blend_lanes(low(a0), low(a1), low(b0), low(b1), wx, wy);
+    const auto hi =
+        blend_lanes(high(a0), high(a1), high(b0), high(b1), wx, wy);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k),
+                     _mm_packus_epi16(lo, hi));
+  }
+
+  blend_bytes_scalar(a + k, b + k, out + k, count - k, fx, fy);
+}
+
+inline auto load_pixel(const std::uint8_t* p) noexcept -> int {
+  int v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <bool perspective>
+auto warp_sse4(warp_job const& job) noexcept -> void {
+  const auto lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const auto scale = _mm_set1_ps(static_cast<float>(sub_size));
+  const auto upper = _mm_set1_ps(fixed_limit);
+  const auto lower = _mm_set1_ps(-fixed_limit);
+  const auto to_fixed_lanes = [&](const __m128 v) {
+    return _mm_cvtps_epi32(
+        _mm_min_ps(_mm_max_ps(_mm_mul_ps(v, scale), lower), upper));
+  };
+
+  // Each neighbour is loaded as 4 bytes, so the right-hand one reads a byte
+  // of the pixel after it, which must be in the same row
+  const auto none = _mm_set1_epi32(-1);
+  const auto max_x = _mm_set1_epi32(job.src_cols - 2);
+  const auto max_y = _mm_set1_epi32(job.src_rows - 1);
+  const auto step = _mm_set1_epi32(static_cast<int>(job.src_step));
+  const auto mask = _mm_set1_epi32(sub_mask);
+  const auto drop_fourth =
+      _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+  remap<perspective, 4>(job, [&](map_row const& r, const int x,
+                                 std::uint8_t* row) {
+    const auto xs = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lane);
+    auto sx = _mm_add_ps(_mm_set1_ps(r.x), _mm_mul_ps(_mm_set1_ps(r.m0), xs));
+    auto sy = _mm_add_ps(_mm_set1_ps(r.y), _mm_mul_ps(_mm_set1_ps(r.m3), xs));
+    if constexpr (perspective) {
+      const auto w =
+          _mm_add_ps(_mm_set1_ps(r.w), _mm_mul_ps(_mm_set1_ps(r.m6), xs));
+      sx = _mm_div_ps(sx, w);
+      sy = _mm_div_ps(sy, w);
+    }
+    const auto fx = to_fixed_lanes(sx);
+    const auto fy = to_fixed_lanes(sy);
+    const auto ix = _mm_srai_epi32(fx, sub_bits);
+    const auto iy = _mm_srai_epi32(fy, sub_bits);
+    auto* out = row + x * 3;
+
+    const auto inside = _mm_and_si128(
+        _mm_and_si128(_mm_cmpgt_epi32(ix, none), _mm_cmplt_epi32(ix, max_x)),
+        _mm_and_si128(_mm_cmpgt_epi32(iy, none), _mm_cmplt_epi32(iy, max_y)));
+    if (_mm_movemask_ps(_mm_castsi128_ps(inside)) != 0xF) {
+      alignas(16) int xs_fixed[4];
+      alignas(16) int ys_fixed[4];
+      _mm_store_si128(reinterpret_cast<__m128i*>(xs_fixed), fx);
+      _mm_store_si128(reinterpret_cast<__m128i*>(ys_fixed), fy);
+      for (auto k = 0; k < 4; ++k) {
+        sample(job, xs_fixed[k], ys_fixed[k], out + k * 3);
+      }
+      return;
+    }
+
+    alignas(16) int offsets[4];
+    _mm_store_si128(
+        reinterpret_cast<__m128i*>(offsets),
+        _mm_add_epi32(_mm_mullo_epi32(iy, step),
+                      _mm_add_epi32(ix, _mm_add_epi32(ix, ix))));
+    const auto gather = [&](const std::ptrdiff_t delta) {
+      return _mm_setr_epi32(load_pixel(job.src + offsets[0] + delta),
+                            load_pixel(job.src + offsets[1] + delta),
+                            load_pixel(job.src + offsets[2] + delta),
+                            load_pixel(job.src + offsets[3] + delta));
+    };
+    const auto g00 = gather(0);
+    const auto g01 = gather(3);
+    const auto g10 = gather(job.src_step);
+    const auto g11 = gather(job.src_step + 3);
+
+    // One weight per channel of each pixel
+    const auto wx = _mm_and_si128(fx, mask);
+    const auto wy = _mm_and_si128(fy, mask);
+    const auto wx_pair = _mm_or_si128(wx, _mm_slli_epi32(wx, 16));
+    const auto wy_pair = _mm_or_si128(wy, _mm_slli_epi32(wy, 16));
+
+    const auto low = [](const __m128i v) { return _mm_cvtepu8_epi16(v); };
+    const auto high = [](const __m128i v) {
+      return _mm_cvtepu8_epi16(_mm_srli_si128(v, 8));
+    };
+    const auto lo = blend_lanes(
+        low(g00), low(g01), low(g10), low(g11),
+        _mm_shuffle_epi32(wx_pair, _MM_SHUFFLE(1, 1, 0, 0)),
+        _mm_shuffle_epi32(wy_pair, _MM_SHUFFLE(1, 1, 0, 0)));
+    const auto hi = blend_lanes(
+        high(g00), high(g01), high(g10), high(g11),
+        _mm_shuffle_epi32(wx_pair, _MM_SHUFFLE(3, 3, 2, 2)),
+        _mm_shuffle_epi32(wy_pair, _MM_SHUFFLE(3, 3, 2, 2)));
+
+    const auto pixels =
+        _mm_shuffle_epi8(_mm_packus_epi16(lo, hi), drop_fourth);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), pixels);
+    const auto last = _mm_extract_epi32(pixels, 2);
+    std::memcpy(out + 8, &last, sizeof(last));
+  });
+}
+
+auto translate_sse4(warp_job const& job) noexcept -> void {
+  translate(job, blend_bytes);
+}
+}  // namespace
+
+auto sse4_kernels() noexcept -> warp_kernels {
+  return {translate_sse4, warp_sse4<false>, warp_sse4<true>};
+}
+}  // namespace img::detail
@@ -0,0 +1,120 @@
+#include "image/yuv.h"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+#include "image/warp.h"
+
+namespace img {
+namespace {
+// Black in the video range OpenCV's I420 conversions use
+constexpr double black_luma = 16.0;
+constexpr double black_chroma = 128.0;
+
+/**
+ * \brief Maps picture pixels to chroma pixels. Each chroma sample sits at
+ * the centre of the 2x2 block of luma samples it covers.
+ */
+const cv::Matx33d to_chroma(0.5, 0.0, -0.25,
+                            0.0, 0.5, -0.25,
+                            0.0, 0.0, 1.0);
+}  // namespace
+
+auto fits_i420(const cv::Size size) noexcept -> bool {
+  return size.width > 0 && size.height > 0 && size.width % 2 == 0 &&
+         size.height % 2 == 0;
+}
+
+auto picture_size(cv::Mat const& frame, const pixel_format format)
+    -> cv::Size {
+  if (format == pixel_format::i420) {
+    return {frame.cols, frame.rows * 2 / 3};
+  }
+
+  return frame.size();
+}
+
+auto i420_planes(cv::Mat const& frame) -> yuv_planes {
+  CV_Assert(frame.type() == CV_8UC1 && frame.isContinuous());
+
+  const auto size = picture_size(frame, pixel_format::i420);
+  const auto chroma = cv::Size(size.width / 2, size.height / 2);
+  auto* const u = frame.data + size.area();
+  auto* const v = u + chroma.area();
+
+  return {frame.rowRange(0, size.height),
+          cv::Mat(chroma, CV_8UC1, u),
+          cv::Mat(chroma, CV_8UC1, v)};
+}
+
+auto luma(cv::Mat const& frame, const pixel_format format) -> cv::Mat {
+  if (format == pixel_format::i420) {
+    return frame.rowRange(0, picture_size(frame, format).height);
+  }
+
+  return frame;
+}
+
+auto from_bgr(cv::Mat const& bgr, cv::Mat& dst, const pixel_format format)
+    -> void {
+  if (format == pixel_format::i420) {
+    cv::cvtColor(bgr, dst, cv::COLOR_BGR2YUV_I420);
+  } else {
+    dst = bgr;
+  }
+}
+
+auto to_bgr(cv::Mat const& frame, cv::Mat& dst, const pixel_format format)
+    -> void {
+  if (format == pixel_format::i420) {
+    cv::cvtColor(frame, dst, cv::COLOR_YUV2BGR_I420);
+  } else {
+    dst = frame;
+  }
+}
+
+auto warp_i420(cv::Mat const& src, cv::Mat& dst, cv::Mat const& h,
+               cv::Rect region) -> void {
+  const auto size = picture_size(src, pixel_format::i420);
+  if (region.empty()) region = cv::Rect({0, 0}, size);
+  region = even_region(region);
+
+  // The planes can't be warped in place
+  cv::Mat out = dst.data == src.data ? cv::Mat{} : dst;
+  out.create(region.height * 3 / 2, region.width, CV_8UC1);
+  if (region.empty()) {
+    dst = out;
+    return;
+  }
+
+  const auto in_planes = i420_planes(src);
+  auto out_planes = i420_planes(out);
+
+  cv::Mat h_64;
+  h.convertTo(h_64, CV_64FC1);
+  const cv::Mat h_chroma(to_chroma * cv::Matx33d(h_64.ptr<double>()) *
+                         to_chroma.inv());
+  const cv::Rect chroma_region(region.x / 2, region.y / 2, region.width / 2,
+                               region.height / 2);
+
+  // The output planes already have the region's size, so they're written in
+  // place
+  warp_perspective(in_planes.y, out_planes.y, h_64, region,
+                   cv::Scalar::all(black_luma));
+  warp_perspective(in_planes.u, out_planes.u, h_chroma, chroma_region,
+                   cv::Scalar::all(black_chroma));
+  warp_perspective(in_planes.v, out_planes.v, h_chroma, chroma_region,
+                   cv::Scalar::all(black_chroma));
+
+  dst = out;
+}
+
+auto even_region(const cv::Rect region) noexcept -> cv::Rect {
+  const auto x = region.x + (region.x & 1);
+  const auto y = region.y + (region.y & 1);
+  const auto right = region.br().x & ~1;
+  const auto bottom = region.br().y & ~1;
+
+  return {x, y, std::max(right - x, 0), std::max(bottom - y, 0)};
+}
+}  // namespace img
@@ -1,83 +1,140 @@
 #include <logger/logger.h>
+#include <logger/sinks.h>
 
-logger::logger() { clear_log(); }
+#include <algorithm>
 
-logger::~logger() { clear_log(); }
+namespace {
+std::mutex options_mutex;
+logger_options pending_options;
+bool created = false;
 
-auto logger::instance() -> logger* {
-  // Static local variable initialization is thread-safe
-  // and happens only once.
-  static logger instance{};
+auto take_options() -> logger_options {
+  std::lock_guard lock(options_mutex);
+  created = true;
 
-  return &instance;
+  return pending_options;
 }
+}  // namespace
+
+logger::logger(logger_options options)
+    : options_{options},
+      min_severity_{options.min_severity},
+      ring_{options.capacity},
+      epoch_ns_{std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count()} {
+  if (options_.stderr_severity != severity::off) {
+    sinks_.push_back(std::make_shared<stderr_sink>(options_.stderr_severity));
+  }
 
-auto logger::clear_log() -> void {
-  buf_.clear();
-  clear_ = false;
+  consumer_ = std::jthread([this](const std::stop_token stop) { run(stop); });
 }
 
-auto logger::add_log(const char* fmt, ...) -> void IM_FMTARGS(2) {
-  std::lock_guard lock(mutex_);
+logger::~logger() {
+  consumer_.request_stop();
+  if (consumer_.joinable()) consumer_.join();
 
-  int old_size = buf_.size();
-  va_list args;
-  va_start(args, fmt);
-  buf_.appendfv(fmt, args);
-  va_end(args);
-  for (const int new_size = buf_.size(); old_size < new_size; old_size++)
-    if (buf_[old_size] == '\n') line_offsets_.push_back(old_size + 1);
+  // Don't lose anything logged while shutting down
+  flush();
 }
 
-auto logger::add_dynamic_log(const std::string& id,
-                          std::function<std::string()> getter) -> void {
-  std::lock_guard lock(mutex_);
-  dynamic_logs_[id] = std::move(getter);
+auto logger::configure(logger_options const& options) -> bool {
+  std::lock_guard lock(options_mutex);
+  if (created) return false;
+  pending_options = options;
+
+  return true;
 }
 
-auto logger::remove_dynamic_log(const std::string& id) -> void {
-  std::lock_guard lock(mutex_);
-  dynamic_logs_.erase(id);
+auto logger::instance() -> logger* {
+  // Static local variable initialization is thread-safe
+  // and happens only once.
+  static logger instance{take_options()};
+
+  return &instance;
 }
 
-auto logger::draw() -> void IM_FMTARGS(2) {
-  std::lock_guard lock(mutex_);
+auto logger::log_lines(const severity level, std::string_view text) noexcept
+    -> void {
+  // Each string argument holds only so much, so a line is logged in as
+  // many records as it takes two pieces of that size to carry it
+  constexpr auto piece = log_detail::captured_string::capacity - 1;
+
+  while (!text.empty()) {
+    const auto end = text.find('\n');
+    auto line = text.substr(0, end);
+    do {
+      const auto first = line.substr(0, piece);
+      line.remove_prefix(first.size());
+      const auto second = line.substr(0, piece);
+      line.remove_prefix(second.size());
+      log(level, "%s%s", first, second);
+    } while (!line.empty());
+
+    if (end == std::string_view::npos) break;
+    text.remove_prefix(end + 1);
+  }
+}
 
-  ImGui::Separator();
+auto logger::add_sink(std::shared_ptr<log_sink> sink) -> void {
+  std::lock_guard lock(consumer_mutex_);
+  sinks_.push_back(std::move(sink));
+}
 
-  // Text area
-  const float footer_height = ImGui::GetStyle().ItemSpacing.y +
-                              ImGui::GetFrameHeightWithSpacing() +
-                              footer_buffer;
+auto logger::remove_sink(std::shared_ptr<log_sink> const& sink) -> void {
+  std::lock_guard lock(consumer_mutex_);
+  drain();
+  std::erase(sinks_, sink);
+}
 
-  if (ImGui::BeginChild("scrolling", ImVec2(0, -footer_height),
-                        ImGuiChildFlags_None,
-                        ImGuiWindowFlags_HorizontalScrollbar)) {
-    if (clear_) clear_log();
+auto logger::flush() -> void {
+  std::lock_guard lock(consumer_mutex_);
+  drain();
+}
 
-    ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4, 1));
+auto logger::thread_index() noexcept -> std::uint32_t {
+  static std::atomic<std::uint32_t> next = 0;
+  thread_local const auto index = next.fetch_add(1, std::memory_order_relaxed);
 
-    ImGui::TextUnformatted(buf_.begin(), buf_.end());
+  return index;
+}
 
-    // Draw dynamic log entries
-    for (const auto& [id, getter] : dynamic_logs_) {
-      ImGui::TextUnformatted(getter().c_str());
-    }
+auto logger::drain() -> void {
+  log_record record;
+  auto wrote = false;
+  while (ring_.try_pop(record)) {
+    record.format(record, scratch_);
+    dispatch({record.level, record.timestamp_ns, record.thread, scratch_});
+    wrote = true;
   }
-  ImGui::PopStyleVar();
 
-  // Keep up at the bottom of the scroll region if we were already at the
-  // bottom at the beginning of the frame. Using a scrollbar or mouse-wheel
-  // will take away from the bottom edge.
-  if (auto_scroll_ && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
-    ImGui::SetScrollHereY(1.0f);
-  ImGui::EndChild();
+  // Report dropped messages once the backlog has cleared
+  if (const auto dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+    dropped_total_.fetch_add(dropped, std::memory_order_relaxed);
+    scratch_ = std::to_string(dropped) +
+               " log messages were dropped because the log buffer was full";
+    dispatch({severity::warning, now_ns(), thread_index(), scratch_});
+    wrote = true;
+  }
 
-  ImGui::Separator();
+  if (!wrote) return;
+  for (auto const& sink : sinks_) sink->flush();
 }
 
-auto logger::empty() const noexcept -> bool { return buf_.empty(); }
+auto logger::dispatch(log_entry const& entry) -> void {
+  for (auto const& sink : sinks_) {
+    if (sink->accepts(entry.level)) sink->write(entry);
+  }
+}
 
-auto logger::clear() noexcept -> void { clear_ = true; }
+auto logger::run(std::stop_token const& stop) -> void {
+  while (!stop.stop_requested()) {
+    {
+      std::lock_guard lock(consumer_mutex_);
+      drain();
+    }
 
-auto logger::set_auto_scroll(const bool b) noexcept -> void { auto_scroll_ = b; }
+    std::unique_lock lock(wake_mutex_);
+    wake_.wait_for(lock, stop, options_.flush_interval, []() { return false; });
+  }
+}
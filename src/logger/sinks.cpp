@@ -0,0 +1,24 @@
+#include <logger/sinks.h>
+
+auto stderr_sink::write(log_entry const& entry) -> void {
+  std::fprintf(stderr, "[%s] %.*s\n", severity_name(entry.level),
+               static_cast<int>(entry.message.size()), entry.message.data());
+}
+
+auto stderr_sink::flush() -> void { std::fflush(stderr); }
+
+file_sink::file_sink(std::filesystem::path const& path,
+                     const severity min_severity)
+    : log_sink{min_severity}, out_{path, std::ios::app} {}
+
+auto file_sink::write(log_entry const& entry) -> void {
+  if (!out_) return;
+
+  char prefix[64];
+  std::snprintf(prefix, sizeof(prefix), "%12.6f [%u] %-5s ",
+                static_cast<double>(entry.timestamp_ns) / 1e9, entry.thread,
+                severity_name(entry.level));
+  out_ << prefix << entry.message << '\n';
+}
+
+auto file_sink::flush() -> void { out_.flush(); }
@@ -0,0 +1,224 @@
+#include "memory/frame_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace mem {
+namespace {
+// Buffers are mapped in multiples of this, which is a whole number of pages
+// on every platform, and the allocation granularity on Windows
+constexpr std::size_t granule = std::size_t{64} << 10;
+
+// Transparent huge pages are 2 MiB on x86-64 and most ARM64 kernels
+[[maybe_unused]] constexpr std::size_t huge_page = std::size_t{2} << 20;
+
+/**
+ * @brief Maps zeroed, page-aligned memory from the OS, or returns nullptr.
+ */
+auto map_pages(const std::size_t bytes, [[maybe_unused]] const bool huge)
+    -> void* {
+#if defined(_WIN32)
+  // Large pages need a privilege most users don't have, so they aren't used
+  return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT,
+                      PAGE_READWRITE);
+#else
+#if defined(MADV_HUGEPAGE)
+  if (huge && bytes >= huge_page) {
+    // Huge pages only back whole, aligned huge pages, so map one more than
+    // needed and unmap whatever is left over either side of the boundary
+    const auto padded = bytes + huge_page;
+    auto* const raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+
+    const auto start = reinterpret_cast<std::uintptr_t>(raw);
+    const auto aligned = (start + huge_page - 1) & ~(huge_page - 1);
+    const auto head = aligned - start;
+    const auto tail = padded - head - bytes;
+    if (head > 0) munmap(raw, head);
+    if (tail > 0) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+
+    auto* const buffer = reinterpret_cast<void*>(aligned);
+    madvise(buffer, bytes, MADV_HUGEPAGE);
+    return buffer;
+  }
+#endif
+
+  auto* const buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return buffer == MAP_FAILED ? nullptr : buffer;
+#endif
+}
+
+auto unmap_pages(void* buffer, [[maybe_unused]] const std::size_t bytes)
+    -> void {
+#if defined(_WIN32)
+  VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+  munmap(buffer, bytes);
+#endif
+}
+}  // namespace
+
+auto frame_pool::instance() -> frame_pool* {
+  // Never destroyed, since OpenCV hands matrices back to their allocator
+  // whenever they're released, which may be after static destruction
+  static auto* const instance = new frame_pool{};
+
+  return instance;
+}
+
+auto frame_pool::install() -> void { cv::Mat::setDefaultAllocator(this); }
+
+auto frame_pool::set_options(pool_options const& options) -> void {
+  std::lock_guard lock(mutex_);
+  options_ = options;
+  min_bytes_.store(options.min_bytes, std::memory_order_relaxed);
+}
+
+auto frame_pool::options() const -> pool_options {
+  std::lock_guard lock(mutex_);
+  return options_;
+}
+
+auto frame_pool::stats() const -> pool_stats {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+auto frame_pool::trim() const -> void {
+  decltype(free_) released;
+  {
+    std::lock_guard lock(mutex_);
+    released.swap(free_);
+    stats_.cached_bytes = 0;
+    for (auto const& [bytes, buffers] : released) {
+      stats_.os_releases += buffers.size();
+    }
+  }
+
+  for (auto const& [bytes, buffers] : released) {
+    for (auto* const buffer : buffers) unmap_pages(buffer, bytes);
+  }
+}
+
+auto frame_pool::allocate(const int dims, const int* sizes, const int type,
+                          void* data, std::size_t* step,
+                          const cv::AccessFlag flags,
+                          const cv::UMatUsageFlags usage) const
+    -> cv::UMatData* {
+  // Lay out the matrix the way OpenCV's own allocator does
+  auto total = static_cast<std::size_t>(CV_ELEM_SIZE(type));
+  for (auto i = dims - 1; i >= 0; --i) {
+    if (step) {
+      if (data && step[i] != CV_AUTOSTEP) {
+        CV_Assert(total <= step[i]);
+        total = step[i];
+      } else {
+        step[i] = total;
+      }
+    }
+    total *= static_cast<std::size_t>(sizes[i]);
+  }
+
+  // Matrices over the caller's data, and small ones, aren't pooled
+  if (data || total < min_bytes_.load(std::memory_order_relaxed)) {
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step,
+                                                flags, usage);
+  }
+
+  auto* const buffer = take(total);
+  if (!buffer) {
+    CV_Error_(cv::Error::StsNoMem,
+              ("Failed to allocate %zu bytes for a frame", total));
+  }
+
+  auto* const u = new cv::UMatData(this);
+  u->data = u->origdata = static_cast<uchar*>(buffer);
+  u->size = total;
+
+  return u;
+}
+
+auto frame_pool::allocate(cv::UMatData* data, cv::AccessFlag,
+                          cv::UMatUsageFlags) const -> bool {
+  return data != nullptr;
+}
+
+auto frame_pool::deallocate(cv::UMatData* data) const -> void {
+  if (!data) return;
+
+  CV_Assert(data->urefcount == 0 && data->refcount == 0);
+  give_back(data->origdata, data->size);
+  data->origdata = nullptr;
+  delete data;
+}
+
+auto frame_pool::size_class(const std::size_t bytes) noexcept
+    -> std::size_t {
+  if (bytes <= granule) return granule;
+
+  const auto step = std::max(std::bit_floor(bytes) / 8, granule);
+  return (bytes + step - 1) / step * step;
+}
+
+auto frame_pool::take(const std::size_t bytes) const -> void* {
+  const auto size = size_class(bytes);
+  auto huge = false;
+  {
+    std::lock_guard lock(mutex_);
+    ++stats_.allocations;
+
+    const auto it = free_.find(size);
+    if (it != free_.end() && !it->second.empty()) {
+      // The most recently freed buffer is the likeliest to still be cached
+      auto* const buffer = it->second.back();
+      it->second.pop_back();
+      ++stats_.reuses;
+      stats_.cached_bytes -= size;
+      stats_.live_bytes += size;
+      return buffer;
+    }
+
+    huge = options_.huge_pages;
+  }
+
+  auto* const buffer = map_pages(size, huge);
+  if (!buffer) return nullptr;
+
+  std::lock_guard lock(mutex_);
+  ++stats_.os_allocations;
+  stats_.live_bytes += size;
+  stats_.peak_bytes =
+      std::max(stats_.peak_bytes, stats_.live_bytes + stats_.cached_bytes);
+
+  return buffer;
+}
+
+auto frame_pool::give_back(void* buffer, const std::size_t bytes) const
+    -> void {
+  const auto size = size_class(bytes);
+  {
+    std::lock_guard lock(mutex_);
+    stats_.live_bytes -= size;
+
+    if (stats_.cached_bytes + size <= options_.max_cached_bytes) {
+      free_[size].push_back(buffer);
+      stats_.cached_bytes += size;
+      return;
+    }
+
+    ++stats_.os_releases;
+  }
+
+  unmap_pages(buffer, size);
+}
+}  // namespace mem
@@ -0,0 +1,102 @@
+#include "memory/governor.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "memory/frame_pool.h"
+
+namespace mem {
+auto governor::instance() -> governor* {
+  // Never destroyed, since static videos leave it during static destruction
+  static auto* const instance = new governor{};
+
+  return instance;
+}
+
+auto governor::set_budget(const std::size_t bytes) -> void {
+  std::lock_guard lock(mutex_);
+  budget_ = bytes;
+  enforce_locked();
+}
+
+auto governor::budget() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return budget_;
+}
+
+auto governor::enroll(tenant* t) -> void {
+  std::lock_guard lock(mutex_);
+  entries_.push_back({t, false, 0});
+}
+
+auto governor::leave(tenant* t) -> void {
+  std::lock_guard lock(mutex_);
+  std::erase_if(entries_, [t](entry const& e) { return e.t == t; });
+}
+
+auto governor::set_cold(tenant* t, const bool cold) -> void {
+  std::lock_guard lock(mutex_);
+
+  const auto it = std::ranges::find(entries_, t, &entry::t);
+  if (it == entries_.end() || it->cold == cold) return;
+
+  it->cold = cold;
+  it->cooled_at = ++clock_;
+}
+
+auto governor::enforce() -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return enforce_locked();
+}
+
+auto governor::resident_bytes() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return total_locked();
+}
+
+auto governor::report() const -> std::vector<tenant_usage> {
+  std::lock_guard lock(mutex_);
+
+  std::vector<tenant_usage> usage;
+  usage.reserve(entries_.size());
+  for (auto const& e : entries_) {
+    usage.push_back({e.t->tenant_name(), e.t->resident_bytes(),
+                     e.t->spilled_bytes(), e.cold});
+  }
+
+  return usage;
+}
+
+auto governor::total_locked() const -> std::size_t {
+  std::size_t total = 0;
+  for (auto const& e : entries_) total += e.t->resident_bytes();
+
+  return total;
+}
+
+auto governor::enforce_locked() -> std::size_t {
+  auto total = total_locked();
+  if (budget_ == 0 || total <= budget_) return total;
+
+  // Coldest first. Tenants are asked once each, since one that frees
+  // nothing now won't free anything if asked again.
+  std::vector<entry> cold;
+  std::ranges::copy_if(entries_, std::back_inserter(cold),
+                       [](entry const& e) { return e.cold; });
+  std::ranges::sort(cold, {}, &entry::cooled_at);
+
+  std::size_t released = 0;
+  for (auto const& e : cold) {
+    if (total <= budget_) break;
+    const auto freed = std::min(e.t->release(total - budget_), total);
+    total -= freed;
+    released += freed;
+  }
+
+  // Spilled frames go back to the pool's cache rather than the OS, so
+  // they're only out of memory once the pool lets go of them
+  if (released > 0) frame_pool::instance()->trim();
+
+  return total;
+}
+}  // namespace mem
@@ -0,0 +1,513 @@
+#include "profiler/allocations.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <opencv2/core/mat.hpp>
+#include <utility>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "profiler/memory.h"
+
+namespace prof {
+namespace {
+// The stage of the calling thread, or -1 to follow the process's stage
+thread_local int thread_stage = -1;
+
+constexpr auto mb(const std::int64_t bytes) -> double {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+/**
+ * @brief Raises the peak to the value, unless it's already higher.
+ */
+auto raise(std::atomic<std::int64_t>& peak, const std::int64_t value) noexcept
+    -> void {
+  auto seen = peak.load(std::memory_order_relaxed);
+  while (seen < value &&
+         !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+/**
+ * @brief Returns the bytes the heap actually reserved for a block, which is
+ * what it costs, rather than what was asked for.
+ */
+auto usable_size(void* block) noexcept -> std::size_t {
+#if defined(_WIN32)
+  return _msize(block);
+#elif defined(__APPLE__)
+  return malloc_size(block);
+#else
+  return malloc_usable_size(block);
+#endif
+}
+
+auto usable_size(void* block, [[maybe_unused]] const std::align_val_t align)
+    noexcept -> std::size_t {
+#if defined(_WIN32)
+  return _aligned_msize(block, static_cast<std::size_t>(align), 0);
+#else
+  return usable_size(block);
+#endif
+}
+}  // namespace
+
+//----------------------------------------------------- counting_allocator --//
+/**
+ * @brief Counts the frames another allocator makes while the tracker runs.
+ *
+ * Each matrix it allocates is handed to it, so it sees the matrix freed, and
+ * keeps the allocator that really made it in <code>userdata</code>, which
+ * OpenCV's CPU allocators don't use, to hand the matrix back to.
+ */
+class counting_allocator final : public cv::MatAllocator {
+ public:
+  counting_allocator(cv::MatAllocator* inner, memory_tracker* tracker)
+      : inner_{inner}, tracker_{tracker} {}
+
+  [[nodiscard]] auto inner() const noexcept -> cv::MatAllocator* {
+    return inner_;
+  }
+
+  auto allocate(const int dims, const int* sizes, const int type, void* data,
+                std::size_t* step, const cv::AccessFlag flags,
+                const cv::UMatUsageFlags usage) const
+      -> cv::UMatData* override {
+    auto* const u =
+        inner_->allocate(dims, sizes, type, data, step, flags, usage);
+
+    // Matrices over the caller's data cost nothing
+    if (!u || data) return u;
+
+    u->userdata = const_cast<cv::MatAllocator*>(u->currAllocator);
+    u->currAllocator = this;
+    tracker_->frame_allocated(u->size);
+
+    return u;
+  }
+
+  auto allocate(cv::UMatData* data, const cv::AccessFlag flags,
+                const cv::UMatUsageFlags usage) const -> bool override {
+    return data && original(data)->allocate(data, flags, usage);
+  }
+
+  auto deallocate(cv::UMatData* data) const -> void override {
+    if (!data) return;
+
+    tracker_->frame_freed(data->size);
+    const auto* const allocator = original(data);
+    data->currAllocator = allocator;
+    data->userdata = nullptr;
+    allocator->deallocate(data);
+  }
+
+ private:
+  cv::MatAllocator* inner_;
+  memory_tracker* tracker_;
+
+  [[nodiscard]] auto original(cv::UMatData* data) const
+      -> const cv::MatAllocator* {
+    return data->userdata ? static_cast<cv::MatAllocator*>(data->userdata)
+                          : inner_;
+  }
+};
+
+//--------------------------------------------------------- memory_tracker --//
+memory_tracker::memory_tracker() { stages_[0].name = "other"; }
+
+auto memory_tracker::instance() -> memory_tracker* {
+  // Never destroyed, since matrices it counts may be freed after static
+  // destruction
+  static auto* const instance = new memory_tracker{};
+
+  return instance;
+}
+
+auto memory_tracker::start(const std::chrono::milliseconds interval)
+    -> void {
+  stop();
+  {
+    std::lock_guard lock(mutex_);
+    timeline_.clear();
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  // The wrapper outlives the tracker's run, since matrices allocated through
+  // it come back to it whenever they're freed
+  if (!allocator_) {
+    allocator_ = std::make_unique<counting_allocator>(
+        cv::Mat::getDefaultAllocator(), this);
+  }
+  cv::Mat::setDefaultAllocator(allocator_.get());
+  active_.store(this, std::memory_order_release);
+
+  sampler_ = std::jthread([this, interval](const std::stop_token& stop) {
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    while (!stop.stop_requested()) {
+      sample();
+
+      std::unique_lock lock(mutex);
+      wake.wait_for(lock, stop, interval, []() { return false; });
+    }
+  });
+}
+
+auto memory_tracker::stop() -> void {
+  if (sampler_.joinable()) {
+    sampler_.request_stop();
+    sampler_.join();
+    sample();
+  }
+
+  active_.store(nullptr, std::memory_order_release);
+  if (allocator_ && cv::Mat::getDefaultAllocator() == allocator_.get()) {
+    cv::Mat::setDefaultAllocator(allocator_->inner());
+  }
+}
+
+auto memory_tracker::stages() const -> std::vector<stage_memory> {
+  std::vector<stage_memory> stages;
+  const auto count = stage_count_.load(std::memory_order_acquire);
+  for (auto i = 0; i < count; ++i) {
+    auto const& slot = stages_[i];
+    const auto* const name = slot.name.load(std::memory_order_acquire);
+    if (!name) continue;
+
+    stages.push_back({
+        name,
+        slot.heap_allocations.load(std::memory_order_relaxed),
+        slot.heap_bytes.load(std::memory_order_relaxed),
+        slot.frame_allocations.load(std::memory_order_relaxed),
+        slot.frame_bytes.load(std::memory_order_relaxed),
+        slot.peak_frame_bytes.load(std::memory_order_relaxed),
+        slot.peak_total_bytes.load(std::memory_order_relaxed),
+    });
+  }
+
+  return stages;
+}
+
+auto memory_tracker::timeline() const -> std::vector<memory_sample> {
+  std::lock_guard lock(mutex_);
+  return timeline_;
+}
+
+auto memory_tracker::summary() const -> std::string {
+  std::string table;
+  char line[256];
+
+  std::snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %10s\n",
+                "stage", "heap n", "heap MB", "frames n", "frames MB",
+                "peak fr MB", "peak MB");
+  table += line;
+
+  std::int64_t peak = 0;
+  for (auto const& s : stages()) {
+    if (s.heap_allocations == 0 && s.frame_allocations == 0) continue;
+
+    std::snprintf(line, sizeof(line),
+                  "%-16s %10llu %10.1f %10llu %10.1f %10.1f %10.1f\n",
+                  s.name.c_str(),
+                  static_cast<unsigned long long>(s.heap_allocations),
+                  mb(static_cast<std::int64_t>(s.heap_bytes)),
+                  static_cast<unsigned long long>(s.frame_allocations),
+                  mb(static_cast<std::int64_t>(s.frame_bytes)),
+                  mb(s.peak_frame_bytes), mb(s.peak_total_bytes));
+    table += line;
+    peak = std::max(peak, s.peak_total_bytes);
+  }
+
+  std::snprintf(line, sizeof(line),
+                "\nPeak %.1f MB allocated, %.1f MB resident\n", mb(peak),
+                mb(static_cast<std::int64_t>(peak_rss_bytes())));
+  table += line;
+
+  return table;
+}
+
+auto memory_tracker::export_report(std::filesystem::path const& path) const
+    -> bool {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) return false;
+
+  char line[256];
+  out << "stage,heap_allocations,heap_mb,frame_allocations,frame_mb,"
+         "peak_frame_mb,peak_total_mb\n";
+  for (auto const& s : stages()) {
+    std::snprintf(line, sizeof(line), "%s,%llu,%.3f,%llu,%.3f,%.3f,%.3f\n",
+                  s.name.c_str(),
+                  static_cast<unsigned long long>(s.heap_allocations),
+                  mb(static_cast<std::int64_t>(s.heap_bytes)),
+                  static_cast<unsigned long long>(s.frame_allocations),
+                  mb(static_cast<std::int64_t>(s.frame_bytes)),
+                  mb(s.peak_frame_bytes), mb(s.peak_total_bytes));
+    out << line;
+  }
+
+  // The timeline follows as a second table, after a blank line
+  out << "\nt_s,stage,heap_mb,frame_mb,rss_mb\n";
+  for (auto const& s : timeline()) {
+    std::snprintf(line, sizeof(line), "%.3f,%s,%.3f,%.3f,%.3f\n", s.t_s,
+                  s.stage.c_str(), mb(s.heap_bytes), mb(s.frame_bytes),
+                  mb(static_cast<std::int64_t>(s.rss_bytes)));
+    out << line;
+  }
+
+  return static_cast<bool>(out);
+}
+
+auto memory_tracker::heap_allocated(const std::size_t bytes) noexcept
+    -> void {
+  const auto size = static_cast<std::int64_t>(bytes);
+  const auto live =
+      heap_live_.fetch_add(size, std::memory_order_relaxed) + size;
+
+  auto& stage = current_stage();
+  stage.heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  stage.heap_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  raise(stage.peak_total_bytes,
+        live + frame_live_.load(std::memory_order_relaxed));
+}
+
+auto memory_tracker::heap_freed(const std::size_t bytes) noexcept -> void {
+  heap_live_.fetch_sub(static_cast<std::int64_t>(bytes),
+                       std::memory_order_relaxed);
+}
+
+auto memory_tracker::frame_allocated(const std::size_t bytes) noexcept
+    -> void {
+  const auto size = static_cast<std::int64_t>(bytes);
+  const auto live =
+      frame_live_.fetch_add(size, std::memory_order_relaxed) + size;
+
+  auto& stage = current_stage();
+  stage.frame_allocations.fetch_add(1, std::memory_order_relaxed);
+  stage.frame_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  raise(stage.peak_frame_bytes, live);
+  raise(stage.peak_total_bytes,
+        live + heap_live_.load(std::memory_order_relaxed));
+}
+
+auto memory_tracker::frame_freed(const std::size_t bytes) noexcept -> void {
+  frame_live_.fetch_sub(static_cast<std::int64_t>(bytes),
+                        std::memory_order_relaxed);
+}
+
+auto memory_tracker::stage_index(const char* name) -> int {
+  std::lock_guard lock(mutex_);
+  const auto count = stage_count_.load(std::memory_order_relaxed);
+  for (auto i = 1; i < count; ++i) {
+    const auto* const existing =
+        stages_[i].name.load(std::memory_order_relaxed);
+    if (existing == name || std::strcmp(existing, name) == 0) return i;
+  }
+
+  // Past the table's end, allocations count as outside any stage
+  if (count == max_stages) return 0;
+
+  stages_[count].name.store(name, std::memory_order_release);
+  stage_count_.store(count + 1, std::memory_order_release);
+
+  return count;
+}
+
+auto memory_tracker::current_stage() noexcept -> stage_slot& {
+  const auto index = thread_stage >= 0
+                         ? thread_stage
+                         : process_stage_.load(std::memory_order_relaxed);
+
+  return stages_[index];
+}
+
+auto memory_tracker::sample() -> void {
+  const auto rss = current_rss_bytes();
+  const auto* const stage =
+      stages_[process_stage_.load(std::memory_order_relaxed)].name.load(
+          std::memory_order_acquire);
+
+  std::lock_guard lock(mutex_);
+  const std::chrono::duration<double> t =
+      std::chrono::steady_clock::now() - start_;
+  timeline_.push_back({t.count(), stage,
+                       heap_live_.load(std::memory_order_relaxed),
+                       frame_live_.load(std::memory_order_relaxed), rss});
+}
+
+//----------------------------------------------------------- memory_stage --//
+memory_stage::memory_stage(const char* name, const scope kind) noexcept
+    : scope_{kind} {
+  auto* const tracker = memory_tracker::active();
+  if (!tracker) return;
+
+  try {
+    const auto index = tracker->stage_index(name);
+    if (scope_ == scope::thread) {
+      previous_ = std::exchange(thread_stage, index);
+    } else {
+      previous_ =
+          tracker->process_stage_.exchange(index, std::memory_order_relaxed);
+      tracker->sample();
+    }
+    active_ = true;
+  } catch (...) {
+    // A stage that can't be named is only left out of the report
+  }
+}
+
+memory_stage::~memory_stage() {
+  if (!active_) return;
+
+  if (scope_ == scope::thread) {
+    thread_stage = previous_;
+    return;
+  }
+
+  auto* const tracker = memory_tracker::instance();
+  tracker->process_stage_.store(previous_, std::memory_order_relaxed);
+  if (!tracker->enabled()) return;
+
+  try {
+    tracker->sample();
+  } catch (...) {
+    // The timeline only misses a point
+  }
+}
+}  // namespace prof
+
+//------------------------------------------------------------ Global heap --//
+// Replacing the global operators counts every allocation made with new in
+// the process, including the standard library's. They're visible even when
+// the rest of the library is built with hidden visibility.
+#if defined(__GNUC__)
+#define PROF_HEAP_HOOK __attribute__((visibility("default")))
+#else
+#define PROF_HEAP_HOOK
+#endif
+
+namespace {
+auto allocate_or_throw(const std::size_t bytes) -> void* {
+  while (true) {
+    if (auto* const block = std::malloc(bytes == 0 ? 1 : bytes)) return block;
+
+    // Give the new handler a chance to free memory, as operator new must
+    const auto handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc{};
+    handler();
+  }
+}
+
+auto allocate_or_throw(const std::size_t bytes, const std::align_val_t align)
+    -> void* {
+  const auto alignment = static_cast<std::size_t>(align);
+  while (true) {
+#if defined(_WIN32)
+    auto* const block = _aligned_malloc(bytes == 0 ? 1 : bytes, alignment);
+#else
+    // aligned_alloc needs the size to be a multiple of the alignment
+    auto* const block = std::aligned_alloc(
+        alignment, ((bytes == 0 ? 1 : bytes) + alignment - 1) / alignment *
+                       alignment);
+#endif
+    if (block) return block;
+
+    const auto handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc{};
+    handler();
+  }
+}
+}  // namespace
+
+PROF_HEAP_HOOK auto operator new(const std::size_t bytes) -> void* {
+  auto* const block = allocate_or_throw(bytes);
+  if (auto* const tracker = prof::memory_tracker::active()) {
+    tracker->heap_allocated(prof::usable_size(block));
+  }
+
+  return block;
+}
+
+PROF_HEAP_HOOK auto operator new[](const std::size_t bytes) -> void* {
+  return ::operator new(bytes);
+}
+
+PROF_HEAP_HOOK auto operator delete(void* block) noexcept -> void {
+  if (!block) return;
+  if (auto* const tracker = prof::memory_tracker::active()) {
+    tracker->heap_freed(prof::usable_size(block));
+  }
+  std::free(block);
+}
+
+PROF_HEAP_HOOK auto operator delete[](void* block) noexcept -> void {
+  ::operator delete(block);
+}
+
+PROF_HEAP_HOOK auto operator delete(void* block, std::size_t) noexcept
+    -> void {
+  ::operator delete(block);
+}
+
+PROF_HEAP_HOOK auto operator delete[](void* block, std::size_t) noexcept
+    -> void {
+  ::operator delete(block);
+}
+
+PROF_HEAP_HOOK auto operator new(const std::size_t bytes,
+                                 const std::align_val_t align) -> void* {
+  auto* const block = allocate_or_throw(bytes, align);
+  if (auto* const tracker = prof::memory_tracker::active()) {
+    tracker->heap_allocated(prof::usable_size(block, align));
+  }
+
+  return block;
+}
+
+PROF_HEAP_HOOK auto operator new[](const std::size_t bytes,
+                                   const std::align_val_t align) -> void* {
+  return ::operator new(bytes, align);
+}
+
+PROF_HEAP_HOOK auto operator delete(void* block,
+                                    const std::align_val_t align) noexcept
+    -> void {
+  if (!block) return;
+  if (auto* const tracker = prof::memory_tracker::active()) {
+    tracker->heap_freed(prof::usable_size(block, align));
+  }
+#if defined(_WIN32)
+  _aligned_free(block);
+#else
+  std::free(block);
+#endif
+}
+
+PROF_HEAP_HOOK auto operator delete[](void* block,
+                                      const std::align_val_t align) noexcept
+    -> void {
+  ::operator delete(block, align);
+}
+
+PROF_HEAP_HOOK auto operator delete(void* block, std::size_t,
+                                    const std::align_val_t align) noexcept
+    -> void {
+  ::operator delete(block, align);
+}
+
+PROF_HEAP_HOOK auto operator delete[](void* block, std::size_t,
+                                      const std::align_val_t align) noexcept
+    -> void {
+  ::operator delete(block, align);
+}
@@ -0,0 +1,73 @@
+#include "profiler/memory.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdio>
+#endif
+
+namespace prof {
+auto peak_rss_bytes() noexcept -> std::size_t {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+
+  return counters.PeakWorkingSetSize;
+#elif defined(__APPLE__)
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+  // macOS reports bytes
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#elif defined(__linux__)
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+  // Linux reports kilobytes
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#else
+  return 0;
+#endif
+}
+
+auto current_rss_bytes() noexcept -> std::size_t {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+
+  return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+  mach_task_basic_info info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+    return 0;
+
+  return info.resident_size;
+#elif defined(__linux__)
+  // The second field of statm is the number of resident pages
+  auto* statm = std::fopen("/proc/self/statm", "r");
+  if (!statm) return 0;
+
+  unsigned long pages = 0, resident = 0;
+  const auto read = std::fscanf(statm, "%lu %lu", &pages, &resident);
+  std::fclose(statm);
+  if (read != 2) return 0;
+
+  return static_cast<std::size_t>(resident) *
+         static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+}  // namespace prof
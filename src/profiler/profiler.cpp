@@ -0,0 +1,263 @@
+#include "profiler/profiler.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+namespace prof {
+//-------------------------------------------------------------- Histogram --//
+auto histogram::bucket_of(const std::int64_t ns) noexcept -> int {
+  if (ns < sub_buckets) return static_cast<int>(std::max<std::int64_t>(ns, 0));
+
+  const auto msb = std::bit_width(static_cast<std::uint64_t>(ns)) - 1;
+  const auto octave = msb - 2;
+  if (octave >= octaves) return octaves * sub_buckets - 1;
+
+  const auto sub = static_cast<int>((ns >> (msb - 3)) & (sub_buckets - 1));
+
+  return octave * sub_buckets + sub;
+}
+
+auto histogram::lower_bound_of(const int bucket) noexcept -> std::int64_t {
+  const auto octave = bucket / sub_buckets;
+  const auto sub = bucket % sub_buckets;
+  if (octave == 0) return sub;
+
+  return static_cast<std::int64_t>(sub_buckets + sub) << (octave - 1);
+}
+
+auto histogram::add(const std::int64_t ns) noexcept -> void {
+  ++buckets_[bucket_of(ns)];
+  ++count_;
+  total_ns_ += ns;
+  min_ns_ = std::min(min_ns_, ns);
+  max_ns_ = std::max(max_ns_, ns);
+}
+
+auto histogram::merge(histogram const& other) noexcept -> void {
+  for (auto i = 0; i < octaves * sub_buckets; ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  total_ns_ += other.total_ns_;
+  min_ns_ = std::min(min_ns_, other.min_ns_);
+  max_ns_ = std::max(max_ns_, other.max_ns_);
+}
+
+auto histogram::percentile(const double p) const noexcept -> std::int64_t {
+  if (count_ == 0) return 0;
+
+  const auto target = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(p * static_cast<double>(count_) + 0.5));
+  std::uint64_t seen = 0;
+  for (auto i = 0; i < octaves * sub_buckets; ++i) {
+    seen += buckets_[i];
+    if (seen < target) continue;
+
+    // Report the middle of the bucket, clamped to the observed range
+    const auto mid = (lower_bound_of(i) + lower_bound_of(i + 1)) / 2;
+    return std::clamp(mid, min_ns(), max_ns_);
+  }
+
+  return max_ns_;
+}
+
+//--------------------------------------------------------------- Profiler --//
+auto profiler::instance() -> profiler* {
+  // Static local variable initialization is thread-safe
+  // and happens only once.
+  static profiler instance{};
+
+  return &instance;
+}
+
+auto profiler::local_buffer() -> thread_buffer* {
+  // Buffers are owned by the profiler, so they outlive the threads that
+  // write to them and nothing is lost when a worker thread exits.
+  thread_local thread_buffer* buffer = nullptr;
+  if (buffer) return buffer;
+
+  std::lock_guard lock(buffers_mutex_);
+  auto& b = buffers_.emplace_back(std::make_unique<thread_buffer>());
+  b->tid = static_cast<int>(buffers_.size());
+  buffer = b.get();
+
+  return buffer;
+}
+
+auto profiler::record_span(const char* name, const std::int64_t start_ns,
+                           const std::int64_t end_ns) noexcept -> void {
+  try {
+    auto* b = local_buffer();
+    std::lock_guard lock(b->mutex);
+
+    // Names are string literals, so comparing pointers is enough to find the
+    // histogram on the hot path. Duplicates across translation units are
+    // merged by name when reporting.
+    auto it =
+        std::ranges::find_if(b->histograms, [&](named_histogram const& h) {
+          return h.name == name;
+        });
+    if (it == b->histograms.end()) {
+      b->histograms.push_back({name, {}});
+      it = std::prev(b->histograms.end());
+    }
+    it->hist.add(end_ns - start_ns);
+
+    if (b->spans.size() < max_events_per_thread) {
+      b->spans.push_back({name, start_ns, end_ns});
+    } else {
+      ++b->dropped;
+    }
+  } catch (...) {
+    // Out of memory, the span is dropped rather than ending the traced run
+  }
+}
+
+auto profiler::record_counter(const char* name, const int frame,
+                              const double value) noexcept -> void {
+  try {
+    auto* b = local_buffer();
+    std::lock_guard lock(b->mutex);
+
+    if (b->counters.size() < max_events_per_thread) {
+      b->counters.push_back({name, now_ns(), frame, value});
+    } else {
+      ++b->dropped;
+    }
+  } catch (...) {
+    // As for spans, the counter is dropped
+  }
+}
+
+auto profiler::export_trace(std::filesystem::path const& path) const -> bool {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) return false;
+
+  std::lock_guard buffers_lock(buffers_mutex_);
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  auto first = true;
+  char line[256];
+  const auto emit = [&](const int n) {
+    if (!first) out << ",\n";
+    out.write(line, std::min<int>(n, sizeof(line) - 1));
+    first = false;
+  };
+
+  for (auto const& b : buffers_) {
+    std::lock_guard lock(b->mutex);
+
+    emit(std::snprintf(line, sizeof(line),
+                       R"({"name":"thread_name","ph":"M","pid":1,"tid":%d,)"
+                       R"("args":{"name":"worker %d"}})",
+                       b->tid, b->tid));
+
+    // Timestamps are in microseconds relative to profiler creation
+    for (auto const& [name, start, end] : b->spans) {
+      emit(std::snprintf(line, sizeof(line),
+                         R"({"name":"%s","ph":"X","pid":1,"tid":%d,)"
+                         R"("ts":%.3f,"dur":%.3f})",
+                         name, b->tid,
+                         static_cast<double>(start - epoch_ns_) / 1000.0,
+                         static_cast<double>(end - start) / 1000.0));
+    }
+
+    for (auto const& [name, ts, frame, value] : b->counters) {
+      emit(std::snprintf(line, sizeof(line),
+                         R"({"name":"%s","ph":"C","pid":1,"tid":%d,)"
+                         R"("ts":%.3f,"args":{"value":%g,"frame":%d}})",
+                         name, b->tid,
+                         static_cast<double>(ts - epoch_ns_) / 1000.0, value,
+                         frame));
+    }
+  }
+
+  out << "\n]}\n";
+
+  return static_cast<bool>(out);
+}
+
+auto profiler::summary() const -> std::string {
+  struct counter_stats {
+    std::uint64_t n = 0;
+    double sum = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+  };
+
+  std::map<std::string, histogram> spans;
+  std::map<std::string, counter_stats> counters;
+  std::uint64_t dropped = 0;
+  {
+    std::lock_guard buffers_lock(buffers_mutex_);
+    for (auto const& b : buffers_) {
+      std::lock_guard lock(b->mutex);
+      for (auto const& [name, hist] : b->histograms) spans[name].merge(hist);
+
+      for (auto const& c : b->counters) {
+        auto& s = counters[c.name];
+        s.min = s.n == 0 ? c.value : std::min(s.min, c.value);
+        s.max = s.n == 0 ? c.value : std::max(s.max, c.value);
+        s.sum += c.value;
+        ++s.n;
+      }
+      dropped += b->dropped;
+    }
+  }
+
+  std::string table;
+  char line[256];
+  const auto ms = [](const std::int64_t ns) {
+    return static_cast<double>(ns) / 1.0e6;
+  };
+
+  std::snprintf(line, sizeof(line), "%-28s %8s %12s %10s %10s %10s %10s\n",
+                "span", "count", "total ms", "mean ms", "p50 ms", "p95 ms",
+                "max ms");
+  table += line;
+  for (auto const& [name, h] : spans) {
+    std::snprintf(line, sizeof(line),
+                  "%-28s %8llu %12.2f %10.3f %10.3f %10.3f %10.3f\n",
+                  name.c_str(), static_cast<unsigned long long>(h.count()),
+                  ms(h.total_ns()),
+                  ms(h.total_ns()) / static_cast<double>(h.count()),
+                  ms(h.percentile(0.5)), ms(h.percentile(0.95)),
+                  ms(h.max_ns()));
+    table += line;
+  }
+
+  if (!counters.empty()) {
+    std::snprintf(line, sizeof(line), "\n%-28s %8s %12s %10s %10s\n",
+                  "counter", "frames", "mean", "min", "max");
+    table += line;
+    for (auto const& [name, s] : counters) {
+      std::snprintf(line, sizeof(line), "%-28s %8llu %12.3f %10.3f %10.3f\n",
+                    name.c_str(), static_cast<unsigned long long>(s.n),
+                    s.sum / static_cast<double>(s.n), s.min, s.max);
+      table += line;
+    }
+  }
+
+  if (dropped > 0) {
+    std::snprintf(line, sizeof(line), "\n%llu trace events dropped\n",
+                  static_cast<unsigned long long>(dropped));
+    table += line;
+  }
+
+  return table;
+}
+
+auto profiler::reset() -> void {
+  std::lock_guard buffers_lock(buffers_mutex_);
+  for (auto const& b : buffers_) {
+    std::lock_guard lock(b->mutex);
+    b->spans.clear();
+    b->counters.clear();
+    b->histograms.clear();
+    b->dropped = 0;
+  }
+  epoch_ns_ = now_ns();
+}
+}  // namespace prof
@@ -0,0 +1,442 @@
+/// PROJECT: Video Stabilizer
+/// DESCRIPTION: End-to-end throughput and accuracy regression harness.
+///
+/// Generates a synthetic shaky clip with a known camera trajectory, runs the
+/// full stabilization pipeline on it and reports the throughput, the peak
+/// resident memory and the error of the estimated trajectory against the
+/// ground truth. Exits with a non-zero code if either the throughput or the
+/// error is outside the given thresholds, so it can gate speed-oriented
+/// changes without any external footage.
+///
+/// Per-machine throughput thresholds can be set with the VIDSTAB_MIN_FPS
+/// environment variable instead of --min-fps.
+///
+/// With --max-stage-mb, or VIDSTAB_MAX_STAGE_MB, every allocation is
+/// attributed to the stage that made it, and the run fails if the memory
+/// live while any stage ran peaks above the limit, so memory regressions
+/// show up next to speed ones.
+///
+/// Before the pipeline runs, every warp kernel the CPU supports is checked
+/// against the scalar one, which it must match bit for bit, and against
+/// cv::warpPerspective(), which it must stay close to. --warp-only runs that
+/// check alone.
+///
+/// The preview cache is also driven headless, over a clip with a frame that
+/// can't be read, and must build its proxies and thumbnails within its
+/// budget. --preview-only runs that check alone.
+///
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "image/warp.h"
+#include "memory/frame_pool.h"
+#include "profiler/allocations.h"
+#include "profiler/memory.h"
+#include "profiler/profiler.h"
+#include "video/frame_source.h"
+#include "video/preview.h"
+#include "video/stabilizer.h"
+#include "video/synthetic.h"
+
+namespace {
+enum exit_code : int { passed = 0, failed = 1, bad_usage = 2 };
+
+struct options {
+  int width = 1280;
+  int height = 720;
+  int frames = 60;
+  std::uint64_t seed = 1;
+  double magnitude = 1.0;
+  int jpeg_quality = 0;
+  double min_fps = 0.0;
+  double max_error = 2.0;
+  double max_stage_mb = 0.0;
+  std::string trace_path;
+  std::string memory_report;
+  bool warp_only = false;
+  bool preview_only = false;
+};
+
+// Largest mean difference from cv::warpPerspective(), per channel, and
+// largest share of pixels more than a couple of levels off. The kernels round
+// coordinates in single precision, so a few pixels land on the other side of
+// a 1/32 step.
+constexpr double max_warp_mean_error = 0.5;
+constexpr double max_warp_outliers = 0.005;
+
+auto print_usage() -> void {
+  std::cerr
+      << "Usage: regress [options]\n"
+         "  --width <px>          Frame width (default 1280)\n"
+         "  --height <px>         Frame height (default 720)\n"
+         "  --frames <n>          Number of frames (default 60)\n"
+         "  --seed <n>            Seed for the texture and trajectory\n"
+         "  --magnitude <x>       Camera shake magnitude (default 1.0)\n"
+         "  --jpeg-quality <q>    Simulate encoding at JPEG quality 1-100\n"
+         "  --min-fps <fps>       Fail below this throughput "
+         "(default $VIDSTAB_MIN_FPS or 0)\n"
+         "  --max-error <px>      Fail above this mean trajectory error "
+         "(default 2.0)\n"
+         "  --max-stage-mb <MB>   Fail if any stage peaks above this "
+         "much memory\n"
+         "                        (default $VIDSTAB_MAX_STAGE_MB or 0, no "
+         "limit)\n"
+         "  --trace <file>        Write a Chrome trace of the run\n"
+         "  --memory-report <file> Write each stage's allocations and a "
+         "memory timeline\n"
+         "  --warp-only           Only check the warp kernels\n"
+         "  --preview-only        Only check the preview cache\n";
+}
+
+/**
+ * @brief Warps a textured image on every instruction set the CPU supports,
+ * by translations, affine and perspective maps, into the picture and into a
+ * region past its edges, and returns whether every instruction set matched
+ * the scalar kernels exactly and stayed close to OpenCV.
+ */
+auto check_warp_kernels() -> bool {
+  // Odd sizes leave a tail after every block of pixels
+  const cv::Size size(333, 211);
+  const auto src = vid::synthetic::textured_frame(size, 5);
+  const cv::Scalar border(10.0, 20.0, 30.0);
+
+  const auto c = cv::Point2d(size.width / 2.0, size.height / 2.0);
+  const auto similarity = [&](const double angle, const double scale,
+                              const double tx, const double ty) {
+    const auto a = std::cos(angle) * scale;
+    const auto b = std::sin(angle) * scale;
+    return cv::Matx33d(a, -b, c.x - a * c.x + b * c.y + tx, b, a,
+                       c.y - b * c.x - a * c.y + ty, 0.0, 0.0, 1.0);
+  };
+
+  const auto translation = [](const double tx, const double ty) {
+    return cv::Matx33d(1.0, 0.0, tx, 0.0, 1.0, ty, 0.0, 0.0, 1.0);
+  };
+  const auto tilt = [](const double px, const double py) {
+    return cv::Matx33d(1.0, 0.0, 0.0, 0.0, 1.0, 0.0, px, py, 1.0);
+  };
+
+  struct warp_case {
+    const char* name;
+    cv::Matx33d h;
+  };
+  const warp_case cases[] = {
+      {"whole pixel translation", translation(5.0, -7.0)},
+      {"sub-pixel translation", translation(3.3, -2.71)},
+      {"translation past the edges", translation(-60.4, 45.2)},
+      {"rotation and zoom", similarity(0.09, 1.07, 4.5, -3.2)},
+      {"rotation and shrink", similarity(-0.3, 0.6, 0.0, 0.0)},
+      {"perspective", similarity(0.05, 1.0, 2.0, 1.0) * tilt(4e-4, -3e-4)},
+      {"strong perspective", tilt(3e-3, 1e-3)},
+      // The horizon crosses the picture, so some pixels map behind the camera
+      {"horizon", cv::Matx33d(1.0, 0.1, 0.0, 0.05, 1.0, 0.0, -4e-3, 1e-3, 1.0)
+                      .inv()},
+  };
+  const cv::Rect regions[] = {
+      {0, 0, size.width, size.height},
+      {-25, -17, size.width + 50, size.height + 34},
+  };
+
+  const auto best = img::best_warp_isa();
+  auto passed = true;
+  for (auto const& test : cases) {
+    for (auto const& region : regions) {
+      const cv::Mat h(test.h);
+
+      cv::Mat scalar;
+      img::warp_perspective(src, scalar, h, region, border,
+                            img::warp_isa::scalar);
+
+      for (const auto isa :
+           {img::warp_isa::sse4, img::warp_isa::avx2, img::warp_isa::avx512}) {
+        if (isa > best) break;
+
+        cv::Mat out;
+        img::warp_perspective(src, out, h, region, border, isa);
+        if (cv::norm(out, scalar, cv::NORM_INF) != 0.0) {
+          std::cerr << "FAIL: " << img::warp_isa_name(isa) << " warp of "
+                    << test.name << " to " << region
+                    << " differs from scalar\n";
+          passed = false;
+        }
+      }
+
+      // OpenCV warps to the region from the picture shifted by its offset
+      const cv::Matx33d shift(1.0, 0.0, -region.x, 0.0, 1.0, -region.y, 0.0,
+                              0.0, 1.0);
+      cv::Mat reference;
+      cv::warpPerspective(src, reference, cv::Mat(shift * test.h),
+                          region.size(), cv::INTER_LINEAR,
+                          cv::BORDER_CONSTANT, border);
+
+      cv::Mat diff;
+      cv::absdiff(scalar, reference, diff);
+      const auto mean_error = cv::mean(diff);
+      cv::Mat channels[3];
+      cv::split(diff, channels);
+      cv::Mat worst;
+      cv::max(channels[0], channels[1], worst);
+      cv::max(worst, channels[2], worst);
+      const auto outliers =
+          static_cast<double>(cv::countNonZero(worst > 2)) /
+          static_cast<double>(diff.total());
+      const auto mean = std::max({mean_error[0], mean_error[1],
+                                  mean_error[2]});
+      if (mean > max_warp_mean_error || outliers > max_warp_outliers) {
+        std::cerr << "FAIL: warp of " << test.name << " to " << region
+                  << " is " << mean << " levels off OpenCV on average, "
+                  << outliers * 100.0 << "% of pixels by more than 2\n";
+        passed = false;
+      }
+    }
+  }
+
+  std::cout << "Warp kernels:     " << (passed ? "match" : "differ")
+            << " up to " << img::warp_isa_name(best) << "\n";
+
+  return passed;
+}
+
+/**
+ * @brief Previews a short clip, one of whose frames is empty as if it
+ * couldn't be read back from disk, with a cache that only holds a few
+ * proxies, and returns whether the proxies, thumbnails and cache behaved.
+ */
+auto check_preview() -> bool {
+  constexpr int frame_count = 8;
+  const cv::Size size(320, 180);
+  constexpr int missing = 3;
+
+  std::vector<cv::Mat> frames;
+  for (auto i = 0; i < frame_count; ++i) {
+    frames.push_back(i == missing ? cv::Mat{}
+                                  : vid::synthetic::textured_frame(size, i));
+  }
+
+  vid::preview_options options;
+  options.proxy_width = 160;
+  options.thumbnail_width = 40;
+  options.thumbnail_count = frame_count;
+  // Room for half the proxies, so building them all evicts some
+  const auto proxy_bytes = std::size_t{160} * 90 * 4;
+  options.cache_bytes = proxy_bytes * frame_count / 2;
+
+  vid::preview preview{options};
+  const auto t = vid::track::original;
+  preview.set_source(t, frames, 30);
+  preview.wait_idle();
+
+  auto passed = true;
+  const auto expect = [&](const bool ok, const char* what) {
+    if (!ok) {
+      std::cerr << "FAIL: preview " << what << "
+";
+      passed = false;
+    }
+  };
+
+  const auto strip = preview.thumbnails(t);
+  expect(static_cast<int>(strip.frames.size()) == frame_count &&
+             strip.atlas.size() ==
+                 cv::Size(strip.thumbnail_size.width * frame_count,
+                          strip.thumbnail_size.height) &&
+             strip.thumbnail_size.width == options.thumbnail_width,
+         "thumbnails have the wrong layout");
+
+  for (auto i = 0; i < frame_count; ++i) {
+    const auto proxy = preview.frame(t, i);
+    if (i == missing) {
+      expect(proxy.empty(), "proxy of an unreadable frame isn't empty");
+      continue;
+    }
+    expect(proxy.type() == CV_8UC4 &&
+               proxy.size() == cv::Size(options.proxy_width, 90),
+           "proxy has the wrong size or type");
+  }
+  expect(preview.frame(t, frame_count).empty(),
+         "proxy of a frame past the end isn't empty");
+
+  auto const& cache = preview.cache();
+  expect(cache.bytes() <= cache.capacity(), "cache is over its budget");
+  expect(cache.evictions() > 0, "cache never evicted a proxy");
+
+  // The first frame was evicted by the later ones, so it's built again
+  expect(preview.try_frame(t, 0).empty(), "evicted proxy is still cached");
+  preview.wait_idle();
+  expect(!preview.try_frame(t, 0).empty(), "requested proxy wasn't built");
+
+  preview.clear(t);
+  expect(preview.frame_count(t) == 0 && preview.frame(t, 0).empty(),
+         "cleared track still has frames");
+
+  std::cout << "Preview cache:    " << (passed ? "works" : "fails") << "\n";
+
+  return passed;
+}
+
+auto parse_args(const int argc, char** argv, options& opts) -> bool {
+  if (const auto* env = std::getenv("VIDSTAB_MIN_FPS")) {
+    opts.min_fps = std::atof(env);
+  }
+  if (const auto* env = std::getenv("VIDSTAB_MAX_STAGE_MB")) {
+    opts.max_stage_mb = std::atof(env);
+  }
+
+  for (auto i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--warp-only") {
+      opts.warp_only = true;
+      continue;
+    }
+    if (arg == "--preview-only") {
+      opts.preview_only = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* value = argv[++i];
+
+    if (arg == "--width") opts.width = std::atoi(value);
+    else if (arg == "--height") opts.height = std::atoi(value);
+    else if (arg == "--frames") opts.frames = std::atoi(value);
+    else if (arg == "--seed") opts.seed = std::strtoull(value, nullptr, 10);
+    else if (arg == "--magnitude") opts.magnitude = std::atof(value);
+    else if (arg == "--jpeg-quality") opts.jpeg_quality = std::atoi(value);
+    else if (arg == "--min-fps") opts.min_fps = std::atof(value);
+    else if (arg == "--max-error") opts.max_error = std::atof(value);
+    else if (arg == "--max-stage-mb") opts.max_stage_mb = std::atof(value);
+    else if (arg == "--trace") opts.trace_path = value;
+    else if (arg == "--memory-report") opts.memory_report = value;
+    else return false;
+  }
+
+  return opts.width > 0 && opts.height > 0 && opts.frames > 1;
+}
+}  // namespace
+
+auto main(const int argc, char** argv) -> int {
+  options opts;
+  if (!parse_args(argc, argv, opts)) {
+    print_usage();
+    return bad_usage;
+  }
+
+  // Run on the same allocator as the applications
+  mem::frame_pool::instance()->install();
+
+  const auto warp_matches = opts.preview_only || check_warp_kernels();
+  const auto preview_works = opts.warp_only || check_preview();
+  if (opts.warp_only || opts.preview_only) {
+    return warp_matches && preview_works ? passed : failed;
+  }
+
+  // Tracking costs a little on every allocation, so it's only on when asked
+  // for, and started before the clip is generated so its frames count
+  const auto track_memory =
+      opts.max_stage_mb > 0.0 || !opts.memory_report.empty();
+  auto* const tracker = prof::memory_tracker::instance();
+  if (track_memory) tracker->start();
+
+  const cv::Size size(opts.width, opts.height);
+  std::cout << "Generating " << opts.frames << " frames at " << size << "\n";
+  vid::synthetic_source source{size, opts.frames, opts.seed, opts.magnitude,
+                               opts.jpeg_quality};
+  vid::video in;
+  in.load_from_source(source);
+  vid::video out;
+  vid::stabilizer stabilizer;
+
+  if (!opts.trace_path.empty()) prof::profiler::instance()->set_enabled(true);
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto stabilized = stabilizer.stabilize(&in, &out);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (!stabilized) {
+    std::cerr << "Error: stabilization failed\n";
+    return failed;
+  }
+
+  // Compare every estimated inter-frame homography with the ground truth
+  auto mean_error = 0.0, max_error = 0.0;
+  const auto& h_mats = stabilizer.h_mats();
+  for (auto i = 1; i < opts.frames; ++i) {
+    const auto error =
+        vid::synthetic::corner_error(h_mats[i], source.h_mats()[i], size);
+    mean_error += error;
+    max_error = std::max(max_error, error);
+  }
+  mean_error /= static_cast<double>(opts.frames - 1);
+
+  const auto fps = static_cast<double>(opts.frames) / elapsed.count();
+  const auto peak_mb =
+      static_cast<double>(prof::peak_rss_bytes()) / (1024.0 * 1024.0);
+  const auto pool = mem::frame_pool::instance()->stats();
+
+  std::cout << "Elapsed:          " << elapsed.count() << " s\n"
+            << "Throughput:       " << fps << " fps\n"
+            << "Peak RSS:         " << peak_mb << " MB\n"
+            << "Frame buffers:    " << pool.reuses << " of "
+            << pool.allocations << " reused\n"
+            << "Trajectory error: " << mean_error << " px mean, " << max_error
+            << " px max\n";
+
+  if (!opts.trace_path.empty()) {
+    std::cout << prof::profiler::instance()->summary();
+    if (!prof::profiler::instance()->export_trace(opts.trace_path)) {
+      std::cerr << "Error: could not write trace to " << opts.trace_path
+                << "\n";
+    }
+  }
+
+  auto worst_stage = std::string{};
+  auto worst_stage_mb = 0.0;
+  if (track_memory) {
+    tracker->stop();
+    std::cout << tracker->summary();
+    for (auto const& stage : tracker->stages()) {
+      const auto mb =
+          static_cast<double>(stage.peak_total_bytes) / (1024.0 * 1024.0);
+      if (mb > worst_stage_mb) {
+        worst_stage = stage.name;
+        worst_stage_mb = mb;
+      }
+    }
+
+    if (!opts.memory_report.empty() &&
+        !tracker->export_report(opts.memory_report)) {
+      std::cerr << "Error: could not write memory report to "
+                << opts.memory_report << "\n";
+    }
+  }
+
+  auto result = warp_matches && preview_works ? passed : failed;
+  if (fps < opts.min_fps) {
+    std::cerr << "FAIL: throughput " << fps << " fps is below " << opts.min_fps
+              << " fps\n";
+    result = failed;
+  }
+  if (opts.max_stage_mb > 0.0 && worst_stage_mb > opts.max_stage_mb) {
+    std::cerr << "FAIL: stage " << worst_stage << " peaked at "
+              << worst_stage_mb << " MB, above " << opts.max_stage_mb
+              << " MB\n";
+    result = failed;
+  }
+  if (!(mean_error <= opts.max_error)) {
+    std::cerr << "FAIL: trajectory error " << mean_error << " px is above "
+              << opts.max_error << " px\n";
+    result = failed;
+  }
+
+  return result;
+}
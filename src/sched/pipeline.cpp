@@ -0,0 +1,103 @@
+#include "sched/pipeline.h"
+
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <utility>
+
+namespace sched {
+pipeline::context::item_timer::~item_timer() {
+  const auto elapsed = std::chrono::steady_clock::now() - start_;
+  ctx_.items_.fetch_add(1, std::memory_order_relaxed);
+  ctx_.busy_ns_.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+      std::memory_order_relaxed);
+}
+
+pipeline::pipeline(std::stop_token stop) : external_{std::move(stop)} {}
+
+auto pipeline::add_stage(std::string name, const int workers,
+                         std::function<void(context&)> body,
+                         std::function<void()> done) -> void {
+  auto& s = stages_.emplace_back();
+  s.name = std::move(name);
+  s.workers = std::max(workers, 1);
+  s.body = std::move(body);
+  s.done = std::move(done);
+}
+
+auto pipeline::on_stop(std::function<void()> f) -> void {
+  on_stop_.push_back(std::move(f));
+}
+
+auto pipeline::run() -> bool {
+  const auto start = std::chrono::steady_clock::now();
+
+  source_ = {};
+  error_ = nullptr;
+  for (auto& s : stages_) {
+    s.running.store(s.workers, std::memory_order_relaxed);
+    s.items.store(0, std::memory_order_relaxed);
+    s.busy_ns.store(0, std::memory_order_relaxed);
+  }
+
+  // Stopping closes the queues, waking any worker asleep on one. The
+  // callbacks run on whichever thread requests the stop.
+  const auto close_all = [this]() {
+    for (auto const& f : on_stop_) f();
+  };
+  const std::stop_callback on_stop{source_.get_token(), close_all};
+  std::optional<std::stop_callback<std::function<void()>>> forward;
+  if (external_.stop_possible()) {
+    forward.emplace(external_, [this]() { source_.request_stop(); });
+  }
+
+  {
+    std::vector<std::jthread> threads;
+    for (auto& s : stages_) {
+      for (auto i = 0; i < s.workers; ++i) {
+        threads.emplace_back([this, &s]() { run_worker(s); });
+      }
+    }
+  }
+
+  wall_s_ = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count();
+
+  if (error_) std::rethrow_exception(error_);
+
+  return !source_.stop_requested();
+}
+
+auto pipeline::stats() const -> std::vector<stage_stats> {
+  std::vector<stage_stats> stats;
+  stats.reserve(stages_.size());
+  for (auto const& s : stages_) {
+    stats.push_back(
+        {s.name, s.workers, s.items.load(std::memory_order_relaxed),
+         static_cast<double>(s.busy_ns.load(std::memory_order_relaxed)) *
+             1e-9});
+  }
+
+  return stats;
+}
+
+auto pipeline::run_worker(stage& s) -> void {
+  context ctx{source_, s.items, s.busy_ns};
+  try {
+    s.body(ctx);
+  } catch (...) {
+    {
+      std::lock_guard lock(error_mutex_);
+      if (!error_) error_ = std::current_exception();
+    }
+    source_.request_stop();
+  }
+
+  // The last worker out hands over to the next stage
+  if (s.running.fetch_sub(1, std::memory_order_acq_rel) == 1 && s.done) {
+    s.done();
+  }
+}
+}  // namespace sched
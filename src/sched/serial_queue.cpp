@@ -0,0 +1,42 @@
+#include "sched/serial_queue.h"
+
+#include <utility>
+
+namespace sched {
+serial_queue::serial_queue(std::function<void()> wake)
+    : wake_{std::move(wake)} {}
+
+auto serial_queue::submit(const int priority, std::function<void()> task)
+    -> void {
+  {
+    std::lock_guard lock(mutex_);
+    queue_.push({priority, next_seq_++, std::move(task)});
+  }
+
+  if (wake_) wake_();
+}
+
+auto serial_queue::drain() -> int {
+  auto count = 0;
+  while (true) {
+    std::function<void()> fn;
+    {
+      std::lock_guard lock(mutex_);
+      if (queue_.empty()) return count;
+
+      // Popped straight away, so moving out of the top is safe
+      fn = std::move(const_cast<task&>(queue_.top()).fn);
+      queue_.pop();
+    }
+
+    // Run without the lock, since tasks may queue more tasks
+    fn();
+    ++count;
+  }
+}
+
+auto serial_queue::empty() const -> bool {
+  std::lock_guard lock(mutex_);
+  return queue_.empty();
+}
+}  // namespace sched
@@ -0,0 +1,130 @@
+#include "sched/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace sched {
+thread_pool::thread_pool(int threads) {
+  if (threads < 1) {
+    threads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  workers_.reserve(threads);
+  for (auto i = 0; i < threads; ++i)
+    workers_.emplace_back([this]() { worker_loop(); });
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+
+  for (auto& worker : workers_) worker.join();
+}
+
+auto thread_pool::submit(const int priority, std::function<void()> task)
+    -> void {
+  {
+    std::lock_guard lock(mutex_);
+    queue_.push({priority, next_seq_++, std::move(task)});
+  }
+  work_cv_.notify_one();
+}
+
+auto thread_pool::worker_loop() -> void {
+  while (true) {
+    std::function<void()> fn;
+    {
+      std::unique_lock lock(mutex_);
+      work_cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+
+      // Only stop once everything queued has run
+      if (queue_.empty()) return;
+
+      // The queue only hands out const references, but the task is popped
+      // straight away so moving out of it is safe
+      fn = std::move(const_cast<task&>(queue_.top()).fn);
+      queue_.pop();
+      ++running_;
+    }
+
+    fn();
+
+    {
+      std::lock_guard lock(mutex_);
+      --running_;
+      if (running_ == 0 && queue_.empty()) idle_cv_.notify_all();
+    }
+  }
+}
+
+auto thread_pool::wait_idle() -> void {
+  std::unique_lock lock(mutex_);
+  idle_cv_.wait(lock, [this]() { return running_ == 0 && queue_.empty(); });
+}
+
+auto thread_pool::parallel_for(const int begin, const int end, const int grain,
+                               const int priority,
+                               std::function<void(int, int)> const& body)
+    -> void {
+  if (begin >= end) return;
+
+  const auto step = std::max(1, grain);
+  const auto chunks = (end - begin + step - 1) / step;
+
+  // Shared with the helper tasks, which may still be queued after the loop
+  // has finished and must then find nothing left to do
+  struct loop_state {
+    std::atomic<int> next{0};
+    std::atomic<int> remaining{0};
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<loop_state>();
+  state->remaining = chunks;
+
+  // Claims and runs chunks until there are none left. Returns once this
+  // thread can't help any further.
+  auto work = [state, &body, begin, end, step, chunks]() {
+    while (true) {
+      const auto chunk = state->next.fetch_add(1);
+      if (chunk >= chunks) return;
+
+      const auto lo = begin + chunk * step;
+      const auto hi = std::min(end, lo + step);
+      try {
+        body(lo, hi);
+      } catch (...) {
+        std::lock_guard lock(state->mutex);
+        if (!state->error) state->error = std::current_exception();
+      }
+
+      if (state->remaining.fetch_sub(1) == 1) {
+        std::lock_guard lock(state->mutex);
+        state->done_cv.notify_all();
+      }
+    }
+  };
+
+  // The calling thread takes part too, so at most size() helpers are useful
+  const auto helpers = std::min(chunks - 1, size());
+  for (auto i = 0; i < helpers; ++i) {
+    // Helpers only touch `body` while chunks remain, and the caller can't
+    // return before every chunk has finished, so the reference stays valid
+    submit(priority, work);
+  }
+
+  work();
+
+  std::unique_lock lock(state->mutex);
+  state->done_cv.wait(lock, [&]() { return state->remaining.load() == 0; });
+
+  if (state->error) std::rethrow_exception(state->error);
+}
+}  // namespace sched
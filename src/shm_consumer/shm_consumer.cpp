@@ -0,0 +1,166 @@
+/// PROJECT: Video Stabilizer
+/// DESCRIPTION: Reference reader of the shared memory output.
+///
+/// Maps the ring a stabilizer writes to with an shm:<name> output, and reads
+/// every frame in place, as a downstream analysis process on the same host
+/// would. Reports the frames read each second, the latency from publishing
+/// a frame to reading it, and any frames the writer dropped or skipped.
+///
+/// Start it before the writer, which creates the ring once it has its first
+/// frame:
+///
+///   shm_consumer stabilized &
+///   stabilize_cli --stream in.mp4 shm:stabilized
+///
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <string>
+#include <string_view>
+
+#include "video/shm_ring.h"
+
+namespace {
+enum exit_code : int { success = 0, failed = 1, bad_usage = 2 };
+
+struct options {
+  std::string name;
+  // Seconds to wait for the ring to appear, and then for each frame
+  double timeout_s = 10.0;
+  // Whether to read every pixel, as an analysis would
+  bool touch = false;
+};
+
+auto print_usage() -> void {
+  std::cerr << "Usage: shm_consumer [options] <name>\n"
+               "  --timeout <s>    Wait this long for the ring and for each "
+               "frame\n"
+               "                   (default 10)\n"
+               "  --touch          Read every pixel of every frame\n";
+}
+
+auto parse_args(const int argc, char** argv, options& opts) -> bool {
+  for (auto i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--touch") {
+      opts.touch = true;
+    } else if (arg == "--timeout" && i + 1 < argc) {
+      opts.timeout_s = std::atof(argv[++i]);
+    } else if (!arg.starts_with("--") && opts.name.empty()) {
+      opts.name = arg;
+    } else {
+      return false;
+    }
+  }
+
+  return !opts.name.empty() && opts.timeout_s > 0.0;
+}
+
+auto steady_ns() -> std::int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Latency and frame counts over a reporting interval.
+ */
+struct interval {
+  std::uint64_t frames = 0;
+  double latency_ms = 0.0;
+  double max_latency_ms = 0.0;
+
+  auto add(const double ms) -> void {
+    ++frames;
+    latency_ms += ms;
+    max_latency_ms = std::max(max_latency_ms, ms);
+  }
+
+  auto print(const double seconds, const std::uint64_t dropped) const
+      -> void {
+    std::cout << frames << " frames, "
+              << static_cast<double>(frames) / seconds << " fps, latency "
+              << (frames > 0 ? latency_ms / static_cast<double>(frames) : 0.0)
+              << " ms mean, " << max_latency_ms << " ms max, " << dropped
+              << " dropped\n";
+  }
+};
+}  // namespace
+
+auto main(const int argc, char** argv) -> int {
+  options opts;
+  if (!parse_args(argc, argv, opts)) {
+    print_usage();
+    return bad_usage;
+  }
+
+  const auto timeout = std::chrono::milliseconds(
+      static_cast<std::int64_t>(opts.timeout_s * 1000.0));
+
+  vid::shm_reader reader{opts.name};
+  if (!reader.connect(timeout)) return failed;
+
+  const auto size = reader.size();
+  std::cout << "Reading " << size.width << "x" << size.height << " "
+            << (reader.format() == img::pixel_format::i420 ? "I420" : "BGR")
+            << " frames at " << reader.fps() << " fps from " << opts.name
+            << "\n";
+
+  const auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+  interval total;
+  interval second;
+  std::int64_t next_index = 0;
+  std::uint64_t skipped = 0;
+  auto checksum = 0.0;
+
+  vid::shm_frame frame;
+  auto status = vid::shm_reader::status::frame;
+  while ((status = reader.acquire(frame, timeout)) ==
+         vid::shm_reader::status::frame) {
+    const auto latency_ms =
+        static_cast<double>(steady_ns() - frame.published_ns) / 1e6;
+    total.add(latency_ms);
+    second.add(latency_ms);
+
+    // Frames the writer dropped leave gaps in the stream's numbering
+    if (frame.index > next_index) {
+      skipped += static_cast<std::uint64_t>(frame.index - next_index);
+    }
+    next_index = frame.index + 1;
+
+    if (opts.touch) checksum += cv::sum(frame.frame)[0];
+
+    reader.release();
+
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> since = now - last_report;
+    if (since.count() >= 1.0) {
+      second.print(since.count(), reader.dropped());
+      second = interval{};
+      last_report = now;
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Total: ";
+  total.print(elapsed.count(), reader.dropped());
+  if (skipped > 0) std::cout << skipped << " frames skipped\n";
+  if (opts.touch) std::cout << "Checksum: " << checksum << "\n";
+
+  switch (status) {
+    case vid::shm_reader::status::finished:
+      return success;
+    case vid::shm_reader::status::timeout:
+      std::cerr << "Error: no frame for " << opts.timeout_s << " s\n";
+      return failed;
+    default:
+      std::cerr << "Error: the writer gave up\n";
+      return failed;
+  }
+}
@@ -0,0 +1,218 @@
+#include "video/batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <opencv2/videoio.hpp>
+
+#include "memory/governor.h"
+#include "profiler/profiler.h"
+
+namespace vid {
+namespace {
+using batch_clock = std::chrono::steady_clock;
+
+auto seconds_between(const batch_clock::time_point from,
+                     const batch_clock::time_point to) -> double {
+  return std::chrono::duration<double>(to - from).count();
+}
+
+/**
+ * @brief Returns roughly how many bytes of frames a job holds at its peak,
+ * when the original and stabilized frames are both in memory, or 0 if the
+ * input can't be opened.
+ */
+auto estimated_bytes(batch_job const& job, const img::pixel_format format)
+    -> std::size_t {
+  cv::VideoCapture capture(job.input.string());
+  if (!capture.isOpened()) return 0;
+
+  const auto frames = std::max(capture.get(cv::CAP_PROP_FRAME_COUNT), 0.0);
+  const cv::Size size(
+      static_cast<int>(capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+      static_cast<int>(capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  const auto bytes_per_pixel =
+      format == img::pixel_format::i420 && img::fits_i420(size) ? 1.5 : 3.0;
+
+  return static_cast<std::size_t>(frames * size.area() * bytes_per_pixel *
+                                  2.0);
+}
+
+/**
+ * @brief Loads, stabilizes and exports a single video. Every stage that can
+ * run in parallel does so on the pool at the given priority.
+ */
+auto run_job(batch_job const& job, batch_options const& options,
+             sched::thread_pool& pool, const int priority,
+             const batch_clock::time_point batch_start,
+             std::stop_token const& stop) -> batch_result {
+  prof::scoped_timer timer{"batch_job"};
+
+  batch_result result;
+  result.job = job;
+
+  auto start = batch_clock::now();
+  result.started_s = seconds_between(batch_start, start);
+
+  const auto fail = [&](const char* error) {
+    result.error = stop.stop_requested() ? "cancelled" : error;
+    result.finished_s = seconds_between(batch_start, batch_clock::now());
+    return result;
+  };
+  if (stop.stop_requested()) return fail("cancelled");
+
+  video out;
+  {
+    video in;
+    in.set_load_format(options.format);
+    in.load_video_from_file(job.input, nullptr, stop);
+    result.load_s = seconds_between(start, batch_clock::now());
+    result.frames = in.frame_count();
+
+    if (in.empty()) return fail("could not load video");
+
+    // The stabilizer only lives as long as this stage
+    start = batch_clock::now();
+    stabilizer s{options.stabilizer};
+    s.set_thread_pool(&pool, priority);
+    if (!options.checkpoint_dir.empty()) {
+      // Inputs with the same name overwrite each other's checkpoints, but
+      // the fingerprint stops them from resuming the wrong one
+      s.set_checkpoint_path(options.checkpoint_dir /
+                            (job.input.stem().string() + ".checkpoint"));
+    }
+    if (!s.stabilize(&in, &out, stop)) {
+      return fail("could not stabilize video");
+    }
+    result.stabilize_s = seconds_between(start, batch_clock::now());
+  }
+
+  start = batch_clock::now();
+  result.ok = out.export_to_path(job.output, job.fourcc, nullptr, stop);
+  if (!result.ok) {
+    result.error =
+        stop.stop_requested() ? "cancelled" : "could not write video";
+  }
+  result.export_s = seconds_between(start, batch_clock::now());
+  result.finished_s = seconds_between(batch_start, batch_clock::now());
+
+  return result;
+}
+}  // namespace
+
+auto run_batch(std::vector<batch_job> const& jobs,
+               batch_options const& options, sched::thread_pool& pool,
+               std::function<void(batch_result const&)> const& on_done,
+               std::stop_token stop) -> std::vector<batch_result> {
+  std::vector<batch_result> results(jobs.size());
+  if (jobs.empty()) return results;
+
+  const auto batch_start = batch_clock::now();
+  const auto total = static_cast<int>(jobs.size());
+
+  const auto in_flight = std::clamp(options.max_in_flight, 1, total);
+
+  // Under a memory budget, each job reserves what its frames are expected to
+  // take while it's in flight
+  const auto budget = mem::governor::instance()->budget();
+  std::vector<std::size_t> estimates(jobs.size(), 0);
+  if (budget > 0) {
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+      estimates[i] = estimated_bytes(jobs[i], options.format);
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable finished_cv;
+  auto finished = 0;
+  auto next_job = 0;
+  auto running = 0;
+  std::size_t reserved = 0;
+
+  // Starts the next job if there's room for it, and returns whether it did.
+  // A job that doesn't fit the budget waits for those in flight to finish,
+  // unless there are none, in which case it runs over budget rather than
+  // never. A job's index is also its priority, so the pool always prefers
+  // work from the oldest job in flight.
+  std::function<bool()> start_next = [&]() {
+    auto index = 0;
+    {
+      std::lock_guard lock(mutex);
+      if (next_job >= total || running >= in_flight) return false;
+
+      index = next_job;
+      if (budget > 0 && running > 0 && reserved + estimates[index] > budget) {
+        return false;
+      }
+      ++next_job;
+      ++running;
+      reserved += estimates[index];
+    }
+
+    pool.submit(index, [&, index]() {
+      try {
+        results[index] =
+            run_job(jobs[index], options, pool, index, batch_start, stop);
+      } catch (std::exception const& e) {
+        results[index].job = jobs[index];
+        results[index].error = e.what();
+      }
+
+      {
+        std::lock_guard lock(mutex);
+        --running;
+        reserved -= estimates[index];
+      }
+
+      // Keep the number of jobs in flight constant, or as close to it as the
+      // budget allows
+      while (start_next()) {
+      }
+
+      std::lock_guard lock(mutex);
+      if (on_done) on_done(results[index]);
+      ++finished;
+      finished_cv.notify_all();
+    });
+
+    return true;
+  };
+
+  while (start_next()) {
+  }
+
+  std::unique_lock lock(mutex);
+  finished_cv.wait(lock, [&]() { return finished == total; });
+
+  return results;
+}
+
+auto write_batch_report(std::vector<batch_result> const& results,
+                        std::filesystem::path const& path) -> bool {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) return false;
+
+  // Quote paths, since they may contain commas
+  const auto quoted = [](std::filesystem::path const& p) {
+    std::string s = "\"";
+    for (const auto c : p.string()) {
+      if (c == '"') s += '"';
+      s += c;
+    }
+    return s + "\"";
+  };
+
+  out << "input,output,status,error,frames,started_s,finished_s,load_s,"
+         "stabilize_s,export_s\n";
+  for (auto const& r : results) {
+    out << quoted(r.job.input) << ',' << quoted(r.job.output) << ','
+        << (r.ok ? "ok" : "failed") << ",\"" << r.error << "\"," << r.frames
+        << ',' << r.started_s << ',' << r.finished_s << ',' << r.load_s << ','
+        << r.stabilize_s << ',' << r.export_s << '\n';
+  }
+
+  return static_cast<bool>(out);
+}
+}  // namespace vid
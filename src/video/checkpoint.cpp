@@ -0,0 +1,185 @@
+#include "video/checkpoint.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+namespace vid {
+namespace {
+// "VSCK" followed by the format version
+constexpr std::array<char, 4> magic{'V', 'S', 'C', 'K'};
+constexpr std::uint32_t version = 1;
+
+// Guards against absurd sizes when reading a damaged file
+constexpr int max_frames = 1 << 26;
+
+/**
+ * @brief 64-bit FNV-1a.
+ */
+class fnv1a {
+ public:
+  auto add(void const* data, const std::size_t size) noexcept -> void {
+    const auto* bytes = static_cast<unsigned char const*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ull;
+    }
+  }
+
+  template <typename T>
+  auto add(T const& value) noexcept -> void {
+    add(&value, sizeof(value));
+  }
+
+  [[nodiscard]] auto value() const noexcept -> std::uint64_t { return hash_; }
+
+ private:
+  std::uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+template <typename T>
+auto write(std::ofstream& out, T const& value) -> void {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+auto read(std::ifstream& in, T& value) -> bool {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+}  // namespace
+
+auto checkpoint_fingerprint(std::vector<cv::Mat> const& frames,
+                            stabilizer_options const& options,
+                            cv::Mat const& mask) -> std::uint64_t {
+  fnv1a hash;
+  auto const& tracker = options.tracker;
+  hash.add(tracker.ransac_iterations);
+  hash.add(tracker.ransac_epsilon);
+  hash.add(tracker.ransac_confidence);
+  hash.add(tracker.max_features);
+  hash.add(tracker.guided_matching);
+  hash.add(tracker.search_radius);
+  hash.add(tracker.min_guided_matches);
+
+  hash.add(options.estimator);
+  auto const& phase = options.phase;
+  hash.add(phase.width);
+  hash.add(phase.rotation_scale);
+  hash.add(phase.min_response);
+
+  auto const& keyframes = options.keyframes;
+  hash.add(keyframes.enabled);
+  hash.add(keyframes.probe_width);
+  hash.add(keyframes.max_deviation);
+  hash.add(keyframes.max_gap);
+  hash.add(keyframes.min_response);
+
+  // The mask is a single 8-bit image, so it's cheap to hash in full
+  if (!mask.empty()) {
+    const auto m = mask.isContinuous() ? mask : mask.clone();
+    hash.add(m.data, m.total() * m.elemSize());
+  }
+
+  const auto count = static_cast<int>(frames.size());
+  hash.add(count);
+  if (count == 0) return hash.value();
+
+  hash.add(frames[0].rows);
+  hash.add(frames[0].cols);
+  hash.add(frames[0].type());
+
+  // Hashing every pixel would take as long as a small stabilization, so
+  // sample a row from a handful of frames spread across the video
+  constexpr auto samples = 8;
+  for (auto s = 0; s < std::min(samples, count); ++s) {
+    auto const& frame = frames[s * (count - 1) / std::max(samples - 1, 1)];
+    if (frame.empty()) continue;
+
+    const auto row = frame.row(frame.rows / 2);
+    if (row.isContinuous()) hash.add(row.data, row.total() * row.elemSize());
+  }
+
+  return hash.value();
+}
+
+auto save_checkpoint(checkpoint const& cp, std::filesystem::path const& path)
+    -> bool {
+  auto tmp = path;
+  tmp += ".tmp";
+
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    out.write(magic.data(), magic.size());
+    write(out, version);
+    write(out, cp.fingerprint);
+    write(out, cp.frame_count);
+    write(out, static_cast<std::int32_t>(cp.indices.size()));
+
+    for (std::size_t i = 0; i < cp.indices.size(); ++i) {
+      write(out, static_cast<std::int32_t>(cp.indices[i]));
+
+      cv::Mat h;
+      cp.h_mats[i].convertTo(h, CV_64FC1);
+      for (auto r = 0; r < 3; ++r) {
+        for (auto c = 0; c < 3; ++c) write(out, h.at<double>(r, c));
+      }
+    }
+
+    if (!out) return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmp, path, error);
+
+  return !error;
+}
+
+auto load_checkpoint(std::filesystem::path const& path, checkpoint& cp)
+    -> bool {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+
+  std::array<char, 4> file_magic{};
+  std::uint32_t file_version = 0;
+  if (!in.read(file_magic.data(), file_magic.size()) || file_magic != magic) {
+    return false;
+  }
+  if (!read(in, file_version) || file_version != version) return false;
+
+  checkpoint loaded;
+  std::int32_t count = 0;
+  if (!read(in, loaded.fingerprint) || !read(in, loaded.frame_count) ||
+      !read(in, count)) {
+    return false;
+  }
+  if (loaded.frame_count < 0 || loaded.frame_count > max_frames || count < 0 ||
+      count > loaded.frame_count) {
+    return false;
+  }
+
+  loaded.indices.reserve(count);
+  loaded.h_mats.reserve(count);
+  for (auto i = 0; i < count; ++i) {
+    std::int32_t index = 0;
+    if (!read(in, index) || index < 0 || index >= loaded.frame_count) {
+      return false;
+    }
+
+    cv::Mat h(3, 3, CV_64FC1);
+    for (auto r = 0; r < 3; ++r) {
+      for (auto c = 0; c < 3; ++c) {
+        if (!read(in, h.at<double>(r, c))) return false;
+      }
+    }
+
+    loaded.indices.push_back(index);
+    loaded.h_mats.push_back(h);
+  }
+
+  cp = std::move(loaded);
+
+  return true;
+}
+}  // namespace vid
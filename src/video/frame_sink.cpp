@@ -0,0 +1,323 @@
+#include "video/frame_sink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "logger/logger.h"
+
+namespace vid {
+namespace {
+/**
+ * @brief Removes a partly written file, unless it's something else at that
+ * path, such as a named pipe.
+ */
+auto remove_partial(std::filesystem::path const& path) -> void {
+  std::error_code error;
+  if (std::filesystem::is_regular_file(path, error)) {
+    std::filesystem::remove(path, error);
+  }
+}
+
+/**
+ * @brief Returns the frame rate as the ratio YUV4MPEG2 expects, keeping the
+ * NTSC rates such as 29.97 exact.
+ */
+auto frame_rate(const double fps) -> std::pair<long, long> {
+  if (fps <= 0.0) return {30, 1};
+
+  if (const auto whole = std::lround(fps);
+      std::abs(fps - static_cast<double>(whole)) < 1e-3) {
+    return {whole, 1};
+  }
+  if (const auto ntsc = std::lround(fps * 1.001);
+      std::abs(fps * 1.001 - static_cast<double>(ntsc)) < 1e-2) {
+    return {ntsc * 1000, 1001};
+  }
+
+  return {std::lround(fps * 1000.0), 1000};
+}
+}  // namespace
+
+//------------------------------------------------------------- frame_sink --//
+auto frame_sink::put(cv::Mat const& frame, const img::pixel_format format)
+    -> bool {
+  const auto to = this->format();
+  if (format == to) return write(frame);
+
+  cv::Mat bgr;
+  img::to_bgr(frame, bgr, format);
+  if (to == img::pixel_format::bgr) return write(bgr);
+
+  cv::Mat converted;
+  img::from_bgr(bgr, converted, to);
+
+  return write(converted);
+}
+
+//------------------------------------------------------------ writer_sink --//
+auto writer_sink::open(const cv::Size size, const double fps) -> bool {
+  writer_.open(path_.string(), fourcc_, fps, size, true);
+  if (!writer_.isOpened()) {
+    logger::instance()->error("Could not open %s to write", path_);
+    return false;
+  }
+
+  logger::instance()->debug("Using %s to write %s", writer_.getBackendName(),
+                            path_);
+
+  return true;
+}
+
+auto writer_sink::write(cv::Mat const& frame) -> bool {
+  writer_.write(frame);
+
+  return true;
+}
+
+auto writer_sink::close() -> bool {
+  writer_.release();
+
+  return true;
+}
+
+auto writer_sink::abort() -> void {
+  writer_.release();
+  remove_partial(path_);
+}
+
+//------------------------------------------------------------ stream_sink --//
+stream_sink::stream_sink(std::filesystem::path path, const container kind)
+    : path_{std::move(path)}, kind_{kind} {}
+
+stream_sink::~stream_sink() {
+  if (file_ && !is_stdout()) std::fclose(file_);
+}
+
+auto stream_sink::open(const cv::Size size, const double fps) -> bool {
+  if (!img::fits_i420(size)) {
+    logger::instance()->error("%dx%d frames can't be written to %s as YUV "
+                              "4:2:0",
+                              size.width, size.height, path_);
+    return false;
+  }
+
+  if (is_stdout()) {
+#ifdef _WIN32
+    // Otherwise bytes that look like line endings get translated
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    file_ = stdout;
+  } else {
+    file_ = std::fopen(path_.string().c_str(), "wb");
+    if (!file_) {
+      logger::instance()->error("Could not open %s to write", path_);
+      return false;
+    }
+  }
+
+  if (kind_ == container::y4m) {
+    // Progressive, square pixels, and chroma sited as ffmpeg's yuv420p
+    const auto [num, den] = frame_rate(fps);
+    if (std::fprintf(file_, "YUV4MPEG2 W%d H%d F%ld:%ld Ip A1:1 C420jpeg\n",
+                     size.width, size.height, num, den) < 0) {
+      logger::instance()->error("Could not write to %s", path_);
+      failed_ = true;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+auto stream_sink::write(cv::Mat const& frame) -> bool {
+  if (!file_ || failed_) return false;
+
+  constexpr char frame_header[] = "FRAME\n";
+  auto written = kind_ != container::y4m ||
+                 std::fwrite(frame_header, sizeof(frame_header) - 1, 1,
+                             file_) == 1;
+
+  // I420 frames are one 8-bit plane, the chroma planes below Y
+  const auto row_bytes = static_cast<std::size_t>(frame.cols) *
+                         frame.elemSize();
+  if (frame.isContinuous()) {
+    written = written && std::fwrite(frame.data, row_bytes * frame.rows, 1,
+                                     file_) == 1;
+  } else {
+    for (auto y = 0; written && y < frame.rows; ++y) {
+      written = std::fwrite(frame.ptr(y), row_bytes, 1, file_) == 1;
+    }
+  }
+
+  if (!written) {
+    logger::instance()->error("Could not write to %s", path_);
+    failed_ = true;
+  }
+
+  return written;
+}
+
+auto stream_sink::close() -> bool {
+  if (!file_) return false;
+
+  auto ok = std::fflush(file_) == 0 && !failed_;
+  if (!is_stdout()) ok = std::fclose(file_) == 0 && ok;
+  file_ = nullptr;
+
+  return ok;
+}
+
+auto stream_sink::abort() -> void {
+  if (!file_) return;
+
+  if (is_stdout()) {
+    std::fflush(file_);
+  } else {
+    std::fclose(file_);
+    remove_partial(path_);
+  }
+  file_ = nullptr;
+}
+
+//--------------------------------------------------------------- shm_sink --//
+shm_sink::shm_sink(std::string name, const img::pixel_format format,
+                   shm_options const& options)
+    : name_{std::move(name)}, format_{format}, options_{options} {}
+
+shm_sink::~shm_sink() = default;
+
+auto shm_sink::open(const cv::Size size, const double fps) -> bool {
+  fps_ = fps > 0.0 ? fps : 30.0;
+  ring_ = shm_ring::create(name_, size, format_, fps_, options_.slots);
+
+  return ring_ != nullptr;
+}
+
+auto shm_sink::write(cv::Mat const& frame) -> bool {
+  if (!ring_ || failed_) return false;
+
+  auto& h = ring_->header();
+  const auto sequence = h.written.load(std::memory_order_relaxed);
+  const auto index = index_++;
+  const auto full = [&]() {
+    return sequence - h.read.load(std::memory_order_acquire) >= h.slot_count;
+  };
+
+  if (full()) {
+    if (options_.drop_when_full) {
+      h.dropped.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    // The event is read before the check, so a slot freed in between wakes
+    // the wait straight away
+    const auto deadline = std::chrono::steady_clock::now() + options_.timeout;
+    while (true) {
+      const auto seen = h.read_event.load(std::memory_order_acquire);
+      if (!full()) break;
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        logger::instance()->error("Nothing read from ring %s for %lld ms",
+                                  name_,
+                                  static_cast<long long>(
+                                      options_.timeout.count()));
+        failed_ = true;
+        return false;
+      }
+      shm_ring::wait(h.read_event, seen,
+                     std::chrono::ceil<std::chrono::milliseconds>(deadline -
+                                                                  now));
+    }
+  }
+
+  auto pixels = ring_->frame(sequence);
+  if (frame.size() != pixels.size() || frame.type() != pixels.type()) {
+    logger::instance()->error("A %dx%d frame doesn't fit ring %s", frame.cols,
+                              frame.rows, name_);
+    failed_ = true;
+    return false;
+  }
+  frame.copyTo(pixels);
+
+  auto& slot = ring_->slot(sequence);
+  slot.sequence = sequence;
+  slot.index = index;
+  slot.timestamp_ns =
+      std::llround(static_cast<double>(index) * 1e9 / fps_);
+  slot.published_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+
+  h.written.store(sequence + 1, std::memory_order_release);
+  shm_ring::notify(h.written_event);
+
+  return true;
+}
+
+auto shm_sink::close() -> bool {
+  if (!ring_) return false;
+
+  auto& h = ring_->header();
+  h.state.store(static_cast<std::uint32_t>(shm::ring_state::finished),
+                std::memory_order_release);
+  shm_ring::notify(h.written_event);
+
+  return !failed_;
+}
+
+auto shm_sink::abort() -> void {
+  if (!ring_) return;
+
+  auto& h = ring_->header();
+  h.state.store(static_cast<std::uint32_t>(shm::ring_state::aborted),
+                std::memory_order_release);
+  shm_ring::notify(h.written_event);
+  ring_.reset();
+}
+
+//-------------------------------------------------------------- open_sink --//
+auto open_sink(std::filesystem::path const& path, const int fourcc,
+               const bool raw) -> std::unique_ptr<frame_sink> {
+  const auto spec = path.string();
+  constexpr std::string_view shm_prefix = "shm:";
+  if (spec.starts_with(shm_prefix)) {
+    // shm:name[:slots[:drop]]
+    shm_options options;
+    auto name = spec.substr(shm_prefix.size());
+    if (const auto colon = name.find(':'); colon != std::string::npos) {
+      auto rest = name.substr(colon + 1);
+      name.resize(colon);
+      options.slots = std::max(std::atoi(rest.c_str()), 1);
+      options.drop_when_full = rest.ends_with(":drop");
+    }
+
+    return std::make_unique<shm_sink>(name, img::pixel_format::bgr, options);
+  }
+
+  if (raw) {
+    return std::make_unique<stream_sink>(path, stream_sink::container::raw);
+  }
+
+  auto ext = path.extension().string();
+  std::ranges::transform(ext, ext.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  if (path == "-" || ext == ".y4m") {
+    return std::make_unique<stream_sink>(path, stream_sink::container::y4m);
+  }
+
+  return std::make_unique<writer_sink>(path, fourcc);
+}
+}  // namespace vid
@@ -0,0 +1,489 @@
+#include "video/frame_source.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "logger/logger.h"
+#include "video/synthetic.h"
+
+namespace vid {
+namespace {
+auto is_image_file(std::filesystem::path const& path) -> bool {
+  static const std::vector<std::string> extensions{
+      ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp"};
+  auto ext = path.extension().string();
+  std::ranges::transform(ext, ext.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+
+  return std::ranges::find(extensions, ext) != extensions.end();
+}
+
+/**
+ * @brief Parses <code>WxH:frames[:seed]</code> for a synthetic source.
+ */
+auto parse_synthetic(std::string const& spec, cv::Size& size, int& frames,
+                     std::uint64_t& seed) -> bool {
+  char* end = nullptr;
+  size.width = static_cast<int>(std::strtol(spec.c_str(), &end, 10));
+  if (*end != 'x') return false;
+  size.height = static_cast<int>(std::strtol(end + 1, &end, 10));
+  if (*end != ':') return false;
+  frames = static_cast<int>(std::strtol(end + 1, &end, 10));
+  if (*end == ':') seed = std::strtoull(end + 1, &end, 10);
+
+  return *end == '\0' && size.width > 0 && size.height > 0 && frames > 0;
+}
+
+auto has_extension(std::filesystem::path const& path, std::string_view ext)
+    -> bool {
+  auto lower = path.extension().string();
+  std::ranges::transform(lower, lower.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+
+  return lower == ext;
+}
+
+auto set_binary(std::FILE* file) -> void {
+#ifdef _WIN32
+  // Otherwise bytes that look like line endings get translated
+  if (file == stdin) _setmode(_fileno(stdin), _O_BINARY);
+#else
+  static_cast<void>(file);
+#endif
+}
+
+auto open_input(std::filesystem::path const& path) -> std::FILE* {
+  return path == "-" ? stdin : std::fopen(path.string().c_str(), "rb");
+}
+
+auto input_name(std::filesystem::path const& path) -> std::string {
+  return path == "-" ? "stdin" : path.filename().string();
+}
+
+/**
+ * @brief Reads a line of text, without its newline. Stream headers are
+ * short, so a longer line isn't one.
+ */
+auto read_line(std::FILE* file, std::string& line) -> bool {
+  constexpr std::size_t max_bytes = 1024;
+
+  line.clear();
+  for (auto c = std::getc(file); c != EOF; c = std::getc(file)) {
+    if (c == '\n') return true;
+    if (line.size() >= max_bytes) return false;
+    line.push_back(static_cast<char>(c));
+  }
+
+  return false;
+}
+
+/**
+ * @brief Reads a frame of the given size and format into a buffer of its
+ * own. A read this big is copied straight into the buffer rather than
+ * through the stream's, so the frame takes a single copy from the OS.
+ */
+auto read_frame(std::FILE* file, const cv::Size size,
+                const img::pixel_format format, std::string const& name,
+                cv::Mat& frame) -> bool {
+  // I420 frames are stored as one 8-bit plane, the chroma planes below Y
+  cv::Mat raw = format == img::pixel_format::i420
+                    ? cv::Mat(size.height * 3 / 2, size.width, CV_8UC1)
+                    : cv::Mat(size, CV_8UC3);
+
+  const auto bytes = raw.total() * raw.elemSize();
+  const auto got = std::fread(raw.data, 1, bytes, file);
+  if (got != bytes) {
+    // A frame cut short is the end of the stream, not a frame
+    if (got != 0) {
+      logger::instance()->warn("Dropping a truncated frame at the end of %s",
+                               name);
+    }
+    return false;
+  }
+
+  frame = raw;
+
+  return true;
+}
+}  // namespace
+
+//----------------------------------------------------------- frame_source --//
+auto frame_source::next(cv::Mat& frame, const img::pixel_format format)
+    -> bool {
+  cv::Mat native;
+  if (!read(native)) return false;
+
+  const auto from = info().format;
+  if (from == format) {
+    frame = native;
+  } else {
+    cv::Mat bgr;
+    img::to_bgr(native, bgr, from);
+    img::from_bgr(bgr, frame, format);
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------- capture_source --//
+capture_source::capture_source(std::filesystem::path const& path)
+    : capture_{path.string()} {
+  info_.name = path.filename().string();
+  if (!capture_.isOpened()) return;
+
+  info_.size =
+      cv::Size(static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_WIDTH)),
+               static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  info_.fps = capture_.get(cv::CAP_PROP_FPS);
+  info_.frame_count = static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_COUNT));
+  info_.fourcc = static_cast<int>(capture_.get(cv::CAP_PROP_FOURCC));
+  info_.bitrate = capture_.get(cv::CAP_PROP_BITRATE);
+}
+
+auto capture_source::read(cv::Mat& frame) -> bool {
+  // A fresh buffer each time, since the capture would otherwise reuse the
+  // previous frame's
+  cv::Mat decoded;
+  if (!capture_.read(decoded)) return false;
+  frame = decoded;
+
+  return true;
+}
+
+//-------------------------------------------------- image_sequence_source --//
+image_sequence_source::image_sequence_source(
+    std::vector<std::filesystem::path> paths, const double fps)
+    : paths_{std::move(paths)} {
+  info_.fps = fps;
+  info_.frame_count = static_cast<int>(paths_.size());
+  if (paths_.empty()) return;
+
+  info_.name = paths_.front().parent_path().filename().string();
+  first_ = cv::imread(paths_.front().string(), cv::IMREAD_COLOR);
+  info_.size = first_.size();
+}
+
+auto image_sequence_source::list_images(std::filesystem::path const& dir)
+    -> std::vector<std::filesystem::path> {
+  std::vector<std::filesystem::path> paths;
+
+  std::error_code error;
+  for (auto const& entry : std::filesystem::directory_iterator(dir, error)) {
+    if (entry.is_regular_file() && is_image_file(entry.path())) {
+      paths.push_back(entry.path());
+    }
+  }
+
+  // Directory order is unspecified, and frames are usually numbered
+  std::ranges::sort(paths);
+
+  return paths;
+}
+
+auto image_sequence_source::read(cv::Mat& frame) -> bool {
+  if (next_ >= paths_.size()) return false;
+
+  const auto& path = paths_[next_];
+  cv::Mat image = next_ == 0 ? std::move(first_)
+                             : cv::imread(path.string(), cv::IMREAD_COLOR);
+  ++next_;
+
+  if (image.empty()) {
+    logger::instance()->error("Could not read image %s", path);
+    return false;
+  }
+  if (image.size() != info_.size) {
+    logger::instance()->error("Image %s is %dx%d, unlike the %dx%d before it",
+                              path, image.cols, image.rows, info_.size.width,
+                              info_.size.height);
+    return false;
+  }
+
+  frame = image;
+
+  return true;
+}
+
+//------------------------------------------------------------- raw_source --//
+raw_source::raw_source(std::FILE* file, const cv::Size size,
+                       const img::pixel_format format, const double fps,
+                       std::string name)
+    : file_{file} {
+  info_.name = std::move(name);
+  info_.size = size;
+  info_.format = format;
+  info_.fps = fps;
+
+  set_binary(file_);
+}
+
+raw_source::raw_source(std::filesystem::path const& path, const cv::Size size,
+                       const img::pixel_format format, const double fps)
+    : raw_source(open_input(path), size, format, fps, input_name(path)) {}
+
+raw_source::~raw_source() {
+  if (file_ && file_ != stdin) std::fclose(file_);
+}
+
+auto raw_source::read(cv::Mat& frame) -> bool {
+  if (!file_) return false;
+
+  return read_frame(file_, info_.size, info_.format, info_.name, frame);
+}
+
+//------------------------------------------------------------- y4m_source --//
+y4m_source::y4m_source(std::FILE* file, std::string name) : file_{file} {
+  info_.name = std::move(name);
+  info_.format = img::pixel_format::i420;
+  if (!file_) return;
+
+  set_binary(file_);
+  if (!read_header()) info_.size = cv::Size{};
+}
+
+y4m_source::y4m_source(std::filesystem::path const& path)
+    : y4m_source(open_input(path), input_name(path)) {
+  if (!opened() || path == "-") return;
+
+  // Frames are all the same size, so a file's size gives their count, if
+  // none of them carries parameters in its header
+  std::error_code error;
+  const auto file_bytes = std::filesystem::file_size(path, error);
+  const auto header_bytes = std::ftell(file_);
+  if (error || header_bytes < 0) return;
+
+  constexpr std::size_t frame_header_bytes = sizeof("FRAME\n") - 1;
+  const auto frame_bytes = static_cast<std::size_t>(info_.size.area()) * 3 /
+                               2 +
+                           frame_header_bytes;
+  info_.frame_count = static_cast<int>(
+      (file_bytes - static_cast<std::uintmax_t>(header_bytes)) / frame_bytes);
+}
+
+y4m_source::~y4m_source() {
+  if (file_ && file_ != stdin) std::fclose(file_);
+}
+
+auto y4m_source::read_header() -> bool {
+  std::string line;
+  constexpr std::string_view magic = "YUV4MPEG2";
+  if (!read_line(file_, line) || !line.starts_with(magic)) {
+    logger::instance()->error("%s isn't a YUV4MPEG2 stream", info_.name);
+    return false;
+  }
+
+  // Space-separated tags, each a letter followed by its value
+  cv::Size size;
+  std::string colorspace = "420jpeg";
+  std::istringstream tags{line.substr(magic.size())};
+  std::string tag;
+  while (tags >> tag) {
+    const auto value = tag.substr(1);
+    char* end = nullptr;
+    switch (tag.front()) {
+      case 'W':
+        size.width = std::atoi(value.c_str());
+        break;
+      case 'H':
+        size.height = std::atoi(value.c_str());
+        break;
+      case 'F': {
+        const auto num = std::strtod(value.c_str(), &end);
+        const auto den = *end == ':' ? std::strtod(end + 1, &end) : 1.0;
+        if (num > 0.0 && den > 0.0) info_.fps = num / den;
+        break;
+      }
+      case 'C':
+        colorspace = value;
+        break;
+      default:
+        // Interlacing, aspect ratio and extensions don't change the pixels
+        break;
+    }
+  }
+
+  if (colorspace != "420" && colorspace != "420jpeg" &&
+      colorspace != "420paldv" && colorspace != "420mpeg2") {
+    logger::instance()->error("%s holds C%s frames, but only 8-bit 4:2:0 "
+                              "is supported, such as ffmpeg's yuv420p",
+                              info_.name, colorspace);
+    return false;
+  }
+  if (size.width <= 0 || size.height <= 0 || !img::fits_i420(size)) {
+    logger::instance()->error("%s holds %dx%d frames, which can't be read "
+                              "as YUV 4:2:0",
+                              info_.name, size.width, size.height);
+    return false;
+  }
+
+  info_.size = size;
+
+  return true;
+}
+
+auto y4m_source::read(cv::Mat& frame) -> bool {
+  if (!opened()) return false;
+
+  // Each frame follows a line of its own, which may carry parameters
+  std::string line;
+  if (!read_line(file_, line)) {
+    if (!line.empty()) {
+      logger::instance()->warn("Dropping a truncated frame at the end of %s",
+                               info_.name);
+    }
+    return false;
+  }
+  if (!line.starts_with("FRAME")) {
+    logger::instance()->error("Expected a frame header in %s", info_.name);
+    return false;
+  }
+
+  return read_frame(file_, info_.size, info_.format, info_.name, frame);
+}
+
+//------------------------------------------------------- synthetic_source --//
+synthetic_source::synthetic_source(const cv::Size size, const int frame_count,
+                                   const std::uint64_t seed,
+                                   const double magnitude,
+                                   const int jpeg_quality)
+    : size_{size},
+      frame_count_{std::max(frame_count, 0)},
+      magnitude_{magnitude},
+      jpeg_quality_{jpeg_quality},
+      still_{synthetic::textured_frame(size, seed)},
+      rng_{seed + 1} {}
+
+auto synthetic_source::info() const -> source_info {
+  source_info info;
+  info.name = "synthetic";
+  info.size = size_;
+  info.fps = 30.0;
+  info.frame_count = frame_count_;
+
+  return info;
+}
+
+auto synthetic_source::read(cv::Mat& frame) -> bool {
+  if (static_cast<int>(h_mats_.size()) >= frame_count_) return false;
+
+  // Each frame is the still as seen through a randomly shaken camera, T_i.
+  // Reflecting the borders keeps the frames free of black edges, and the
+  // reflected texture moves with the rest of the frame.
+  const auto t = synthetic::shake_homography(rng_, size_, magnitude_);
+
+  cv::Mat shaken;
+  cv::warpPerspective(still_, shaken, t, size_, cv::INTER_LINEAR,
+                      cv::BORDER_REFLECT);
+
+  if (jpeg_quality_ >= 1 && jpeg_quality_ <= 100) {
+    std::vector<uchar> encoded;
+    cv::imencode(".jpg", shaken, encoded,
+                 {cv::IMWRITE_JPEG_QUALITY, jpeg_quality_});
+    shaken = cv::imdecode(encoded, cv::IMREAD_COLOR);
+  }
+
+  // A point x in frame i is T_i^-1 * x on the still, which is
+  // T_(i-1) * T_i^-1 * x in frame i - 1
+  h_mats_.push_back(h_mats_.empty() ? cv::Mat::eye(3, 3, CV_64FC1)
+                                    : cv::Mat(previous_t_ * t.inv()));
+  previous_t_ = t;
+
+  frame = shaken;
+
+  return true;
+}
+
+//-------------------------------------------------------- prefetch_source --//
+prefetch_source::prefetch_source(std::unique_ptr<frame_source> inner,
+                                 const int depth)
+    : inner_{std::move(inner)},
+      info_{inner_->info()},
+      queue_{static_cast<std::size_t>(std::max(depth, 1))} {
+  thread_ = std::jthread([this](const std::stop_token stop) {
+    cv::Mat frame;
+    while (!stop.stop_requested() && inner_->read(frame)) {
+      if (!queue_.push(frame)) break;
+      frame = cv::Mat{};
+    }
+    queue_.close();
+  });
+}
+
+prefetch_source::~prefetch_source() {
+  // Wakes the reader if it's waiting for room, before the thread is joined
+  thread_.request_stop();
+  queue_.close();
+}
+
+auto prefetch_source::read(cv::Mat& frame) -> bool {
+  return queue_.pop(frame);
+}
+
+//------------------------------------------------------------ open_source --//
+auto open_source(std::string const& spec) -> std::unique_ptr<frame_source> {
+  if (spec == "-" || has_extension(spec, ".y4m")) {
+    auto source = std::make_unique<y4m_source>(spec);
+    if (!source->opened()) {
+      logger::instance()->error("Could not read YUV4MPEG2 frames from %s",
+                                spec == "-" ? "stdin" : spec);
+      return nullptr;
+    }
+
+    return source;
+  }
+
+  constexpr std::string_view synthetic_prefix = "synthetic:";
+  if (spec.starts_with(synthetic_prefix)) {
+    cv::Size size;
+    auto frames = 0;
+    std::uint64_t seed = 1;
+    if (!parse_synthetic(spec.substr(synthetic_prefix.size()), size, frames,
+                         seed)) {
+      logger::instance()->error("Expected synthetic:WxH:frames[:seed], got "
+                                "%s",
+                                spec);
+      return nullptr;
+    }
+
+    return std::make_unique<synthetic_source>(size, frames, seed);
+  }
+
+  std::error_code error;
+  if (std::filesystem::is_directory(spec, error)) {
+    auto paths = image_sequence_source::list_images(spec);
+    if (paths.empty()) {
+      logger::instance()->error("No images in %s", spec);
+      return nullptr;
+    }
+
+    auto source = std::make_unique<image_sequence_source>(std::move(paths));
+    if (source->info().size.empty()) {
+      logger::instance()->error("Could not read the first image in %s", spec);
+      return nullptr;
+    }
+
+    return source;
+  }
+
+  auto source = std::make_unique<capture_source>(spec);
+  if (!source->opened()) {
+    logger::instance()->error("Could not open video file %s", spec);
+    return nullptr;
+  }
+
+  return source;
+}
+}  // namespace vid
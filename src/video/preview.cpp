@@ -0,0 +1,278 @@
+#include "video/preview.h"
+
+#include <algorithm>
+#include <exception>
+#include <opencv2/imgproc.hpp>
+
+#include "logger/logger.h"
+#include "profiler/profiler.h"
+
+namespace vid {
+namespace {
+auto mat_bytes(cv::Mat const& m) -> std::size_t {
+  return m.total() * m.elemSize();
+}
+}  // namespace
+
+preview::preview(preview_options options)
+    : options_{options}, cache_{options.cache_bytes} {
+  worker_ = std::jthread([this](const std::stop_token stop) { run(stop); });
+}
+
+preview::~preview() {
+  worker_.request_stop();
+  if (worker_.joinable()) worker_.join();
+}
+
+auto preview::set_source(const track t, std::shared_ptr<video const> clip)
+    -> void {
+  std::lock_guard lock(mutex_);
+
+  auto& s = sources_[static_cast<std::size_t>(t)];
+  s.frame_count = clip ? clip->frame_count() : 0;
+  s.format = clip ? clip->format() : img::pixel_format::bgr;
+  s.fps = clip ? clip->fps() : 0;
+  s.clip = std::move(clip);
+  s.generation = next_generation_++;
+  s.thumbnails = {};
+  ++s.version;
+
+  // Drop work for the old frames, then build the first frames, so playback
+  // can start right away, followed by the thumbnails
+  std::erase_if(jobs_, [t](job const& j) { return j.t == t; });
+  const auto count = s.frame_count;
+  for (auto i = 0; i < std::min(options_.prefetch_ahead, count); ++i) {
+    jobs_.push_back({t, s.generation, i});
+  }
+  if (count > 0) jobs_.push_back({t, s.generation, -1});
+
+  wake_.notify_one();
+}
+
+auto preview::set_source(const track t, std::vector<cv::Mat> frames,
+                         const int fps, const img::pixel_format format)
+    -> void {
+  set_source(t, std::make_shared<video>(std::move(frames), fps, format));
+}
+
+auto preview::clear(const track t) -> void { set_source(t, nullptr); }
+
+auto preview::frame_count(const track t) const -> int {
+  std::lock_guard lock(mutex_);
+  return sources_[static_cast<std::size_t>(t)].frame_count;
+}
+
+auto preview::fps(const track t) const -> int {
+  std::lock_guard lock(mutex_);
+  return sources_[static_cast<std::size_t>(t)].fps;
+}
+
+auto preview::try_frame(const track t, const int index) -> cv::Mat {
+  std::lock_guard lock(mutex_);
+
+  auto const& s = sources_[static_cast<std::size_t>(t)];
+  if (index < 0 || index >= s.frame_count) return {};
+
+  if (auto proxy = cache_.get(key(s.generation, index))) return *proxy;
+
+  // Build it next, unless it's already on its way
+  const auto queued = std::ranges::any_of(jobs_, [&](job const& j) {
+    return j.t == t && j.generation == s.generation && j.index == index;
+  });
+  if (!queued) {
+    jobs_.push_front({t, s.generation, index});
+    wake_.notify_one();
+  }
+
+  return {};
+}
+
+auto preview::frame(const track t, const int index) -> cv::Mat {
+  std::shared_ptr<video const> clip;
+  auto format = img::pixel_format::bgr;
+  std::uint64_t generation = 0;
+  {
+    std::lock_guard lock(mutex_);
+
+    auto const& s = sources_[static_cast<std::size_t>(t)];
+    if (index < 0 || index >= s.frame_count) return {};
+
+    generation = s.generation;
+    if (auto proxy = cache_.get(key(generation, index))) return *proxy;
+    clip = s.clip;
+    format = s.format;
+  }
+
+  // Outside the lock, since a spilled frame is read back from disk. A frame
+  // that couldn't be read isn't cached, so it's tried again next time.
+  auto proxy = make_proxy(clip->frame(index), options_.proxy_width, format);
+  if (!proxy.empty()) {
+    cache_.put(key(generation, index), proxy, mat_bytes(proxy));
+  }
+
+  return proxy;
+}
+
+auto preview::prefetch(const track t, const int index) -> void {
+  std::lock_guard lock(mutex_);
+
+  auto const& s = sources_[static_cast<std::size_t>(t)];
+  const auto count = s.frame_count;
+
+  // Only the latest playhead matters when scrubbing
+  std::erase_if(jobs_, [t](job const& j) { return j.t == t && j.index >= 0; });
+
+  const auto end = std::min(index + options_.prefetch_ahead, count);
+  for (auto i = std::max(index, 0); i < end; ++i) {
+    if (!cache_.contains(key(s.generation, i))) {
+      jobs_.push_back({t, s.generation, i});
+    }
+  }
+
+  wake_.notify_one();
+}
+
+auto preview::thumbnails(const track t) const -> thumbnail_strip {
+  std::lock_guard lock(mutex_);
+  return sources_[static_cast<std::size_t>(t)].thumbnails;
+}
+
+auto preview::version(const track t) const -> std::uint64_t {
+  std::lock_guard lock(mutex_);
+  return sources_[static_cast<std::size_t>(t)].version;
+}
+
+auto preview::wait_idle() -> void {
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+}
+
+auto preview::make_proxy(cv::Mat const& frame, const int max_width,
+                         const img::pixel_format format) -> cv::Mat {
+  prof::scoped_timer timer{"make_proxy"};
+
+  if (frame.empty()) return {};
+
+  cv::Mat bgr;
+  img::to_bgr(frame, bgr, format);
+
+  // Area interpolation avoids aliasing when shrinking
+  cv::Mat small;
+  if (bgr.cols > max_width) {
+    const auto scale = static_cast<double>(max_width) / bgr.cols;
+    cv::resize(bgr, small, cv::Size(), scale, scale, cv::INTER_AREA);
+  } else {
+    small = bgr;
+  }
+
+  cv::Mat rgba;
+  switch (small.channels()) {
+    case 1:
+      cv::cvtColor(small, rgba, cv::COLOR_GRAY2RGBA);
+      break;
+    case 4:
+      cv::cvtColor(small, rgba, cv::COLOR_BGRA2RGBA);
+      break;
+    default:
+      cv::cvtColor(small, rgba, cv::COLOR_BGR2RGBA);
+      break;
+  }
+
+  return rgba;
+}
+
+auto preview::build(job const& j) -> void {
+  std::shared_ptr<video const> clip;
+  auto format = img::pixel_format::bgr;
+  {
+    std::lock_guard lock(mutex_);
+
+    // Skip work for frames that have since been replaced or cached
+    auto const& s = sources_[static_cast<std::size_t>(j.t)];
+    if (s.generation != j.generation) return;
+    if (cache_.contains(key(j.generation, j.index))) return;
+    clip = s.clip;
+    format = s.format;
+  }
+
+  auto proxy = make_proxy(clip->frame(j.index), options_.proxy_width, format);
+  if (proxy.empty()) return;
+  cache_.put(key(j.generation, j.index), proxy, mat_bytes(proxy));
+}
+
+auto preview::build_thumbnails(job const& j) -> void {
+  prof::scoped_timer timer{"build_thumbnails"};
+
+  std::shared_ptr<video const> clip;
+  auto count = 0;
+  auto format = img::pixel_format::bgr;
+  {
+    std::lock_guard lock(mutex_);
+    auto const& s = sources_[static_cast<std::size_t>(j.t)];
+    if (s.generation != j.generation) return;
+    clip = s.clip;
+    count = s.frame_count;
+    format = s.format;
+  }
+
+  const auto n = std::min(options_.thumbnail_count, count);
+  if (n <= 0 || clip->size().empty()) return;
+
+  // Every thumbnail has the size of the first, so they pack into a strip
+  const auto first = clip->size();
+  const auto width = std::min(options_.thumbnail_width, first.width);
+  const auto height = std::max(1, first.height * width / first.width);
+  const cv::Size size(width, height);
+
+  thumbnail_strip strip;
+  strip.thumbnail_size = size;
+  strip.atlas = cv::Mat(size.height, size.width * n, CV_8UC4, cv::Scalar(0));
+  for (auto i = 0; i < n; ++i) {
+    const auto index = n == 1 ? 0 : i * (count - 1) / (n - 1);
+    strip.frames.push_back(index);
+
+    // A frame that couldn't be read back leaves its thumbnail blank
+    cv::Mat thumb = make_proxy(clip->frame(index), size.width, format);
+    if (thumb.empty()) continue;
+    cv::resize(thumb, thumb, size, 0, 0, cv::INTER_AREA);
+    thumb.copyTo(strip.atlas(cv::Rect(i * size.width, 0, size.width,
+                                      size.height)));
+  }
+
+  std::lock_guard lock(mutex_);
+  auto& s = sources_[static_cast<std::size_t>(j.t)];
+  if (s.generation != j.generation) return;
+  s.thumbnails = std::move(strip);
+  ++s.version;
+}
+
+auto preview::run(std::stop_token const& stop) -> void {
+  while (true) {
+    job j{};
+    {
+      std::unique_lock lock(mutex_);
+      busy_ = false;
+      if (jobs_.empty()) idle_.notify_all();
+
+      if (!wake_.wait(lock, stop, [this]() { return !jobs_.empty(); })) {
+        return;
+      }
+
+      j = jobs_.front();
+      jobs_.pop_front();
+      busy_ = true;
+    }
+
+    // An exception would end the worker thread, and with it the process
+    try {
+      if (j.index < 0) {
+        build_thumbnails(j);
+      } else {
+        build(j);
+      }
+    } catch (std::exception const& e) {
+      logger::instance()->error("Could not build a preview: %s", e.what());
+    }
+  }
+}
+}  // namespace vid
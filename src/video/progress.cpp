@@ -0,0 +1,95 @@
+#include "video/progress.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace vid {
+namespace {
+auto now_ns() noexcept -> std::int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+auto stage_name(const stage s) noexcept -> std::string_view {
+  switch (s) {
+    case stage::idle:
+      return "Idle";
+    case stage::decode:
+      return "Processing video";
+    case stage::probe:
+      return "Measuring motion";
+    case stage::track:
+      return "Generating homography matrices";
+    case stage::accumulate:
+      return "Calculating cumulative transformation matrices";
+    case stage::smooth:
+      return "Applying filter to cumulative matrices";
+    case stage::update:
+      return "Computing update transforms";
+    case stage::crop:
+      return "Finding the crop";
+    case stage::warp:
+      return "Stabilizing frames";
+    case stage::encode:
+      return "Writing frames";
+    case stage::count:
+      break;
+  }
+
+  return "Unknown";
+}
+
+auto progress::begin(const stage s, const int total) noexcept -> void {
+  auto& c = counters_[index(s)];
+  c.done.store(0, std::memory_order_relaxed);
+  c.total.store(total, std::memory_order_relaxed);
+  c.end_ns.store(0, std::memory_order_relaxed);
+  c.start_ns.store(now_ns(), std::memory_order_relaxed);
+
+  // Publish the counters along with the stage
+  current_.store(s, std::memory_order_release);
+}
+
+auto progress::finish(const stage s) noexcept -> void {
+  auto& c = counters_[index(s)];
+  c.done.store(c.total.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+  c.end_ns.store(now_ns(), std::memory_order_release);
+}
+
+auto progress::reset() noexcept -> void {
+  for (auto& c : counters_) {
+    c.done.store(0, std::memory_order_relaxed);
+    c.total.store(0, std::memory_order_relaxed);
+    c.start_ns.store(0, std::memory_order_relaxed);
+    c.end_ns.store(0, std::memory_order_relaxed);
+  }
+
+  current_.store(stage::idle, std::memory_order_release);
+}
+
+auto progress::snapshot(const stage s) const noexcept -> progress_snapshot {
+  auto const& c = counters_[index(s)];
+
+  progress_snapshot snap;
+  snap.current = s;
+  snap.total = c.total.load(std::memory_order_relaxed);
+  snap.done = c.done.load(std::memory_order_relaxed);
+  // A frame count read from the container may undercount
+  if (snap.total > 0) snap.done = std::min(snap.done, snap.total);
+
+  const auto start = c.start_ns.load(std::memory_order_relaxed);
+  const auto end = c.end_ns.load(std::memory_order_acquire);
+  if (start > 0) {
+    snap.elapsed_s = static_cast<double>((end > 0 ? end : now_ns()) - start) /
+                     1e9;
+  }
+  if (snap.elapsed_s > 0.0) {
+    snap.throughput = static_cast<double>(snap.done) / snap.elapsed_s;
+  }
+
+  return snap;
+}
+}  // namespace vid
@@ -0,0 +1,307 @@
+#include "video/rendition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <utility>
+
+#include "image/warp.h"
+#include "logger/logger.h"
+#include "profiler/allocations.h"
+
+namespace vid {
+namespace {
+// Frames each rendition's encoder may fall behind the first
+constexpr std::size_t encoder_queue_frames = 4;
+
+/**
+ * @brief Returns the map that scales pixels of an image by the given
+ * factors, keeping the centres of the pixels at the corners in the
+ * corners.
+ */
+auto scale_map(const double sx, const double sy) -> cv::Matx33d {
+  return cv::Matx33d(sx, 0.0, 0.5 * (sx - 1.0), 0.0, sy, 0.5 * (sy - 1.0),
+                     0.0, 0.0, 1.0);
+}
+
+/**
+ * @brief Returns the size of the given rendition's picture, from the size
+ * of the crop.
+ */
+auto rendition_size(const cv::Size requested, const cv::Size crop,
+                    const img::pixel_format format) -> cv::Size {
+  auto size = requested;
+  if (size.width <= 0 && size.height <= 0) {
+    size = crop;
+  } else if (size.width <= 0) {
+    size.width = static_cast<int>(
+        std::lround(static_cast<double>(size.height) * crop.width /
+                    crop.height));
+  } else if (size.height <= 0) {
+    size.height = static_cast<int>(
+        std::lround(static_cast<double>(size.width) * crop.height /
+                    crop.width));
+  }
+
+  // Rounded down to whole chroma samples
+  if (format == img::pixel_format::i420) {
+    size.width = std::max(size.width & ~1, 2);
+    size.height = std::max(size.height & ~1, 2);
+  }
+
+  return {std::max(size.width, 1), std::max(size.height, 1)};
+}
+
+/**
+ * @brief Returns the size of the picture halved, or an empty size if it
+ * can't be halved any more.
+ */
+auto half_size(const cv::Size size, const img::pixel_format format)
+    -> cv::Size {
+  cv::Size half(size.width / 2, size.height / 2);
+  if (format == img::pixel_format::i420) {
+    half.width &= ~1;
+    half.height &= ~1;
+  }
+
+  return half.width >= 2 && half.height >= 2 ? half : cv::Size{};
+}
+
+/**
+ * @brief Resamples a frame to the given picture size with an area filter,
+ * plane by plane for I420 frames.
+ */
+auto downscale(cv::Mat const& src, const cv::Size size,
+               const img::pixel_format format) -> cv::Mat {
+  cv::Mat dst;
+  if (format != img::pixel_format::i420) {
+    cv::resize(src, dst, size, 0.0, 0.0, cv::INTER_AREA);
+    return dst;
+  }
+
+  dst.create(size.height * 3 / 2, size.width, CV_8UC1);
+  const auto in = img::i420_planes(src);
+  auto out = img::i420_planes(dst);
+
+  // The planes already have their sizes, so they're written in place
+  cv::resize(in.y, out.y, out.y.size(), 0.0, 0.0, cv::INTER_AREA);
+  cv::resize(in.u, out.u, out.u.size(), 0.0, 0.0, cv::INTER_AREA);
+  cv::resize(in.v, out.v, out.v.size(), 0.0, 0.0, cv::INTER_AREA);
+
+  return dst;
+}
+}  // namespace
+
+rendition_writer::rendition_writer(std::vector<rendition> const& renditions) {
+  for (auto const& spec : renditions) {
+    auto out = std::make_unique<output>();
+    out->spec = spec;
+    out->owned = open_sink(spec.path, spec.fourcc, spec.raw);
+    out->sink = out->owned.get();
+    outputs_.push_back(std::move(out));
+  }
+}
+
+rendition_writer::rendition_writer(frame_sink& sink) {
+  auto out = std::make_unique<output>();
+  out->sink = &sink;
+  outputs_.push_back(std::move(out));
+}
+
+rendition_writer::~rendition_writer() {
+  if (opened_ && !closed_) abort();
+  stop_encoders();
+}
+
+auto rendition_writer::open(const cv::Size picture,
+                            const img::pixel_format format, cv::Rect crop,
+                            const double fps) -> bool {
+  if (opened_ || outputs_.empty() || picture.empty()) return false;
+
+  format_ = format;
+  if (crop.empty()) crop = cv::Rect({0, 0}, picture);
+  if (format_ == img::pixel_format::i420) crop = img::even_region(crop);
+  if (crop.empty()) return false;
+
+  levels_ = {picture};
+  from_level_ = {cv::Matx33d::eye()};
+  for (auto const& out : outputs_) {
+    out->picture = rendition_size(out->spec.size, crop.size(), format_);
+
+    // Cropped and scaled, from stabilized pixels of the whole picture
+    const auto sx = static_cast<double>(out->picture.width) / crop.width;
+    const auto sy = static_cast<double>(out->picture.height) / crop.height;
+    const cv::Matx33d to_crop(1.0, 0.0, -crop.x, 0.0, 1.0, -crop.y, 0.0, 0.0,
+                              1.0);
+    out->transform = scale_map(sx, sy) * to_crop;
+
+    // Bilinear sampling only sees every source pixel down to half size, so
+    // smaller renditions start from a smaller copy of the source
+    out->level = 0;
+    while (true) {
+      auto const& level = levels_[out->level];
+      const auto lx = static_cast<double>(level.width) / picture.width;
+      const auto ly = static_cast<double>(level.height) / picture.height;
+      if (std::max(sx / lx, sy / ly) >= 0.5) break;
+
+      if (out->level + 1 == static_cast<int>(levels_.size())) {
+        const auto half = half_size(level, format_);
+        if (half.empty()) break;
+
+        levels_.push_back(half);
+        from_level_.push_back(
+            scale_map(static_cast<double>(half.width) / picture.width,
+                      static_cast<double>(half.height) / picture.height)
+                .inv());
+      }
+      ++out->level;
+    }
+  }
+
+  for (std::size_t i = 0; i < outputs_.size(); ++i) {
+    auto& out = *outputs_[i];
+    if (!out.sink || !out.sink->open(out.picture, fps)) {
+      logger::instance()->error("Could not open %s for %dx%d frames",
+                                out.spec.path, out.picture.width,
+                                out.picture.height);
+      for (std::size_t j = 0; j < i; ++j) outputs_[j]->sink->abort();
+      closed_ = true;
+
+      return false;
+    }
+
+    logger::instance()->debug("Rendering %dx%d frames to %s from %dx%d",
+                              out.picture.width, out.picture.height,
+                              out.spec.path, levels_[out.level].width,
+                              levels_[out.level].height);
+  }
+
+  // Every rendition but the first is encoded on a thread of its own
+  for (std::size_t i = 1; i < outputs_.size(); ++i) {
+    auto& out = *outputs_[i];
+    out.queue = std::make_unique<sched::bounded_queue<cv::Mat>>(
+        encoder_queue_frames);
+    out.encoder = std::jthread([this, &out]() { encode(out); });
+  }
+  opened_ = true;
+
+  return true;
+}
+
+auto rendition_writer::render(cv::Mat const& frame,
+                              cv::Mat const& update) const
+    -> std::vector<cv::Mat> {
+  cv::Mat update_64;
+  update.convertTo(update_64, CV_64FC1);
+  const cv::Matx33d u(update_64.ptr<double>());
+
+  // Each level is made from the one before it, once, for every rendition
+  // that needs it
+  std::vector<cv::Mat> levels(levels_.size());
+  levels[0] = frame;
+  const auto level = [&](const int index) -> cv::Mat const& {
+    for (auto i = 1; i <= index; ++i) {
+      if (levels[i].empty()) {
+        levels[i] = downscale(levels[i - 1], levels_[i], format_);
+      }
+    }
+    return levels[index];
+  };
+
+  std::vector<cv::Mat> rendered(outputs_.size());
+  for (std::size_t i = 0; i < outputs_.size(); ++i) {
+    auto const& out = *outputs_[i];
+    const cv::Mat h(out.transform * u * from_level_[out.level]);
+    const cv::Rect region({0, 0}, out.picture);
+
+    if (format_ == img::pixel_format::i420) {
+      img::warp_i420(level(out.level), rendered[i], h, region);
+    } else {
+      img::warp_perspective(level(out.level), rendered[i], h, region);
+    }
+  }
+
+  return rendered;
+}
+
+auto rendition_writer::write(std::vector<cv::Mat> frames) -> bool {
+  if (!opened_ || closed_ || frames.size() != outputs_.size()) return false;
+
+  for (std::size_t i = 1; i < outputs_.size(); ++i) {
+    auto& out = *outputs_[i];
+    if (out.failed.load(std::memory_order_relaxed) ||
+        !out.queue->push(frames[i])) {
+      return false;
+    }
+  }
+
+  auto& first = *outputs_.front();
+  if (!first.sink->put(frames.front(), format_)) {
+    first.failed.store(true, std::memory_order_relaxed);
+    return false;
+  }
+
+  return true;
+}
+
+auto rendition_writer::close() -> bool {
+  if (!opened_ || closed_) return false;
+
+  stop_encoders();
+
+  const auto failed = std::ranges::any_of(outputs_, [](auto const& out) {
+    return out->failed.load(std::memory_order_relaxed);
+  });
+  if (failed) {
+    abort();
+    return false;
+  }
+
+  auto closed = true;
+  for (auto const& out : outputs_) {
+    if (!out->sink->close()) {
+      logger::instance()->error("Could not finish writing %s", out->spec.path);
+      closed = false;
+    }
+  }
+  closed_ = true;
+
+  return closed;
+}
+
+auto rendition_writer::abort() -> void {
+  // Encoders drop what's left in their queues rather than encode it
+  for (auto const& out : outputs_) {
+    out->failed.store(true, std::memory_order_relaxed);
+  }
+  stop_encoders();
+
+  // Outputs that were never opened have nothing of theirs to remove
+  if (opened_) {
+    for (auto const& out : outputs_) out->sink->abort();
+  }
+  closed_ = true;
+}
+
+auto rendition_writer::encode(output& out) -> void {
+  prof::memory_stage memory{"encode", prof::memory_stage::scope::thread};
+
+  cv::Mat frame;
+  while (out.queue->pop(frame)) {
+    if (!out.failed.load(std::memory_order_relaxed) &&
+        !out.sink->put(frame, format_)) {
+      logger::instance()->error("Could not write a frame to %s",
+                                out.spec.path);
+      out.failed.store(true, std::memory_order_relaxed);
+    }
+    frame = cv::Mat{};
+  }
+}
+
+auto rendition_writer::stop_encoders() -> void {
+  for (auto const& out : outputs_) {
+    if (out->queue) out->queue->close();
+    if (out->encoder.joinable()) out->encoder.join();
+  }
+}
+}  // namespace vid
@@ -0,0 +1,304 @@
+#include "video/shm_ring.h"
+
+#include <algorithm>
+#include <climits>
+#include <new>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "logger/logger.h"
+
+namespace vid {
+namespace {
+constexpr std::size_t page_bytes = 4096;
+
+constexpr auto round_up(const std::size_t bytes, const std::size_t to)
+    -> std::size_t {
+  return (bytes + to - 1) / to * to;
+}
+
+// Slots start after the header's page, so every frame is page aligned
+// relative to the start of the region
+constexpr std::size_t header_bytes =
+    round_up(sizeof(shm::ring_header), page_bytes);
+
+// Frames start a cache line after their slot's header
+constexpr std::size_t frame_offset = round_up(sizeof(shm::slot_header), 64);
+
+/**
+ * @brief Returns the name as POSIX expects it, with a single leading slash.
+ */
+auto posix_name(std::string const& name) -> std::string {
+  return name.starts_with('/') ? name : "/" + name;
+}
+
+auto frame_type(const img::pixel_format format) -> int {
+  return format == img::pixel_format::i420 ? CV_8UC1 : CV_8UC3;
+}
+
+auto frame_rows(const cv::Size size, const img::pixel_format format) -> int {
+  // I420 frames are one 8-bit plane, the chroma planes below Y
+  return format == img::pixel_format::i420 ? size.height * 3 / 2
+                                           : size.height;
+}
+}  // namespace
+
+//--------------------------------------------------------------- shm_ring --//
+shm_ring::~shm_ring() {
+#if !defined(_WIN32)
+  munmap(base_, bytes_);
+  if (owner_) shm_unlink(name_.c_str());
+#endif
+}
+
+auto shm_ring::create(std::string const& name, const cv::Size size,
+                      const img::pixel_format format, const double fps,
+                      const int slots) -> std::unique_ptr<shm_ring> {
+#if defined(_WIN32)
+  static_cast<void>(size);
+  static_cast<void>(format);
+  static_cast<void>(fps);
+  static_cast<void>(slots);
+  logger::instance()->error("Can't write %s: shared memory rings need a "
+                            "POSIX system",
+                            name);
+  return nullptr;
+#else
+  if (size.empty() || slots < 1 ||
+      (format == img::pixel_format::i420 && !img::fits_i420(size))) {
+    logger::instance()->error("Can't make a ring of %d %dx%d frames", slots,
+                              size.width, size.height);
+    return nullptr;
+  }
+
+  const auto row_bytes =
+      static_cast<std::size_t>(size.width) * CV_ELEM_SIZE(frame_type(format));
+  const auto frame_bytes =
+      row_bytes * static_cast<std::size_t>(frame_rows(size, format));
+  const auto slot_bytes = round_up(frame_offset + frame_bytes, page_bytes);
+  const auto bytes = header_bytes + slot_bytes * static_cast<std::size_t>(
+                                                     slots);
+
+  // A ring left behind by a writer that crashed would have the wrong
+  // layout, and its reader would never see new frames
+  const auto shm_name = posix_name(name);
+  shm_unlink(shm_name.c_str());
+
+  const auto fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    logger::instance()->error("Could not create shared memory %s", shm_name);
+    return nullptr;
+  }
+  if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+    logger::instance()->error("Could not size shared memory %s to %zu MB",
+                              shm_name, bytes >> 20);
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    return nullptr;
+  }
+
+  auto* const base =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    logger::instance()->error("Could not map shared memory %s", shm_name);
+    shm_unlink(shm_name.c_str());
+    return nullptr;
+  }
+
+  auto* const header = new (base) shm::ring_header{};
+  header->version = shm::ring_version;
+  header->slot_count = static_cast<std::uint32_t>(slots);
+  header->format = static_cast<std::uint32_t>(format);
+  header->width = size.width;
+  header->height = size.height;
+  header->slot_bytes = slot_bytes;
+  header->frame_offset = frame_offset;
+  header->frame_bytes = frame_bytes;
+  header->row_bytes = row_bytes;
+  header->fps = fps;
+  header->writer_pid = static_cast<std::int64_t>(getpid());
+
+  // Readers only trust the rest of the header once they see this
+  header->magic.store(shm::ring_magic, std::memory_order_release);
+
+  logger::instance()->debug("Created ring %s of %d %dx%d frames, %zu MB",
+                            shm_name, slots, size.width, size.height,
+                            bytes >> 20);
+
+  return std::unique_ptr<shm_ring>(new shm_ring(shm_name, base, bytes, true));
+#endif
+}
+
+auto shm_ring::open(std::string const& name) -> std::unique_ptr<shm_ring> {
+#if defined(_WIN32)
+  static_cast<void>(name);
+  return nullptr;
+#else
+  const auto shm_name = posix_name(name);
+  const auto fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+  if (fd < 0) return nullptr;
+
+  // The writer may not have sized the region yet
+  struct stat st{};
+  if (fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < header_bytes) {
+    close(fd);
+    return nullptr;
+  }
+
+  const auto bytes = static_cast<std::size_t>(st.st_size);
+  auto* const base =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return nullptr;
+
+  std::unique_ptr<shm_ring> ring(new shm_ring(shm_name, base, bytes, false));
+  auto const& header = ring->header();
+  if (header.magic.load(std::memory_order_acquire) != shm::ring_magic) {
+    return nullptr;
+  }
+  if (header.version != shm::ring_version ||
+      header_bytes + header.slot_bytes * header.slot_count > bytes) {
+    logger::instance()->error("Shared memory %s isn't a ring this version "
+                              "can read",
+                              shm_name);
+    return nullptr;
+  }
+
+  return ring;
+#endif
+}
+
+auto shm_ring::slot(const std::uint64_t sequence) noexcept
+    -> shm::slot_header& {
+  auto const& h = header();
+  auto* const start = static_cast<std::byte*>(base_) + header_bytes +
+                      (sequence % h.slot_count) * h.slot_bytes;
+
+  return *reinterpret_cast<shm::slot_header*>(start);
+}
+
+auto shm_ring::frame(const std::uint64_t sequence) -> cv::Mat {
+  auto const& h = header();
+  const auto format = static_cast<img::pixel_format>(h.format);
+  auto* const data = reinterpret_cast<std::byte*>(&slot(sequence)) +
+                     h.frame_offset;
+
+  return {frame_rows(cv::Size(h.width, h.height), format), h.width,
+          frame_type(format), data, static_cast<std::size_t>(h.row_bytes)};
+}
+
+auto shm_ring::wait(std::atomic<std::uint32_t>& word,
+                    const std::uint32_t seen,
+                    const std::chrono::milliseconds timeout) -> void {
+  if (timeout <= std::chrono::milliseconds::zero()) return;
+
+#if defined(__linux__)
+  // Not FUTEX_PRIVATE_FLAG, which std::atomic::wait may use, since the
+  // other side is another process
+  const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  const timespec relative{
+      static_cast<time_t>(s.count()),
+      static_cast<long>(std::chrono::nanoseconds(timeout - s).count())};
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT,
+          seen, &relative, nullptr, 0);
+#else
+  if (word.load(std::memory_order_acquire) == seen) {
+    std::this_thread::sleep_for(
+        std::min(timeout, std::chrono::milliseconds(1)));
+  }
+#endif
+}
+
+auto shm_ring::notify(std::atomic<std::uint32_t>& word) -> void {
+  word.fetch_add(1, std::memory_order_release);
+
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE,
+          INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+//------------------------------------------------------------- shm_reader --//
+auto shm_reader::connect(const std::chrono::milliseconds timeout) -> bool {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!(ring_ = shm_ring::open(name_))) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      logger::instance()->error("No ring named %s to read", name_);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  auto& h = ring_->header();
+  size_ = cv::Size(h.width, h.height);
+  format_ = static_cast<img::pixel_format>(h.format);
+  fps_ = h.fps;
+  next_ = h.read.load(std::memory_order_acquire);
+  held_ = false;
+
+  return true;
+}
+
+auto shm_reader::acquire(shm_frame& frame,
+                         const std::chrono::milliseconds timeout) -> status {
+  if (!ring_) return status::aborted;
+  if (held_) release();
+
+  auto& h = ring_->header();
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    const auto seen = h.written_event.load(std::memory_order_acquire);
+
+    // The state is read first, since the writer only changes it after
+    // publishing its last frame
+    const auto state =
+        static_cast<shm::ring_state>(h.state.load(std::memory_order_acquire));
+    if (h.written.load(std::memory_order_acquire) > next_) break;
+    if (state == shm::ring_state::finished) return status::finished;
+    if (state == shm::ring_state::aborted) return status::aborted;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) return status::timeout;
+    shm_ring::wait(h.written_event, seen,
+                   std::chrono::ceil<std::chrono::milliseconds>(deadline -
+                                                                now));
+  }
+
+  auto const& slot = ring_->slot(next_);
+  frame.frame = ring_->frame(next_);
+  frame.format = format_;
+  frame.sequence = slot.sequence;
+  frame.index = slot.index;
+  frame.timestamp_ns = slot.timestamp_ns;
+  frame.published_ns = slot.published_ns;
+  held_ = true;
+
+  return status::frame;
+}
+
+auto shm_reader::release() -> void {
+  if (!held_) return;
+
+  auto& h = ring_->header();
+  h.read.store(++next_, std::memory_order_release);
+  shm_ring::notify(h.read_event);
+  held_ = false;
+}
+
+auto shm_reader::dropped() const noexcept -> std::uint64_t {
+  return ring_ ? ring_->header().dropped.load(std::memory_order_relaxed) : 0;
+}
+}  // namespace vid
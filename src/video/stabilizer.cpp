@@ -1,14 +1,66 @@
 #include "video/stabilizer.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "image/homography.h"
+#include "image/keyframes.h"
+#include "image/warp.h"
+#include "image/yuv.h"
 #include "logger/logger.h"
+#include "profiler/allocations.h"
+#include "profiler/profiler.h"
+#include "video/checkpoint.h"
 
 namespace vid {
 //----------------------------------------------------------------- Public --//
-auto stabilizer::stabilize(video const* in, video* out) noexcept -> bool {
+auto stabilizer::stabilize(video const* in, video* out,
+                           std::stop_token stop) noexcept -> bool {
+  prof::scoped_timer timer{"stabilize"};
+
+  stop_ = std::move(stop);
+  const auto stabilized = run(in, out);
+
+  // Holding on to the frames would keep both videos resident, and stop the
+  // memory governor from spilling either of them
+  release_frames();
+
+  return stabilized;
+}
+
+auto stabilizer::render(video const* in, rendition_writer& output,
+                        std::stop_token stop) noexcept -> bool {
+  prof::scoped_timer timer{"render"};
+
+  stop_ = std::move(stop);
+  auto rendered = false;
+  if (!in->empty()) {
+    prof::memory_stage memory{"prepare"};
+
+    // The source frames are only read, so they're shared rather than copied
+    rendered = load_frames(*in) && analyse() &&
+               render_frames(output, in->fps());
+  }
+  if (!rendered) output.abort();
+
+  if (rendered && checkpointing()) {
+    std::error_code error;
+    std::filesystem::remove(options_.checkpoint_path, error);
+  }
+  release_frames();
+
+  return rendered;
+}
+
+//---------------------------------------------------------------- Private --//
+auto stabilizer::run(video const* in, video* out) noexcept -> bool {
+  // Covers the copies made here, and whatever the later stages don't
+  prof::memory_stage memory{"prepare"};
+
   *out = in->clone();
 
   // No video or frames to stabilize
@@ -16,70 +68,269 @@ auto stabilizer::stabilize(video const* in, video* out) noexcept -> bool {
 
   // TODO: check at each stage if the expected output was generated, return false if no
 
-  // Create copy of video
-  frames_ = out->frames();
+  if (!load_frames(*out) || !analyse()) return false;
+
+  // Apply the corresponding update transformation matrices to each frame
+  stabilize_frames();
+  if (cancelled()) return false;
+
+  // Update out video object frames and size
+  out->frames(stabilized_frames_);
+
+  // The job is done, so there's nothing left to resume
+  if (checkpointing()) {
+    std::error_code error;
+    std::filesystem::remove(options_.checkpoint_path, error);
+  }
+
+  return true;
+}
+
+auto stabilizer::load_frames(video const& in) noexcept -> bool {
+  // Motion is measured on the luma of YUV frames
+  frames_ = in.frames();
+  format_ = in.format();
+  track_frames_.clear();
+  for (auto const& frame : frames_) {
+    track_frames_.push_back(img::luma(frame, format_));
+  }
+
+  // Spilled frames that couldn't be read back leave nothing to stabilize
+  return !frames_.empty();
+}
 
+auto stabilizer::analyse() noexcept -> bool {
   // Generate the H matrices for all frame pairs
   generate_h_mats();
+  if (cancelled()) return false;
 
   // Calculate the cumulative transformation matrices
   compute_h_tilde();
+  if (cancelled()) return false;
 
   // Smooth out the cumulative transformation matrices
   compute_h_tilde_prime();
+  if (cancelled()) return false;
 
   // Calculate the update transformation matrices
   compute_update_transforms();
+  if (cancelled()) return false;
 
-  // Apply the corresponding update transformation matrices to each frame
-  stabilize_frames();
+  // Find the crop that removes introduced artefacts, so only the pixels
+  // inside it need warping
+  crop_ = {};
+  if (options_.crop) find_crop();
 
-  // Crop the frames to remove introduced artefacts
-  crop_frames();
+  return !cancelled();
+}
 
-  // Update out video object frames and size
-  out->frames(frames_);
+auto stabilizer::release_frames() noexcept -> void {
+  frames_.clear();
+  frames_.shrink_to_fit();
+  stabilized_frames_.clear();
+  stabilized_frames_.shrink_to_fit();
+  track_frames_.clear();
+  track_frames_.shrink_to_fit();
+}
 
-  return true;
+auto stabilizer::build_feature_mask() noexcept -> void {
+  const auto size = track_frames_.front().size();
+
+  img::detection_mask detected;
+  detected.content = cv::Rect({0, 0}, size);
+  if (options_.auto_mask) {
+    detected = img::build_detection_mask(track_frames_, options_.mask);
+
+    if (detected.content.size() != size) {
+      logger::instance()->info("Letterboxing found, picture is %dx%d at "
+                               "(%d, %d)",
+                               detected.content.width, detected.content.height,
+                               detected.content.x, detected.content.y);
+    }
+    if (detected.overlay_fraction > 0.0) {
+      logger::instance()->info("Static overlays cover %.1f%% of the picture",
+                               detected.overlay_fraction * 100.0);
+    }
+  }
+
+  content_ = detected.content;
+  feature_mask_ =
+      img::combine_masks(detected.mask, options_.feature_mask, size);
 }
-  
-//---------------------------------------------------------------- Private --//
-auto stabilizer::generate_h_mats() noexcept -> void {
-  logger::instance()->add_dynamic_log("h-mats", []() -> std::string {
-    return std::string("Generating homography matrices") +
-           utils::loading_dots() + "\n";
+
+auto stabilizer::select_keyframes() noexcept -> std::vector<int> {
+  const auto size = static_cast<int>(frames_.size());
+
+  std::vector<int> keys;
+  if (!options_.keyframes.enabled || size < 3) {
+    keys.resize(size);
+    std::iota(keys.begin(), keys.end(), 0);
+    return keys;
+  }
+
+  prof::scoped_timer timer{"select_keyframes"};
+  begin(progress_, stage::probe, size);
+  advance(progress_, stage::probe);
+
+  // Each run of frames starts and ends on a keyframe, sharing the last one
+  // with the next run
+  std::mutex keys_mutex;
+  const auto last = size - 1;
+  for_each_chunk(0, last, chunk_size(last), [&](const int lo, const int hi) {
+    img::keyframe_selector selector{options_.keyframes};
+    selector.start(lo, track_frames_[lo]);
+    for (auto i = lo + 1; i <= hi; ++i) {
+      if (cancelled()) return;
+
+      selector.add(i, track_frames_[i]);
+      advance(progress_, stage::probe);
+    }
+    selector.finish();
+
+    std::lock_guard lock(keys_mutex);
+    keys.insert(keys.end(), selector.keyframes().begin(),
+                selector.keyframes().end());
   });
 
+  std::ranges::sort(keys);
+  const auto [first, end] = std::ranges::unique(keys);
+  keys.erase(first, end);
+
+  finish(progress_, stage::probe);
+
+  return keys;
+}
+
+auto stabilizer::generate_h_mats() noexcept -> void {
+  prof::scoped_timer timer{"generate_h_mats"};
+  prof::memory_stage memory{"track"};
+
+  // Keep features off overlays and letterboxing, before anything depends on
+  // where they are detected
+  build_feature_mask();
+
   // Clear any existing homography matrices
-  h_mats_.clear();
-  // Ensure the vector has enough space for (frames + 1) matrices
   const auto size = static_cast<int>(frames_.size());
-  h_mats_.reserve(size);
+  h_mats_.assign(size, cv::Mat{});
 
   // Add the identity matrix first
-  h_mats_.push_back(cv::Mat::eye(3, 3, CV_64FC1));
+  h_mats_[0] = cv::Mat::eye(3, 3, CV_64FC1);
 
-  // Calculate the homography matrices for all frame pairs
-  for (auto i = 1; i < size; ++i) {
-    // Get the current and previous frames
-    const auto img_1 = frames_[i];
-    const auto img_2 = frames_[i - 1];
+  {
+    std::lock_guard lock(checkpoint_mutex_);
+    h_done_.assign(size, 0);
+    h_done_[0] = 1;
+    since_checkpoint_ = 0;
+  }
+
+  // Pick up from where an interrupted run on the same frames left off
+  const auto resumed = resume_h_mats();
+
+  // Only track between keyframes, interpolating the frames in between
+  const auto keys = select_keyframes();
+  if (cancelled()) return;
+
+  const auto pairs = static_cast<int>(keys.size()) - 1;
+  if (pairs < size - 1) {
+    logger::instance()->info("Tracking %d of %d frame pairs, interpolating "
+                             "the rest",
+                             pairs, size - 1);
+  }
+
+  // Calculate the homography matrices for all keyframe pairs. The pairs are
+  // split into runs of consecutive pairs, and each run is tracked in order
+  // by its own tracker so runs can be processed in parallel.
+  begin(progress_, stage::track, size);
+  advance(progress_, stage::track, 1 + resumed);
+  const auto use_phase = options_.estimator == img::estimator::phase;
+  const auto track_run = [&](const int lo, const int hi) {
+    img::feature_tracker ft{options_.tracker};
+    img::phase_tracker pt{options_.phase};
+    if (use_phase) {
+      pt.set_mask(feature_mask_);
+    } else {
+      ft.set_mask(feature_mask_);
+    }
+
+    for (auto p = lo; p < hi; ++p) {
+      if (cancelled()) return;
+
+      const auto a = keys[p];
+      const auto b = keys[p + 1];
+      const auto gap = b - a;
+
+      // Restored from a checkpoint. Only this run ever sets entries a + 1 to
+      // b, so they can be read without the lock.
+      if (std::all_of(h_done_.begin() + a + 1, h_done_.begin() + b + 1,
+                      [](const std::uint8_t done) { return done != 0; })) {
+        ft.reset_prediction();
+        continue;
+      }
 
-    ft_.set_images(img_1, img_2);
-    ft_.track();
-    h_mats_.push_back(ft_.h_mat());
+      // Track the keyframe against the previous keyframe
+      auto h = track_pair(ft, pt, track_frames_[b], track_frames_[a], b);
+
+      // Split the motion evenly between the frames in between
+      if (gap > 1) h = img::homography_root(h, gap);
+      for (auto i = a + 1; i <= b; ++i) {
+        h_mats_[i] = gap > 1 ? h.clone() : h;
+        mark_h_mat_done(i);
+      }
+
+      prof::count("keyframe_gap", b, gap);
+
+      advance(progress_, stage::track, gap);
+    }
+  };
+  for_each_chunk(0, pairs, chunk_size(pairs), track_run);
+
+  // Save whatever was tracked since the last checkpoint, whether the run was
+  // cancelled or not, since a later stage may still be interrupted
+  if (checkpointing()) {
+    std::lock_guard lock(checkpoint_mutex_);
+    if (since_checkpoint_ > 0) write_checkpoint();
+  }
+
+  finish(progress_, stage::track);
+}
+
+auto stabilizer::track_pair(img::feature_tracker& ft, img::phase_tracker& pt,
+                            cv::Mat const& image, cv::Mat const& previous,
+                            const int index) const -> cv::Mat {
+  cv::Mat h;
+  if (options_.estimator == img::estimator::phase) {
+    pt.set_images(image, previous);
+    pt.track();
+    h = pt.h_mat();
+    prof::count("phase_response", index, pt.response());
+  } else {
+    ft.set_images(image, previous);
+    ft.track();
+    h = ft.h_mat();
+    prof::count("key_points", index,
+                static_cast<double>(ft.key_point_count()));
+    prof::count("matches", index, static_cast<double>(ft.match_count()));
+    prof::count("inlier_ratio", index,
+                ft.match_count() == 0
+                    ? 0.0
+                    : static_cast<double>(ft.inlier_count()) /
+                          static_cast<double>(ft.match_count()));
+    prof::count("ransac_iterations", index, ft.ransac_iterations());
+    prof::count("guided_matching", index, ft.guided() ? 1.0 : 0.0);
   }
 
-  logger::instance()->remove_dynamic_log("h-mats");
+  // If tracking failed, assume the camera didn't move
+  if (h.empty()) h = cv::Mat::eye(3, 3, CV_64FC1);
+
+  return h;
 }
 
 auto stabilizer::compute_h_tilde() noexcept -> void {
-  logger::instance()->add_dynamic_log("h-tilde", []() -> std::string {
-    return std::string("Calculating cumulative transformation matrices") +
-           utils::loading_dots() + "\n";
-  });
+  prof::scoped_timer timer{"compute_h_tilde"};
+  prof::memory_stage memory{"smooth"};
 
   h_tilde_.clear();
+  begin(progress_, stage::accumulate, 1);
 
   // The first transformation matrix is always the identity matrix, which is
   // the first entry in the h_mats_ vector.
@@ -88,102 +339,208 @@ auto stabilizer::compute_h_tilde() noexcept -> void {
   // Calculate the cumulative transformation matrices
   const auto size = static_cast<int>(h_mats_.size());
   for (auto i = 1; i < size; ++i) {
+    if (cancelled()) return;
     h_tilde_.push_back(h_tilde_[i - 1] * h_mats_[i]);
   }
 
-  logger::instance()->remove_dynamic_log("h-tilde");
+  finish(progress_, stage::accumulate);
 }
 
 auto stabilizer::compute_h_tilde_prime() noexcept -> void {
-  logger::instance()->add_dynamic_log("h-tilde-prime", []() -> std::string {
-    return std::string("Applying filter to cumulative matrices") +
-           utils::loading_dots() + "\n";
-  });
+  prof::scoped_timer timer{"compute_h_tilde_prime"};
+  prof::memory_stage memory{"smooth"};
 
   h_tilde_prime_.clear();
+  begin(progress_, stage::smooth, 1);
+
+  const auto& weights = options_.smoothing_weights;
+  const auto filter_size = static_cast<int>(weights.size());
+  const auto half_window = filter_size / 2;
 
   const auto size = static_cast<int>(h_tilde_.size());
   for (auto i = 0; i < size; ++i) {
+    if (cancelled()) return;
+
     double sum = 0.0;
     cv::Mat h(3, 3, CV_64FC1, cv::Scalar(0.0));
 
     // Apply the filter to each cumulative transformation matrix
-    const auto filter_size = static_cast<int>(weight_list_.size());
     for (auto j = 0; j < filter_size; ++j) {
-      const auto idx = i + j - 2;
+      const auto idx = i + j - half_window;
       // If we're too close to the first or last frame, we can't use the
       // filter
       if (idx < 0 || idx >= size) continue;
-      h += h_tilde_[idx].mul(weight_list_[j]);
-      sum += weight_list_[j];
+      h += h_tilde_[idx].mul(weights[j]);
+      sum += weights[j];
     }
 
-    h_tilde_prime_.push_back(h.mul(1.0 / sum));
+    // Fall back to the unfiltered trajectory if no weights applied
+    h_tilde_prime_.push_back(sum > 0.0 ? cv::Mat(h.mul(1.0 / sum))
+                                       : h_tilde_[i].clone());
   }
 
-  logger::instance()->remove_dynamic_log("h-tilde-prime");
+  finish(progress_, stage::smooth);
 }
 
 auto stabilizer::compute_update_transforms() noexcept -> void {
-  logger::instance()->add_dynamic_log("update-transforms", []() -> std::string {
-    return std::string("Computing update transforms") + utils::loading_dots() +
-           "\n";
-  });
+  prof::scoped_timer timer{"compute_update_transforms"};
+  prof::memory_stage memory{"smooth"};
 
   update_transforms_.clear();
+  begin(progress_, stage::update, 1);
 
   // Ensure the update_transforms vector has enough
   // space for the number of frames
   const auto size = static_cast<int>(frames_.size());
 
   for (auto i = 0; i < size; ++i) {
+    if (cancelled()) return;
+
     // U_i = H~'_i^-1 * H~_i
     update_transforms_.push_back(h_tilde_prime_[i].inv() * h_tilde_[i]);
   }
 
-  logger::instance()->remove_dynamic_log("update-transforms");
+  finish(progress_, stage::update);
 }
 
 auto stabilizer::stabilize_frames() noexcept -> void {
-  logger::instance()->add_dynamic_log("stabilize-frames", []() -> std::string {
-    return std::string("Stabilizing frames") + utils::loading_dots() + "\n";
+  prof::scoped_timer timer{"stabilize_frames"};
+  prof::memory_stage memory{"warp"};
+
+  const auto size = static_cast<int>(frames_.size());
+  stabilized_frames_.assign(size, cv::Mat{});
+
+  logger::instance()->debug("Warping frames with the %s kernels",
+                            img::warp_isa_name(img::best_warp_isa()));
+
+  begin(progress_, stage::warp, size);
+  for_each_chunk(0, size, 1, [&](const int lo, const int hi) {
+    for (auto i = lo; i < hi; ++i) {
+      if (cancelled()) return;
+
+      prof::scoped_timer warp_timer{"warp"};
+
+      // Only the pixels inside the crop, if there is one, are computed
+      if (format_ == img::pixel_format::i420) {
+        img::warp_i420(frames_[i], stabilized_frames_[i],
+                       update_transforms_[i], crop_);
+      } else {
+        img::warp_perspective(frames_[i], stabilized_frames_[i],
+                              update_transforms_[i], crop_);
+      }
+
+      advance(progress_, stage::warp);
+    }
   });
+  finish(progress_, stage::warp);
+}
 
-  stabilized_frames_.clear();
+auto stabilizer::render_frames(rendition_writer& output, const double fps)
+    noexcept -> bool {
+  prof::scoped_timer timer{"render_frames"};
+  prof::memory_stage memory{"warp"};
 
   const auto size = static_cast<int>(frames_.size());
-  stabilized_frames_.reserve(size);
-
-  for (auto i = 0; i < size; ++i) {
-    cv::Mat stabilized_frame;
+  if (!output.open(img::picture_size(frames_.front(), format_), format_,
+                   crop_, fps)) {
+    return false;
+  }
 
-    cv::warpPerspective(frames_[i], stabilized_frame, update_transforms_[i],
-                        frames_[i].size(), 1, cv::BORDER_CONSTANT);
-    stabilized_frames_.push_back(stabilized_frame);
+  // Frames are rendered in parallel a few at a time and written in order,
+  // so only a few of them are ever held at every size
+  const auto batch = pool_ ? 2 * pool_->size() : 1;
+  std::vector<std::vector<cv::Mat>> rendered(batch);
+
+  begin(progress_, stage::warp, size);
+  begin(progress_, stage::encode, size);
+  auto written = true;
+  for (auto lo = 0; lo < size && written; lo += batch) {
+    const auto hi = std::min(lo + batch, size);
+    for_each_chunk(lo, hi, 1, [&](const int first, const int last) {
+      for (auto i = first; i < last; ++i) {
+        if (cancelled()) return;
+
+        prof::scoped_timer warp_timer{"warp"};
+        rendered[i - lo] = output.render(frames_[i], update_transforms_[i]);
+        advance(progress_, stage::warp);
+      }
+    });
+    if (cancelled()) break;
+
+    prof::memory_stage encoding{"encode"};
+    for (auto i = lo; i < hi && written; ++i) {
+      prof::scoped_timer encode_timer{"encode"};
+      written = output.write(std::move(rendered[i - lo]));
+      advance(progress_, stage::encode);
+    }
   }
+  finish(progress_, stage::warp);
+  finish(progress_, stage::encode);
 
-  logger::instance()->remove_dynamic_log("stabilize-frames");
+  return written && !cancelled() && output.close();
 }
-  
-auto stabilizer::crop_frames() noexcept -> void {
-  // If there are no stabilized frames, don't do anything.
-  if (stabilized_frames_.empty()) return;
 
-  // Create a white mask
-  cv::Mat white_mask(stabilized_frames_[0].size(), CV_8UC1, cv::Scalar(1.0));
+auto stabilizer::find_crop() noexcept -> void {
+  prof::scoped_timer timer{"find_crop"};
+  prof::memory_stage memory{"crop"};
+
+  // If there are no frames, don't do anything.
+  if (frames_.empty()) return;
+
+  const auto size = static_cast<int>(frames_.size());
+  begin(progress_, stage::crop, size);
+
+  // Create a white mask of the picture, leaving out any letterboxing so the
+  // crop never includes the bars
+  cv::Mat white_mask(img::picture_size(frames_[0], format_), CV_8UC1,
+                     cv::Scalar(0.0));
+  const cv::Rect frame_rect({0, 0}, white_mask.size());
+  const auto picture = content_.empty() ? frame_rect : content_ & frame_rect;
+  white_mask(picture).setTo(1.0);
   cv::Mat mask = white_mask.clone();
-  const auto size = static_cast<int>(stabilized_frames_.size());
-  for (auto i = 0; i < size; ++i) {
-    cv::Mat transformed;
-    cv::warpPerspective(white_mask, transformed, update_transforms_[i],
-                        white_mask.size(), 1, cv::BORDER_CONSTANT,
-                        cv::Scalar(0.0));
 
-    mask = mask.mul(transformed);
-  }
+  // Corners of the picture's outermost pixels
+  const std::vector<cv::Point2d> corners{
+      {static_cast<double>(picture.x), static_cast<double>(picture.y)},
+      {static_cast<double>(picture.br().x - 1),
+       static_cast<double>(picture.y)},
+      {static_cast<double>(picture.br().x - 1),
+       static_cast<double>(picture.br().y - 1)},
+      {static_cast<double>(picture.x),
+       static_cast<double>(picture.br().y - 1)}};
+
+  // Each run of frames builds its own mask, which is then combined with the
+  // others
+  std::mutex mask_mutex;
+  for_each_chunk(0, size, chunk_size(size), [&](const int lo, const int hi) {
+    cv::Mat run_mask = white_mask.clone();
+    cv::Mat transformed(white_mask.size(), CV_8UC1);
+    std::vector<cv::Point2d> warped;
+    std::vector<cv::Point> outline(corners.size());
+    for (auto i = lo; i < hi; ++i) {
+      if (cancelled()) return;
+
+      // A homography keeps straight edges straight, so the stabilized
+      // picture is the polygon its corners are mapped to, and no pixels need
+      // warping to find it
+      cv::perspectiveTransform(corners, warped, update_transforms_[i]);
+      for (std::size_t k = 0; k < warped.size(); ++k) {
+        outline[k] = {cvRound(warped[k].x), cvRound(warped[k].y)};
+      }
+      transformed.setTo(0.0);
+      cv::fillConvexPoly(transformed, outline, cv::Scalar(1.0));
+
+      cv::bitwise_and(run_mask, transformed, run_mask);
+      advance(progress_, stage::crop);
+    }
+
+    std::lock_guard lock(mask_mutex);
+    cv::bitwise_and(mask, run_mask, mask);
+  });
+  if (cancelled()) return;
 
   // Convert mask to square shape by using the smallest of the dimensions
-  const auto min_dim = min(mask.rows, mask.cols);
+  const auto min_dim = std::min(mask.rows, mask.cols);
   mask = mask(cv::Rect(0, 0, min_dim, min_dim));
 
   // Find the largest inscribed square of all the stabilized frames, starting
@@ -205,8 +562,8 @@ auto stabilizer::crop_frames() noexcept -> void {
       // Otherwise, calculate the value of this cell by following the formula:
       // S[x, y] = min(S[x + 1, y], S[x, y + 1], S[x + 1, y + 1]) + 1
       s.at<int>(row, col) =
-          min(s.at<int>(row + 1, col),
-              min(s.at<int>(row, col + 1), s.at<int>(row + 1, col + 1))) +
+          std::min({s.at<int>(row + 1, col), s.at<int>(row, col + 1),
+                    s.at<int>(row + 1, col + 1)}) +
           1;
     }
   }
@@ -230,8 +587,95 @@ auto stabilizer::crop_frames() noexcept -> void {
       cv::Size2i(static_cast<int>(scale.x * square.width),
                  static_cast<int>(scale.y * square.height)));
 
-  // Crop the stabilized frames to the largest inscribed square
-  for (auto& frame : stabilized_frames_) frame = frame(scaled_square);
+  // Crop the stabilized frames to the largest inscribed square, lined up
+  // with the chroma samples of YUV frames
+  crop_ = format_ == img::pixel_format::i420 ? img::even_region(scaled_square)
+                                             : scaled_square;
+  finish(progress_, stage::crop);
+}
+
+auto stabilizer::resume_h_mats() noexcept -> int {
+  if (!checkpointing()) return 0;
+
+  fingerprint_ = checkpoint_fingerprint(frames_, options_, feature_mask_);
+
+  checkpoint cp;
+  if (!load_checkpoint(options_.checkpoint_path, cp)) return 0;
+
+  const auto size = static_cast<int>(frames_.size());
+  if (cp.fingerprint != fingerprint_ || cp.frame_count != size) {
+    logger::instance()->warn("Ignoring checkpoint %s, which is for other "
+                             "frames or tracker settings",
+                             options_.checkpoint_path);
+    return 0;
+  }
+
+  auto resumed = 0;
+  std::lock_guard lock(checkpoint_mutex_);
+  for (std::size_t j = 0; j < cp.indices.size(); ++j) {
+    const auto i = cp.indices[j];
+    if (i == 0 || h_done_[i]) continue;
+
+    h_mats_[i] = cp.h_mats[j];
+    h_done_[i] = 1;
+    ++resumed;
+  }
+
+  logger::instance()->info("Resuming from checkpoint: %d of %d frame pairs "
+                           "already tracked",
+                           resumed, size - 1);
+
+  return resumed;
+}
+
+auto stabilizer::mark_h_mat_done(const int i) noexcept -> void {
+  std::lock_guard lock(checkpoint_mutex_);
+  h_done_[i] = 1;
+
+  if (!checkpointing()) return;
+  if (++since_checkpoint_ >= std::max(options_.checkpoint_interval, 1)) {
+    write_checkpoint();
+  }
+}
+
+auto stabilizer::write_checkpoint() noexcept -> void {
+  prof::scoped_timer timer{"write_checkpoint"};
+
+  checkpoint cp;
+  cp.fingerprint = fingerprint_;
+  cp.frame_count = static_cast<int>(h_mats_.size());
+  for (auto i = 1; i < cp.frame_count; ++i) {
+    if (!h_done_[i]) continue;
+    cp.indices.push_back(i);
+    cp.h_mats.push_back(h_mats_[i]);
+  }
+
+  since_checkpoint_ = 0;
+  if (!save_checkpoint(cp, options_.checkpoint_path)) {
+    logger::instance()->error("Failed to write checkpoint %s",
+                              options_.checkpoint_path);
+  }
+}
+
+auto stabilizer::chunk_size(const int n) const noexcept -> int {
+  if (!pool_) return std::max(n, 1);
+
+  // A few runs per worker keeps the workers balanced when some frames take
+  // longer than others
+  return std::max(1, n / (pool_->size() * 4));
+}
+
+auto stabilizer::for_each_chunk(const int begin, const int end,
+                                const int grain,
+                                std::function<void(int, int)> const& body)
+    -> void {
+  if (begin >= end) return;
+
+  if (pool_) {
+    pool_->parallel_for(begin, end, grain, priority_, body);
+  } else {
+    body(begin, end);
+  }
 }
 
 }  // namespace vid
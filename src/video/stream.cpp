@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "image/detection_mask.h"
+#include "image/yuv.h"
+#include "logger/logger.h"
+#include "profiler/allocations.h"
+#include "profiler/profiler.h"
+#include "sched/bounded_queue.h"
+#include "video/stabilizer.h"
+
+namespace vid {
+namespace {
+// Consecutive frames each tracker is handed at once, so each pair but the
+// first of a run follows on from the pair its tracker measured before
+constexpr std::size_t track_run_frames = 4;
+
+// A frame on its way from the decoder to the trackers, with the image its
+// motion is measured on and that of the frame before it
+struct decoded_frame {
+  int index = -1;
+  cv::Mat frame;
+  cv::Mat luma;
+  cv::Mat previous_luma;
+};
+
+// Consecutive frames, tracked in order by a single tracker
+using decoded_run = std::vector<decoded_frame>;
+
+// A frame and the homography mapping it to the frame before it
+struct tracked_frame {
+  cv::Mat frame;
+  cv::Mat h;
+};
+
+// A frame and the update transformation that stabilizes it
+struct smoothed_frame {
+  int index = -1;
+  cv::Mat frame;
+  cv::Mat update;
+};
+
+// A frame and its cumulative transformation, kept for the smoothing window
+struct window_entry {
+  cv::Mat frame;
+  cv::Mat h_tilde;
+};
+
+/**
+ * @brief Returns the crop that trims the given fraction off each edge of the
+ * picture, inside any letterboxing.
+ */
+auto margin_crop(const cv::Rect picture, const double margin,
+                 const img::pixel_format format) -> cv::Rect {
+  const auto clamped = std::clamp(margin, 0.0, 0.45);
+  const auto dx = static_cast<int>(std::lround(picture.width * clamped));
+  const auto dy = static_cast<int>(std::lround(picture.height * clamped));
+  const cv::Rect crop(picture.x + dx, picture.y + dy, picture.width - 2 * dx,
+                      picture.height - 2 * dy);
+
+  // Lined up with the chroma samples of YUV frames
+  return format == img::pixel_format::i420 ? img::even_region(crop) : crop;
+}
+}  // namespace
+
+auto stabilizer::stabilize_stream(std::filesystem::path const& input,
+                                  std::filesystem::path const& output,
+                                  const int fourcc,
+                                  stream_options const& stream,
+                                  std::stop_token stop) noexcept -> bool {
+  capture_source source{input};
+  if (!source.opened()) {
+    logger::instance()->error("Could not open video file %s", input);
+    stream_stats_.clear();
+
+    return false;
+  }
+
+  writer_sink sink{output, fourcc};
+
+  return stabilize_stream(source, sink, stream, std::move(stop));
+}
+
+auto stabilizer::stabilize_stream(frame_source& input, frame_sink& output,
+                                  stream_options const& stream,
+                                  std::stop_token stop) noexcept -> bool {
+  rendition_writer writer{output};
+
+  return stabilize_stream(input, writer, stream, std::move(stop));
+}
+
+auto stabilizer::stabilize_stream(frame_source& input,
+                                  rendition_writer& output,
+                                  stream_options const& stream,
+                                  std::stop_token stop) noexcept -> bool {
+  prof::scoped_timer timer{"stabilize_stream"};
+
+  stream_stats_.clear();
+
+  const auto info = input.info();
+  const auto fps = info.fps > 0.0 ? info.fps : 30.0;
+  const auto frame_count = info.frame_count;
+  const auto size = info.size;
+
+  auto format = stream.format;
+  if (format == img::pixel_format::i420 && !img::fits_i420(size)) {
+    logger::instance()->warn("%dx%d frames can't be stored as YUV 4:2:0, "
+                             "storing them as BGR",
+                             size.width, size.height);
+    format = img::pixel_format::bgr;
+  }
+
+  // Tracking is the heaviest stage, so it gets two thirds of the threads
+  // that aren't decoding or encoding
+  const auto hardware =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const auto spare = std::max(2, hardware - 2);
+  const auto track_workers = stream.track_workers > 0
+                                 ? stream.track_workers
+                                 : std::max(1, spare * 2 / 3);
+  const auto warp_workers = stream.warp_workers > 0
+                                ? stream.warp_workers
+                                : std::max(1, spare - track_workers);
+
+  logger::instance()->debug("Streaming %s with %d tracking and %d warping "
+                            "threads, %d frames per queue",
+                            info.name, track_workers, warp_workers,
+                            stream.queue_frames);
+
+  const auto capacity =
+      static_cast<std::size_t>(std::max(stream.queue_frames, 2));
+  sched::bounded_queue<decoded_run> decoded{
+      std::max<std::size_t>(capacity / track_run_frames, 1)};
+  sched::reorder_queue<tracked_frame> tracked{capacity};
+  sched::bounded_queue<smoothed_frame> smoothed{capacity};
+  sched::reorder_queue<std::vector<cv::Mat>> warped{capacity};
+
+  // Set by the decoder before it hands over the first frame, and only read
+  // by later stages once they have a frame, so the queues order the writes
+  // before the reads
+  cv::Mat feature_mask;
+
+  auto written = 0;
+  auto write_failed = false;
+
+  // Frame pairs matched near where the previous pair predicted, out of all
+  // those tracked with features
+  std::atomic<int> guided_pairs = 0;
+  std::atomic<int> feature_pairs = 0;
+
+  sched::pipeline pipeline{stop};
+  pipeline.on_stop([&]() {
+    decoded.close();
+    tracked.close();
+    smoothed.close();
+    warped.close();
+  });
+
+  for (const auto s : {stage::decode, stage::track, stage::smooth,
+                       stage::warp, stage::encode}) {
+    begin(progress_, s, frame_count);
+  }
+
+  //------------------------------------------------------------ Decode --//
+  pipeline.add_stage(
+      "decode", 1,
+      [&](sched::pipeline::context& ctx) {
+        prof::memory_stage memory{"decode",
+                                  prof::memory_stage::scope::thread};
+
+        const auto read = [&](cv::Mat& frame) {
+          auto item = ctx.time_item();
+          prof::scoped_timer decode_timer{"decode"};
+
+          // Each frame gets a buffer of its own from the source
+          if (!input.next(frame, format)) return false;
+          advance(progress_, stage::decode);
+
+          return true;
+        };
+
+        // The automatic mask is built from the first frames, which are held
+        // back until it's ready
+        std::vector<cv::Mat> warm_up;
+        const auto warm_up_count =
+            options_.auto_mask ? std::max(options_.mask.sample_count, 1) : 1;
+        cv::Mat frame;
+        while (static_cast<int>(warm_up.size()) < warm_up_count &&
+               !ctx.stop_requested() && read(frame)) {
+          warm_up.push_back(frame);
+          frame = cv::Mat{};
+        }
+        if (warm_up.empty()) return;
+
+        const auto track_size = img::luma(warm_up.front(), format).size();
+        img::detection_mask detected;
+        detected.content = cv::Rect({0, 0}, track_size);
+        if (options_.auto_mask) {
+          std::vector<cv::Mat> lumas;
+          for (auto const& f : warm_up) lumas.push_back(img::luma(f, format));
+          detected = img::build_detection_mask(lumas, options_.mask);
+        }
+        feature_mask = img::combine_masks(detected.mask,
+                                          options_.feature_mask, track_size);
+        cv::Rect crop;
+        if (options_.crop) {
+          crop = margin_crop(detected.content, stream.crop_margin, format);
+        }
+
+        // The outputs are opened before any frame reaches the warpers,
+        // which render into them
+        if (!output.open(img::picture_size(warm_up.front(), format), format,
+                         crop, fps)) {
+          write_failed = true;
+          ctx.request_stop();
+          return;
+        }
+
+        auto index = 0;
+        cv::Mat previous_luma;
+        decoded_run run;
+        const auto hand_over = [&](cv::Mat const& f) {
+          decoded_frame item{index++, f, img::luma(f, format), previous_luma};
+          previous_luma = item.luma;
+          run.push_back(std::move(item));
+          if (run.size() < track_run_frames) return true;
+
+          const auto pushed = decoded.push(run);
+          run.clear();
+          return pushed;
+        };
+
+        for (auto const& f : warm_up) {
+          if (!hand_over(f)) return;
+        }
+        warm_up.clear();
+
+        while (!ctx.stop_requested() && read(frame)) {
+          if (!hand_over(frame)) return;
+          frame = cv::Mat{};
+        }
+        if (!run.empty()) decoded.push(run);
+      },
+      [&]() { decoded.close(); });
+
+  //------------------------------------------------------------- Track --//
+  pipeline.add_stage(
+      "track", track_workers,
+      [&](sched::pipeline::context& ctx) {
+        prof::memory_stage memory{"track",
+                                  prof::memory_stage::scope::thread};
+
+        img::feature_tracker ft{options_.tracker};
+        img::phase_tracker pt{options_.phase};
+        auto masked = false;
+        const auto use_features =
+            options_.estimator == img::estimator::features;
+
+        // The last frame this tracker measured, whose pair predicts the
+        // next one's only if the next frame follows it
+        auto last = -1;
+
+        decoded_run run;
+        while (!ctx.stop_requested() && decoded.pop(run)) {
+          if (run.front().index != last + 1) ft.reset_prediction();
+
+          for (auto& in : run) {
+            cv::Mat h;
+            {
+              auto item = ctx.time_item();
+              prof::scoped_timer track_timer{"track"};
+
+              if (!masked) {
+                ft.set_mask(feature_mask);
+                pt.set_mask(feature_mask);
+                masked = true;
+              }
+
+              if (in.index == 0) {
+                h = cv::Mat::eye(3, 3, CV_64FC1);
+              } else {
+                h = track_pair(ft, pt, in.luma, in.previous_luma, in.index);
+                if (use_features) {
+                  ++feature_pairs;
+                  if (ft.guided()) ++guided_pairs;
+                }
+              }
+            }
+            last = in.index;
+
+            if (!tracked.put(in.index, {std::move(in.frame), h})) return;
+            in = decoded_frame{};
+            advance(progress_, stage::track);
+          }
+          run.clear();
+        }
+      },
+      [&]() { tracked.close(); });
+
+  //------------------------------------------------------------ Smooth --//
+  pipeline.add_stage(
+      "smooth", 1,
+      [&](sched::pipeline::context& ctx) {
+        prof::memory_stage memory{"smooth",
+                                  prof::memory_stage::scope::thread};
+
+        const auto& weights = options_.smoothing_weights;
+        const auto filter_size = static_cast<int>(weights.size());
+        const auto half_window = filter_size / 2;
+
+        // Frames from first_index on, up to the last one received
+        std::deque<window_entry> window;
+        auto first_index = 0;
+        auto received = 0;
+        auto next = 0;
+
+        // Smooths frame i over the frames received so far, which is the
+        // whole window unless the video has ended
+        const auto emit = [&](const int i) {
+          cv::Mat update;
+          {
+            auto item = ctx.time_item();
+
+            double sum = 0.0;
+            cv::Mat h(3, 3, CV_64FC1, cv::Scalar(0.0));
+            for (auto j = 0; j < filter_size; ++j) {
+              const auto idx = i + j - half_window;
+              if (idx < 0 || idx >= received) continue;
+              h += window[idx - first_index].h_tilde.mul(weights[j]);
+              sum += weights[j];
+            }
+
+            auto const& h_tilde = window[i - first_index].h_tilde;
+            const cv::Mat h_tilde_prime =
+                sum > 0.0 ? cv::Mat(h.mul(1.0 / sum)) : h_tilde;
+
+            // U_i = H~'_i^-1 * H~_i
+            update = h_tilde_prime.inv() * h_tilde;
+          }
+
+          advance(progress_, stage::smooth);
+          if (!smoothed.push({i, window[i - first_index].frame, update})) {
+            return false;
+          }
+
+          // Only the frames the next window reaches back to are kept
+          window[i - first_index].frame = cv::Mat{};
+          while (first_index < i + 1 - half_window) {
+            window.pop_front();
+            ++first_index;
+          }
+
+          return true;
+        };
+
+        tracked_frame in;
+        cv::Mat h_tilde = cv::Mat::eye(3, 3, CV_64FC1);
+        while (!ctx.stop_requested() && tracked.take(in)) {
+          // A new matrix each time, since the window shares the old one
+          h_tilde = cv::Mat(h_tilde * in.h);
+          window.push_back({std::move(in.frame), h_tilde});
+          in = tracked_frame{};
+          ++received;
+
+          // Frame i's window is full once half a window past it has arrived
+          while (next + half_window < received) {
+            if (!emit(next++)) return;
+          }
+        }
+
+        // The last frames are smoothed over what's left of their windows
+        while (!ctx.stop_requested() && next < received) {
+          if (!emit(next++)) return;
+        }
+      },
+      [&]() { smoothed.close(); });
+
+  //-------------------------------------------------------------- Warp --//
+  pipeline.add_stage(
+      "warp", warp_workers,
+      [&](sched::pipeline::context& ctx) {
+        prof::memory_stage memory{"warp",
+                                  prof::memory_stage::scope::thread};
+
+        smoothed_frame in;
+        while (!ctx.stop_requested() && smoothed.pop(in)) {
+          std::vector<cv::Mat> out;
+          {
+            auto item = ctx.time_item();
+            prof::scoped_timer warp_timer{"warp"};
+
+            // Only the pixels inside the crop are computed, straight at the
+            // size of each output
+            out = output.render(in.frame, in.update);
+          }
+
+          if (!warped.put(in.index, out)) return;
+          in = smoothed_frame{};
+          advance(progress_, stage::warp);
+        }
+      },
+      [&]() { warped.close(); });
+
+  //------------------------------------------------------------ Encode --//
+  pipeline.add_stage("encode", 1, [&](sched::pipeline::context& ctx) {
+    prof::memory_stage memory{"encode", prof::memory_stage::scope::thread};
+
+    std::vector<cv::Mat> frames;
+    while (!ctx.stop_requested() && warped.take(frames)) {
+      auto item = ctx.time_item();
+      prof::scoped_timer encode_timer{"encode"};
+
+      if (!output.write(std::move(frames))) {
+        write_failed = true;
+        ctx.request_stop();
+        return;
+      }
+      frames.clear();
+      ++written;
+      advance(progress_, stage::encode);
+    }
+  });
+
+  auto finished = false;
+  try {
+    finished = pipeline.run();
+  } catch (std::exception const& e) {
+    logger::instance()->error("Streaming %s failed: %s", info.name,
+                              e.what());
+  }
+
+  stream_stats_ = pipeline.stats();
+  for (auto const& s : stream_stats_) {
+    logger::instance()->debug("%s: %llu frames on %d threads, %.2f s busy "
+                              "per thread",
+                              s.name,
+                              static_cast<unsigned long long>(s.items),
+                              s.workers, s.solo_s());
+  }
+  logger::instance()->debug("Streamed in %.2f s", pipeline.wall_s());
+  if (feature_pairs > 0) {
+    logger::instance()->debug("Matched %d of %d frame pairs near their "
+                              "predicted positions",
+                              guided_pairs.load(), feature_pairs.load());
+  }
+
+  for (const auto s : {stage::decode, stage::track, stage::smooth,
+                       stage::warp, stage::encode}) {
+    finish(progress_, s);
+  }
+
+  if (finished && written == 0) {
+    logger::instance()->error("No frames to stabilize in %s", info.name);
+  }
+
+  if (finished && !write_failed && written > 0 && !output.close()) {
+    logger::instance()->error("Could not finish writing the stabilized %s",
+                              info.name);
+    write_failed = true;
+  }
+
+  if (!finished || write_failed || written == 0) {
+    // Don't leave a truncated video behind
+    output.abort();
+    if (stop.stop_requested()) {
+      logger::instance()->debug("Cancelled streaming %s", info.name);
+    }
+
+    return false;
+  }
+
+  return true;
+}
+}  // namespace vid
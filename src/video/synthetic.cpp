@@ -0,0 +1,106 @@
+#include "video/synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "video/frame_source.h"
+
+namespace vid::synthetic {
+auto textured_frame(const cv::Size size, const std::uint64_t seed) -> cv::Mat {
+  cv::RNG rng(seed);
+
+  // Start from low frequency colour noise scaled up to the frame size, which
+  // gives large smooth gradients across the frame
+  cv::Mat noise(std::max(size.height / 64, 2), std::max(size.width / 64, 2),
+                CV_8UC3);
+  rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  cv::Mat frame;
+  cv::resize(noise, frame, size, 0.0, 0.0, cv::INTER_CUBIC);
+
+  // Scatter random shapes over the top to create corners and blobs. The
+  // number of shapes scales with the area so the feature density is the same
+  // at every resolution.
+  const auto min_dim = std::min(size.width, size.height);
+  const auto shapes = size.area() / 4096;
+  for (auto i = 0; i < shapes; ++i) {
+    const cv::Point centre(rng.uniform(0, size.width),
+                           rng.uniform(0, size.height));
+    const auto radius = rng.uniform(min_dim / 200 + 2, min_dim / 25 + 4);
+    const cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256),
+                           rng.uniform(0, 256));
+
+    if (rng.uniform(0, 2) == 0) {
+      cv::circle(frame, centre, radius, color, cv::FILLED, cv::LINE_AA);
+    } else {
+      const cv::Point offset(radius, rng.uniform(radius / 2, radius * 2));
+      cv::rectangle(frame, centre - offset, centre + offset, color, cv::FILLED);
+    }
+  }
+
+  // Fine grain noise so flat areas aren't perfectly flat
+  cv::Mat grain(size, CV_16SC3);
+  rng.fill(grain, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(4));
+  cv::add(frame, grain, frame, cv::noArray(), CV_8UC3);
+
+  cv::GaussianBlur(frame, frame, cv::Size(3, 3), 0.0);
+
+  return frame;
+}
+
+auto shake_homography(cv::RNG& rng, const cv::Size size, const double magnitude)
+    -> cv::Mat {
+  const auto tx = rng.uniform(-1.0, 1.0) * magnitude * 0.01 * size.width;
+  const auto ty = rng.uniform(-1.0, 1.0) * magnitude * 0.01 * size.width;
+  const auto angle =
+      rng.uniform(-1.0, 1.0) * magnitude * 0.1 * std::numbers::pi / 180.0;
+  const auto scale = 1.0 + rng.uniform(-1.0, 1.0) * magnitude * 0.002;
+
+  // Rotate and scale about the centre of the frame, then translate
+  const cv::Point2d centre(size.width / 2.0, size.height / 2.0);
+  const auto a = scale * std::cos(angle);
+  const auto b = scale * std::sin(angle);
+
+  return (cv::Mat_<double>(3, 3) << a, -b,
+          centre.x - a * centre.x + b * centre.y + tx, b, a,
+          centre.y - b * centre.x - a * centre.y + ty, 0.0, 0.0, 1.0);
+}
+
+auto shaky_clip(const cv::Size size, const int frame_count,
+                const std::uint64_t seed, const double magnitude,
+                const int jpeg_quality) -> clip {
+  clip c;
+  if (frame_count <= 0) return c;
+
+  // Made one frame at a time by the same source streaming consumers use
+  synthetic_source source{size, frame_count, seed, magnitude, jpeg_quality};
+  for (auto const& frame : frames(source)) c.frames.push_back(frame);
+  c.h_mats = source.h_mats();
+
+  return c;
+}
+
+auto corner_error(cv::Mat const& h_estimated, cv::Mat const& h_truth,
+                  const cv::Size size) -> double {
+  if (h_estimated.empty()) return std::numeric_limits<double>::infinity();
+
+  const std::vector<cv::Point2d> corners{
+      {0.0, 0.0},
+      {static_cast<double>(size.width), 0.0},
+      {0.0, static_cast<double>(size.height)},
+      {static_cast<double>(size.width), static_cast<double>(size.height)}};
+
+  std::vector<cv::Point2d> estimated, truth;
+  cv::perspectiveTransform(corners, estimated, h_estimated);
+  cv::perspectiveTransform(corners, truth, h_truth);
+
+  auto error = 0.0;
+  for (auto i = 0; i < 4; ++i) error += cv::norm(estimated[i] - truth[i]);
+
+  return error / 4.0;
+}
+}  // namespace vid::synthetic
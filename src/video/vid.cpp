@@ -2,16 +2,45 @@
 
 #include <opencv2/core/core_c.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <ranges>
 #include <filesystem>
-#include <iostream>
+#include <fstream>
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
 
 #include "logger/logger.h"
+#include "profiler/allocations.h"
+#include "profiler/profiler.h"
+#include "video/frame_sink.h"
+#include "video/frame_source.h"
 
 namespace vid {
+namespace {
+auto mat_bytes(cv::Mat const& m) -> std::size_t {
+  return m.total() * m.elemSize();
+}
+
+/**
+ * @brief Returns a path in the temporary directory no other video uses.
+ */
+auto new_spill_path() -> std::filesystem::path {
+  static std::atomic<unsigned> count = 0;
+
+  std::error_code error;
+  auto dir = std::filesystem::temp_directory_path(error);
+  if (error) dir = ".";
+
+  const auto stamp =
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  return dir / ("stabilizer-" + std::to_string(stamp) + "-" +
+                std::to_string(count.fetch_add(1)) + ".frames");
+}
+}  // namespace
+
 video::video() {
   frames_ = std::vector<cv::Mat>{};
 
@@ -20,26 +49,41 @@ video::video() {
   fourcc_ = 0;
   fps_ = 0;
   size_ = {0, 0};
+
+  mem::governor::instance()->enroll(this);
 }
 
-video::video(video const& other) {
+video::video(video const& other) : mem::tenant(other) {
   if (this != &other) {
-    std::ranges::copy(other.frames_,
-                      std::back_inserter(frames_));
-    file_name_ = other.file_name_;
+    frames_ = other.frames();
+    file_name_ = other.name();
 
     bitrate_ = other.bitrate_;
     fourcc_ = other.fourcc_;
     fps_ = other.fps_;
     frame_count_ = static_cast<int>(frames_.size());
     size_ = other.size_;
+    format_ = other.format_;
+    load_format_ = other.load_format_;
   }
+
+  mem::governor::instance()->enroll(this);
 }
 
 video::video(video&& other) noexcept {
   if (this != &other) {
+    std::lock_guard lock(*other.mutex_);
+
+    // Spilled frames move along with their file
     std::ranges::move(other.frames_,
                       std::back_inserter(frames_));
+    other.frames_.clear();
+    spilled_ = std::move(other.spilled_);
+    other.spilled_.clear();
+    spill_path_ = std::move(other.spill_path_);
+    other.spill_path_.clear();
+    slot_size_ = other.slot_size_;
+    slot_type_ = other.slot_type_;
 
     file_name_ = other.file_name_;
     other.file_name_ = "";
@@ -53,177 +97,407 @@ video::video(video&& other) noexcept {
     other.frame_count_ = 0;
     size_ = other.size_;
     other.size_ = {0, 0};
+    format_ = other.format_;
+    load_format_ = other.load_format_;
   }
+
+  mem::governor::instance()->enroll(this);
 }
 
 video::video(std::filesystem::path const& video_file_path) {
+  mem::governor::instance()->enroll(this);
+
   file_name_ = video_file_path.filename().string();
 
   load_video_from_file(video_file_path.string());
 }
 
-auto video::load_frames(
-    std::vector<std::string> const& frames_file_paths) noexcept -> void {
-  // Clear out old data
-  frames_.clear();
+video::video(std::vector<cv::Mat> frames, const int fps,
+             const img::pixel_format format)
+    : frames_{std::move(frames)}, fps_{fps}, format_{format} {
+  frame_count_ = static_cast<int>(frames_.size());
+  if (!frames_.empty()) size_ = img::picture_size(frames_[0], format_);
 
-  logger::instance()->add_dynamic_log("load-frames", [&]() -> std::string {
-    return std::string("Loading frames") + utils::loading_dots() + "\n";
-  });
+  mem::governor::instance()->enroll(this);
+  mem::governor::instance()->enforce();
+}
 
-  for (const auto& path : frames_file_paths) {
-    cv::Mat frame = cv::imread(path);
-    if (frame.empty()) {
-      // TODO: convert to debug log
-      std::cerr << "Error: Could not read image at \"" << path << "\"\n";
-      continue;
-    }
+video::~video() {
+  // Leaving waits for the governor to finish spilling this video, if it is
+  mem::governor::instance()->leave(this);
 
-    frames_.push_back(frame);
-  }
-
-  logger::instance()->remove_dynamic_log("load-frames");
+  std::lock_guard lock(*mutex_);
+  drop_spill_locked();
 }
 
-auto video::padded_string(const int n, const int frame_count) noexcept
-    -> std::string {
-  std::string s = std::to_string(n);
-  const auto fc_str = std::to_string(frame_count);
+auto video::operator=(video const& other) -> video& {
+  if (this == &other) return *this;
 
-  while (s.length() < fc_str.length()) {
-    s.insert(s.begin(), '0');
+  auto frames = other.frames();
+  const auto name = other.name();
+  {
+    std::lock_guard lock(*mutex_);
+    drop_spill_locked();
+    frames_ = std::move(frames);
+    file_name_ = name;
   }
 
-  return s;
+  bitrate_ = other.bitrate_;
+  fourcc_ = other.fourcc_;
+  fps_ = other.fps_;
+  frame_count_ = static_cast<int>(frames_.size());
+  size_ = other.size_;
+  format_ = other.format_;
+  load_format_ = other.load_format_;
+
+  return *this;
 }
 
-auto video::load_video_from_file(
-    std::filesystem::path const& video_file_path) noexcept -> void {
-  // Clear out old data
-  if (!frames_.empty()) {
-    frames_.clear();
-    file_name_ = "";
-    bitrate_ = 0.0;
-    fourcc_ = 0;
-    fps_ = 0;
-    frame_count_ = 0;
-    size_ = {0, 0};
+auto video::load_video_from_file(std::filesystem::path const& video_file_path,
+                                progress* progress,
+                                std::stop_token stop) noexcept -> void {
+  // A source that didn't open yields no frames, leaving the video empty
+  capture_source source{video_file_path};
+  if (!source.opened()) {
+    logger::instance()->error("Could not open video file %s",
+                              video_file_path);
   }
 
-  process_video(video_file_path);
+  load_from_source(source, progress, std::move(stop));
+}
 
-  // Read all the frames in the tmp folder into frames vector
-  std::vector<cv::String> image_paths;
-  cv::glob(".//tmp//", image_paths);
+auto video::load_from_source(frame_source& source, progress* progress,
+                             std::stop_token stop) noexcept -> void {
+  prof::scoped_timer timer{"load"};
+  prof::memory_stage memory{"load"};
 
-  load_frames(image_paths);
+  const auto info = source.info();
 
-  // Delete all tmp files
-  std::filesystem::remove_all(".//tmp//");
-}
+  // Clear out old data
+  {
+    std::lock_guard lock(*mutex_);
+    drop_spill_locked();
+    frames_.clear();
+    file_name_ = info.name;
+  }
+  bitrate_ = info.bitrate;
+  fourcc_ = info.fourcc;
+  fps_ = static_cast<int>(info.fps);
+  frame_count_ = 0;
+  size_ = info.size;
 
-auto video::process_video(std::filesystem::path const& video_file_path) noexcept
-    -> void {
-  // Create a VideoCapture Object
-  auto video_capture = cv::VideoCapture(video_file_path.string());
+  process_source(source, info.frame_count, progress, stop);
 
-  if (!video_capture.isOpened()) {
-    std::cerr << "Error: Could not open video file\n";
+  // Make room for the new frames, if anything can give it up
+  mem::governor::instance()->enforce();
+}
 
-    return;
+auto video::process_source(frame_source& source, const int expected_frames,
+                           progress* progress,
+                           std::stop_token const& stop) noexcept -> void {
+  logger::instance()->debug("Opened %s", file_name_);
+  logger::instance()->debug("FPS: %d, frame count: %d", fps_,
+                            expected_frames);
+
+  format_ = load_format_;
+  if (format_ == img::pixel_format::i420 && !img::fits_i420(size_)) {
+    logger::instance()->warn("%dx%d frames can't be stored as YUV 4:2:0, "
+                             "storing them as BGR",
+                             size_.width, size_.height);
+    format_ = img::pixel_format::bgr;
   }
 
-  // Add dynamic log to track progress of video load
-  logger::instance()->add_dynamic_log("progress", [&]() -> std::string {
-    return std::string("Processing video") + utils::loading_dots() + "\n";
-  });
+  // Decode the frames straight into memory, converted to the format they're
+  // stored in. The source gives each frame a buffer of its own. They're only
+  // handed over once decoded, so the governor never sees half a video.
+  std::vector<cv::Mat> decoded_frames;
+  if (expected_frames > 0) decoded_frames.reserve(expected_frames);
+
+  begin(progress, stage::decode, expected_frames);
+  while (!stop.stop_requested()) {
+    cv::Mat frame;
+    {
+      prof::scoped_timer decode_timer{"decode"};
+      if (!source.next(frame, format_)) break;
+    }
 
-  bitrate_ = video_capture.get(cv::CAP_PROP_BITRATE);
-  fourcc_ = static_cast<int>(video_capture.get(cv::CAP_PROP_FOURCC));
-  fps_ = static_cast<int>(video_capture.get(cv::CAP_PROP_FPS));
-  frame_count_ = static_cast<int>(video_capture.get(cv::CAP_PROP_FRAME_COUNT));
-  size_ =
-      cv::Size(static_cast<int>(video_capture.get(cv::CAP_PROP_FRAME_WIDTH)),
-               static_cast<int>(video_capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    decoded_frames.push_back(frame);
+    advance(progress, stage::decode);
+  }
 
-  // TODO: convert to debug log
-  std::cout << "Opened video file: " << video_file_path.string() << "\n";
-  std::cout << "FPS: " << fps_ << "\n";
-  std::cout << "Frame Count: " << frame_count_ << "\n";
+  // Half a video is no use to anyone
+  if (stop.stop_requested()) {
+    logger::instance()->debug("Cancelled loading %s", file_name_);
+    decoded_frames.clear();
+  }
 
-  // Create a tmp directory to store the frames
-  if (!std::filesystem::exists(".//tmp")) {
-    std::filesystem::create_directory(".//tmp");
+  // Trust the number of frames that were actually decoded, since the frame
+  // count reported by the container is only an estimate
+  frame_count_ = static_cast<int>(decoded_frames.size());
+  {
+    std::lock_guard lock(*mutex_);
+    frames_ = std::move(decoded_frames);
   }
+  finish(progress, stage::decode);
+}
 
-  // Extract the frames from the video into the tmp directory
-  cv::Mat frame;
+auto video::export_to_file(std::string const& save_dir, progress* progress,
+                           std::stop_token stop) const noexcept -> bool {
+  // TODO: support user setting name of file
+  // TODO: Use codec based on platform, currently using "DIVX" for Windows.
+  return export_to_path(save_dir + "/video_0.avi",
+                        cv::VideoWriter::fourcc('D', 'I', 'V', 'X'), progress,
+                        std::move(stop));
+}
 
-  auto i = 0;
-  while (video_capture.read(frame)) {
-    const auto tmp = std::string{".//tmp//frame_" +
-                                 padded_string(i++, frame_count_) + ".png"};
-    cv::imwrite(tmp, frame);
-  }
+auto video::export_to_path(std::filesystem::path const& file_path,
+                           const int fourcc, progress* progress,
+                           std::stop_token stop) const noexcept -> bool {
+  writer_sink sink{file_path, fourcc};
 
-  logger::instance()->remove_dynamic_log("progress");
+  return export_to_sink(sink, progress, std::move(stop));
 }
 
-auto video::export_to_file(std::string const& save_dir) const noexcept -> bool {
-  if (frames_.empty()) {
-    // TODO: convert to debug log
-    std::cerr << "Error: No frames to export\n";
+auto video::export_to_sink(frame_sink& sink, progress* progress,
+                           std::stop_token stop) const noexcept -> bool {
+  if (frame_count_ == 0) {
+    logger::instance()->error("No frames to export");
 
     return false;
   }
 
-  // TODO: support user setting name of file
-  const auto save_location = std::string{save_dir + "/video_0.avi"};
-  const auto dimensions = frames_[0].size();
+  const auto dimensions = size_;
 
-  // TODO: convert to debug log
-  std::cout << "FPS: " << fps_ << "\n";
-  std::cout << "FOURCC Codec : " << fourcc_ << "\n";
-  std::cout << "Dimensions: " << dimensions << "\n";
+  logger::instance()->debug("FPS: %d, FOURCC codec: %d, dimensions: %dx%d",
+                            fps_, fourcc_, dimensions.width,
+                            dimensions.height);
 
-  // Create a VideoWriter object
-  cv::VideoWriter writer;
-  // TODO: Use codec based on platform, currently using "DIVX" for Windows.
-  const auto fourcc = cv::VideoWriter::fourcc('D', 'I', 'V', 'X');
-  writer.open(save_location, fourcc, fps_, dimensions, true);
+  if (!sink.open(dimensions, fps_)) return false;
 
-  if (!writer.isOpened()) {
-    // TODO: convert to debug log
-    std::cerr << "Error: Could not open the output video file to write.\n";
+  logger::instance()->debug("Writing %d frames", frame_count_);
 
-    return false;
-  }
+  prof::scoped_timer timer{"export"};
+  prof::memory_stage memory{"export"};
+  begin(progress, stage::encode, frame_count_);
+  for (auto i = 0; i < frame_count_; ++i) {
+    if (stop.stop_requested()) {
+      // Don't leave a truncated video behind
+      sink.abort();
+      logger::instance()->debug("Cancelled exporting %s", file_name_);
 
-  // TODO: convert to debug log
-  std::cout << "Using " << writer.getBackendName() << " to write new file.\n";
-  std::cout << frame_count_ << " frames to write\n";
+      return false;
+    }
+
+    // Encode the frame into the output. Spilled frames are streamed back
+    // from disk rather than restored.
+    prof::scoped_timer encode_timer{"encode"};
+    if (!sink.put(frame(i), format_)) {
+      sink.abort();
+      finish(progress, stage::encode);
 
-  for (auto const& frame : frames_) {
-    // Encode the frame into the video file stream
-    writer.write(frame);
+      return false;
+    }
+
+    advance(progress, stage::encode);
   }
+  finish(progress, stage::encode);
 
-  return true;
+  return sink.close();
 }
 
 auto video::clone() const noexcept -> video {
   vid::video cloned{};
 
-  std::ranges::copy(frames_,
-                    std::back_inserter(cloned.frames_));
+  cloned.frames_ = frames();
 
-  cloned.file_name_ = file_name_;
+  cloned.file_name_ = name();
   cloned.bitrate_ = bitrate();
   cloned.fourcc_ = fourcc();
   cloned.fps_ = fps();
-  cloned.frame_count_ = frame_count();
+  cloned.frame_count_ = static_cast<int>(cloned.frames_.size());
   cloned.size_ = size_;
+  cloned.format_ = format_;
+  cloned.load_format_ = load_format_;
 
   return cloned;
 }
+
+auto video::frames() const noexcept -> std::vector<cv::Mat> {
+  std::lock_guard lock(*mutex_);
+  if (!restore_locked()) return {};
+
+  return frames_;
+}
+
+auto video::frames(std::vector<cv::Mat> const& new_frames) noexcept -> void {
+  {
+    std::lock_guard lock(*mutex_);
+    drop_spill_locked();
+    frames_ = new_frames;
+  }
+  frame_count_ = static_cast<int>(new_frames.size());
+  size_ = new_frames.empty() ? cv::Size{}
+                             : img::picture_size(new_frames[0], format_);
+
+  mem::governor::instance()->enforce();
+}
+
+auto video::frame(const int index) const noexcept -> cv::Mat {
+  std::lock_guard lock(*mutex_);
+
+  const auto i = static_cast<std::size_t>(index);
+  if (index < 0 || i >= frames_.size()) return {};
+  if (i < spilled_.size() && spilled_[i]) return read_slot(i);
+
+  return frames_[i];
+}
+
+auto video::name() const -> std::string {
+  std::lock_guard lock(*mutex_);
+  return file_name_;
+}
+
+auto video::set_name(std::string name) -> void {
+  std::lock_guard lock(*mutex_);
+  file_name_ = std::move(name);
+}
+
+auto video::set_cold(const bool cold) -> void {
+  mem::governor::instance()->set_cold(this, cold);
+  if (cold) mem::governor::instance()->enforce();
+}
+
+auto video::tenant_name() const -> std::string { return name(); }
+
+auto video::resident_bytes() const -> std::size_t {
+  std::lock_guard lock(*mutex_);
+
+  std::size_t bytes = 0;
+  for (auto const& frame : frames_) bytes += mat_bytes(frame);
+
+  return bytes;
+}
+
+auto video::spilled_bytes() const -> std::size_t {
+  std::lock_guard lock(*mutex_);
+
+  return static_cast<std::size_t>(std::ranges::count(spilled_, true)) *
+         slot_bytes();
+}
+
+auto video::release(const std::size_t bytes) -> std::size_t {
+  std::lock_guard lock(*mutex_);
+  if (frames_.empty()) return 0;
+
+  if (spill_path_.empty()) {
+    // Every frame of a video has the same shape, so each gets a fixed slot
+    auto const& first = frames_.front();
+    if (first.empty()) return 0;
+    slot_size_ = first.size();
+    slot_type_ = first.type();
+    spill_path_ = new_spill_path();
+    std::ofstream create(spill_path_, std::ios::binary);
+  }
+  spilled_.resize(frames_.size(), false);
+
+  std::fstream file(spill_path_,
+                    std::ios::in | std::ios::out | std::ios::binary);
+  if (!file) {
+    logger::instance()->error("Could not open %s to spill frames",
+                              spill_path_);
+    return 0;
+  }
+
+  // Playback and export start at the beginning, so the latest frames are
+  // the last to be needed again
+  const auto slot = slot_bytes();
+  std::size_t freed = 0;
+  for (auto i = frames_.size(); i-- > 0 && freed < bytes;) {
+    auto& frame = frames_[i];
+
+    // Frames shared with anything else stay, since spilling them frees
+    // nothing
+    const auto spillable = !spilled_[i] && frame.isContinuous() &&
+                           frame.size() == slot_size_ &&
+                           frame.type() == slot_type_ && frame.u &&
+                           frame.u->refcount == 1;
+    if (!spillable) continue;
+
+    file.seekp(static_cast<std::streamoff>(i * slot));
+    file.write(reinterpret_cast<const char*>(frame.data),
+               static_cast<std::streamsize>(slot));
+    if (!file) {
+      logger::instance()->error("Could not spill frames to %s", spill_path_);
+      break;
+    }
+
+    frame.release();
+    spilled_[i] = true;
+    freed += slot;
+  }
+
+  if (freed > 0) {
+    logger::instance()->debug("Spilled %zu MB of %s to disk", freed >> 20,
+                              file_name_);
+  }
+
+  return freed;
+}
+
+auto video::slot_bytes() const noexcept -> std::size_t {
+  if (slot_type_ < 0) return 0;
+
+  return static_cast<std::size_t>(slot_size_.area()) *
+         static_cast<std::size_t>(CV_ELEM_SIZE(slot_type_));
+}
+
+auto video::read_slot(const std::size_t index) const noexcept -> cv::Mat {
+  std::ifstream file(spill_path_, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(index * slot_bytes()));
+
+  cv::Mat frame(slot_size_, slot_type_);
+  file.read(reinterpret_cast<char*>(frame.data),
+            static_cast<std::streamsize>(slot_bytes()));
+  if (!file) {
+    logger::instance()->error("Could not read frame %zu back from %s", index,
+                              spill_path_);
+    return {};
+  }
+
+  return frame;
+}
+
+auto video::restore_locked() const noexcept -> bool {
+  auto restored = true;
+  for (std::size_t i = 0; i < spilled_.size(); ++i) {
+    if (!spilled_[i]) continue;
+
+    // A frame that can't be read back stays spilled, so a later call can
+    // try again
+    auto frame = read_slot(i);
+    if (frame.empty()) {
+      restored = false;
+      continue;
+    }
+    frames_[i] = std::move(frame);
+    spilled_[i] = false;
+  }
+
+  if (!restored) {
+    logger::instance()->error("Could not restore the spilled frames of %s",
+                              file_name_);
+  }
+
+  return restored;
+}
+
+auto video::drop_spill_locked() noexcept -> void {
+  spilled_.clear();
+  slot_type_ = -1;
+  if (spill_path_.empty()) return;
+
+  std::error_code error;
+  std::filesystem::remove(spill_path_, error);
+  spill_path_.clear();
+}
 }  // namespace vid